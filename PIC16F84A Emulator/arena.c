@@ -0,0 +1,86 @@
+//
+//  arena.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+//Allocations are aligned to the size of a pointer
+#define ARENA_ALIGN(x) (((x) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+//Block header size rounded up to keep the payload aligned
+#define ARENA_HEADER_SIZE ARENA_ALIGN(sizeof(ARENA_BLOCK))
+
+void ArenaInitialize(ARENA *Arena)
+{
+    Arena->Head = NULL;
+}
+
+void ArenaDestroy(ARENA *Arena)
+{
+    ARENA_BLOCK *block, *next;
+
+    //Free every block in the chain
+    for (block = Arena->Head; block != NULL; block = next)
+    {
+        next = block->Next;
+        free(block);
+    }
+
+    Arena->Head = NULL;
+}
+
+void *ArenaAlloc(ARENA *Arena, size_t Size)
+{
+    ARENA_BLOCK *block = Arena->Head;
+    void *ret;
+
+    Size = ARENA_ALIGN(Size);
+
+    //Start a new block if the current one is full
+    if (block == NULL || block->Size - block->Used < Size)
+    {
+        size_t blockSize = ARENA_BLOCK_SIZE;
+
+        //Oversized allocations get a block of their own
+        if (Size > blockSize)
+            blockSize = Size;
+
+        block = malloc(ARENA_HEADER_SIZE + blockSize);
+        if (!block)
+            return NULL;
+
+        block->Size = blockSize;
+        block->Used = 0;
+        block->Next = Arena->Head;
+        Arena->Head = block;
+    }
+
+    //Bump the allocation pointer
+    ret = (unsigned char *)block + ARENA_HEADER_SIZE + block->Used;
+    block->Used += Size;
+
+    return ret;
+}
+
+char *ArenaStrDup(ARENA *Arena, const char *String, size_t Length)
+{
+    char *ret;
+
+    ret = ArenaAlloc(Arena, Length + 1);
+    if (!ret)
+        return NULL;
+
+    //Copy the string and terminate it
+    memcpy(ret, String, Length);
+    ret[Length] = 0;
+
+    return ret;
+}
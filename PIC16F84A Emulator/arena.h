@@ -0,0 +1,36 @@
+//
+//  arena.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#ifndef PIC16F84A_Emulator_arena_h
+#define PIC16F84A_Emulator_arena_h
+
+#include <stddef.h>
+
+//Default size of a single arena block
+#define ARENA_BLOCK_SIZE 0x10000
+
+//One chunk of arena memory
+typedef struct _ARENA_BLOCK {
+    struct _ARENA_BLOCK *Next;
+    size_t Size;
+    size_t Used;
+} ARENA_BLOCK;
+
+//This struct represents a bump allocator that is freed all at once
+typedef struct _ARENA {
+    ARENA_BLOCK *Head;
+} ARENA;
+
+void ArenaInitialize(ARENA *Arena);
+void ArenaDestroy(ARENA *Arena);
+
+void *ArenaAlloc(ARENA *Arena, size_t Size);
+char *ArenaStrDup(ARENA *Arena, const char *String, size_t Length);
+
+#endif
@@ -10,11 +10,12 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <stdarg.h>
 
 #include "opcode.h"
-#include "str.h"
 
 #include "assembler.h"
+#include "lexer.h"
 #include "regs.h"
 
 ASM_STRINT_TUPLE StaticTuples[] =
@@ -51,386 +52,666 @@ ASM_STRINT_TUPLE StaticTuples[] =
     {0, NULL}
 };
 
-//Naive parsing function
-int DecodeStringInput(ASM_CONTEXT *context, char *opstr, char *opname, int *op1, int *op2)
+int AsmInitializeContext(ASM_CONTEXT *context)
 {
-    char eater[255];
-    int i, matches;
-    char hasMore;
-    int op;
-    char isHex[2];
-    int tempOp[2];
-    
-    //Initialize output
-    *op1 = *op2 = 0;
-    
-    //Convert to upper case
-    for (i = 0; opstr[i]; i++)
+    int i;
+    int err;
+
+    context->Quiet = 0;
+    context->ErrorLine = 0;
+    context->ErrorColumn = 0;
+
+    err = SymInitialize(&context->Symbols);
+    if (err < 0)
+        return err;
+
+    //Insert the static tuple table
+    for (i = 0; StaticTuples[i].String; i++)
     {
-        //Truncate the string on the first control char
-        if (iscntrl(opstr[i]))
+        err = SymInsert(&context->Symbols, StaticTuples[i].String,
+                        (int)strlen(StaticTuples[i].String),
+                        SYM_TYPE_BUILTIN, StaticTuples[i].Value);
+        if (err < 0)
         {
-            opstr[i] = 0;
-            break;
+            SymDestroy(&context->Symbols);
+            return err;
         }
-        
-        opstr[i] = toupper(opstr[i]);
     }
     
-    //Truncate at the first non-alphabetic character
-    hasMore = 0;
-    for (i = 0; opstr[i]; i++)
-    {
-        if (!isalpha(opstr[i]))
-        {
-            opstr[i] = 0;
-            hasMore = 1;
-            break;
-        }
-    }
+    return 0;
+}
+
+void AsmDestroyContext(ASM_CONTEXT *context)
+{
+    SymDestroy(&context->Symbols);
+}
+
+int AsmGetOperandVal(ASM_CONTEXT *context, const char *str)
+{
+    SYM_ENTRY *entry;
+    int i;
+
+    //The symbol ends at the first space or comma
+    for (i = 0; str[i] && !isspace((unsigned char)str[i]) && str[i] != ','; i++);
     
-    //Copy the opname
-    strcpy(opname, opstr);
+    //Look it up in the symbol table
+    entry = SymLookup(&context->Symbols, str, i);
+    if (entry == NULL)
+        return -1;
     
-    //Done if there's nothing left
-    if (!hasMore)
-    {
+    return entry->Value;
+}
+
+//Initial size of the growable output buffers
+#define ASM_INITIAL_OPCODES 0x400
+#define ASM_INITIAL_FIXUPS  0x40
+
+//Fixup addresses that define a constant instead of patching an opcode
+#define ASM_FIXUP_CONSTANT  (-1)
+#define ASM_FIXUP_DEFINED   (-2)
+
+//An operand or constant that referenced a symbol defined further down
+typedef struct _ASM_FIXUP
+{
+    int Address;
+    int Id;
+    int Operands[2];
+    int Index;          //Which operand gets patched
+    int Sign;           //Sign the label is applied with
+    ASM_TOKEN Symbol;
+    ASM_TOKEN Name;     //Constant being defined (ASM_FIXUP_CONSTANT only)
+} ASM_FIXUP;
+
+//State of a single pass over the token stream
+typedef struct _ASM_PARSER
+{
+    ASM_CONTEXT *Context;
+    ASM_LEXER Lexer;
+    ASM_TOKEN Token;
+
+    PIC_OPCODE *Opcodes;
+    int *Lines;
+    int Address;
+    int Capacity;
+
+    ASM_FIXUP *Fixups;
+    int FixupCount;
+    int FixupCapacity;
+
+    int InCblock;
+    int CblockAddress;
+    ASM_TOKEN CblockBase;   //Forward symbol the CBLOCK address is relative to
+    int CblockSign;
+} ASM_PARSER;
+
+static int AsmError(ASM_PARSER *Parser, const ASM_TOKEN *Token, const char *Format, ...)
+{
+    va_list args;
+
+    //Embedders get the position back instead of a message
+    Parser->Context->ErrorLine = Token->Line;
+    Parser->Context->ErrorColumn = Token->Column;
+    if (Parser->Context->Quiet)
+        return -1;
+
+    printf("Line %d, column %d: ", Token->Line, Token->Column);
+
+    va_start(args, Format);
+    vprintf(Format, args);
+    va_end(args);
+
+    printf("\n");
+
+    return -1;
+}
+
+static void AsmAdvance(ASM_PARSER *Parser)
+{
+    LexNext(&Parser->Lexer, &Parser->Token);
+}
+
+//Looks at the token after the current one without consuming it
+static void AsmPeek(ASM_PARSER *Parser, ASM_TOKEN *Token)
+{
+    ASM_LEXER lexer = Parser->Lexer;
+
+    LexNext(&lexer, Token);
+}
+
+static int AsmAtEndOfLine(ASM_PARSER *Parser)
+{
+    return Parser->Token.Type == TOK_NEWLINE || Parser->Token.Type == TOK_EOF;
+}
+
+static int AsmIsMnemonic(const ASM_TOKEN *Token)
+{
+    if (Token->Type != TOK_IDENT)
         return 0;
+
+    return IsaLookupMnemonic(Token->Start, Token->Length) >= 0;
+}
+
+static int AsmIsDirective(const ASM_TOKEN *Token)
+{
+    return LexTokenEquals(Token, "CBLOCK") ||
+           LexTokenEquals(Token, "ENDC") ||
+           LexTokenEquals(Token, "EQU");
+}
+
+static int AsmDefineSymbol(ASM_PARSER *Parser, const ASM_TOKEN *Name, int Type, int Value)
+{
+    if (SymLookup(&Parser->Context->Symbols, Name->Start, Name->Length) != NULL)
+        return AsmError(Parser, Name, "Symbol redefined: %.*s", Name->Length, Name->Start);
+
+    if (SymInsert(&Parser->Context->Symbols, Name->Start, Name->Length, Type, Value) < 0)
+        return AsmError(Parser, Name, "Out of memory");
+
+    return 0;
+}
+
+//Parses term [(+|-) term]...
+//A single undefined symbol is left to the caller if Unresolved is non-NULL
+static int AsmParseExpression(ASM_PARSER *Parser, int *Value, ASM_TOKEN *Unresolved, int *UnresolvedSign)
+{
+    int sign = 1;
+    int haveUnresolved = 0;
+
+    *Value = 0;
+
+    //Leading minus
+    if (Parser->Token.Type == TOK_MINUS)
+    {
+        sign = -1;
+        AsmAdvance(Parser);
     }
-    
-    //Skip the opname and trailing NUL now
-    opstr += strlen(opname) + 1;
-    
-    //Search for the 0x hex prefix
-    op = 0;
-    isHex[0] = 0;
-    isHex[1] = 0;
-    for (i = 0; opstr[i]; i++)
+
+    for (;;)
     {
-        int replacedOper;
-        
-        //Skip to next operand on comma
-        if (opstr[i] == ',')
-        {
-            op++;
-            continue;
-        }
-        
-        //Check if we should skip
-        if (*op1 != 0 && op == 0)
-        {
-            continue;
-        }
-        else if (*op2 != 0 && op == 1)
-        {
-            break;
-        }
-        
-        //Check for the hex prefix
-        if (opstr[i] == '0' && opstr[i+1] == 'X')
-        {
-            //Check for multiple prefixes
-            if (isHex[op])
-                return -1;
-            
-            isHex[op] = 1;
-            
-            //Skip the X
-            i++;
-            continue;
-        }
-        
-        //Check for a valid number
-        if (!isHex[op] && !isdigit(opstr[i]) && !isspace(opstr[i]))
+        ASM_TOKEN *token = &Parser->Token;
+
+        if (token->Type == TOK_NUMBER)
         {
-            //Make sure we're checking the start of the operand
-            if (i == 0 || opstr[i - 1] == ',')
-            {
-                replacedOper = AsmGetOperandVal(context, &opstr[i]);
-                if (replacedOper < 0)
-                {
-                    //Replacement failed
-                    return -1;
-                }
-                else
-                {
-                    if (op == 0)
-                    {
-                        *op1 = -1;
-                        tempOp[0] = replacedOper;
-                    }
-                    else
-                    {
-                        *op2 = -1;
-                        tempOp[1] = replacedOper;
-                    }
-                    continue;
-                }
-                
-            }
-            
-            return -1;
+            *Value += sign * (int)token->Value;
         }
-        else if (isHex[op] && !isdigit(opstr[i]) && !isspace(opstr[i]) &&
-                 !(opstr[i] >= 'A' && opstr[i] <= 'F'))
-            return -1;
-    }
-    
-    if (op == 0)
-    {
-        //Only write if no replacement was done
-        if (*op1 == 0)
+        else if (token->Type == TOK_IDENT)
         {
-            if (isHex[0])
-            {
-                matches = sscanf(opstr, "%x", &tempOp[0]);
-            }
-            else
+            SYM_ENTRY *entry = SymLookup(&Parser->Context->Symbols, token->Start, token->Length);
+
+            if (entry != NULL)
             {
-                matches = sscanf(opstr, "%d", &tempOp[0]);
+                *Value += sign * entry->Value;
             }
-        }
-        else
-        {
-            //Replaced all
-            matches = 1;
-        }
-    }
-    else
-    {
-        //No replacement of either operand
-        if (*op1 == 0 && *op2 == 0)
-        {
-            if (isHex[0])
+            else if (Unresolved != NULL && !haveUnresolved)
             {
-                if (isHex[1])
-                {
-                    matches = sscanf(opstr, "%x , %x", &tempOp[0], &tempOp[1]);
-                }
-                else
-                {
-                    matches = sscanf(opstr, "%x , %d", &tempOp[0], &tempOp[1]);
-                }
+                //Might be a label further down
+                *Unresolved = *token;
+                *UnresolvedSign = sign;
+                haveUnresolved = 1;
             }
             else
             {
-                if (isHex[1])
-                {
-                    matches = sscanf(opstr, "%d , %x", &tempOp[0], &tempOp[1]);
-                }
-                else
-                {
-                    matches = sscanf(opstr, "%d , %d", &tempOp[0], &tempOp[1]);
-                }
+                return AsmError(Parser, token, "Undefined symbol: %.*s", token->Length, token->Start);
             }
         }
-        //Replacement of both is nop
-        else if (*op1 != 0 && *op2 != 0)
+        else if (token->Type == TOK_ERROR)
         {
-            matches = 2;
+            return AsmError(Parser, token, "Malformed token: %.*s", token->Length, token->Start);
         }
-        //Replacement of op1
-        else if (*op1 != 0)
-        {
-            if (isHex[0])
-            {
-                if (isHex[1])
-                {
-                    matches = sscanf(opstr, "%s , %x", eater, &tempOp[1]);
-                }
-                else
-                {
-                    matches = sscanf(opstr, "%s , %d", eater, &tempOp[1]);
-                }
-            }
-            else
-            {
-                if (isHex[1])
-                {
-                    matches = sscanf(opstr, "%s , %x", eater, &tempOp[1]);
-                }
-                else
-                {
-                    matches = sscanf(opstr, "%s , %d", eater, &tempOp[1]);
-                }
-            }
-            matches++;
-        }
-        //Replacement of op2
         else
         {
-            if (isHex[0])
-            {
-                if (isHex[1])
-                {
-                    matches = sscanf(opstr, "%x ,", &tempOp[0]);
-                }
-                else
-                {
-                    matches = sscanf(opstr, "%x ,", &tempOp[0]);
-                }
-            }
-            else
-            {
-                if (isHex[1])
-                {
-                    matches = sscanf(opstr, "%d ,", &tempOp[0]);
-                }
-                else
-                {
-                    matches = sscanf(opstr, "%d ,", &tempOp[0]);
-                }
-            }
-            matches++;
+            return AsmError(Parser, token, "Expected a number or symbol");
         }
+
+        AsmAdvance(Parser);
+
+        if (Parser->Token.Type == TOK_PLUS)
+            sign = 1;
+        else if (Parser->Token.Type == TOK_MINUS)
+            sign = -1;
+        else
+            break;
+
+        AsmAdvance(Parser);
     }
-    
-    //Make sure the string was well-formatted
-    if (matches != op + 1)
-        return -1;
-    
-    //Store the variables back
-    if (op >= 0)
-        *op1 = tempOp[0];
-    if (op >= 1)
-        *op2 = tempOp[1];
-    
+
+    if (Unresolved != NULL && !haveUnresolved)
+    {
+        Unresolved->Type = TOK_EOF;
+    }
+
     return 0;
 }
 
-int AsmInitializeContext(ASM_CONTEXT *context)
+static int AsmExpectEndOfLine(ASM_PARSER *Parser)
 {
-    int i;
+    if (!AsmAtEndOfLine(Parser))
+        return AsmError(Parser, &Parser->Token, "Unexpected text: %.*s", Parser->Token.Length, Parser->Token.Start);
 
-    //Copy the static tuple table in
-    for (i = 0; StaticTuples[i].String; i++)
+    return 0;
+}
+
+static int AsmEmit(ASM_PARSER *Parser, unsigned short Opcode)
+{
+    //Grow the output buffer
+    if (Parser->Address == Parser->Capacity)
+    {
+        int capacity = Parser->Capacity ? Parser->Capacity * 2 : ASM_INITIAL_OPCODES;
+        PIC_OPCODE *opcodes = realloc(Parser->Opcodes, capacity * sizeof(PIC_OPCODE));
+        int *lines;
+
+        if (!opcodes)
+            return AsmError(Parser, &Parser->Token, "Out of memory");
+
+        Parser->Opcodes = opcodes;
+
+        lines = realloc(Parser->Lines, capacity * sizeof(int));
+        if (!lines)
+            return AsmError(Parser, &Parser->Token, "Out of memory");
+
+        Parser->Lines = lines;
+        Parser->Capacity = capacity;
+    }
+
+    //The parser is still on the instruction's line
+    Parser->Lines[Parser->Address] = Parser->Token.Line;
+    Parser->Opcodes[Parser->Address++].Opcode = Opcode;
+
+    return 0;
+}
+
+static int AsmAddFixup(ASM_PARSER *Parser, ASM_FIXUP *Fixup)
+{
+    if (Parser->FixupCount == Parser->FixupCapacity)
     {
-        context->TupleTable[i] = StaticTuples[i];
+        int capacity = Parser->FixupCapacity ? Parser->FixupCapacity * 2 : ASM_INITIAL_FIXUPS;
+        ASM_FIXUP *fixups = realloc(Parser->Fixups, capacity * sizeof(ASM_FIXUP));
+
+        if (!fixups)
+            return AsmError(Parser, &Parser->Token, "Out of memory");
+
+        Parser->Fixups = fixups;
+        Parser->FixupCapacity = capacity;
     }
-    
-    context->TupleCount = i;
-    
+
+    Parser->Fixups[Parser->FixupCount++] = *Fixup;
+
     return 0;
 }
 
-int AsmGetOperandVal(ASM_CONTEXT *context, char *str)
+//Defines a constant now, or once Symbol is known if it is still undefined
+static int AsmDefineConstant(ASM_PARSER *Parser, const ASM_TOKEN *Name, int Value, const ASM_TOKEN *Symbol, int Sign)
 {
-    char truncatedChar = 0;
-    int i;
-    int ret = -1;
+    ASM_FIXUP fixup;
+
+    if (Symbol->Type == TOK_EOF)
+        return AsmDefineSymbol(Parser, Name, SYM_TYPE_CONSTANT, Value);
+
+    fixup.Address = ASM_FIXUP_CONSTANT;
+    fixup.Id = -1;
+    fixup.Operands[0] = Value;
+    fixup.Operands[1] = 0;
+    fixup.Index = 0;
+    fixup.Sign = Sign;
+    fixup.Symbol = *Symbol;
+    fixup.Name = *Name;
+
+    return AsmAddFixup(Parser, &fixup);
+}
+
+//Parses a mnemonic and its operands
+static int AsmParseInstruction(ASM_PARSER *Parser, int AllowForward)
+{
+    ASM_TOKEN mnemonic = Parser->Token;
+    ASM_FIXUP fixup;
+    ASM_TOKEN unresolved;
+    int sign;
+    int i, err;
+    int maxOperands, minOperands;
+
+    fixup.Id = (mnemonic.Type == TOK_IDENT) ? IsaLookupMnemonic(mnemonic.Start, mnemonic.Length) : -1;
+    if (fixup.Id < 0)
+        return AsmError(Parser, &mnemonic, "Illegal opcode: %.*s", mnemonic.Length, mnemonic.Start);
+
+    AsmAdvance(Parser);
 
-    //Truncate the string at the first space or comma
-    for (i = 0; str[i]; i++)
+    fixup.Operands[0] = fixup.Operands[1] = 0;
+    fixup.Index = -1;
+
+    //Comma-separated operands
+    maxOperands = IsaOperandCount(fixup.Id, &minOperands);
+    for (i = 0; !AsmAtEndOfLine(Parser); i++)
     {
-        if (isspace(str[i]) || str[i] == ',')
+        if (i == maxOperands)
+            return AsmError(Parser, &Parser->Token, "Too many operands for %s", IsaTable[fixup.Id].Mnemonic);
+
+        if (i > 0)
         {
-            truncatedChar = str[i];
-            str[i] = 0;
-            break;
+            if (Parser->Token.Type != TOK_COMMA)
+                return AsmError(Parser, &Parser->Token, "Expected ','");
+
+            AsmAdvance(Parser);
         }
-    }
-    
-    //Search the string tuple table
-    for (i = 0; i < context->TupleCount; i++)
-    {
-        if (!strcmp(str, context->TupleTable[i].String))
+
+        err = AsmParseExpression(Parser, &fixup.Operands[i], AllowForward ? &unresolved : NULL, &sign);
+        if (err < 0)
+            return err;
+
+        if (AllowForward && unresolved.Type != TOK_EOF)
         {
-            ret = context->TupleTable[i].Value;
-            break;
+            if (fixup.Index >= 0)
+                return AsmError(Parser, &unresolved, "Undefined symbol: %.*s", unresolved.Length, unresolved.Start);
+
+            fixup.Index = i;
+            fixup.Sign = sign;
+            fixup.Symbol = unresolved;
         }
     }
-    
-    //Replace the character we removed if we removed one
-    if (truncatedChar != 0)
+
+    if (i < minOperands)
+        return AsmError(Parser, &mnemonic, "Missing operand for %s", IsaTable[fixup.Id].Mnemonic);
+
+    //Forward references are patched once every label is known
+    if (fixup.Index >= 0)
     {
-        //Go to the null
-        for (i = 0; str[i]; i++);
-        
-        str[i] = truncatedChar;
+        fixup.Address = Parser->Address;
+        err = AsmAddFixup(Parser, &fixup);
+        if (err < 0)
+            return err;
+
+        return AsmEmit(Parser, 0);
     }
-    
-    return ret;
+
+    return AsmEmit(Parser, IsaEncode(fixup.Id, fixup.Operands[0], fixup.Operands[1]));
 }
 
-int GetNextLine(char *out, int outlen, char *in, int *inIdx)
+//Handles a line of names inside a CBLOCK
+static int AsmParseCblockLine(ASM_PARSER *Parser)
 {
-    int i;
+    ASM_TOKEN name;
+    int size;
+    int err;
+
+    if (LexTokenEquals(&Parser->Token, "ENDC"))
+    {
+        Parser->InCblock = 0;
+        AsmAdvance(Parser);
+        return AsmExpectEndOfLine(Parser);
+    }
+
+    for (;;)
+    {
+        name = Parser->Token;
+        if (name.Type != TOK_IDENT)
+            return AsmError(Parser, &name, "Bad CBLOCK entry");
+
+        AsmAdvance(Parser);
+
+        //Optional size suffix
+        size = 1;
+        if (Parser->Token.Type == TOK_COLON)
+        {
+            AsmAdvance(Parser);
+            err = AsmParseExpression(Parser, &size, NULL, NULL);
+            if (err < 0)
+                return err;
+
+            if (size < 0)
+                return AsmError(Parser, &name, "Bad CBLOCK size");
+        }
 
-    if (in[*inIdx] == 0)
+        err = AsmDefineConstant(Parser, &name, Parser->CblockAddress, &Parser->CblockBase, Parser->CblockSign);
+        if (err < 0)
+            return err;
+
+        Parser->CblockAddress += size;
+
+        if (Parser->Token.Type != TOK_COMMA)
+            break;
+
+        AsmAdvance(Parser);
+    }
+
+    return AsmExpectEndOfLine(Parser);
+}
+
+//Parses one source line
+static int AsmParseLine(ASM_PARSER *Parser)
+{
+    ASM_TOKEN *token = &Parser->Token;
+    ASM_TOKEN next;
+    int err;
+
+    //Blank line
+    if (AsmAtEndOfLine(Parser))
         return 0;
-    
-    for (i = 0; i < outlen - 1 && in[*inIdx] != '\n' && in[*inIdx] != 0; i++)
+
+    if (Parser->InCblock)
+        return AsmParseCblockLine(Parser);
+
+    if (token->Type == TOK_IDENT)
     {
-        out[i] = in[(*inIdx)++];
-        
+        AsmPeek(Parser, &next);
+
+        if (next.Type == TOK_COLON ||
+            (token->Column == 1 && !LexTokenEquals(&next, "EQU") &&
+             !AsmIsMnemonic(token) && !AsmIsDirective(token)))
+        {
+            //Labels name the address of the next instruction
+            err = AsmDefineSymbol(Parser, token, SYM_TYPE_LABEL, Parser->Address);
+            if (err < 0)
+                return err;
+
+            AsmAdvance(Parser);
+            if (token->Type == TOK_COLON)
+                AsmAdvance(Parser);
+
+            if (AsmAtEndOfLine(Parser))
+                return 0;
+        }
+        else if (LexTokenEquals(&next, "EQU"))
+        {
+            ASM_TOKEN name = *token;
+            ASM_TOKEN unresolved;
+            int value, sign;
+
+            //Constant definition
+            AsmAdvance(Parser);
+            AsmAdvance(Parser);
+            err = AsmParseExpression(Parser, &value, &unresolved, &sign);
+            if (err < 0)
+                return err;
+
+            err = AsmDefineConstant(Parser, &name, value, &unresolved, sign);
+            if (err < 0)
+                return err;
+
+            return AsmExpectEndOfLine(Parser);
+        }
     }
-    
-    //Skip the new line
-    if (in[*inIdx] == '\n')
+
+    if (LexTokenEquals(token, "CBLOCK"))
     {
-        (*inIdx)++;
+        AsmAdvance(Parser);
+
+        //The start address is optional after the first block
+        if (!AsmAtEndOfLine(Parser))
+        {
+            err = AsmParseExpression(Parser, &Parser->CblockAddress, &Parser->CblockBase, &Parser->CblockSign);
+            if (err < 0)
+                return err;
+        }
+
+        Parser->InCblock = 1;
+        return AsmExpectEndOfLine(Parser);
     }
 
-    out[i] = 0;
+    if (token->Type != TOK_IDENT)
+        return AsmError(Parser, token, "Expected an opcode");
 
-    return 1;
+    return AsmParseInstruction(Parser, 1);
 }
 
-ASM_PROGRAM *AsmAssembleAscii(ASM_CONTEXT *context, char *fbuffer, int size)
+//Skips the rest of a line
+static void AsmSkipLine(ASM_PARSER *Parser)
 {
-#define MAX_INPUT_LEN 32
-#define MAX_OPNAME_LEN 16
-    char opname[MAX_OPNAME_LEN], opstr[MAX_INPUT_LEN];
-    int op1, op2;
-    ASM_PROGRAM *program;
-    int opcodes = 0;
-    int i;
-    int j;
-    int err;
-    
-    //Stupid way of counting opcodes
-    for (i = 0; i < size; i++)
+    while (!AsmAtEndOfLine(Parser))
+        AsmAdvance(Parser);
+}
+
+//Defines the constants that referenced later symbols. Constants may refer
+//to each other, so keep sweeping while any sweep makes progress.
+static int AsmResolveConstants(ASM_PARSER *Parser)
+{
+    ASM_FIXUP *pending;
+    int progress;
+    int i, err;
+
+    do
     {
-        if (fbuffer[i] == '\n')
+        pending = NULL;
+        progress = 0;
+
+        for (i = 0; i < Parser->FixupCount; i++)
         {
-            opcodes++;
+            ASM_FIXUP *fixup = &Parser->Fixups[i];
+            SYM_ENTRY *entry;
+
+            if (fixup->Address != ASM_FIXUP_CONSTANT)
+                continue;
+
+            entry = SymLookup(&Parser->Context->Symbols, fixup->Symbol.Start, fixup->Symbol.Length);
+            if (entry == NULL)
+            {
+                if (pending == NULL)
+                    pending = fixup;
+                continue;
+            }
+
+            err = AsmDefineSymbol(Parser, &fixup->Name, SYM_TYPE_CONSTANT, fixup->Operands[0] + fixup->Sign * entry->Value);
+            if (err < 0)
+                return err;
+
+            fixup->Address = ASM_FIXUP_DEFINED;
+            progress = 1;
         }
+    } while (pending != NULL && progress);
+
+    if (pending != NULL)
+        return AsmError(Parser, &pending->Symbol, "Undefined symbol: %.*s", pending->Symbol.Length, pending->Symbol.Start);
+
+    return 0;
+}
+
+static int AsmResolveFixups(ASM_PARSER *Parser)
+{
+    int i, err;
+
+    //Operands may name constants that are only known now
+    err = AsmResolveConstants(Parser);
+    if (err < 0)
+        return err;
+
+    for (i = 0; i < Parser->FixupCount; i++)
+    {
+        ASM_FIXUP *fixup = &Parser->Fixups[i];
+        SYM_ENTRY *entry;
+
+        if (fixup->Address < 0)
+            continue;
+
+        entry = SymLookup(&Parser->Context->Symbols, fixup->Symbol.Start, fixup->Symbol.Length);
+        if (entry == NULL)
+            return AsmError(Parser, &fixup->Symbol, "Undefined symbol: %.*s", fixup->Symbol.Length, fixup->Symbol.Start);
+
+        fixup->Operands[fixup->Index] += fixup->Sign * entry->Value;
+
+        Parser->Opcodes[fixup->Address].Opcode = IsaEncode(fixup->Id, fixup->Operands[0], fixup->Operands[1]);
     }
+
+    return 0;
+}
+
+ASM_PROGRAM *AsmAssembleAscii(ASM_CONTEXT *context, const char *fbuffer, size_t size)
+{
+    ASM_PARSER parser;
+    ASM_PROGRAM *program = NULL;
+    int err = 0;
+
+    memset(&parser, 0, sizeof(parser));
+    parser.Context = context;
+    parser.CblockBase.Type = TOK_EOF;
+    LexInitialize(&parser.Lexer, fbuffer, size);
     
-    //Allocate bytecode buffer
-    program = malloc(opcodes * sizeof(PIC_OPCODE) + sizeof(int));
-    if (!program)
-        return NULL;
+    //Single pass over the token stream
+    AsmAdvance(&parser);
+    while (parser.Token.Type != TOK_EOF)
+    {
+        err = AsmParseLine(&parser);
+        if (err < 0)
+            break;
+
+        AsmSkipLine(&parser);
+        if (parser.Token.Type == TOK_NEWLINE)
+            AsmAdvance(&parser);
+    }
+
+    if (err == 0 && parser.InCblock)
+        err = AsmError(&parser, &parser.Token, "Missing ENDC");
     
-    //Decode opcodes
-    i = 0;
-    for (j = 0; j < opcodes; j++)
+    //Patch forward symbol references
+    if (err == 0)
+        err = AsmResolveFixups(&parser);
+
+    if (err == 0)
     {
-        unsigned short opcode;
+        //The line map follows the opcodes in one allocation
+        size_t linesOffset = offsetof(ASM_PROGRAM, Opcodes) + parser.Address * sizeof(PIC_OPCODE);
 
-        if (!GetNextLine(opstr, MAX_INPUT_LEN, fbuffer, &i))
-            break;
+        if (linesOffset < sizeof(ASM_PROGRAM))
+            linesOffset = sizeof(ASM_PROGRAM);
 
-        //Decode the string
-        err = DecodeStringInput(context, opstr, opname, &op1, &op2);
-        if (err < 0)
-        {
-            printf("Illegal opcode: %s\n", opstr);
-            return NULL;
-        }
-        
-        //Generate an opcode
-        opcode = OpGenerateOpcode(opname, (char)op1, (char)op2);
-        if (opcode == OP_INVALID)
+        linesOffset = (linesOffset + sizeof(int) - 1) & ~(sizeof(int) - 1);
+        program = malloc(linesOffset + parser.Address * sizeof(int));
+        if (program)
         {
-            printf("Illegal opcode: %s\n", opstr);
-            return NULL;
+            program->Lines = (int *)((char *)program + linesOffset);
+            memcpy(program->Opcodes, parser.Opcodes, parser.Address * sizeof(PIC_OPCODE));
+            memcpy(program->Lines, parser.Lines, parser.Address * sizeof(int));
+            program->OpcodeCount = parser.Address;
         }
-        
-        program->Opcodes[j].Opcode = opcode;
     }
-    
-    program->OpcodeCount = opcodes;
+
+    free(parser.Opcodes);
+    free(parser.Lines);
+    free(parser.Fixups);
     
     return program;
-}
\ No newline at end of file
+}
+
+int AsmAssembleLine(ASM_CONTEXT *context, const char *line, size_t size, unsigned short *opcode)
+{
+    ASM_PARSER parser;
+    PIC_OPCODE output;
+    int outputLine;
+    int err;
+
+    memset(&parser, 0, sizeof(parser));
+    parser.Context = context;
+    LexInitialize(&parser.Lexer, line, size);
+
+    //One instruction fits without touching the heap
+    parser.Opcodes = &output;
+    parser.Lines = &outputLine;
+    parser.Capacity = 1;
+
+    //Just one instruction (and maybe a comment)
+    AsmAdvance(&parser);
+    if (parser.Token.Type != TOK_IDENT)
+        return AsmError(&parser, &parser.Token, "Expected an opcode");
+
+    err = AsmParseInstruction(&parser, 0);
+    if (err == 0)
+        *opcode = output.Opcode;
+
+    return err;
+}
@@ -9,11 +9,15 @@
 #ifndef PIC16F84A_Emulator_assembler_h
 #define PIC16F84A_Emulator_assembler_h
 
-#define MAX_TUPLES 0xFF
+#include <stddef.h>
+
+#include "opcode.h"
+#include "symtab.h"
 
 typedef struct _ASM_PROGRAM
 {
     int OpcodeCount;
+    int *Lines;             //Source line of each opcode (same allocation)
     PIC_OPCODE Opcodes[1];
 } ASM_PROGRAM;
 
@@ -25,15 +29,16 @@ typedef struct _ASM_STRINT_TUPLE
 
 typedef struct _ASM_CONTEXT
 {
-    ASM_STRINT_TUPLE TupleTable[MAX_TUPLES];
-    int TupleCount;
+    SYM_TABLE Symbols;
+    int Quiet;              //Don't print errors
+    int ErrorLine;          //Position of the last error
+    int ErrorColumn;
 } ASM_CONTEXT;
 
-int AsmGetOperandVal(ASM_CONTEXT *context, char *str);
+int AsmGetOperandVal(ASM_CONTEXT *context, const char *str);
 int AsmInitializeContext(ASM_CONTEXT *context);
-ASM_PROGRAM *AsmAssembleAscii(ASM_CONTEXT *context, char *buff, int size);
-
-//FIXME: Shouldn't be exposed
-int DecodeStringInput(ASM_CONTEXT *context, char *opstr, char *opname, int *op1, int *op2);
+void AsmDestroyContext(ASM_CONTEXT *context);
+ASM_PROGRAM *AsmAssembleAscii(ASM_CONTEXT *context, const char *buff, size_t size);
+int AsmAssembleLine(ASM_CONTEXT *context, const char *line, size_t size, unsigned short *opcode);
 
 #endif
@@ -0,0 +1,119 @@
+//
+//  compile.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  pic-compile: builds a .pcf file from assembly, Intel HEX or raw bytecode
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "assembler.h"
+#include "image.h"
+#include "lexer.h"
+#include "pcf.h"
+
+static int CompileIsAssembly(const char *Path)
+{
+    const char *ext = strrchr(Path, '.');
+
+    return ext != NULL && (strcasecmp(ext, ".asm") == 0 || strcasecmp(ext, ".s") == 0);
+}
+
+static int CompileAssembly(const char *Path, const char *OutPath)
+{
+    ASM_CONTEXT context;
+    ASM_PROGRAM *program;
+    ASM_SOURCE source;
+    PIC_IMAGE image;
+    int err;
+
+    err = LexMapSource(Path, &source);
+    if (err < 0)
+    {
+        printf("Failed to open %s\n", Path);
+        return err;
+    }
+
+    err = AsmInitializeContext(&context);
+    if (err < 0)
+    {
+        LexUnmapSource(&source);
+        return err;
+    }
+
+    program = AsmAssembleAscii(&context, source.Buffer, source.Size);
+    if (program == NULL)
+    {
+        printf("Assembly failed\n");
+        AsmDestroyContext(&context);
+        LexUnmapSource(&source);
+        return -1;
+    }
+
+    //Keep the output reproducible
+    memset(&image, 0, sizeof(image));
+    err = ImgParseRaw(&image, (const unsigned char *)program->Opcodes, program->OpcodeCount * sizeof(PIC_OPCODE), 0);
+    if (err == 0)
+    {
+        image.Hash = ImgHash(source.Buffer, source.Size);
+        image.SourceSize = source.Size;
+
+        err = PcfWrite(OutPath, &image, &context.Symbols, program->Lines, program->OpcodeCount);
+    }
+
+    free(program);
+    AsmDestroyContext(&context);
+    LexUnmapSource(&source);
+
+    return err;
+}
+
+static int CompileImage(const char *Path, const char *OutPath)
+{
+    PIC_IMAGE *image;
+    int err;
+
+    image = ImgLoadFile(Path);
+    if (image == NULL)
+    {
+        printf("Failed to load %s\n", Path);
+        return -1;
+    }
+
+    //Images carry no symbols or line numbers
+    err = PcfWrite(OutPath, image, NULL, NULL, 0);
+    ImgRelease(image);
+
+    return err;
+}
+
+int main(int argc, const char * argv[])
+{
+    int err;
+
+    if (argc != 3)
+    {
+        printf("Usage: %s <file.asm|file.hex|file.bin> <output.pcf>\n", argv[0]);
+        return -1;
+    }
+
+    if (CompileIsAssembly(argv[1]))
+        err = CompileAssembly(argv[1], argv[2]);
+    else
+        err = CompileImage(argv[1], argv[2]);
+
+    if (err < 0)
+    {
+        printf("Failed to compile %s\n", argv[1]);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+//
+//  cover.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cover.h"
+#include "image.h"
+
+static void CovExec(void *Context, PIC_CPU *Cpu, unsigned short PC, int Id, unsigned short Opcode)
+{
+    PIC_COVERAGE *coverage = Context;
+
+    coverage->Hits[PC % PROGRAM_MEM_INSTRUCTIONS]++;
+}
+
+static void CovBranch(void *Context, PIC_CPU *Cpu, unsigned short From, unsigned short To)
+{
+    PIC_COVERAGE *coverage = Context;
+
+    coverage->Taken[From % PROGRAM_MEM_INSTRUCTIONS]++;
+}
+
+//The returned hooks are ready for CpuAttachHooks
+PIC_COVERAGE *CovCreate(void)
+{
+    PIC_COVERAGE *coverage;
+
+    coverage = calloc(1, sizeof(PIC_COVERAGE));
+    if (coverage == NULL)
+        return NULL;
+
+    coverage->Hooks.Exec = CovExec;
+    coverage->Hooks.Branch = CovBranch;
+    coverage->Hooks.Context = coverage;
+
+    return coverage;
+}
+
+void CovDestroy(PIC_COVERAGE *Coverage)
+{
+    free(Coverage);
+}
+
+//Lists every word that was executed or is programmed with something other
+//than NOP (unprogrammed flash reads as IMAGE_ERASED_WORD)
+int CovWriteCsv(const PIC_COVERAGE *Coverage, PIC_CPU *Cpu, const char *Path)
+{
+    char text[0x40];
+    unsigned short opcode;
+    int i, program = 0, covered = 0;
+    FILE *file;
+
+    file = fopen(Path, "w");
+    if (file == NULL)
+    {
+        printf("Failed to create %s\n", Path);
+        return -1;
+    }
+
+    fprintf(file, "address,instruction,hits,taken\n");
+
+    for (i = 0; i < PROGRAM_MEM_INSTRUCTIONS; i++)
+    {
+        opcode = CpuGetOpcode(Cpu, i);
+        if ((opcode == 0 || opcode == IMAGE_ERASED_WORD) && Coverage->Hits[i] == 0)
+            continue;
+
+        IsaFormat(opcode, text, sizeof(text));
+        fprintf(file, "0x%03x,\"%s\",%llu,%llu\n", i, text, Coverage->Hits[i], Coverage->Taken[i]);
+
+        program++;
+        if (Coverage->Hits[i] != 0)
+            covered++;
+    }
+
+    fclose(file);
+
+    printf("Coverage: %d of %d instructions executed\n", covered, program);
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+//
+//  cover.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Instruction and branch coverage collected through the CPU's exec and
+//  branch hooks.
+//
+
+#ifndef PIC16F84A_Emulator_cover_h
+#define PIC16F84A_Emulator_cover_h
+
+#include "cpu.h"
+
+//This struct represents the coverage of one run
+typedef struct _PIC_COVERAGE {
+    PIC_HOOKS Hooks;
+    unsigned long long Hits[PROGRAM_MEM_INSTRUCTIONS];
+    unsigned long long Taken[PROGRAM_MEM_INSTRUCTIONS];    //Times the word jumped, skipped or returned
+} PIC_COVERAGE;
+
+PIC_COVERAGE *CovCreate(void);
+void CovDestroy(PIC_COVERAGE *Coverage);
+
+int CovWriteCsv(const PIC_COVERAGE *Coverage, PIC_CPU *Cpu, const char *Path);
+
+#endif
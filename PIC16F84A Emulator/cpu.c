@@ -8,12 +8,27 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "cpu.h"
+#include "isa.h"
 #include "opcode.h"
 #include "stack.h"
+#include "debug.h"
+#include "fuse.h"
+#include "stats.h"
 
+//Pools and lockstep runs copy whole CPUs, so keep one within five cache lines
+//on 64-bit hosts. Hot core state comes first and the pointers follow it
+//without padding.
+typedef char CpuCheckSize[(sizeof(PIC_CPU) <= 5 * 64) ? 1 : -1];
+
+//Points the CPU at the register view for the bank STATUS selects
+static void CpuSelectBank(PIC_CPU *Cpu)
+{
+    Cpu->Bank = RegsBankViews[(Cpu->Regs.STATUS & STATUS_RP0) != 0];
+}
 
 int CpuInitializeCore(PIC_CPU *Cpu)
 {
@@ -22,6 +37,23 @@ int CpuInitializeCore(PIC_CPU *Cpu)
 
     //Initialize the stack
     StkInitialize(&Cpu->Stack);
+
+    CpuSelectBank(Cpu);
+
+    //Nothing is predecoded yet
+    Cpu->Decoded = NULL;
+    Cpu->Fused = NULL;
+
+    //Print every state change by default
+    Cpu->Trace = 1;
+
+    Cpu->Cycles = 0;
+    Cpu->Vcd = NULL;
+    Cpu->Debug = NULL;
+    Cpu->Stats = NULL;
+    Cpu->PortHash = NULL;
+    Cpu->Traps = NULL;
+    Cpu->Hooks = NULL;
     
     //W and SRAM state is left undefined
 
@@ -29,10 +61,35 @@ int CpuInitializeCore(PIC_CPU *Cpu)
     return 0;
 }
 
+//Gives the CPU its own writable copy of program memory
+static int CpuPrivateProgramMemory(PIC_CPU *Cpu)
+{
+    if (Cpu->ProgMem == Cpu->PrivateProgMem && Cpu->ProgMem != NULL)
+        return 0;
+
+    if (Cpu->PrivateProgMem == NULL)
+    {
+        Cpu->PrivateProgMem = calloc(PROGRAM_MEM_INSTRUCTIONS, sizeof(PIC_OPCODE));
+        if (Cpu->PrivateProgMem == NULL)
+        {
+            printf("Out of memory\n");
+            return -1;
+        }
+    }
+
+    //Copy on write
+    if (Cpu->ProgMem != NULL)
+        memcpy(Cpu->PrivateProgMem, Cpu->ProgMem, PROGRAM_MEM_INSTRUCTIONS * sizeof(PIC_OPCODE));
+
+    Cpu->ProgMem = Cpu->PrivateProgMem;
+
+    return 0;
+}
+
 int CpuInitializeProgramMemory(PIC_CPU *Cpu, unsigned char *buffer, int size)
 {
     //Make sure the bytecode fits in the PIC's memory
-    if (size > PROGRAM_MEM_SIZE)
+    if (size > PROGRAM_MEM_INSTRUCTIONS * sizeof(PIC_OPCODE))
     {
         printf("Program is too large for the PIC\n");
         return -1;
@@ -45,13 +102,39 @@ int CpuInitializeProgramMemory(PIC_CPU *Cpu, unsigned char *buffer, int size)
         return -1;
     }
 
+    if (CpuPrivateProgramMemory(Cpu) < 0)
+        return -1;
+
     //Copy the bytecode into our private memory
-    memcpy(Cpu->ProgMem, buffer, size);
+    memcpy(Cpu->PrivateProgMem, buffer, size);
+
+    //Any predecoded program no longer matches
+    Cpu->Decoded = NULL;
+    Cpu->Fused = NULL;
 
     //Success
     return 0;
 }
 
+//Shares immutable program memory (and optionally its predecoded copy)
+//with any number of other CPUs
+void CpuAttachProgram(PIC_CPU *Cpu, const PIC_OPCODE *ProgMem, const ISA_INSN *Decoded)
+{
+    CpuFreeProgramMemory(Cpu);
+
+    Cpu->ProgMem = ProgMem;
+    Cpu->Decoded = Decoded;
+}
+
+void CpuFreeProgramMemory(PIC_CPU *Cpu)
+{
+    free(Cpu->PrivateProgMem);
+    Cpu->PrivateProgMem = NULL;
+    Cpu->ProgMem = NULL;
+    Cpu->Decoded = NULL;
+    Cpu->Fused = NULL;
+}
+
 unsigned short CpuGetPC(PIC_CPU *Cpu)
 {
     //Construct the full PC and do wrap-around handling
@@ -61,7 +144,7 @@ unsigned short CpuGetPC(PIC_CPU *Cpu)
 void CpuSetPC(PIC_CPU *Cpu, unsigned short PC)
 {
     //Write the new PC back
-    Cpu->Regs.PCLATH = (PC << 8) & 0x1F;
+    Cpu->Regs.PCLATH = (PC >> 8) & 0x1F;
     Cpu->Regs.PCL = (PC & 0xFF);
 }
 
@@ -70,758 +153,1004 @@ unsigned short CpuGetOpcode(PIC_CPU *Cpu, unsigned short PC)
     return (Cpu->ProgMem[PC].Opcode) & PIC_OPCODE_MASK;
 }
 
-void CpuSetOpcode(PIC_CPU *Cpu, unsigned short PC, unsigned short Opcode)
+int CpuSetOpcode(PIC_CPU *Cpu, unsigned short PC, unsigned short Opcode)
 {
-    Cpu->ProgMem[PC].Opcode = Opcode & PIC_OPCODE_MASK;
+    if (CpuPrivateProgramMemory(Cpu) < 0)
+        return -1;
+
+    Cpu->PrivateProgMem[PC].Opcode = Opcode & PIC_OPCODE_MASK;
+
+    //The shared predecoded program (and its superinstructions) no longer match
+    Cpu->Decoded = NULL;
+    Cpu->Fused = NULL;
+
+    return 0;
 }
 
-unsigned short CpuExecuteOpcode(PIC_CPU *Cpu, short opcode, unsigned short PC)
+//Uses an immutable predecoded copy of ProgMem (e.g. from a PIC_IMAGE)
+void CpuAttachDecoded(PIC_CPU *Cpu, const ISA_INSN *Decoded)
+{
+    Cpu->Decoded = Decoded;
+    Cpu->Fused = NULL;
+}
+
+//Uses superinstructions marked by FuseProgram over the attached Decoded
+void CpuAttachFused(PIC_CPU *Cpu, const unsigned char *Fused)
+{
+    Cpu->Fused = Fused;
+}
+
+void CpuSetTrace(PIC_CPU *Cpu, int Trace)
+{
+    Cpu->Trace = (Trace != 0);
+}
+
+//The debug state is only consulted while attached
+void CpuAttachDebug(PIC_CPU *Cpu, PIC_DEBUG *Debug)
+{
+    Cpu->Debug = Debug;
+}
+
+//Counters are only updated while attached
+void CpuAttachStats(PIC_CPU *Cpu, PIC_STATS *Stats)
+{
+    Cpu->Stats = Stats;
+}
+
+//Hooks are only called while attached
+void CpuAttachHooks(PIC_CPU *Cpu, const PIC_HOOKS *Hooks)
+{
+    Cpu->Hooks = Hooks;
+}
+
+//Signature shared by every instruction handler
+typedef unsigned short (*CPU_HANDLER)(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status);
+
+static void CpuUpdateZ(unsigned char *Status, unsigned char Result)
+{
+    if (Result == 0)
+        *Status |= STATUS_Z;
+    else
+        *Status &= ~STATUS_Z;
+}
+
+//Folds a port or TRIS write and the cycle it happened on into the hash
+static void CpuHashPortWrite(PIC_CPU *Cpu, int Offset)
+{
+    unsigned long long hash = *Cpu->PortHash;
+
+    switch (Offset)
+    {
+        case REG_PORTA:
+        case REG_PORTB:
+        case REG_TRISA:
+        case REG_TRISB:
+            break;
+        default:
+            return;
+    }
+
+    hash = (hash ^ (unsigned int)Offset) * 1099511628211ull;
+    hash = (hash ^ ((unsigned char *)&Cpu->Regs)[Offset]) * 1099511628211ull;
+    hash = (hash ^ Cpu->Cycles) * 1099511628211ull;
+
+    *Cpu->PortHash = hash;
+}
+
+//Reads an f operand through the selected bank's view
+static unsigned char CpuReadFile(PIC_CPU *Cpu, unsigned char File)
+{
+    unsigned char offset = Cpu->Bank[File];
+
+    if (offset == REGS_VIEW_INDIRECT)
+        return RegsGetValue(&Cpu->Regs, File);
+    if (offset == REGS_VIEW_NONE)
+        return 0;
+
+    return ((unsigned char *)&Cpu->Regs)[offset] & RegsReadMasks[offset];
+}
+
+//Writes a file register and records the change for waveform output
+static void CpuWriteFile(PIC_CPU *Cpu, unsigned char File, unsigned char Value)
+{
+    unsigned char *regs = (unsigned char *)&Cpu->Regs;
+    int offset = Cpu->Bank[File];
+
+    //INDF and traced writes take the long way
+    if (offset == REGS_VIEW_INDIRECT || Cpu->Trace)
+        offset = RegsSetValue(&Cpu->Regs, File, Value, Cpu->Trace);
+    else if (offset == REGS_VIEW_NONE)
+        offset = -1;
+    else
+        regs[offset] = (regs[offset] & ~RegsWriteMasks[offset]) | (Value & RegsWriteMasks[offset]);
+
+    if (offset < 0)
+        return;
+
+    //RP0 can only move when STATUS is written
+    if (offset == REG_STATUS)
+        CpuSelectBank(Cpu);
+
+    if (Cpu->Vcd != NULL)
+        VcdRecord(Cpu->Vcd, Cpu->Cycles, offset, ((unsigned char *)&Cpu->Regs)[offset]);
+    if (Cpu->PortHash != NULL)
+        CpuHashPortWrite(Cpu, offset);
+}
+
+//Writes the result of an f,d instruction to W or back to the file
+static void CpuStoreResult(PIC_CPU *Cpu, unsigned short Opcode, unsigned char Result)
+{
+    if (ISA_DEST(Opcode) == DST_W)
+        Cpu->W = Result;
+    else
+        CpuWriteFile(Cpu, ISA_FILE(Opcode), Result);
+}
+
+//Computes A + B and sets C, DC and Z
+static unsigned char CpuAdd(unsigned char A, unsigned char B, unsigned char *Status)
+{
+    unsigned char result = A + B;
+
+    //If the low 4-bit add overflowed, set the DC bit
+    if (((A & 0x0F) + (B & 0x0F)) & 0x10)
+        *Status |= STATUS_DC;
+    else
+        *Status &= ~STATUS_DC;
+
+    //If the 8-bit add overflowed, set the C bit
+    if ((A + B) & 0x100)
+        *Status |= STATUS_C;
+    else
+        *Status &= ~STATUS_C;
+
+    CpuUpdateZ(Status, result);
+
+    return result;
+}
+
+//Computes A - B and sets C, DC and Z (polarity is reversed for SUB)
+static unsigned char CpuSub(unsigned char A, unsigned char B, unsigned char *Status)
+{
+    unsigned char result = A - B;
+
+    //DC is set if the low 4-bit sub didn't borrow
+    if ((A & 0x0F) >= (B & 0x0F))
+        *Status |= STATUS_DC;
+    else
+        *Status &= ~STATUS_DC;
+
+    //C is set if the 8-bit sub didn't borrow
+    if (A >= B)
+        *Status |= STATUS_C;
+    else
+        *Status &= ~STATUS_C;
+
+    CpuUpdateZ(Status, result);
+
+    return result;
+}
+
+static unsigned short CpuOpADDWF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    CpuStoreResult(Cpu, Opcode, CpuAdd(Cpu->W, CpuReadFile(Cpu, ISA_FILE(Opcode)), Status));
+    return PC;
+}
+
+static unsigned short CpuOpANDWF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    unsigned char result = Cpu->W & CpuReadFile(Cpu, ISA_FILE(Opcode));
+
+    CpuStoreResult(Cpu, Opcode, result);
+    CpuUpdateZ(Status, result);
+    return PC;
+}
+
+static unsigned short CpuOpCLRF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    CpuWriteFile(Cpu, ISA_FILE(Opcode), 0);
+    *Status |= STATUS_Z;
+    return PC;
+}
+
+static unsigned short CpuOpCLRW(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    Cpu->W = 0;
+    *Status |= STATUS_Z;
+    return PC;
+}
+
+static unsigned short CpuOpCOMF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    unsigned char result = ~CpuReadFile(Cpu, ISA_FILE(Opcode));
+
+    CpuStoreResult(Cpu, Opcode, result);
+    CpuUpdateZ(Status, result);
+    return PC;
+}
+
+static unsigned short CpuOpDECF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    unsigned char result = CpuReadFile(Cpu, ISA_FILE(Opcode)) - 1;
+
+    CpuStoreResult(Cpu, Opcode, result);
+    CpuUpdateZ(Status, result);
+    return PC;
+}
+
+static unsigned short CpuOpDECFSZ(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    unsigned char result = CpuReadFile(Cpu, ISA_FILE(Opcode)) - 1;
+
+    CpuStoreResult(Cpu, Opcode, result);
+
+    //Skip next instruction if 0
+    if (result == 0)
+        PC++;
+    return PC;
+}
+
+static unsigned short CpuOpINCF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    unsigned char result = CpuReadFile(Cpu, ISA_FILE(Opcode)) + 1;
+
+    CpuStoreResult(Cpu, Opcode, result);
+    CpuUpdateZ(Status, result);
+    return PC;
+}
+
+static unsigned short CpuOpINCFSZ(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    unsigned char result = CpuReadFile(Cpu, ISA_FILE(Opcode)) + 1;
+
+    CpuStoreResult(Cpu, Opcode, result);
+
+    //Skip next instruction if 0
+    if (result == 0)
+        PC++;
+    return PC;
+}
+
+static unsigned short CpuOpIORWF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    unsigned char result = Cpu->W | CpuReadFile(Cpu, ISA_FILE(Opcode));
+
+    CpuStoreResult(Cpu, Opcode, result);
+    CpuUpdateZ(Status, result);
+    return PC;
+}
+
+static unsigned short CpuOpMOVF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    unsigned char result = CpuReadFile(Cpu, ISA_FILE(Opcode));
+
+    CpuStoreResult(Cpu, Opcode, result);
+    CpuUpdateZ(Status, result);
+    return PC;
+}
+
+static unsigned short CpuOpMOVWF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    CpuWriteFile(Cpu, ISA_FILE(Opcode), Cpu->W);
+    return PC;
+}
+
+static unsigned short CpuOpNOP(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    return PC;
+}
+
+static unsigned short CpuOpRLF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    unsigned char value = CpuReadFile(Cpu, ISA_FILE(Opcode));
+
+    //Shift left through carry
+    CpuStoreResult(Cpu, Opcode, (value << 1) | ((*Status & STATUS_C) ? 0x01 : 0x00));
+
+    //Bit 7 -> Carry bit
+    if (value & 0x80)
+        *Status |= STATUS_C;
+    else
+        *Status &= ~STATUS_C;
+    return PC;
+}
+
+static unsigned short CpuOpRRF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    unsigned char value = CpuReadFile(Cpu, ISA_FILE(Opcode));
+
+    //Shift right through carry
+    CpuStoreResult(Cpu, Opcode, (value >> 1) | ((*Status & STATUS_C) ? 0x80 : 0x00));
+
+    //Bit 0 -> Carry bit
+    if (value & 0x01)
+        *Status |= STATUS_C;
+    else
+        *Status &= ~STATUS_C;
+    return PC;
+}
+
+static unsigned short CpuOpSUBWF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    CpuStoreResult(Cpu, Opcode, CpuSub(CpuReadFile(Cpu, ISA_FILE(Opcode)), Cpu->W, Status));
+    return PC;
+}
+
+static unsigned short CpuOpSWAPF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    unsigned char value = CpuReadFile(Cpu, ISA_FILE(Opcode));
+
+    CpuStoreResult(Cpu, Opcode, (unsigned char)((value << 4) | (value >> 4)));
+    return PC;
+}
+
+static unsigned short CpuOpXORWF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    unsigned char result = Cpu->W ^ CpuReadFile(Cpu, ISA_FILE(Opcode));
+
+    CpuStoreResult(Cpu, Opcode, result);
+    CpuUpdateZ(Status, result);
+    return PC;
+}
+
+static unsigned short CpuOpBCF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    CpuWriteFile(Cpu, ISA_FILE(Opcode), CpuReadFile(Cpu, ISA_FILE(Opcode)) & ~(1 << ISA_BIT(Opcode)));
+    return PC;
+}
+
+static unsigned short CpuOpBSF(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    CpuWriteFile(Cpu, ISA_FILE(Opcode), CpuReadFile(Cpu, ISA_FILE(Opcode)) | (1 << ISA_BIT(Opcode)));
+    return PC;
+}
+
+static unsigned short CpuOpBTFSC(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    //Skip the next instruction if the bit is clear
+    if ((CpuReadFile(Cpu, ISA_FILE(Opcode)) & (1 << ISA_BIT(Opcode))) == 0)
+        PC++;
+    return PC;
+}
+
+static unsigned short CpuOpBTFSS(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    //Skip the next instruction if the bit is set
+    if ((CpuReadFile(Cpu, ISA_FILE(Opcode)) & (1 << ISA_BIT(Opcode))) != 0)
+        PC++;
+    return PC;
+}
+
+static unsigned short CpuOpADDLW(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    Cpu->W = CpuAdd(Cpu->W, ISA_K8(Opcode), Status);
+    return PC;
+}
+
+static unsigned short CpuOpANDLW(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    Cpu->W &= ISA_K8(Opcode);
+    CpuUpdateZ(Status, Cpu->W);
+    return PC;
+}
+
+static unsigned short CpuOpCALL(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    //Push the return address
+    StkPush(&Cpu->Stack, PC);
+
+    //The upper 2 bits are preserved
+    return (PC & 0x1800) | ISA_K11(Opcode);
+}
+
+static unsigned short CpuOpCLRWDT(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    //NOTE: Reset WDT if we ever implement one
+    *Status |= (STATUS_PD | STATUS_TO);
+    return PC;
+}
+
+static unsigned short CpuOpGOTO(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    //The upper 2 bits are preserved
+    return (PC & 0x1800) | ISA_K11(Opcode);
+}
+
+static unsigned short CpuOpIORLW(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    Cpu->W |= ISA_K8(Opcode);
+    CpuUpdateZ(Status, Cpu->W);
+    return PC;
+}
+
+static unsigned short CpuOpMOVLW(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    Cpu->W = ISA_K8(Opcode);
+    return PC;
+}
+
+static unsigned short CpuOpRETFIE(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    //TODO: Set the GIE bit in INTCON
+    return StkPop(&Cpu->Stack);
+}
+
+static unsigned short CpuOpRETLW(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    //Write the return value into W
+    Cpu->W = ISA_K8(Opcode);
+    return StkPop(&Cpu->Stack);
+}
+
+static unsigned short CpuOpRETURN(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    return StkPop(&Cpu->Stack);
+}
+
+static unsigned short CpuOpSLEEP(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    //NOTE: Reset WDT if we ever implement one
+    *Status |= STATUS_TO;
+    *Status &= ~STATUS_PD;
+    return PC;
+}
+
+static unsigned short CpuOpSUBLW(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    Cpu->W = CpuSub(ISA_K8(Opcode), Cpu->W, Status);
+    return PC;
+}
+
+static unsigned short CpuOpXORLW(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    Cpu->W ^= ISA_K8(Opcode);
+    CpuUpdateZ(Status, Cpu->W);
+    return PC;
+}
+
+static unsigned short CpuOpInvalid(PIC_CPU *Cpu, unsigned short Opcode, unsigned short PC, unsigned char *Status)
+{
+    if (Cpu->Trace)
+        printf("Invalid opcode 0x%x!\n", Opcode);
+    return 0xFFFF;
+}
+
+//Handlers indexed by instruction ID (one per isa.def row)
+static const CPU_HANDLER CpuHandlers[ISA_COUNT + 1] =
+{
+#define ISA_OP(Name, Mask, Match, Format, Cycles) CpuOp##Name,
+#include "isa.def"
+#undef ISA_OP
+    CpuOpInvalid
+};
+
+static unsigned short CpuDispatch(PIC_CPU *Cpu, int Id, unsigned short opcode, unsigned short PC)
 {
-    unsigned char result;
-    unsigned char op1, op2;
     unsigned char status = Cpu->Regs.STATUS;
     unsigned char oldW = Cpu->W;
     unsigned char oldStatus = status;
+    unsigned short next = PC + 1;
+    
+    //Run the handler, skipping to the next instruction
+    PC = CpuHandlers[Id](Cpu, opcode, next, &status);
+    if (PC == 0xFFFF)
+        return PC;
+    
+    if (status != oldStatus)
+    {
+        if (Cpu->Trace)
+        {
+            printf("STATUS:[");
+            RegsPrintStatusRegister(Cpu->Regs.STATUS);
+            printf("] -> [");
+            RegsPrintStatusRegister(status);
+            printf("]\n");
+        }
+
+        //This can put back an RP0 the handler also wrote through the file
+        Cpu->Regs.STATUS = status;
+        CpuSelectBank(Cpu);
+        if (Cpu->Vcd != NULL)
+            VcdRecord(Cpu->Vcd, Cpu->Cycles, REG_STATUS, status);
+    }
+
+    if (oldW != Cpu->W)
+    {
+        if (Cpu->Trace)
+            printf("W: %d -> %d\n", oldW, Cpu->W);
+        if (Cpu->Vcd != NULL)
+            VcdRecord(Cpu->Vcd, Cpu->Cycles, VCD_ADDR_W, Cpu->W);
+    }
+
+    //Skipping a single-cycle instruction costs a second cycle
+    if (IsaTable[Id].Cycles == 1 && PC != next)
+        Cpu->Cycles += 2;
+    else
+        Cpu->Cycles += IsaTable[Id].Cycles;
+    
+    return PC;
+}
 
+unsigned short CpuExecuteOpcode(PIC_CPU *Cpu, short opcode, unsigned short PC)
+{
     //Make sure this is 14-bit
     if ((opcode & 0xC000) != 0)
     {
         printf("Invalid high bits in opcode\n");
         return 0xFFFF;
     }
-    
-    //Skip to the next instruction
-    PC ++;
-    
-    //Classify the opcode by the highest byte
-    if ((opcode & 0x3000) == 0x0000)
+
+    return CpuDispatch(Cpu, IsaDecode(opcode), opcode, PC);
+}
+
+unsigned short CpuExecuteDecoded(PIC_CPU *Cpu, const ISA_INSN *Insn, unsigned short PC)
+{
+    return CpuDispatch(Cpu, Insn->Id, Insn->Opcode, PC);
+}
+
+//Executes one instruction without any reporting
+static int CpuStep(PIC_CPU *Cpu)
+{
+    unsigned short PC;
+
+    //Get the PC
+    PC = CpuGetPC(Cpu);
+
+    //Execute an opcode
+    if (Cpu->Decoded != NULL)
+        PC = CpuExecuteDecoded(Cpu, &Cpu->Decoded[PC], PC);
+    else
+        PC = CpuExecuteOpcode(Cpu, CpuGetOpcode(Cpu, PC), PC);
+    if (PC == 0xFFFF)
+        return CPU_ERR_INVALID;
+
+    //Make sure the CPU is still running
+    if (!(Cpu->Regs.STATUS & STATUS_PD))
+        return CPU_ERR_HALTED;
+
+    //Set the new PC
+    if (Cpu->Trace)
+        printf("PC -> 0x%x\n", PC);
+    CpuSetPC(Cpu, PC);
+
+    return 0;
+}
+
+//Executes one instruction
+int CpuExec(PIC_CPU *Cpu)
+{
+    int err;
+
+    CpuSelectBank(Cpu);
+
+    err = CpuStep(Cpu);
+    if (err == CPU_ERR_INVALID)
     {
-        //Byte-oriented file register operations
-        switch (opcode & 0xF00)
-        {
-            case OP_ADDWF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-
-                //If the low 4-bit add overflowed, set the DC bit
-                result = (Cpu->W & 0x0F) + (RegsGetValue(&Cpu->Regs, op1) & 0x0F);
-                if ((result & 0x10) != 0)
-                    status |= STATUS_DC;
-                else
-                    status &= ~STATUS_DC;
-                
-                //If the high 4-bit add overflowed, set the C bit
-                result = (Cpu->W >> 4) + (RegsGetValue(&Cpu->Regs, op1) >> 4);
-                result += (status & STATUS_DC) ? 1 : 0;
-                if ((result & 0x10) != 0)
-                    status |= STATUS_C;
-                else
-                    status &= ~STATUS_C;
-                
-                //Do the operation
-                result = Cpu->W + RegsGetValue(&Cpu->Regs, op1);
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-                
-                //Set status flags
-                if (result == 0)
-                    status |= STATUS_Z;
-                else
-                    status &= ~STATUS_Z;
-                break;
-                
-            case OP_ANDWF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-                
-                //Execute the operation
-                result = Cpu->W & RegsGetValue(&Cpu->Regs, op1);
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-                
-                //Set status flags
-                if (result == 0)
-                    status |= STATUS_Z;
-                else
-                    status &= ~STATUS_Z;
-
-                break;
-        
-            case 0x100:
-                if ((opcode & 0x80) != 0)
-                {
-                    //CLRF
-
-                    //Get the operand
-                    op1 = (opcode & 0x7F);
-                    
-                    //Execute the operation
-                    RegsSetValue(&Cpu->Regs, op1, 0);
-                    
-                    //Set status flags
-                    status |= STATUS_Z;
-                }
-                else
-                {
-                    //CLRW
-                    
-                    //Execute the operation
-                    Cpu->W = 0;
-
-                    //Set status flags
-                    status |= STATUS_Z;
-                }
-                break;
-
-            case OP_COMF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-                
-                //Execute the operation
-                result = ~ RegsGetValue(&Cpu->Regs, op1);
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-                
-                //Set status flags
-                if (result == 0)
-                    status |= STATUS_Z;
-                else
-                    status &= ~STATUS_Z;
-                
-                break;
-                
-            case OP_DECF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-                
-                //Execute the operation
-                result = RegsGetValue(&Cpu->Regs, op1) - 1;
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-                
-                //Set status flags
-                if (result == 0)
-                    status |= STATUS_Z;
-                else
-                    status &= ~STATUS_Z;
-                
-                break;
-            case OP_DECFSZ:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-                
-                //Execute the operation
-                result = RegsGetValue(&Cpu->Regs, op1) - 1;
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-                
-                //Skip next instruction if 0
-                if (result == 0)
-                    PC ++;
-                
-                break;
-
-            case OP_INCF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-                
-                //Execute the operation
-                result = RegsGetValue(&Cpu->Regs, op1) + 1;
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-                
-                //Set status flags
-                if (result == 0)
-                    status |= STATUS_Z;
-                else
-                    status &= ~STATUS_Z;
-                
-                break;
-                
-            case OP_INCFSZ:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-                
-                //Execute the operation
-                result = RegsGetValue(&Cpu->Regs, op1) + 1;
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-                
-                //Skip next instruction if 0
-                if (result == 0)
-                    PC ++;
-                break;
-                
-            case OP_IORWF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-                
-                //Execute the operation
-                result = Cpu->W | RegsGetValue(&Cpu->Regs, op1);
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-                
-                //Set status flags
-                if (result == 0)
-                    status |= STATUS_Z;
-                else
-                    status &= ~STATUS_Z;
-                break;
-                
-            case OP_MOVF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-                
-                //Execute the operation
-                result = RegsGetValue(&Cpu->Regs, op1);
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-                
-                //Set status flags
-                if (result == 0)
-                    status |= STATUS_Z;
-                else
-                    status &= ~STATUS_Z;
-                break;
-
-            case 0x000:
-                if ((opcode & 0x80) != 0)
-                {
-                    //MOVWF
-
-                    //Get the operand
-                    op1 = (opcode & 0x7F);
-                    
-                    //Execute the operation
-                    RegsSetValue(&Cpu->Regs, op1, Cpu->W);
-                }
-                else if ((opcode & 0xF) == 0)
-                {
-                    //Nop
-                }
-                else
-                {
-                    //Control ops
-                    switch (opcode & 0xFF)
-                    {
-                        case OP_CLRWDT:
-                            //NOTE: Reset WDT if we ever implement one
-
-                            //Set the status bits
-                            status |= (STATUS_PD | STATUS_TO);
-                            break;
-                        case OP_RETFIE:
-                            //TODO: Set the GIE bit in INTCON
-
-                            //Pop the return address into PC
-                            PC = StkPop(&Cpu->Stack);
-                            break;
-                        case OP_RETURN:
-                            //Pop the return address into PC
-                            PC = StkPop(&Cpu->Stack);
-                            break;
-                        case OP_SLEEP:
-                            //NOTE: Reset WDT if we ever implement one
-                            
-                            //Change the status bits
-                            status |= STATUS_TO;
-                            status &= ~STATUS_PD;
-                            break;
-                        default:
-                            printf("Invalid 00 0000 opcode!\n");
-                            return 0xFFFF;
-                    }
-                }
-                break;
-                
-            case OP_RLF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-                
-                //Execute the operation
-                result = RegsGetValue(&Cpu->Regs, op1);
-                
-                //Bit 7 -> Carry bit
-                if ((result & 0x80) != 0)
-                    status |= STATUS_C;
-                else
-                    status &= ~STATUS_C;
-
-                //Shift left 1
-                result = result << 1;
-                
-                //Carry bit -> Bit 0
-                if ((Cpu->Regs.STATUS & STATUS_C) != 0)
-                    result |= 0x01;
-                else
-                    result &= ~0x01;
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-
-                break;
-                
-            case OP_RRF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-                
-                //Execute the operation
-                result = RegsGetValue(&Cpu->Regs, op1);
-                
-                //Bit 0 -> Carry bit
-                if (result & 0x01)
-                    status |= STATUS_C;
-                else
-                    status &= ~STATUS_C;
-                
-                //Shift right 1
-                result = result >> 1;
-                
-                //Carry bit -> Bit 7
-                if ((Cpu->Regs.STATUS & STATUS_C) != 0)
-                    result |= 0x80;
-                else
-                    result &= ~0x80;
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-
-                break;
-                
-            case OP_SUBWF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-                
-                //If the low 4-bit sub underflowed, set the DC bit
-                result = (RegsGetValue(&Cpu->Regs, op1) & 0x0F) - (Cpu->W & 0x0F);
-                
-                //Polarity is reversed for SUB
-                if ((result & 0x10) == 0)
-                    status |= STATUS_DC;
-                else
-                    status &= ~STATUS_DC;
-                
-                //If the high 4-bit sub underflowed, set the C bit
-                result = RegsGetValue(&Cpu->Regs, op1) >> 4;
-                result -= (status & STATUS_DC) ? 0 : 1;
-                result -= Cpu->W >> 4;
-                
-                //Polarity is reversed for SUB
-                if ((result & 0x10) == 0)
-                    status |= STATUS_C;
-                else
-                    status &= ~STATUS_C;
-                
-                //Execute the operation
-                result = RegsGetValue(&Cpu->Regs, op1) - Cpu->W;
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-                
-                //Set status flags
-                if (result == 0)
-                    status |= STATUS_Z;
-                else
-                    status &= ~STATUS_Z;
-                
-                break;
-
-            case OP_SWAPF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-                
-                //Execute the operation
-                result = (RegsGetValue(&Cpu->Regs, op1) << 4) & 0xF0;
-                result |= (RegsGetValue(&Cpu->Regs, op1) >> 4) & 0x0F;
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-                
-                break;
-                
-            case OP_XORWF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x80) >> 7;
-                
-                //Execute the operation
-                result = Cpu->W ^ RegsGetValue(&Cpu->Regs, op1);
-                
-                //Store the results
-                if (op2 == 0)
-                    Cpu->W = result;
-                else
-                    RegsSetValue(&Cpu->Regs, op1, result);
-                
-                //Set status flags
-                if (result == 0)
-                    status |= STATUS_Z;
-                else
-                    status &= ~STATUS_Z;
-                break;
-            default:
-                printf("Invalid 00 opcode!\n");
-                return 0xFFFF;
-        }
+        printf("Opcode unsupported\n");
+        return -1;
     }
-    else if ((opcode & 0x3000) == 0x1000)
+    else if (err == CPU_ERR_HALTED)
     {
-        //Bit-oriented file register operations
-        switch (opcode & 0x3C00)
-        {
-            case OP_BCF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x380) >> 7;
-                
-                //Execute the operation
-                result = RegsGetValue(&Cpu->Regs, op1) & ~(1 << op2);
-                
-                //Store the results
-                RegsSetValue(&Cpu->Regs, op1, result);
-                break;
-                
-            case OP_BSF:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x380) >> 7;
-                
-                //Execute the operation
-                result = RegsGetValue(&Cpu->Regs, op1) | (1 << op2);
-                
-                //Store the results
-                RegsSetValue(&Cpu->Regs, op1, result);
-                break;
-                
-            case OP_BTFSC:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x380) >> 7;
-                
-                //Execute the operation
-                result = RegsGetValue(&Cpu->Regs, op1) & (1 << op2);
-                
-                //Skip the next instruction
-                if (result == 0)
-                    PC ++;
-                break;
-                
-            case OP_BTFSS:
-                //Get the operands
-                op1 = (opcode & 0x7F);
-                op2 = (opcode & 0x380) >> 7;
-                
-                //Execute the operation
-                result = RegsGetValue(&Cpu->Regs, op1) & (1 << op2);
-                
-                //Skip the next instruction
-                if (result != 0)
-                    PC ++;
-                break;
-                
-            default:
-                printf("Invalid 01 opcode!\n");
-                return 0xFFFF;
-        }
+        printf("CPU is halted\n");
+        return -1;
     }
-    else if ((opcode & 0x3000) == 0x2000)
+
+    //1 instruction retired :)
+    return 0;
+}
+
+//Signature shared by every superinstruction. Returns the instructions retired,
+//at most Left (0 if it couldn't make progress and the words must be stepped).
+typedef unsigned int (*CPU_FUSED_HANDLER)(PIC_CPU *Cpu, const ISA_INSN *Insn, unsigned short PC, unsigned int Left);
+
+//Each superinstruction leaves exactly the state its words would have left
+//when stepped one at a time without tracing or waveform output
+
+static unsigned int CpuFusedMOVLW_MOVWF(PIC_CPU *Cpu, const ISA_INSN *Insn, unsigned short PC, unsigned int Left)
+{
+    Cpu->W = ISA_K8(Insn[0].Opcode);
+    Cpu->Cycles++;
+
+    CpuWriteFile(Cpu, ISA_FILE(Insn[1].Opcode), Cpu->W);
+    Cpu->Cycles++;
+
+    CpuSetPC(Cpu, PC + 2);
+    return 2;
+}
+
+static unsigned int CpuFusedBANK_MOVWF(PIC_CPU *Cpu, const ISA_INSN *Insn, unsigned short PC, unsigned int Left)
+{
+    unsigned char status = CpuReadFile(Cpu, REG_STATUS);
+
+    if (Insn[0].Id == ISA_BSF)
+        status |= STATUS_RP0;
+    else
+        status &= ~STATUS_RP0;
+    CpuWriteFile(Cpu, REG_STATUS, status);
+    Cpu->Cycles++;
+
+    //Resolved in the bank just selected
+    CpuWriteFile(Cpu, ISA_FILE(Insn[1].Opcode), Cpu->W);
+    Cpu->Cycles++;
+
+    CpuSetPC(Cpu, PC + 2);
+    return 2;
+}
+
+//Finishes a skip followed by a GOTO: the skip retires alone, otherwise both do
+static unsigned int CpuFusedSkipGoto(PIC_CPU *Cpu, const ISA_INSN *Insn, unsigned short PC, int Skip)
+{
+    if (Skip)
     {
-        //GOTO / CALL
-        if ((opcode & 0x800) != 0)
-        {
-            //GOTO
+        Cpu->Cycles += 2;
+        CpuSetPC(Cpu, PC + 2);
+        return 1;
+    }
 
-            //The upper 2 bits are preserved
-            PC = PC & 0x1800;
-            
-            //Update the PC
-            PC |= (opcode & 0x7FF);
-        }
-        else
+    //The upper 2 bits are preserved
+    Cpu->Cycles += 1 + IsaTable[ISA_GOTO].Cycles;
+    CpuSetPC(Cpu, ((PC + 2) & 0x1800) | ISA_K11(Insn[1].Opcode));
+    return 2;
+}
+
+static unsigned int CpuFusedBIT_GOTO(PIC_CPU *Cpu, const ISA_INSN *Insn, unsigned short PC, unsigned int Left)
+{
+    int set = (CpuReadFile(Cpu, ISA_FILE(Insn[0].Opcode)) & (1 << ISA_BIT(Insn[0].Opcode))) != 0;
+
+    return CpuFusedSkipGoto(Cpu, Insn, PC, (Insn[0].Id == ISA_BTFSS) ? set : !set);
+}
+
+static unsigned int CpuFusedDECFSZ_GOTO(PIC_CPU *Cpu, const ISA_INSN *Insn, unsigned short PC, unsigned int Left)
+{
+    unsigned char result = CpuReadFile(Cpu, ISA_FILE(Insn[0].Opcode)) - 1;
+
+    CpuStoreResult(Cpu, Insn[0].Opcode, result);
+
+    return CpuFusedSkipGoto(Cpu, Insn, PC, result == 0);
+}
+
+static unsigned int CpuFusedCOMPARE(PIC_CPU *Cpu, const ISA_INSN *Insn, unsigned short PC, unsigned int Left)
+{
+    unsigned char status = Cpu->Regs.STATUS;
+    int zero;
+
+    //MOVF's Z is always overwritten by XORLW's
+    Cpu->W = CpuReadFile(Cpu, ISA_FILE(Insn[0].Opcode)) ^ ISA_K8(Insn[1].Opcode);
+    CpuUpdateZ(&status, Cpu->W);
+    Cpu->Regs.STATUS = status;
+    Cpu->Cycles += 2;
+
+    zero = (status & STATUS_Z) != 0;
+    if ((Insn[2].Id == ISA_BTFSS) ? zero : !zero)
+    {
+        Cpu->Cycles += 2;
+        CpuSetPC(Cpu, PC + 4);
+    }
+    else
+    {
+        Cpu->Cycles++;
+        CpuSetPC(Cpu, PC + 3);
+    }
+
+    return 3;
+}
+
+//What one pass through a delay loop's body costs
+typedef struct _CPU_DELAY_BODY {
+    unsigned int Words;             //Words in front of the loop's DECFSZ
+    unsigned long long Retired;
+    unsigned long long Cycles;
+} CPU_DELAY_BODY;
+
+//Loads a DECFSZ counter (0 runs 256 times)
+#define CPU_DELAY_COUNT(Value) ((Value) != 0 ? (unsigned int)(Value) : 0x100)
+
+//Every body reloads its inner counter, so its cost only depends on the code
+static void CpuDelayBody(const ISA_INSN *Insn, CPU_DELAY_BODY *Body)
+{
+    CPU_DELAY_BODY inner;
+    unsigned long long count;
+
+    if (Insn[0].Id != ISA_MOVLW)
+    {
+        Body->Words = 0;
+        Body->Retired = 0;
+        Body->Cycles = 0;
+        return;
+    }
+
+    CpuDelayBody(&Insn[2], &inner);
+    count = CPU_DELAY_COUNT(ISA_K8(Insn[0].Opcode));
+
+    //MOVLW, MOVWF, then the inner loop: every pass but the last
+    //costs a DECFSZ (1 cycle) and a GOTO (2), the last one a skip (2)
+    Body->Words = 2 + inner.Words + 2;
+    Body->Retired = 2 + count * (inner.Retired + 2) - 1;
+    Body->Cycles = 2 + count * (inner.Cycles + 3) - 1;
+}
+
+//Runs a nest of counted delay loops in closed form. Nothing but the counters
+//and W changes inside, and interrupts aren't modelled, so the only thing that
+//can land in the middle is the end of the run: the loop then stops after the
+//last whole pass that fits and resumes from its first word next time.
+static unsigned int CpuFusedDELAY(PIC_CPU *Cpu, const ISA_INSN *Insn, unsigned short PC, unsigned int Left)
+{
+    unsigned char *regs = (unsigned char *)&Cpu->Regs;
+    CPU_DELAY_BODY body;
+    const ISA_INSN *reload;
+    unsigned char file;
+    unsigned long long count, passes, retired;
+
+    CpuDelayBody(Insn, &body);
+    file = ISA_FILE(Insn[body.Words].Opcode);
+    count = CPU_DELAY_COUNT(regs[file]);
+
+    //All the way out, or as many whole passes as fit
+    retired = count * (body.Retired + 2) - 1;
+    if (retired <= Left)
+    {
+        passes = count;
+        regs[file] = 0;
+        Cpu->Cycles += count * (body.Cycles + 3) - 1;
+        CpuSetPC(Cpu, PC + body.Words + 2);
+    }
+    else
+    {
+        passes = Left / (body.Retired + 2);
+        if (passes == 0)
+            return 0;
+
+        retired = passes * (body.Retired + 2);
+        regs[file] -= passes;
+        Cpu->Cycles += passes * (body.Cycles + 3);
+    }
+
+    //Each pass leaves the inner counters at 0 and W at the innermost reload
+    if (body.Words != 0)
+    {
+        for (reload = Insn; reload->Id == ISA_MOVLW; reload += 2)
         {
-            //CALL
-            
-            //Push the return address
-            StkPush(&Cpu->Stack, PC);
-
-            //The upper 2 bits are preserved
-            PC = PC & 0x1800;
-            
-            //Update the PC
-            PC |= (opcode & 0x7FF);
+            Cpu->W = ISA_K8(reload[0].Opcode);
+            regs[ISA_FILE(reload[1].Opcode)] = 0;
         }
     }
-    else //0x3000
+
+    return (unsigned int)retired;
+}
+
+//Superinstructions indexed by FUSE_* kind
+static const CPU_FUSED_HANDLER CpuFusedHandlers[FUSE_KINDS] =
+{
+    NULL,
+    CpuFusedMOVLW_MOVWF,
+    CpuFusedBANK_MOVWF,
+    CpuFusedBIT_GOTO,
+    CpuFusedDECFSZ_GOTO,
+    CpuFusedCOMPARE,
+    CpuFusedDELAY
+};
+
+//The plain loop with superinstructions. A sequence only runs fused if all
+//of its words fit in what is left of Count, so Retired stays exact.
+static int CpuRunFused(PIC_CPU *Cpu, unsigned int Count, unsigned int *Retired)
+{
+    const ISA_INSN *decoded = Cpu->Decoded;
+    const unsigned char *fused = Cpu->Fused;
+    unsigned short PC;
+    unsigned int i = 0, retired;
+    int err = 0, kind;
+
+    while (i < Count)
     {
-        if ((opcode & 0xE00) == 0xE00)
+        PC = CpuGetPC(Cpu);
+        kind = fused[PC];
+        if (kind != FUSE_NONE && Count - i >= FuseLength[kind])
         {
-            //ADDLW
-            
-            //Get the operand
-            op1 = (opcode & 0xFF);
-
-            //If the low 4-bit add overflowed, set the DC bit
-            result = (Cpu->W & 0x0F) + (op1 & 0x0F);
-            if ((result & 0x10) != 0)
-                status |= STATUS_DC;
-            else
-                status &= ~STATUS_DC;
-                        
-            //If the high 4-bit add overflowed, set the C bit
-            result = (Cpu->W >> 4) + (op1 >> 4);
-            result += (status & STATUS_DC) ? 1 : 0;
-            if ((result & 0x10) != 0)
-                status |= STATUS_C;
-            else
-                status &= ~STATUS_C;
-
-            //Do the operation
-            result = Cpu->W + op1;
-            
-            //Store the results
-            Cpu->W = result;
-            
-            //Set status flags
-            if (result == 0)
-                status |= STATUS_Z;
-            else
-                status &= ~STATUS_Z;
+            retired = CpuFusedHandlers[kind](Cpu, &decoded[PC], PC, Count - i);
+            if (retired != 0)
+            {
+                i += retired;
+                continue;
+            }
         }
-        else if ((opcode & 0xF00) == 0x900)
+
+        err = CpuStep(Cpu);
+        if (err < 0)
+            break;
+        i++;
+    }
+
+    *Retired = i;
+
+    return err;
+}
+
+//What a run loop variant checks around each instruction
+#define CPU_RUN_DEBUG        0x01   //Breakpoints, traps, watchpoints and counters
+#define CPU_RUN_EXEC_HOOK    0x02
+#define CPU_RUN_ACCESS_HOOK  0x04
+#define CPU_RUN_BRANCH_HOOK  0x08
+#define CPU_RUN_VARIANTS     0x10
+
+//Value an access hook sees (unimplemented locations read as 0)
+static unsigned char CpuHookValue(PIC_CPU *Cpu, unsigned char Address)
+{
+    unsigned char *file = RegsFilePointer(&Cpu->Regs, Address);
+
+    return (file != NULL) ? *file : 0;
+}
+
+//Body of every instrumented run loop. Variant is a constant in each
+//instantiation below, so the compiler drops whatever that variant doesn't check.
+static inline __attribute__((always_inline))
+int CpuRunLoop(PIC_CPU *Cpu, unsigned int Count, unsigned int *Retired, const int Variant)
+{
+    PIC_DEBUG *debug = Cpu->Debug;
+    PIC_STATS *stats = Cpu->Stats;
+    const PIC_HOOKS *hooks = Cpu->Hooks;
+    unsigned short PC, next, opcode = 0;
+    unsigned char status, address = 0;
+    unsigned int i;
+    int err = 0, id = ISA_INVALID, access = 0, fileAccess = 0;
+
+    for (i = 0; i < Count; i++)
+    {
+        PC = CpuGetPC(Cpu);
+        if ((Variant & CPU_RUN_DEBUG) && debug != NULL && debug->BreakpointCount != 0 &&
+            DbgShouldBreak(debug, Cpu, PC, i == 0))
         {
-            //ANDLW
-            
-            //Get the operand
-            op1 = (opcode & 0xFF);
-            
-            //Execute the operation
-            result = Cpu->W & op1;
-            
-            //Store the results
-            Cpu->W = result;
-            
-            //Set status flags
-            if (result == 0)
-                status |= STATUS_Z;
-            else
-                status &= ~STATUS_Z;
+            err = CPU_ERR_BREAK;
+            break;
         }
-        else if ((opcode & 0xF00) == 0x800)
+
+        if ((Variant & CPU_RUN_DEBUG) && Cpu->Traps != NULL && DbgTestBit(Cpu->Traps, PC))
         {
-            //IORLW
-            
-            //Get the operand
-            op1 = (opcode & 0xFF);
-            
-            //Execute the operation
-            result = Cpu->W | op1;
-            
-            //Store the results
-            Cpu->W = result;
-            
-            //Set status flags
-            if (result == 0)
-                status |= STATUS_Z;
-            else
-                status &= ~STATUS_Z;
+            err = CPU_ERR_TRAP;
+            break;
         }
-        else if ((opcode & 0xF00) == 0xA00)
+
+        if (Cpu->Decoded != NULL)
         {
-            //XORLW
-            
-            //Get the operand
-            op1 = (opcode & 0xFF);
-            
-            //Execute the operation
-            result = Cpu->W ^ op1;
-            
-            //Store the results
-            Cpu->W = result;
-            
-            //Set status flags
-            if (result == 0)
-                status |= STATUS_Z;
-            else
-                status &= ~STATUS_Z;
+            id = Cpu->Decoded[PC].Id;
+            opcode = Cpu->Decoded[PC].Opcode;
         }
-        else if ((opcode & 0xC00) == 0x000)
+        else
         {
-            //MOVLW
-            
-            //Get the operand
-            op1 = (opcode & 0xFF);
-            
-            //Execute the operation
-            result = op1;
-            
-            //Store the results
-            Cpu->W = result;
+            opcode = CpuGetOpcode(Cpu, PC);
+            id = IsaDecode(opcode);
         }
-        else if ((opcode & 0xC00) == 0x400)
+
+        if (Variant & CPU_RUN_EXEC_HOOK)
+            hooks->Exec(hooks->Context, Cpu, PC, id, opcode);
+
+        //Reads are reported with the value the instruction is about to see
+        if (Variant & CPU_RUN_ACCESS_HOOK)
         {
-            //RETLW
-
-            //Get the operand
-            op1 = (opcode & 0xFF);
-            
-            //Write the return value into W
-            Cpu->W = op1;
-            
-            //Pop the return address into PC
-            PC = StkPop(&Cpu->Stack);
+            fileAccess = IsaFileAccess(id, opcode);
+            if (fileAccess != 0)
+            {
+                address = RegsResolveAddress(&Cpu->Regs, ISA_FILE(opcode));
+                if (fileAccess & ISA_ACCESS_READ)
+                    hooks->Access(hooks->Context, Cpu, PC, address, CpuHookValue(Cpu, address), ISA_ACCESS_READ);
+            }
         }
-        else if ((opcode & 0xC00) == 0xC00)
+
+        access = 0;
+        if ((Variant & CPU_RUN_DEBUG) && debug != NULL && debug->WatchCount != 0)
+            access = DbgCheckAccess(debug, Cpu, id, opcode);
+
+        status = Cpu->Regs.STATUS;
+        if ((Variant & CPU_RUN_DEBUG) && stats != NULL)
+            StatRecord(stats, Cpu, id, opcode);
+
+        err = CpuStep(Cpu);
+
+        if ((Variant & CPU_RUN_DEBUG) && stats != NULL)
+            StatRecordStatus(stats, status, Cpu->Regs.STATUS);
+
+        if (err < 0)
+            break;
+
+        if ((Variant & CPU_RUN_ACCESS_HOOK) && (fileAccess & ISA_ACCESS_WRITE))
+            hooks->Access(hooks->Context, Cpu, PC, address, CpuHookValue(Cpu, address), ISA_ACCESS_WRITE);
+
+        if (Variant & CPU_RUN_BRANCH_HOOK)
         {
-            //SUBLW
-            
-            //Get the operand
-            op1 = (opcode & 0xFF);
-            
-            //If the low 4-bit sub underflowed, set the DC bit
-            result = (op1 & 0x0F) - (Cpu->W & 0x0F);
-            
-            //Polarity is reversed for SUB
-            if ((result & 0x10) == 0)
-                status |= STATUS_DC;
-            else
-                status &= ~STATUS_DC;
-            
-            //If the high 4-bit sub underflowed, set the C bit
-            result = op1 >> 4;
-            result -= (status & STATUS_DC) ? 0 : 1;
-            result -= Cpu->W >> 4;
-            
-            //Polarity is reversed for SUB
-            if ((result & 0x10) == 0)
-                status |= STATUS_C;
-            else
-                status &= ~STATUS_C;
-            
-            //Execute the operation
-            result = op1 - Cpu->W;
-            
-            //Store the results
-            Cpu->W = result;
-            
-            //Set status flags
-            if (result == 0)
-                status |= STATUS_Z;
-            else
-                status &= ~STATUS_Z;
+            next = CpuGetPC(Cpu);
+            if (next != PC + 1)
+                hooks->Branch(hooks->Context, Cpu, PC, next);
         }
-        else
+
+        //Watched accesses stop after the instruction
+        if (access != 0)
         {
-            printf("Invalid 11 opcode!\n");
-            return 0xFFFF;
+            debug->StopPC = PC;
+            i++;
+            err = CPU_ERR_WATCH;
+            break;
         }
     }
-    
-    if (status != oldStatus)
-    {
-        printf("STATUS:[");
-        RegsPrintStatusRegister(Cpu->Regs.STATUS);
-        printf("] -> [");
-        Cpu->Regs.STATUS = status;
-        RegsPrintStatusRegister(Cpu->Regs.STATUS);
-        printf("]\n");
-    }
 
-    if (oldW != Cpu->W)
+    *Retired = i;
+
+    return err;
+}
+
+//The plain loop never looks at debug state, traps, counters or hooks
+static int CpuRunVariant0(PIC_CPU *Cpu, unsigned int Count, unsigned int *Retired)
+{
+    unsigned int i;
+    int err = 0;
+
+    for (i = 0; i < Count; i++)
     {
-        printf("W: %d -> %d\n", oldW, Cpu->W);
+        err = CpuStep(Cpu);
+        if (err < 0)
+            break;
     }
-    
-    return PC;
+
+    *Retired = i;
+
+    return err;
 }
 
-//Executes one instruction
-int CpuExec(PIC_CPU *Cpu)
+//One specialized loop per combination of checks
+#define CPU_RUN_VARIANT(Variant) \
+    static int CpuRunVariant##Variant(PIC_CPU *Cpu, unsigned int Count, unsigned int *Retired) \
+    { \
+        return CpuRunLoop(Cpu, Count, Retired, Variant); \
+    }
+
+CPU_RUN_VARIANT(1)
+CPU_RUN_VARIANT(2)
+CPU_RUN_VARIANT(3)
+CPU_RUN_VARIANT(4)
+CPU_RUN_VARIANT(5)
+CPU_RUN_VARIANT(6)
+CPU_RUN_VARIANT(7)
+CPU_RUN_VARIANT(8)
+CPU_RUN_VARIANT(9)
+CPU_RUN_VARIANT(10)
+CPU_RUN_VARIANT(11)
+CPU_RUN_VARIANT(12)
+CPU_RUN_VARIANT(13)
+CPU_RUN_VARIANT(14)
+CPU_RUN_VARIANT(15)
+
+static int (* const CpuRunVariants[CPU_RUN_VARIANTS])(PIC_CPU *Cpu, unsigned int Count, unsigned int *Retired) =
 {
-    unsigned short PC;
+    CpuRunVariant0, CpuRunVariant1, CpuRunVariant2, CpuRunVariant3,
+    CpuRunVariant4, CpuRunVariant5, CpuRunVariant6, CpuRunVariant7,
+    CpuRunVariant8, CpuRunVariant9, CpuRunVariant10, CpuRunVariant11,
+    CpuRunVariant12, CpuRunVariant13, CpuRunVariant14, CpuRunVariant15
+};
 
-    //Get the PC
-    PC = CpuGetPC(Cpu);
+//Executes up to Count instructions, stopping early if the CPU halts or
+//hits an invalid opcode. Nothing is printed unless tracing is enabled.
+int CpuRun(PIC_CPU *Cpu, unsigned int Count, unsigned int *Retired)
+{
+    const PIC_HOOKS *hooks = Cpu->Hooks;
+    int variant = 0;
 
-    //Execute an opcode
-    PC = CpuExecuteOpcode(Cpu, CpuGetOpcode(Cpu, PC), PC);
-    if (PC == 0xFFFF)
-    {
-        printf("Opcode unsupported\n");
-        return -1;
-    }
+    //Callers may have changed STATUS since the last run
+    CpuSelectBank(Cpu);
 
-    //Make sure the CPU is still running
-    if (!(Cpu->Regs.STATUS & STATUS_PD))
+    //The loop is picked once per call, never per instruction
+    if (Cpu->Debug != NULL || Cpu->Stats != NULL || Cpu->Traps != NULL)
+        variant |= CPU_RUN_DEBUG;
+
+    if (hooks != NULL)
     {
-        printf("CPU is halted\n");
-        return -1;
+        if (hooks->Exec != NULL)
+            variant |= CPU_RUN_EXEC_HOOK;
+        if (hooks->Access != NULL)
+            variant |= CPU_RUN_ACCESS_HOOK;
+        if (hooks->Branch != NULL)
+            variant |= CPU_RUN_BRANCH_HOOK;
     }
-    
-    //Set the new PC
-    printf("PC -> 0x%x\n", PC);
-    CpuSetPC(Cpu, PC);
 
-    //1 instruction retired :)
-    return 0;
+    //Superinstructions don't report the steps inside them
+    if (variant == 0 && Cpu->Fused != NULL && Cpu->Decoded != NULL && !Cpu->Trace && Cpu->Vcd == NULL)
+        return CpuRunFused(Cpu, Count, Retired);
+
+    return CpuRunVariants[variant](Cpu, Count, Retired);
 }
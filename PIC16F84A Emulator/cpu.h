@@ -11,8 +11,10 @@
 #define PIC16F84A_Emulator_cpu_h
 
 #include "regs.h"
+#include "isa.h"
 #include "opcode.h"
 #include "stack.h"
+#include "vcd.h"
 
 //PIC's program memory size is 1024 instructions
 #define PROGRAM_MEM_INSTRUCTIONS 0x400
@@ -24,23 +26,108 @@
 //PIC's opcodes are 14 bits
 #define PIC_OPCODE_BITS 0xE
 
-//This struct represents the CPU state
+//PIC has 64 bytes of data EEPROM
+#define EEPROM_SIZE 0x40
+
+//Reasons for CpuRun to stop early
+#define CPU_ERR_INVALID (-1)
+#define CPU_ERR_HALTED  (-2)
+#define CPU_ERR_BREAK   (-3)    //Stopped before a breakpoint
+#define CPU_ERR_WATCH   (-4)    //Stopped after a watched access
+#define CPU_ERR_TRAP    (-5)    //Stopped before a trapped instruction
+
+//This struct represents the CPU state. It only holds mutable state: program
+//memory is shared through a pointer (usually to an image or a mapped .pcf file)
+//and copied on the first write. A CPU must start out zeroed; CpuInitializeCore
+//resets the core but leaves program memory alone.
 typedef struct _PIC_CPU {
     REGISTER_FILE Regs;
     WORKING_REGISTER W;
+
+    //Print register, W, STATUS and PC changes as they happen
+    unsigned char Trace;
+
     PIC_STACK Stack;
-    PIC_OPCODE ProgMem[PROGRAM_MEM_INSTRUCTIONS];
+
+    //Instruction cycles executed since reset
+    unsigned long long Cycles;
+
+    //Program words (shared and read-only unless ProgMem == PrivateProgMem)
+    const PIC_OPCODE *ProgMem;
+    PIC_OPCODE *PrivateProgMem;
+
+    //Predecoded copy of ProgMem (NULL if it must be decoded on fetch)
+    const ISA_INSN *Decoded;
+
+    //Superinstruction kind of each word of Decoded (NULL runs unfused)
+    const unsigned char *Fused;
+
+    //RegsBankViews entry for the bank STATUS.RP0 selects. It is switched on
+    //STATUS writes; direct writes to Regs.STATUS are picked up by the next
+    //CpuRun or CpuExec.
+    const unsigned char *Bank;
+
+    //Waveform output (NULL if not recording)
+    VCD_WRITER *Vcd;
+
+    //Breakpoints and watchpoints (NULL if none are set)
+    struct _PIC_DEBUG *Debug;
+
+    //Instruction mix counters (NULL if not collecting)
+    struct _PIC_STATS *Stats;
+
+    //Running hash of port and TRIS writes (NULL if not hashing)
+    unsigned long long *PortHash;
+
+    //Bitmap of program addresses to stop before (NULL if none, may be shared)
+    const unsigned int *Traps;
+
+    //Tool callbacks (NULL if none are registered)
+    const struct _PIC_HOOKS *Hooks;
+
+    unsigned char Eeprom[EEPROM_SIZE];
 } PIC_CPU;
 
+//Called before each instruction executes
+typedef void (*CPU_EXEC_HOOK)(void *Context, PIC_CPU *Cpu, unsigned short PC, int Id, unsigned short Opcode);
+
+//Called for each file register access (reads before, writes after the instruction)
+typedef void (*CPU_ACCESS_HOOK)(void *Context, PIC_CPU *Cpu, unsigned short PC, unsigned char Address,
+                                unsigned char Value, int Access);
+
+//Called whenever an instruction leaves the PC anywhere but the next word
+typedef void (*CPU_BRANCH_HOOK)(void *Context, PIC_CPU *Cpu, unsigned short From, unsigned short To);
+
+//Hooks for coverage, profiling and tracing tools. Any member may be NULL;
+//CpuRun picks a loop compiled for exactly the hooks that are set.
+typedef struct _PIC_HOOKS {
+    CPU_EXEC_HOOK Exec;
+    CPU_ACCESS_HOOK Access;
+    CPU_BRANCH_HOOK Branch;
+    void *Context;
+} PIC_HOOKS;
+
 int CpuInitializeProgramMemory(PIC_CPU *Cpu, unsigned char *buffer, int size);
+void CpuAttachProgram(PIC_CPU *Cpu, const PIC_OPCODE *ProgMem, const ISA_INSN *Decoded);
+void CpuFreeProgramMemory(PIC_CPU *Cpu);
 
 int CpuInitializeCore(PIC_CPU *Cpu);
 
 int CpuExec(PIC_CPU *Cpu);
+int CpuRun(PIC_CPU *Cpu, unsigned int Count, unsigned int *Retired);
+
+void CpuSetTrace(PIC_CPU *Cpu, int Trace);
+void CpuAttachDebug(PIC_CPU *Cpu, struct _PIC_DEBUG *Debug);
+void CpuAttachStats(PIC_CPU *Cpu, struct _PIC_STATS *Stats);
+void CpuAttachHooks(PIC_CPU *Cpu, const PIC_HOOKS *Hooks);
 
 unsigned short CpuExecuteOpcode(PIC_CPU *Cpu, short opcode, unsigned short PC);
+unsigned short CpuExecuteDecoded(PIC_CPU *Cpu, const ISA_INSN *Insn, unsigned short PC);
+
+void CpuAttachDecoded(PIC_CPU *Cpu, const ISA_INSN *Decoded);
+void CpuAttachFused(PIC_CPU *Cpu, const unsigned char *Fused);
 
-void CpuSetOpcode(PIC_CPU *Cpu, unsigned short PC, unsigned short Opcode);
+int CpuSetOpcode(PIC_CPU *Cpu, unsigned short PC, unsigned short Opcode);
 unsigned short CpuGetOpcode(PIC_CPU *Cpu, unsigned short PC);
 
 void CpuSetPC(PIC_CPU *Cpu, unsigned short PC);
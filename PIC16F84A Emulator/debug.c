@@ -0,0 +1,280 @@
+//
+//  debug.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "debug.h"
+#include "cpu.h"
+
+//W has no file offset, so conditions on it get their own predicates
+#define DBG_FILE(Cpu, Offset) (((const unsigned char *)&(Cpu)->Regs)[Offset])
+
+#define DBG_PREDICATES(Name, Expression) \
+static int DbgW##Name(const PIC_CPU *Cpu, const DBG_CONDITION *Condition) \
+{ \
+    unsigned char value = Cpu->W; \
+    return Expression; \
+} \
+static int DbgFile##Name(const PIC_CPU *Cpu, const DBG_CONDITION *Condition) \
+{ \
+    unsigned char value = DBG_FILE(Cpu, Condition->Offset); \
+    return Expression; \
+}
+
+DBG_PREDICATES(Eq, value == Condition->Value)
+DBG_PREDICATES(Ne, value != Condition->Value)
+DBG_PREDICATES(Le, value <= Condition->Value)
+DBG_PREDICATES(Ge, value >= Condition->Value)
+DBG_PREDICATES(Lt, value < Condition->Value)
+DBG_PREDICATES(Gt, value > Condition->Value)
+DBG_PREDICATES(And, (value & Condition->Value) != 0)
+
+#undef DBG_PREDICATES
+
+//Two character operators must come first
+static const struct {
+    const char *Operator;
+    DBG_PREDICATE W;
+    DBG_PREDICATE File;
+} DbgOperators[] =
+{
+    {"==", DbgWEq, DbgFileEq},
+    {"!=", DbgWNe, DbgFileNe},
+    {"<=", DbgWLe, DbgFileLe},
+    {">=", DbgWGe, DbgFileGe},
+    {"<", DbgWLt, DbgFileLt},
+    {">", DbgWGt, DbgFileGt},
+    {"&", DbgWAnd, DbgFileAnd},
+    {NULL, NULL, NULL}
+};
+
+void DbgInitialize(PIC_DEBUG *Debug)
+{
+    memset(Debug, 0, sizeof(*Debug));
+}
+
+int DbgIsActive(const PIC_DEBUG *Debug)
+{
+    return Debug->BreakpointCount != 0 || Debug->WatchCount != 0;
+}
+
+//Parses an operand (W, a register name or a file address) and stores its offset
+static int DbgParseOperand(const char *Text, int *IsW, unsigned char *Offset)
+{
+    char *end;
+    long value;
+
+    if (strcasecmp(Text, "W") == 0)
+    {
+        *IsW = 1;
+        return 0;
+    }
+
+    *IsW = 0;
+
+    value = RegsLookupRegisterName(Text);
+    if (value < 0)
+    {
+        value = strtol(Text, &end, 0);
+        if (end == Text || *end != 0 || value < 0 || value >= DBG_DATA_SIZE)
+            return -1;
+    }
+
+    *Offset = RegsCanonicalAddress((unsigned char)value);
+
+    return 0;
+}
+
+//Turns "<operand> <op> <value>" (e.g. "W == 5" or "PORTB & 0x80") into a predicate
+int DbgCompileCondition(const char *Text, DBG_CONDITION *Condition)
+{
+    char operand[DBG_CONDITION_MAX];
+    const char *op = NULL;
+    char *end;
+    long value;
+    int length, isW, i;
+
+    memset(Condition, 0, sizeof(*Condition));
+
+    //Find the first operator character
+    for (i = 0; DbgOperators[i].Operator != NULL; i++)
+    {
+        op = strstr(Text, DbgOperators[i].Operator);
+        if (op != NULL)
+            break;
+    }
+
+    if (op == NULL)
+    {
+        printf("Bad condition: %s\n", Text);
+        return -1;
+    }
+
+    //Trim the operand
+    while (isspace((unsigned char)*Text))
+        Text++;
+    length = (int)(op - Text);
+    while (length > 0 && isspace((unsigned char)Text[length - 1]))
+        length--;
+
+    if (length <= 0 || length >= DBG_CONDITION_MAX)
+    {
+        printf("Bad condition: %s\n", Text);
+        return -1;
+    }
+
+    memcpy(operand, Text, length);
+    operand[length] = 0;
+
+    value = strtol(op + strlen(DbgOperators[i].Operator), &end, 0);
+    while (isspace((unsigned char)*end))
+        end++;
+
+    if (*end != 0 || value < 0 || value > 0xFF ||
+        DbgParseOperand(operand, &isW, &Condition->Offset) < 0)
+    {
+        printf("Bad condition: %s\n", Text);
+        return -1;
+    }
+
+    Condition->Value = (unsigned char)value;
+    Condition->Test = isW ? DbgOperators[i].W : DbgOperators[i].File;
+
+    return 0;
+}
+
+int DbgSetBreakpoint(PIC_DEBUG *Debug, int PC, const char *Condition)
+{
+    DBG_CONDITION condition;
+
+    if (PC < 0 || PC >= PROGRAM_MEM_INSTRUCTIONS)
+    {
+        printf("Bad breakpoint address 0x%x\n", PC);
+        return -1;
+    }
+
+    memset(&condition, 0, sizeof(condition));
+    if (Condition != NULL && DbgCompileCondition(Condition, &condition) < 0)
+        return -1;
+
+    if (!DbgTestBit(Debug->Breakpoints, PC))
+    {
+        Debug->Breakpoints[PC >> 5] |= (1u << (PC & 31));
+        Debug->BreakpointCount++;
+    }
+
+    Debug->Conditions[PC] = condition;
+
+    return 0;
+}
+
+void DbgClearBreakpoint(PIC_DEBUG *Debug, int PC)
+{
+    if (PC < 0 || PC >= PROGRAM_MEM_INSTRUCTIONS || !DbgTestBit(Debug->Breakpoints, PC))
+        return;
+
+    Debug->Breakpoints[PC >> 5] &= ~(1u << (PC & 31));
+    memset(&Debug->Conditions[PC], 0, sizeof(DBG_CONDITION));
+    Debug->BreakpointCount--;
+}
+
+int DbgSetWatch(PIC_DEBUG *Debug, int Address, int Flags)
+{
+    if (Address < 0 || Address >= DBG_DATA_SIZE || (Flags & (DBG_WATCH_READ | DBG_WATCH_WRITE)) == 0)
+    {
+        printf("Bad watch address 0x%x\n", Address);
+        return -1;
+    }
+
+    Address = RegsCanonicalAddress((unsigned char)Address);
+
+    DbgClearWatch(Debug, Address);
+
+    if (Flags & DBG_WATCH_READ)
+        Debug->WatchRead[Address >> 5] |= (1u << (Address & 31));
+    if (Flags & DBG_WATCH_WRITE)
+        Debug->WatchWrite[Address >> 5] |= (1u << (Address & 31));
+
+    Debug->WatchCount++;
+
+    return 0;
+}
+
+void DbgClearWatch(PIC_DEBUG *Debug, int Address)
+{
+    if (Address < 0 || Address >= DBG_DATA_SIZE)
+        return;
+
+    Address = RegsCanonicalAddress((unsigned char)Address);
+
+    if (DbgTestBit(Debug->WatchRead, Address) || DbgTestBit(Debug->WatchWrite, Address))
+    {
+        Debug->WatchRead[Address >> 5] &= ~(1u << (Address & 31));
+        Debug->WatchWrite[Address >> 5] &= ~(1u << (Address & 31));
+        Debug->WatchCount--;
+    }
+}
+
+//Checks for a breakpoint before the instruction at PC runs. The first
+//instruction of a resumed run doesn't re-hit the breakpoint it stopped on.
+int DbgShouldBreak(PIC_DEBUG *Debug, const PIC_CPU *Cpu, unsigned short PC, int First)
+{
+    const DBG_CONDITION *condition;
+
+    if (First && Debug->Resume && Debug->StopPC == PC)
+    {
+        Debug->Resume = 0;
+        return 0;
+    }
+
+    Debug->Resume = 0;
+
+    if (!DbgTestBit(Debug->Breakpoints, PC))
+        return 0;
+
+    condition = &Debug->Conditions[PC];
+    if (condition->Test != NULL && !condition->Test(Cpu, condition))
+        return 0;
+
+    Debug->StopPC = PC;
+    Debug->Resume = 1;
+
+    return 1;
+}
+
+//Checks whether the instruction about to run touches a watched file
+//register and returns the access kind (0 if none)
+int DbgCheckAccess(PIC_DEBUG *Debug, PIC_CPU *Cpu, int Id, unsigned short Opcode)
+{
+    unsigned char address;
+    int access;
+
+    access = IsaFileAccess(Id, Opcode);
+    if (access == 0)
+        return 0;
+
+    address = RegsResolveAddress(&Cpu->Regs, ISA_FILE(Opcode));
+
+    if (!((access & DBG_WATCH_READ) && DbgTestBit(Debug->WatchRead, address)))
+        access &= ~DBG_WATCH_READ;
+    if (!((access & DBG_WATCH_WRITE) && DbgTestBit(Debug->WatchWrite, address)))
+        access &= ~DBG_WATCH_WRITE;
+
+    if (access != 0)
+    {
+        Debug->StopAddress = address;
+        Debug->StopAccess = (unsigned char)access;
+    }
+
+    return access;
+}
@@ -0,0 +1,71 @@
+//
+//  debug.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Breakpoints and data watchpoints. Nothing here is consulted unless a
+//  PIC_DEBUG with something set is attached to the CPU, so plain runs
+//  keep the undecorated execution loop and register accessors.
+//
+
+#ifndef PIC16F84A_Emulator_debug_h
+#define PIC16F84A_Emulator_debug_h
+
+#include "cpu.h"
+
+#define DBG_DATA_SIZE     0x100
+#define DBG_BITMAP_WORDS(bits) ((bits) / 32)
+
+//Watch flags (same bits as IsaFileAccess)
+#define DBG_WATCH_READ    ISA_ACCESS_READ
+#define DBG_WATCH_WRITE   ISA_ACCESS_WRITE
+
+//Longest condition text accepted
+#define DBG_CONDITION_MAX 0x40
+
+struct _DBG_CONDITION;
+
+typedef int (*DBG_PREDICATE)(const PIC_CPU *Cpu, const struct _DBG_CONDITION *Condition);
+
+//A breakpoint condition compiled to one specialized test
+typedef struct _DBG_CONDITION {
+    DBG_PREDICATE Test;             //NULL if unconditional
+    unsigned char Offset;           //File offset of the operand
+    unsigned char Value;
+} DBG_CONDITION;
+
+//This struct represents the debug state of one CPU
+typedef struct _PIC_DEBUG {
+    unsigned int Breakpoints[DBG_BITMAP_WORDS(PROGRAM_MEM_INSTRUCTIONS)];
+    unsigned int WatchRead[DBG_BITMAP_WORDS(DBG_DATA_SIZE)];
+    unsigned int WatchWrite[DBG_BITMAP_WORDS(DBG_DATA_SIZE)];
+    DBG_CONDITION Conditions[PROGRAM_MEM_INSTRUCTIONS];
+    int BreakpointCount;
+    int WatchCount;
+
+    //Where and why the last run stopped
+    unsigned short StopPC;
+    unsigned char StopAddress;
+    unsigned char StopAccess;
+    int Resume;                     //Don't re-hit the breakpoint at StopPC
+} PIC_DEBUG;
+
+#define DbgTestBit(bitmap, bit)  (((bitmap)[(bit) >> 5] >> ((bit) & 31)) & 1)
+
+void DbgInitialize(PIC_DEBUG *Debug);
+int DbgIsActive(const PIC_DEBUG *Debug);
+
+int DbgCompileCondition(const char *Text, DBG_CONDITION *Condition);
+
+int DbgSetBreakpoint(PIC_DEBUG *Debug, int PC, const char *Condition);
+void DbgClearBreakpoint(PIC_DEBUG *Debug, int PC);
+int DbgSetWatch(PIC_DEBUG *Debug, int Address, int Flags);
+void DbgClearWatch(PIC_DEBUG *Debug, int Address);
+
+int DbgShouldBreak(PIC_DEBUG *Debug, const PIC_CPU *Cpu, unsigned short PC, int First);
+int DbgCheckAccess(PIC_DEBUG *Debug, PIC_CPU *Cpu, int Id, unsigned short Opcode);
+
+#endif
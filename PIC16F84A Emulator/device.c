@@ -0,0 +1,201 @@
+//
+//  device.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "device.h"
+#include "isa.h"
+#include "regs.h"
+
+//Instructions per CpuRun call when no quantum is set
+#define DEV_RUN_SLICE 0x100000
+
+//Marks every instruction that may touch a port: direct accesses to offsets
+//5 and 6 (PORTA/PORTB in bank 0, TRISA/TRISB in bank 1) and all INDF accesses
+void DevComputeTraps(PIC_CPU *Cpu, unsigned int Traps[DEV_TRAP_WORDS])
+{
+    unsigned short opcode;
+    unsigned char file;
+    int pc;
+
+    memset(Traps, 0, DEV_TRAP_WORDS * sizeof(unsigned int));
+
+    for (pc = 0; pc < PROGRAM_MEM_INSTRUCTIONS; pc++)
+    {
+        opcode = CpuGetOpcode(Cpu, (unsigned short)pc);
+        if (IsaFileAccess(IsaDecode(opcode), opcode) == 0)
+            continue;
+
+        file = ISA_FILE(opcode) & 0x7F;
+        if (file == REG_INDF || file == REG_PORTA || file == REG_PORTB)
+            Traps[pc >> 5] |= 1U << (pc & 31);
+    }
+}
+
+//The CPU must already be reset with its program attached
+void DevInitialize(PIC_DEVICE *Device, const unsigned int *Traps, unsigned long long Quantum)
+{
+    Device->Traps = Traps;
+    Device->Retired = 0;
+    Device->Quantum = Quantum;
+    Device->QuantumEnd = Device->Cpu.Cycles + Quantum;
+    Device->Pending = 0;
+    Device->PendingWrite = 0;
+    memset(&Device->Event, 0, sizeof(DEV_EVENT));
+}
+
+//Returns the access kind if the instruction at PC touches a port right now
+static int DevPortAccess(PIC_CPU *Cpu, unsigned short PC, unsigned char *Address)
+{
+    unsigned short opcode = CpuGetOpcode(Cpu, PC);
+    int access;
+
+    access = IsaFileAccess(IsaDecode(opcode), opcode);
+    if (access == 0)
+        return 0;
+
+    *Address = RegsResolveAddress(&Cpu->Regs, ISA_FILE(opcode));
+    switch (*Address)
+    {
+        case REG_PORTA:
+        case REG_PORTB:
+            return access;
+
+        //TRIS is CPU state rather than pins, so only writes are reported
+        //and reads never ask the host for input
+        case REG_TRISA:
+        case REG_TRISB:
+            return access & ISA_ACCESS_WRITE;
+    }
+
+    return 0;
+}
+
+static int DevEmit(PIC_DEVICE *Device, int Kind, unsigned char Address, unsigned short PC, DEV_EVENT *Event)
+{
+    unsigned char *file = RegsFilePointer(&Device->Cpu.Regs, Address);
+
+    Device->Event.Kind = Kind;
+    Device->Event.Address = Address;
+    Device->Event.Value = (Address != 0 && file != NULL) ? *file : 0;
+    Device->Event.PC = PC;
+    Device->Event.Cycles = Device->Cpu.Cycles;
+
+    if (Event != NULL)
+        *Event = Device->Event;
+
+    return Kind;
+}
+
+static int DevStop(PIC_DEVICE *Device, int Err, DEV_EVENT *Event)
+{
+    return DevEmit(Device, (Err == CPU_ERR_HALTED) ? DEV_EVENT_HALTED : DEV_EVENT_INVALID,
+                   0, CpuGetPC(&Device->Cpu), Event);
+}
+
+//Runs the trapped instruction and reports its port write if it has one.
+//Returns 0 if execution should just carry on.
+static int DevFinish(PIC_DEVICE *Device, unsigned char Address, int Write, unsigned short PC, DEV_EVENT *Event)
+{
+    unsigned int retired;
+    int err;
+
+    Device->Cpu.Traps = NULL;
+    err = CpuRun(&Device->Cpu, 1, &retired);
+    Device->Cpu.Traps = Device->Traps;
+    Device->Retired += retired;
+
+    if (err < 0)
+        return DevStop(Device, err, Event);
+
+    if (Write)
+        return DevEmit(Device, DEV_EVENT_WRITE, Address, PC, Event);
+
+    return 0;
+}
+
+static int DevRun(PIC_DEVICE *Device, unsigned char Input, DEV_EVENT *Event)
+{
+    PIC_CPU *cpu = &Device->Cpu;
+    unsigned long long slice;
+    unsigned int retired;
+    unsigned short PC;
+    unsigned char address = 0;
+    unsigned char *file;
+    int err, access, kind;
+
+    //A halted device stays halted
+    if (!(cpu->Regs.STATUS & STATUS_PD))
+        return DevStop(Device, CPU_ERR_HALTED, Event);
+
+    //Latch the input the host was asked for and finish the read
+    if (Device->Pending == DEV_EVENT_READ)
+    {
+        Device->Pending = 0;
+
+        file = RegsFilePointer(&cpu->Regs, Device->Event.Address);
+        *file = Input;
+
+        kind = DevFinish(Device, Device->Event.Address, Device->PendingWrite, Device->Event.PC, Event);
+        if (kind != 0)
+            return kind;
+    }
+
+    for (;;)
+    {
+        if (Device->Quantum != 0 && cpu->Cycles >= Device->QuantumEnd)
+        {
+            Device->QuantumEnd += Device->Quantum;
+            return DevEmit(Device, DEV_EVENT_QUANTUM, 0, CpuGetPC(cpu), Event);
+        }
+
+        //Instructions take one or two cycles, so this never overshoots
+        //the quantum by more than one cycle
+        slice = DEV_RUN_SLICE;
+        if (Device->Quantum != 0 && (Device->QuantumEnd - cpu->Cycles + 1) / 2 < slice)
+            slice = (Device->QuantumEnd - cpu->Cycles + 1) / 2;
+
+        err = CpuRun(cpu, (unsigned int)slice, &retired);
+        Device->Retired += retired;
+        if (err == 0)
+            continue;
+        else if (err != CPU_ERR_TRAP)
+            return DevStop(Device, err, Event);
+
+        PC = CpuGetPC(cpu);
+        access = DevPortAccess(cpu, PC, &address);
+        if (access & ISA_ACCESS_READ)
+        {
+            Device->Pending = DEV_EVENT_READ;
+            Device->PendingWrite = (access & ISA_ACCESS_WRITE) != 0;
+            return DevEmit(Device, DEV_EVENT_READ, address, PC, Event);
+        }
+
+        //Port writes are reported after they happen, anything else
+        //(INDF pointing elsewhere) just runs
+        kind = DevFinish(Device, address, access != 0, PC, Event);
+        if (kind != 0)
+            return kind;
+    }
+}
+
+//Runs the device until its next event. Input is only used when the
+//previous event was DEV_EVENT_READ and becomes the port's pin value.
+int DevResume(PIC_DEVICE *Device, unsigned char Input, DEV_EVENT *Event)
+{
+    int kind;
+
+    //Traps are only installed while the device is running
+    Device->Cpu.Traps = Device->Traps;
+    kind = DevRun(Device, Input, Event);
+    Device->Cpu.Traps = NULL;
+
+    return kind;
+}
@@ -0,0 +1,55 @@
+//
+//  device.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Resumable devices for co-simulation. A device runs until the firmware
+//  touches PORTA or PORTB, writes TRISA or TRISB, or its cycle quantum runs
+//  out, then returns the event to the host instead of calling back into it.
+//  All of its state lives in PIC_DEVICE, so one host thread can step any
+//  number of devices against its own protocol models.
+//
+
+#ifndef PIC16F84A_Emulator_device_h
+#define PIC16F84A_Emulator_device_h
+
+#include "cpu.h"
+
+//Why DevResume returned
+#define DEV_EVENT_READ      1   //About to read a port; resume with the input value
+#define DEV_EVENT_WRITE     2   //Wrote a port; Value holds what was written
+#define DEV_EVENT_QUANTUM   3   //Cycle quantum expired
+#define DEV_EVENT_HALTED    4   //SLEEP
+#define DEV_EVENT_INVALID   5   //Invalid opcode
+
+#define DEV_TRAP_WORDS      (PROGRAM_MEM_INSTRUCTIONS / 32)
+
+typedef struct _DEV_EVENT {
+    int Kind;
+    unsigned char Address;          //REG_PORTA, REG_PORTB, REG_TRISA or REG_TRISB
+    unsigned char Value;            //Current value for reads, new value for writes
+    unsigned short PC;              //Instruction doing the access
+    unsigned long long Cycles;
+} DEV_EVENT;
+
+//This struct represents one device and where it is suspended
+typedef struct _PIC_DEVICE {
+    PIC_CPU Cpu;
+    const unsigned int *Traps;      //From DevComputeTraps (shared by devices running the same program)
+    unsigned long long Retired;
+    unsigned long long Quantum;     //Cycles between quantum events (0 for none)
+    unsigned long long QuantumEnd;
+    int Pending;                    //DEV_EVENT_READ while waiting for input
+    int PendingWrite;               //The pending read is also a write
+    DEV_EVENT Event;                //Last event returned
+} PIC_DEVICE;
+
+void DevComputeTraps(PIC_CPU *Cpu, unsigned int Traps[DEV_TRAP_WORDS]);
+
+void DevInitialize(PIC_DEVICE *Device, const unsigned int *Traps, unsigned long long Quantum);
+int DevResume(PIC_DEVICE *Device, unsigned char Input, DEV_EVENT *Event);
+
+#endif
@@ -0,0 +1,245 @@
+//
+//  disasm.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Lines are built with direct stores rather than printf so that
+//  listings of very long traces are bounded by memory bandwidth.
+//
+
+#include <string.h>
+
+#include "disasm.h"
+#include "regs.h"
+
+static const char DisHexDigits[] = "0123456789ABCDEF";
+
+//STATUS bits the assembler knows by name
+static const char *DisStatusBits[8] =
+{
+    [STATUS_C_BIT] = "C",
+    [STATUS_DC_BIT] = "DC",
+    [STATUS_Z_BIT] = "Z",
+    [STATUS_PD_BIT] = "PD",
+    [STATUS_RP0_BIT] = "RP0",
+};
+
+void DisInitialize(DIS_CONTEXT *Context)
+{
+    int i;
+
+    memset(Context, 0, sizeof(*Context));
+
+    //File operands can't select a bank, so use the bank 0 names
+    for (i = 0; i < 0x80; i++)
+    {
+        if (!RegsIsGpr(i))
+        {
+            Context->Registers[i] = RegsGetRegisterName(i);
+            if (Context->Registers[i] != NULL)
+                Context->RegisterLength[i] = (unsigned char)strlen(Context->Registers[i]);
+        }
+    }
+
+    for (i = 0; i < ISA_COUNT; i++)
+    {
+        Context->MnemonicLength[i] = (unsigned char)strlen(IsaTable[i].Mnemonic);
+    }
+}
+
+void DisAddLabel(DIS_CONTEXT *Context, int Address, const char *Name, int Length)
+{
+    if (Address < 0 || Address >= PROGRAM_MEM_INSTRUCTIONS)
+        return;
+
+    //The first name given to an address wins
+    if (Context->Labels[Address] != NULL)
+        return;
+
+    Context->Labels[Address] = Name;
+    Context->LabelLength[Address] = (unsigned char)(Length > DIS_LABEL_MAX ? DIS_LABEL_MAX : Length);
+}
+
+void DisAddSymbolTable(DIS_CONTEXT *Context, SYM_TABLE *Symbols)
+{
+    unsigned int i;
+
+    for (i = 0; i < Symbols->SlotCount; i++)
+    {
+        if (Symbols->Slots[i].Name != NULL && Symbols->Slots[i].Type == SYM_TYPE_LABEL)
+        {
+            DisAddLabel(Context, Symbols->Slots[i].Value, Symbols->Slots[i].Name, Symbols->Slots[i].Length);
+        }
+    }
+}
+
+void DisAddCompiledSymbols(DIS_CONTEXT *Context, const PCF_FILE *File)
+{
+    unsigned int i;
+
+    for (i = 0; i < File->SymbolCount; i++)
+    {
+        if (File->Symbols[i].Type == SYM_TYPE_LABEL)
+        {
+            const char *name = &File->Strings[File->Symbols[i].NameOffset];
+
+            DisAddLabel(Context, File->Symbols[i].Value, name, (int)strlen(name));
+        }
+    }
+}
+
+static char *DisPutString(char *Out, const char *String, int Length)
+{
+    memcpy(Out, String, Length);
+    return Out + Length;
+}
+
+static char *DisPutHex(char *Out, unsigned int Value, int Digits)
+{
+    *Out++ = '0';
+    *Out++ = 'x';
+    while (Digits-- > 0)
+    {
+        *Out++ = DisHexDigits[(Value >> (Digits * 4)) & 0xF];
+    }
+
+    return Out;
+}
+
+static char *DisPutRegister(const DIS_CONTEXT *Context, char *Out, int File)
+{
+    if (Context->Registers[File] != NULL)
+        return DisPutString(Out, Context->Registers[File], Context->RegisterLength[File]);
+
+    return DisPutHex(Out, File, 2);
+}
+
+//Writes the instruction text (at most DIS_LINE_MAX bytes)
+static char *DisPutInstruction(const DIS_CONTEXT *Context, char *Out, unsigned short Opcode)
+{
+    int id = IsaDecode(Opcode);
+    int bit;
+
+    if (id == ISA_INVALID)
+    {
+        Out = DisPutString(Out, "DW ", 3);
+        return DisPutHex(Out, Opcode & PIC_OPCODE_MASK, 4);
+    }
+
+    Out = DisPutString(Out, IsaTable[id].Mnemonic, Context->MnemonicLength[id]);
+
+    switch (IsaTable[id].Format)
+    {
+        case ISA_FMT_F:
+            *Out++ = ' ';
+            Out = DisPutRegister(Context, Out, ISA_FILE(Opcode));
+            break;
+        case ISA_FMT_FD:
+            *Out++ = ' ';
+            Out = DisPutRegister(Context, Out, ISA_FILE(Opcode));
+            Out = DisPutString(Out, ISA_DEST(Opcode) == DST_F ? ", F" : ", W", 3);
+            break;
+        case ISA_FMT_FB:
+            *Out++ = ' ';
+            Out = DisPutRegister(Context, Out, ISA_FILE(Opcode));
+            *Out++ = ',';
+            *Out++ = ' ';
+            bit = ISA_BIT(Opcode);
+            if (ISA_FILE(Opcode) == REG_STATUS && DisStatusBits[bit] != NULL)
+                Out = DisPutString(Out, DisStatusBits[bit], (int)strlen(DisStatusBits[bit]));
+            else
+                *Out++ = '0' + bit;
+            break;
+        case ISA_FMT_K8:
+            *Out++ = ' ';
+            Out = DisPutHex(Out, ISA_K8(Opcode), 2);
+            break;
+        case ISA_FMT_K11:
+            *Out++ = ' ';
+            if (ISA_K11(Opcode) < PROGRAM_MEM_INSTRUCTIONS && Context->Labels[ISA_K11(Opcode)] != NULL)
+                Out = DisPutString(Out, Context->Labels[ISA_K11(Opcode)], Context->LabelLength[ISA_K11(Opcode)]);
+            else
+                Out = DisPutHex(Out, ISA_K11(Opcode), 3);
+            break;
+    }
+
+    return Out;
+}
+
+//Writes "0xADDR 0xOPCODE label: INSN\n"
+static char *DisPutLine(const DIS_CONTEXT *Context, char *Out, int Address, unsigned short Opcode)
+{
+    Address &= (PROGRAM_MEM_INSTRUCTIONS - 1);
+
+    Out = DisPutHex(Out, Address, 3);
+    *Out++ = ' ';
+    Out = DisPutHex(Out, Opcode & PIC_OPCODE_MASK, 4);
+    *Out++ = ' ';
+
+    if (Context->Labels[Address] != NULL)
+    {
+        Out = DisPutString(Out, Context->Labels[Address], Context->LabelLength[Address]);
+        *Out++ = ':';
+        *Out++ = ' ';
+    }
+
+    Out = DisPutInstruction(Context, Out, Opcode);
+    *Out++ = '\n';
+
+    return Out;
+}
+
+int DisFormat(const DIS_CONTEXT *Context, unsigned short Opcode, char *Buffer, size_t Size)
+{
+    char line[DIS_LINE_MAX];
+    int length;
+
+    length = (int)(DisPutInstruction(Context, line, Opcode) - line);
+    if ((size_t)length >= Size)
+        return -1;
+
+    memcpy(Buffer, line, length);
+    Buffer[length] = 0;
+
+    return length;
+}
+
+size_t DisAssembleImage(const DIS_CONTEXT *Context, const PIC_OPCODE *ProgMem, int Start, int Count,
+                        char *Buffer, size_t Size, int *Done)
+{
+    char *out = Buffer;
+    int i;
+
+    //Stop at the first line that might not fit
+    for (i = 0; i < Count && (size_t)(out - Buffer) + DIS_LINE_MAX <= Size; i++)
+    {
+        int address = (Start + i) & (PROGRAM_MEM_INSTRUCTIONS - 1);
+
+        out = DisPutLine(Context, out, address, ProgMem[address].Opcode);
+    }
+
+    *Done = i;
+
+    return out - Buffer;
+}
+
+size_t DisAssembleTrace(const DIS_CONTEXT *Context, const PIC_OPCODE *ProgMem, const unsigned short *Trace, size_t Count,
+                        char *Buffer, size_t Size, size_t *Done)
+{
+    char *out = Buffer;
+    size_t i;
+
+    for (i = 0; i < Count && (size_t)(out - Buffer) + DIS_LINE_MAX <= Size; i++)
+    {
+        int address = Trace[i] & (PROGRAM_MEM_INSTRUCTIONS - 1);
+
+        out = DisPutLine(Context, out, address, ProgMem[address].Opcode);
+    }
+
+    *Done = i;
+
+    return out - Buffer;
+}
@@ -0,0 +1,49 @@
+//
+//  disasm.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#ifndef PIC16F84A_Emulator_disasm_h
+#define PIC16F84A_Emulator_disasm_h
+
+#include <stddef.h>
+
+#include "cpu.h"
+#include "opcode.h"
+#include "pcf.h"
+#include "symtab.h"
+
+//Longest label name kept for disassembly (longer names are truncated)
+#define DIS_LABEL_MAX  0x40
+
+//Upper bound of one listing line: address, opcode, label,
+//mnemonic and operands (one of which may be a label) and newline
+#define DIS_LINE_MAX   (0x30 + 2 * DIS_LABEL_MAX)
+
+//This struct holds the name lookups used while disassembling.
+//Strings are not copied, so the symbol source must outlive it.
+typedef struct _DIS_CONTEXT {
+    const char *Labels[PROGRAM_MEM_INSTRUCTIONS];
+    unsigned char LabelLength[PROGRAM_MEM_INSTRUCTIONS];
+    const char *Registers[0x80];
+    unsigned char RegisterLength[0x80];
+    unsigned char MnemonicLength[ISA_COUNT];
+} DIS_CONTEXT;
+
+void DisInitialize(DIS_CONTEXT *Context);
+void DisAddLabel(DIS_CONTEXT *Context, int Address, const char *Name, int Length);
+void DisAddSymbolTable(DIS_CONTEXT *Context, SYM_TABLE *Symbols);
+void DisAddCompiledSymbols(DIS_CONTEXT *Context, const PCF_FILE *File);
+
+int DisFormat(const DIS_CONTEXT *Context, unsigned short Opcode, char *Buffer, size_t Size);
+
+size_t DisAssembleImage(const DIS_CONTEXT *Context, const PIC_OPCODE *ProgMem, int Start, int Count,
+                        char *Buffer, size_t Size, int *Done);
+size_t DisAssembleTrace(const DIS_CONTEXT *Context, const PIC_OPCODE *ProgMem, const unsigned short *Trace, size_t Count,
+                        char *Buffer, size_t Size, size_t *Done);
+
+#endif
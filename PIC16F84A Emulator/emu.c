@@ -8,8 +8,19 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
 
 #include "emu.h"
+#include "debug.h"
+#include "fork.h"
+#include "cover.h"
+#include "gdb.h"
+#include "pace.h"
+#include "stats.h"
 #include "cpu.h"
 #include "assembler.h"
 
@@ -17,6 +28,9 @@ int EmuInitialize(EMU_STATE *State)
 {
     int err;
 
+    //No program memory is attached yet
+    memset(State, 0, sizeof(EMU_STATE));
+
     //Initialize the CPU core state
     err = CpuInitializeCore(&State->Cpu);
     if (err < 0)
@@ -24,25 +38,329 @@ int EmuInitialize(EMU_STATE *State)
         printf("Failed to initialize the CPU's core state\n");
         return err;
     }
-    
-    //Initialize the assembler
-    err = AsmInitializeContext(&State->AsmContext);
-    if (err < 0)
+
+    return 0;
+}
+
+void EmuDestroy(EMU_STATE *State)
+{
+    CpuFreeProgramMemory(&State->Cpu);
+}
+
+int EmuLoadImage(EMU_STATE *State, const PIC_IMAGE *Image)
+{
+    //Execute out of the image's shared program and predecoded copy
+    CpuAttachProgram(&State->Cpu, Image->ProgMem, Image->Decoded);
+    CpuAttachFused(&State->Cpu, Image->Fused);
+
+    memcpy(State->Cpu.Eeprom, Image->Eeprom, EEPROM_SIZE);
+
+    return 0;
+}
+
+int EmuLoadCompiled(EMU_STATE *State, const PCF_FILE *File)
+{
+    //Execute straight out of the read-only mapping
+    CpuAttachProgram(&State->Cpu, File->ProgMem, File->Decoded);
+    CpuAttachFused(&State->Cpu, File->Fused);
+
+    memcpy(State->Cpu.Eeprom, File->Header->Eeprom, EEPROM_SIZE);
+
+    return 0;
+}
+
+//Sets up "-b addr[:condition]" and "-watch addr[:r|w|rw]" options
+static int EmuSetupDebug(PIC_DEBUG *Debug, const EMU_OPTIONS *Options)
+{
+    const char *spec, *suffix;
+    char *end;
+    long address;
+    int flags, i;
+
+    DbgInitialize(Debug);
+
+    for (i = 0; i < Options->BreakpointCount; i++)
     {
-        printf("Failed to initialize the assembler context\n");
-        return err;
+        spec = Options->Breakpoints[i];
+        address = strtol(spec, &end, 0);
+        if (end == spec || (*end != 0 && *end != ':'))
+        {
+            printf("Bad breakpoint: %s\n", spec);
+            return -1;
+        }
+
+        if (DbgSetBreakpoint(Debug, (int)address, *end == ':' ? end + 1 : NULL) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < Options->WatchCount; i++)
+    {
+        char name[DBG_CONDITION_MAX];
+
+        spec = Options->Watches[i];
+        suffix = strchr(spec, ':');
+        snprintf(name, sizeof(name), "%.*s", suffix ? (int)(suffix - spec) : (int)strlen(spec), spec);
+
+        flags = DBG_WATCH_READ | DBG_WATCH_WRITE;
+        if (suffix != NULL)
+        {
+            flags = 0;
+            if (strchr(suffix, 'r'))
+                flags |= DBG_WATCH_READ;
+            if (strchr(suffix, 'w'))
+                flags |= DBG_WATCH_WRITE;
+        }
+
+        address = RegsLookupRegisterName(name);
+        if (address < 0)
+        {
+            address = strtol(name, &end, 0);
+            if (end == name || *end != 0)
+            {
+                printf("Bad watch: %s\n", spec);
+                return -1;
+            }
+        }
+
+        if (DbgSetWatch(Debug, (int)address, flags) < 0)
+            return -1;
     }
 
     return 0;
 }
 
+//Reports a breakpoint or watchpoint stop
+static void EmuReportStop(EMU_STATE *State, PIC_DEBUG *Debug, int Reason)
+{
+    PIC_CPU *cpu = &State->Cpu;
+    unsigned char *file;
+
+    if (Reason == CPU_ERR_BREAK)
+    {
+        printf("Breakpoint at 0x%03x: W=0x%02x STATUS=0x%02x\n",
+               Debug->StopPC, cpu->W, cpu->Regs.STATUS);
+    }
+    else
+    {
+        printf("Watch %s%s 0x%02x at 0x%03x",
+               (Debug->StopAccess & DBG_WATCH_READ) ? "r" : "",
+               (Debug->StopAccess & DBG_WATCH_WRITE) ? "w" : "",
+               Debug->StopAddress, Debug->StopPC);
+
+        //Unimplemented locations have no value to show
+        file = RegsFilePointer(&cpu->Regs, Debug->StopAddress);
+        if (file != NULL)
+            printf(": 0x%02x", *file);
+        printf("\n");
+    }
+}
+
+//Runs until the CPU stops or the instruction limit is reached
+static int EmuRun(EMU_STATE *State, const EMU_OPTIONS *Options)
+{
+#define EMU_RUN_SLICE 0x100000
+    VCD_WRITER *vcd = NULL;
+    PIC_STATS *stats = NULL;
+    PIC_COVERAGE *coverage = NULL;
+    PIC_DEBUG debug;
+    PIC_PACE pace;
+    int paced = 0;
+    unsigned long long remaining = 0;
+    unsigned int retired;
+    int err, i;
+
+    //Warm up once, then every test case runs the rest in a forked child
+    if (Options != NULL && Options->ForkCheckpoint != NULL)
+    {
+        err = ForkRunToCheckpoint(&State->Cpu, Options->ForkCheckpoint);
+        if (err == 0)
+            err = ForkServe(&State->Cpu);
+        if (err != FORK_CHILD)
+            return err;
+    }
+
+    if (Options != NULL)
+    {
+        CpuSetTrace(&State->Cpu, !Options->Quiet);
+        remaining = Options->MaxInstructions;
+
+        if (Options->VcdPath != NULL)
+        {
+            vcd = VcdCreate();
+            if (vcd == NULL)
+            {
+                printf("Out of memory\n");
+                return -1;
+            }
+
+            for (i = 0; i < Options->VcdRegisterCount; i++)
+            {
+                if (VcdAddRegister(vcd, Options->VcdRegisters[i]) < 0)
+                {
+                    VcdClose(vcd, 0);
+                    return -1;
+                }
+            }
+
+            if (VcdOpen(vcd, Options->VcdPath, &State->Cpu) < 0)
+            {
+                VcdClose(vcd, 0);
+                return -1;
+            }
+        }
+
+        //Hand the CPU to a debugger instead of free running
+        if (Options->GdbListen != NULL)
+        {
+            CpuSetTrace(&State->Cpu, 0);
+            err = GdbServe(&State->Cpu, Options->GdbListen);
+
+            if (vcd != NULL)
+                VcdClose(vcd, State->Cpu.Cycles);
+
+            return err;
+        }
+
+        if (EmuSetupDebug(&debug, Options) < 0)
+        {
+            if (vcd != NULL)
+                VcdClose(vcd, 0);
+            return -1;
+        }
+
+        //Leave the CPU on its plain loop unless something is set
+        if (DbgIsActive(&debug))
+            CpuAttachDebug(&State->Cpu, &debug);
+
+        if (Options->StatsPath != NULL)
+        {
+            stats = StatCreate();
+            if (stats == NULL)
+            {
+                printf("Out of memory\n");
+                if (vcd != NULL)
+                    VcdClose(vcd, 0);
+                CpuAttachDebug(&State->Cpu, NULL);
+                return -1;
+            }
+
+            CpuAttachStats(&State->Cpu, stats);
+        }
+
+        if (Options->CoveragePath != NULL)
+        {
+            coverage = CovCreate();
+            if (coverage == NULL)
+            {
+                printf("Out of memory\n");
+                if (vcd != NULL)
+                    VcdClose(vcd, 0);
+                CpuAttachDebug(&State->Cpu, NULL);
+                if (stats != NULL)
+                {
+                    CpuAttachStats(&State->Cpu, NULL);
+                    StatDestroy(stats);
+                }
+                return -1;
+            }
+
+            CpuAttachHooks(&State->Cpu, &coverage->Hooks);
+        }
+
+        //Pacing starts last so setup time isn't counted against the firmware
+        if (Options->OscillatorHz != 0)
+        {
+            if (PaceInitialize(&pace, Options->OscillatorHz, Options->Speed != 0 ? Options->Speed : 1.0,
+                               State->Cpu.Cycles) < 0)
+            {
+                if (vcd != NULL)
+                    VcdClose(vcd, 0);
+                CpuAttachDebug(&State->Cpu, NULL);
+                if (stats != NULL)
+                {
+                    CpuAttachStats(&State->Cpu, NULL);
+                    StatDestroy(stats);
+                }
+                if (coverage != NULL)
+                {
+                    CpuAttachHooks(&State->Cpu, NULL);
+                    CovDestroy(coverage);
+                }
+                return -1;
+            }
+
+            paced = 1;
+        }
+    }
+
+    //Main emulator loop
+    do
+    {
+        unsigned int slice = paced ? pace.Slice : EMU_RUN_SLICE;
+
+        if (remaining != 0 && remaining < slice)
+            slice = (unsigned int)remaining;
+
+        err = CpuRun(&State->Cpu, slice, &retired);
+
+        //Report debug stops and keep going
+        if (err == CPU_ERR_BREAK || err == CPU_ERR_WATCH)
+        {
+            EmuReportStop(State, &debug, err);
+            err = 0;
+        }
+
+        if (paced)
+            PaceWait(&pace, State->Cpu.Cycles);
+
+        if (remaining != 0)
+        {
+            remaining -= retired;
+            if (remaining == 0)
+                break;
+        }
+    }
+    while (err == 0);
+
+    if (err == CPU_ERR_INVALID)
+        printf("Opcode unsupported\n");
+    else if (err == CPU_ERR_HALTED)
+        printf("CPU is halted\n");
+
+    if (paced)
+        PacePrintSummary(&pace);
+
+    if (vcd != NULL)
+        VcdClose(vcd, State->Cpu.Cycles);
+
+    CpuAttachDebug(&State->Cpu, NULL);
+
+    if (stats != NULL)
+    {
+        CpuAttachStats(&State->Cpu, NULL);
+        StatWriteCsv(stats, Options->StatsPath);
+        StatDestroy(stats);
+    }
+
+    if (coverage != NULL)
+    {
+        CpuAttachHooks(&State->Cpu, NULL);
+        CovWriteCsv(coverage, &State->Cpu, Options->CoveragePath);
+        CovDestroy(coverage);
+    }
+
+    //Invalid opcodes and halts before the instruction limit are failures
+    return err;
+}
+
 int EmuExecuteOpcode(EMU_STATE *State)
 {
     return CpuExec(&State->Cpu);
 }
 
-int EmuAssembleAndExecute(char *fbuffer, int size)
+int EmuAssembleAndExecute(const char *fbuffer, size_t size, const EMU_OPTIONS *Options)
 {
+    ASM_CONTEXT context;
     ASM_PROGRAM *program;
     EMU_STATE state;
     int err;
@@ -55,8 +373,17 @@ int EmuAssembleAndExecute(char *fbuffer, int size)
         return err;
     }
     
-    //Run the assembler
-    program = AsmAssembleAscii(&state.AsmContext, fbuffer, size);
+    //The assembler only lives as long as the assembly
+    err = AsmInitializeContext(&context);
+    if (err < 0)
+    {
+        printf("Failed to initialize the assembler context\n");
+        return err;
+    }
+
+    program = AsmAssembleAscii(&context, fbuffer, size);
+    AsmDestroyContext(&context);
+    
     if (!program)
     {
         printf("Assembly failed\n");
@@ -65,22 +392,17 @@ int EmuAssembleAndExecute(char *fbuffer, int size)
     
     //Initialize the CPU program memory
     err = CpuInitializeProgramMemory(&state.Cpu, (unsigned char*)program->Opcodes, program->OpcodeCount * sizeof(PIC_OPCODE));
+    free(program);
     if (err < 0)
     {
         printf("Failed to initialize the CPU's program memory");
         return err;
     }
     
-    //Main emulator loop
-    for (;;)
-    {
-        //Execute the next instruction
-        err = CpuExec(&state.Cpu);
-        if (err < 0)
-            break;
-    }
-    
-    return 0;
+    err = EmuRun(&state, Options);
+    EmuDestroy(&state);
+
+    return err;
 }
 
 int EmuExecuteBytecode(unsigned char *Bytecode, int BytecodeLength)
@@ -104,14 +426,312 @@ int EmuExecuteBytecode(unsigned char *Bytecode, int BytecodeLength)
         return err;
     }
 
-    //Main emulator loop
+    err = EmuRun(&state, NULL);
+    EmuDestroy(&state);
+
+    return err;
+}
+
+int EmuExecuteImage(const PIC_IMAGE *Image, const EMU_OPTIONS *Options)
+{
+    int err;
+    EMU_STATE state;
+
+    //Call common init function
+    err = EmuInitialize(&state);
+    if (err < 0)
+    {
+        printf("Failed to initialize emulator\n");
+        return err;
+    }
+
+    err = EmuLoadImage(&state, Image);
+    if (err < 0)
+    {
+        printf("Failed to initialize the CPU's program memory");
+        return err;
+    }
+
+    err = EmuRun(&state, Options);
+    EmuDestroy(&state);
+
+    return err;
+}
+
+int EmuExecuteCompiled(const PCF_FILE *File, const EMU_OPTIONS *Options)
+{
+    int err;
+    EMU_STATE state;
+
+    //Call common init function
+    err = EmuInitialize(&state);
+    if (err < 0)
+    {
+        printf("Failed to initialize emulator\n");
+        return err;
+    }
+
+    err = EmuLoadCompiled(&state, File);
+    if (err < 0)
+    {
+        printf("Failed to initialize the CPU's program memory");
+        return err;
+    }
+
+    err = EmuRun(&state, Options);
+    EmuDestroy(&state);
+
+    return err;
+}
+
+//Runs with no count keep going in slices of this many instructions
+#define EMU_STREAM_SLICE 0x100000
+
+//This struct tracks a streaming session
+typedef struct _EMU_STREAM {
+    EMU_STATE State;
+    ASM_CONTEXT AsmContext;
+    int LoadAddress;
+    unsigned long long Retired;
+    unsigned long Line;
+} EMU_STREAM;
+
+static void EmuStreamPrint(EMU_STREAM *Stream)
+{
+    PIC_CPU *cpu = &Stream->State.Cpu;
+
+    printf("PC=0x%03x W=0x%02x STATUS=0x%02x RETIRED=%llu\n",
+           CpuGetPC(cpu), cpu->W, cpu->Regs.STATUS, Stream->Retired);
+}
+
+static int EmuStreamRun(EMU_STREAM *Stream, const char *Args)
+{
+    unsigned int retired;
+    unsigned long long count;
+    char *end;
+    int err;
+
+    //No count means run until the CPU stops
+    count = strtoull(Args, &end, 0);
+    if (end == Args)
+        count = ~0ULL;
+
+    do
+    {
+        unsigned int slice = (count < EMU_STREAM_SLICE) ? (unsigned int)count : EMU_STREAM_SLICE;
+
+        err = CpuRun(&Stream->State.Cpu, slice, &retired);
+        Stream->Retired += retired;
+        if (count != ~0ULL)
+            count -= retired;
+    }
+    while (err == 0 && count != 0);
+
+    if (err == CPU_ERR_HALTED)
+        printf("Halted at 0x%03x\n", CpuGetPC(&Stream->State.Cpu));
+    else if (err == CPU_ERR_INVALID)
+        printf("Invalid opcode at 0x%03x\n", CpuGetPC(&Stream->State.Cpu));
+
+    return 0;
+}
+
+//Handles one ".command [args]" line
+static int EmuStreamCommand(EMU_STREAM *Stream, char *Line)
+{
+    char *args;
+    char *end;
+    long value;
+
+    for (args = Line; *args && !isspace((unsigned char)*args); args++);
+    if (*args)
+        *args++ = 0;
+
+    if (strcasecmp(Line, ".run") == 0)
+    {
+        return EmuStreamRun(Stream, args);
+    }
+    else if (strcasecmp(Line, ".print") == 0)
+    {
+        EmuStreamPrint(Stream);
+        return 0;
+    }
+    else if (strcasecmp(Line, ".reg") == 0)
+    {
+        value = strtol(args, &end, 0);
+        if (end == args || value < 0 || value > 0xFF)
+        {
+            printf("Line %lu: Bad register address\n", Stream->Line);
+            return -1;
+        }
+
+        printf("REG[0x%02lx]=0x%02x\n", value, RegsGetValue(&Stream->State.Cpu.Regs, (unsigned char)value));
+        return 0;
+    }
+    else if (strcasecmp(Line, ".org") == 0)
+    {
+        value = strtol(args, &end, 0);
+        if (end == args || value < 0 || value >= PROGRAM_MEM_INSTRUCTIONS)
+        {
+            printf("Line %lu: Bad program address\n", Stream->Line);
+            return -1;
+        }
+
+        Stream->LoadAddress = (int)value;
+        return 0;
+    }
+    else if (strcasecmp(Line, ".reset") == 0)
+    {
+        //Program memory is kept
+        RegsInitializeRegisterFile(&Stream->State.Cpu.Regs);
+        StkInitialize(&Stream->State.Cpu.Stack);
+        Stream->State.Cpu.Cycles = 0;
+        Stream->Retired = 0;
+        return 0;
+    }
+    else if (strcasecmp(Line, ".trace") == 0)
+    {
+        CpuSetTrace(&Stream->State.Cpu, strncasecmp(args, "on", 2) == 0);
+        return 0;
+    }
+
+    printf("Line %lu: Unknown command %s\n", Stream->Line, Line);
+    return -1;
+}
+
+static int EmuStreamLine(EMU_STREAM *Stream, char *Line, size_t Length)
+{
+    unsigned short opcode;
+    int err;
+
+    //Skip blank and comment lines
+    while (Length != 0 && isspace((unsigned char)*Line))
+    {
+        Line++;
+        Length--;
+    }
+
+    if (Length == 0 || *Line == ';')
+        return 0;
+
+    if (*Line == '.')
+        return EmuStreamCommand(Stream, Line);
+
+    if (Stream->LoadAddress >= PROGRAM_MEM_INSTRUCTIONS)
+    {
+        printf("Line %lu: Program memory is full\n", Stream->Line);
+        return -1;
+    }
+
+    err = AsmAssembleLine(&Stream->AsmContext, Line, Length, &opcode);
+    if (err < 0)
+    {
+        printf("Line %lu: Assembly failed\n", Stream->Line);
+        return err;
+    }
+
+    CpuSetOpcode(&Stream->State.Cpu, Stream->LoadAddress++, opcode);
+
+    return 0;
+}
+
+//Non-interactive interpreter. Instructions are assembled into program
+//memory one after another and only run on ".run [count]". Other commands
+//are ".print", ".reg <addr>", ".org <addr>", ".reset" and ".trace on|off".
+int EmuExecuteStream(int InputFd)
+{
+#define EMU_STREAM_BUFFER 0x100000
+    static EMU_STREAM stream;
+    static char buffer[EMU_STREAM_BUFFER + 1];
+    static unsigned char erased[PROGRAM_MEM_INSTRUCTIONS * sizeof(PIC_OPCODE)];
+    size_t used = 0;
+    ssize_t bytes;
+    int err, failed = 0;
+
+    memset(&stream, 0, sizeof(stream));
+
+    err = EmuInitialize(&stream.State);
+    if (err < 0)
+    {
+        printf("Failed to initialize emulator\n");
+        return err;
+    }
+
+    err = AsmInitializeContext(&stream.AsmContext);
+    if (err < 0)
+    {
+        printf("Failed to initialize the assembler context\n");
+        return err;
+    }
+
+    //Quiet until asked otherwise
+    CpuSetTrace(&stream.State.Cpu, 0);
+
+    memset(erased, 0xFF, sizeof(erased));
+    CpuInitializeProgramMemory(&stream.State.Cpu, erased, sizeof(erased));
+
     for (;;)
     {
-        //Execute the next instruction
-        err = CpuExec(&state.Cpu);
-        if (err < 0)
+        char *line, *next;
+        size_t remaining;
+
+        bytes = read(InputFd, buffer + used, EMU_STREAM_BUFFER - used);
+        if (bytes < 0)
+        {
+            printf("Failed to read input\n");
+            err = -1;
             break;
+        }
+
+        //Treat the end of input as the end of the last line
+        if (bytes == 0)
+        {
+            if (used != 0)
+            {
+                buffer[used] = 0;
+                stream.Line++;
+                if (EmuStreamLine(&stream, buffer, used) < 0)
+                    failed = 1;
+            }
+            break;
+        }
+
+        used += bytes;
+
+        //Process every complete line in the buffer
+        line = buffer;
+        remaining = used;
+        while ((next = memchr(line, '\n', remaining)) != NULL)
+        {
+            *next = 0;
+            stream.Line++;
+
+            //Bad lines are reported and skipped like in the interpreter
+            if (EmuStreamLine(&stream, line, next - line) < 0)
+                failed = 1;
+
+            remaining -= (next + 1) - line;
+            line = next + 1;
+        }
+
+        if (remaining == EMU_STREAM_BUFFER)
+        {
+            printf("Line %lu: Line is too long\n", stream.Line + 1);
+            err = -1;
+            break;
+        }
+
+        //Keep the partial line for the next read
+        memmove(buffer, line, remaining);
+        used = remaining;
     }
-    
-    return 0;
+
+    AsmDestroyContext(&stream.AsmContext);
+    EmuDestroy(&stream.State);
+    fflush(stdout);
+
+    //Any bad line still fails the run as a whole
+    if (err == 0 && failed)
+        err = -1;
+
+    return err;
 }
@@ -12,17 +12,43 @@
 
 #include "regs.h"
 #include "cpu.h"
-#include "assembler.h"
+#include "image.h"
+#include "pcf.h"
 
-//This struct represents the emulator's state
+//This struct represents the emulator's state (the assembler is only
+//brought up by the front ends that take source)
 typedef struct _EMU_STATE {
     PIC_CPU Cpu;
-    ASM_CONTEXT AsmContext;
 } EMU_STATE;
 
+//Options for running whole programs
+typedef struct _EMU_OPTIONS {
+    int Quiet;                          //Don't print every state change
+    unsigned long long MaxInstructions; //0 runs until the CPU stops
+    const char *VcdPath;                //Waveform output (NULL for none)
+    const char **VcdRegisters;          //Extra registers to record
+    int VcdRegisterCount;
+    const char **Breakpoints;           //"addr[:condition]"
+    int BreakpointCount;
+    const char **Watches;               //"addr[:r|w|rw]"
+    int WatchCount;
+    const char *GdbListen;              //Port or socket path to debug over (NULL for none)
+    const char *StatsPath;              //Instruction mix CSV (NULL for none)
+    const char *CoveragePath;           //Instruction coverage CSV (NULL for none)
+    const char *ForkCheckpoint;         //"addr[:condition]" to fork test cases from (NULL for none)
+    unsigned long long OscillatorHz;    //Run at wall-clock speed for this clock (0 for flat out)
+    double Speed;                       //Multiplier on the paced rate (0 for 1x)
+} EMU_OPTIONS;
+
 int EmuInitialize(EMU_STATE *State);
+void EmuDestroy(EMU_STATE *State);
 int EmuExecuteOpcode(EMU_STATE *State);
+int EmuLoadImage(EMU_STATE *State, const PIC_IMAGE *Image);
 int EmuExecuteBytecode(unsigned char *Bytecode, int BytecodeLength);
-int EmuAssembleAndExecute(char *fbuffer, int size);
+int EmuExecuteImage(const PIC_IMAGE *Image, const EMU_OPTIONS *Options);
+int EmuLoadCompiled(EMU_STATE *State, const PCF_FILE *File);
+int EmuExecuteCompiled(const PCF_FILE *File, const EMU_OPTIONS *Options);
+int EmuAssembleAndExecute(const char *fbuffer, size_t size, const EMU_OPTIONS *Options);
+int EmuExecuteStream(int InputFd);
 
 #endif
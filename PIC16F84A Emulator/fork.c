@@ -0,0 +1,157 @@
+//
+//  fork.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "fork.h"
+#include "debug.h"
+
+//Instructions per CpuRun call on the way to the checkpoint
+#define FORK_RUN_SLICE 0x100000
+
+//Runs quietly until execution reaches "addr[:condition]"
+int ForkRunToCheckpoint(PIC_CPU *Cpu, const char *Checkpoint)
+{
+    static PIC_DEBUG debug;
+    unsigned int retired;
+    char *end;
+    long address;
+    int err, trace;
+
+    address = strtol(Checkpoint, &end, 0);
+    if (end == Checkpoint || (*end != 0 && *end != ':'))
+    {
+        printf("Bad checkpoint: %s\n", Checkpoint);
+        return -1;
+    }
+
+    DbgInitialize(&debug);
+    if (DbgSetBreakpoint(&debug, (int)address, *end == ':' ? end + 1 : NULL) < 0)
+        return -1;
+
+    trace = Cpu->Trace;
+    CpuSetTrace(Cpu, 0);
+    CpuAttachDebug(Cpu, &debug);
+
+    do
+    {
+        err = CpuRun(Cpu, FORK_RUN_SLICE, &retired);
+    }
+    while (err == 0);
+
+    CpuAttachDebug(Cpu, NULL);
+    CpuSetTrace(Cpu, trace);
+
+    if (err != CPU_ERR_BREAK)
+    {
+        printf("CPU stopped before reaching the checkpoint\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int ForkRead(int Fd, void *Buffer, size_t Length)
+{
+    ssize_t bytes;
+
+    while (Length != 0)
+    {
+        bytes = read(Fd, Buffer, Length);
+        if (bytes <= 0)
+            return -1;
+
+        Buffer = (char *)Buffer + bytes;
+        Length -= bytes;
+    }
+
+    return 0;
+}
+
+static int ForkWrite(int Fd, unsigned int Value)
+{
+    return (write(Fd, &Value, sizeof(Value)) == sizeof(Value)) ? 0 : -1;
+}
+
+//Drives each test case's (file, value) pairs into the child's registers
+static void ForkApplyStimulus(PIC_CPU *Cpu, const unsigned char *Stimulus, unsigned int Length)
+{
+    unsigned char *file;
+    unsigned int i;
+
+    for (i = 0; i + 1 < Length; i += 2)
+    {
+        file = RegsFilePointer(&Cpu->Regs, Stimulus[i]);
+        if (file != NULL)
+            *file = Stimulus[i + 1];
+    }
+}
+
+//Only returns FORK_CHILD in a child that should run its test case. The server
+//itself returns 0 once the control descriptor is closed.
+int ForkServe(PIC_CPU *Cpu)
+{
+    static unsigned char stimulus[FORK_MAX_STIMULUS];
+    unsigned int length;
+    int status;
+    pid_t pid;
+
+    if (fcntl(FORK_CONTROL_FD, F_GETFD) < 0 || fcntl(FORK_STATUS_FD, F_GETFD) < 0)
+    {
+        printf("Fork server needs descriptors %d and %d\n", FORK_CONTROL_FD, FORK_STATUS_FD);
+        return -1;
+    }
+
+    //Tell the harness the checkpoint was reached
+    if (ForkWrite(FORK_STATUS_FD, 0) < 0)
+        return -1;
+
+    for (;;)
+    {
+        if (ForkRead(FORK_CONTROL_FD, &length, sizeof(length)) < 0)
+            return 0;
+
+        if (length > FORK_MAX_STIMULUS || ForkRead(FORK_CONTROL_FD, stimulus, length) < 0)
+        {
+            printf("Bad fork server request\n");
+            return -1;
+        }
+
+        //Children must not repeat anything still buffered
+        fflush(stdout);
+
+        pid = fork();
+        if (pid < 0)
+        {
+            printf("fork() failed\n");
+            return -1;
+        }
+        else if (pid == 0)
+        {
+            close(FORK_CONTROL_FD);
+            close(FORK_STATUS_FD);
+
+            ForkApplyStimulus(Cpu, stimulus, length);
+            return FORK_CHILD;
+        }
+
+        if (ForkWrite(FORK_STATUS_FD, (unsigned int)pid) < 0 ||
+            waitpid(pid, &status, 0) < 0 ||
+            ForkWrite(FORK_STATUS_FD, (unsigned int)status) < 0)
+        {
+            return -1;
+        }
+    }
+}
@@ -0,0 +1,40 @@
+//
+//  fork.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Fork server: the firmware is loaded, decoded and run to a checkpoint
+//  once, then every test case is a fork()ed child that inherits the warmed
+//  up state copy-on-write. The harness talks to the server over two
+//  inherited descriptors:
+//
+//    FORK_STATUS_FD  <- 4 byte hello once the checkpoint is reached
+//    FORK_CONTROL_FD -> 4 byte length N, then N bytes of (file, value) pairs
+//                       applied in the child before it resumes
+//    FORK_STATUS_FD  <- 4 byte child pid, then its 4 byte wait status
+//
+//  Closing the control descriptor shuts the server down.
+//
+
+#ifndef PIC16F84A_Emulator_fork_h
+#define PIC16F84A_Emulator_fork_h
+
+#include "cpu.h"
+
+//Same descriptors as AFL so existing harness code carries over
+#define FORK_CONTROL_FD   198
+#define FORK_STATUS_FD    199
+
+//Largest stimulus accepted per test case
+#define FORK_MAX_STIMULUS 0x200
+
+//ForkServe returns this in each child
+#define FORK_CHILD        1
+
+int ForkRunToCheckpoint(PIC_CPU *Cpu, const char *Checkpoint);
+int ForkServe(PIC_CPU *Cpu);
+
+#endif
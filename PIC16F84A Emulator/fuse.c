@@ -0,0 +1,148 @@
+//
+//  fuse.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stddef.h>
+
+#include "fuse.h"
+#include "opcode.h"
+#include "regs.h"
+
+const unsigned char FuseLength[FUSE_KINDS] = {1, 2, 2, 2, 2, 3, 1};
+
+//Writes a superinstruction may not contain. PCL isn't updated between the
+//fused words and the handler's CpuSetPC would overwrite a PCL write anyway
+//(writes to PCL don't jump in this emulator). A STATUS write could move RP0
+//or PD under a handler that doesn't expect it, or be lost to COMPARE's local
+//STATUS writeback. INDF could reach either through FSR.
+static int FuseSafeWrite(unsigned short Opcode)
+{
+    switch (ISA_FILE(Opcode))
+    {
+        case REG_INDF:
+        case REG_PCL:
+        case REG_STATUS:
+            return 0;
+    }
+
+    return 1;
+}
+
+static int FuseIsBankSelect(const ISA_INSN *Insn)
+{
+    return (Insn->Id == ISA_BSF || Insn->Id == ISA_BCF) &&
+           ISA_FILE(Insn->Opcode) == REG_STATUS && ISA_BIT(Insn->Opcode) == STATUS_RP0_BIT;
+}
+
+static int FuseIsZeroTest(const ISA_INSN *Insn)
+{
+    return (Insn->Id == ISA_BTFSS || Insn->Id == ISA_BTFSC) &&
+           ISA_FILE(Insn->Opcode) == REG_STATUS && ISA_BIT(Insn->Opcode) == STATUS_Z_BIT;
+}
+
+//Delay loop counters must be plain RAM (mirrored in both banks)
+static int FuseIsCounter(unsigned short Opcode)
+{
+    return ISA_FILE(Opcode) >= offsetof(REGISTER_FILE, SRAM) &&
+           ISA_FILE(Opcode) < offsetof(REGISTER_FILE, SRAM) + GPR_COUNT;
+}
+
+//Returns the length of the delay loop starting at PC (0 if there isn't one).
+//Used marks the counters of the loop and everything nested in it.
+static int FuseMatchDelay(const ISA_INSN *Insn, int Left, unsigned short PC, int Depth, unsigned char *Used)
+{
+    unsigned char file;
+    int body = 0, inner;
+
+    if (Depth > FUSE_MAX_DELAY_DEPTH)
+        return 0;
+
+    //The body reloads the inner counter, so it always takes as long
+    if (Left >= 2 && Insn[0].Id == ISA_MOVLW && Insn[1].Id == ISA_MOVWF && FuseIsCounter(Insn[1].Opcode))
+    {
+        inner = FuseMatchDelay(&Insn[2], Left - 2, PC + 2, Depth + 1, Used);
+        if (inner == 0 || ISA_FILE(Insn[2 + inner - 2].Opcode) != ISA_FILE(Insn[1].Opcode))
+            return 0;
+
+        body = 2 + inner;
+    }
+
+    if (Left < body + 2)
+        return 0;
+
+    file = ISA_FILE(Insn[body].Opcode);
+    if (Insn[body].Id != ISA_DECFSZ || ISA_DEST(Insn[body].Opcode) != DST_F ||
+        !FuseIsCounter(Insn[body].Opcode) || Used[file])
+        return 0;
+
+    if (Insn[body + 1].Id != ISA_GOTO || (((PC + body + 2) & 0x1800) | ISA_K11(Insn[body + 1].Opcode)) != PC)
+        return 0;
+
+    Used[file] = 1;
+
+    return body + 2;
+}
+
+//Returns the superinstruction starting at Insn (Left words are available)
+static int FuseMatch(const ISA_INSN *Insn, int Left, unsigned short PC)
+{
+    unsigned char used[0x80] = {0};
+
+    if (Left < 2)
+        return FUSE_NONE;
+
+    //Whole loop nests take priority over the pairs they start with
+    if (FuseMatchDelay(Insn, Left, PC, 1, used) != 0)
+        return FUSE_DELAY;
+
+    switch (Insn[0].Id)
+    {
+        case ISA_MOVLW:
+            if (Insn[1].Id == ISA_MOVWF && FuseSafeWrite(Insn[1].Opcode))
+                return FUSE_MOVLW_MOVWF;
+            break;
+
+        case ISA_BSF:
+        case ISA_BCF:
+            //Only the bank select and the access right after it (see fuse.h)
+            if (FuseIsBankSelect(&Insn[0]) && Insn[1].Id == ISA_MOVWF && FuseSafeWrite(Insn[1].Opcode))
+                return FUSE_BANK_MOVWF;
+            break;
+
+        case ISA_BTFSS:
+        case ISA_BTFSC:
+            if (Insn[1].Id == ISA_GOTO)
+                return FUSE_BIT_GOTO;
+            break;
+
+        case ISA_DECFSZ:
+            if (Insn[1].Id == ISA_GOTO && (ISA_DEST(Insn[0].Opcode) == DST_W || FuseSafeWrite(Insn[0].Opcode)))
+                return FUSE_DECFSZ_GOTO;
+            break;
+
+        case ISA_MOVF:
+            if (Left >= 3 && ISA_DEST(Insn[0].Opcode) == DST_W &&
+                Insn[1].Id == ISA_XORLW && FuseIsZeroTest(&Insn[2]))
+                return FUSE_COMPARE;
+            break;
+    }
+
+    return FUSE_NONE;
+}
+
+//Marks the first word of every idiom in a predecoded program. Sequences may
+//overlap; execution only ever looks at the word it is about to run.
+void FuseProgram(const ISA_INSN *Decoded, int Count, unsigned char *Fused)
+{
+    int i;
+
+    for (i = 0; i < Count; i++)
+    {
+        Fused[i] = FuseMatch(&Decoded[i], Count - i, i);
+    }
+}
@@ -0,0 +1,46 @@
+//
+//  fuse.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Superinstructions. A peephole pass over a predecoded program marks the
+//  first word of common short idioms so the plain run loop can execute the
+//  whole sequence with one dispatch.
+//
+
+#ifndef PIC16F84A_Emulator_fuse_h
+#define PIC16F84A_Emulator_fuse_h
+
+#include "isa.h"
+
+//Superinstruction kinds (one per program word, FUSE_NONE if not fused)
+#define FUSE_NONE           0
+#define FUSE_MOVLW_MOVWF    1   //MOVLW k ; MOVWF f
+#define FUSE_BANK_MOVWF     2   //BSF/BCF STATUS,RP0 ; MOVWF f
+#define FUSE_BIT_GOTO       3   //BTFSS/BTFSC f,b ; GOTO k
+#define FUSE_DECFSZ_GOTO    4   //DECFSZ f,d ; GOTO k
+#define FUSE_COMPARE        5   //MOVF f,W ; XORLW k ; BTFSS/BTFSC STATUS,Z
+#define FUSE_DELAY          6   //Counted delay loop (see below)
+#define FUSE_KINDS          7
+
+//FUSE_BANK_MOVWF doesn't fuse a whole "BSF STATUS,RP0 ... BCF STATUS,RP0"
+//bracket. The code between the two selects has no fixed length, and a
+//superinstruction has to be a fixed run of words whose total count is known
+//before it starts. The select and the MOVWF right after it (usually a TRIS
+//or OPTION write) are fused instead. A closing select followed by a MOVWF
+//starts its own FUSE_BANK_MOVWF.
+
+//A delay loop is "DECFSZ c,F ; GOTO <first word>" with an optional body of
+//"MOVLW k ; MOVWF c2" and a delay loop on c2 in front of it. Every counter is
+//a general purpose register, so the whole nest runs in closed form.
+#define FUSE_MAX_DELAY_DEPTH 4
+
+//Instructions a run must have left before each kind is tried
+extern const unsigned char FuseLength[FUSE_KINDS];
+
+void FuseProgram(const ISA_INSN *Decoded, int Count, unsigned char *Fused);
+
+#endif
@@ -0,0 +1,966 @@
+//
+//  gdb.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "gdb.h"
+#include "debug.h"
+#include "regs.h"
+
+//Register numbers in 'g' packet order
+#define GDB_REG_W       0
+#define GDB_REG_STATUS  1
+#define GDB_REG_FSR     2
+#define GDB_REG_PCLATH  3
+#define GDB_REG_INTCON  4
+#define GDB_REG_PC      5
+#define GDB_REG_SP      6
+#define GDB_REG_STACK   7
+#define GDB_REG_COUNT   (GDB_REG_STACK + PIC_STACK_ENTRIES)
+
+//This struct represents one connected debugger
+typedef struct _GDB_SESSION {
+    PIC_CPU *Cpu;
+    PIC_DEBUG Debug;
+    int Socket;
+    int NoAck;
+    char LastStop[32];
+
+    //Which kinds of breakpoint GDB set at each address (Z0 and Z1)
+    unsigned int SwBreaks[DBG_BITMAP_WORDS(PROGRAM_MEM_INSTRUCTIONS)];
+    unsigned int HwBreaks[DBG_BITMAP_WORDS(PROGRAM_MEM_INSTRUCTIONS)];
+
+    //Receive buffer
+    unsigned char Input[0x1000];
+    int InputStart;
+    int InputEnd;
+
+    char Packet[GDB_PACKET_SIZE + 1];
+    char Reply[GDB_PACKET_SIZE + 1];
+    char Frame[GDB_PACKET_SIZE + 8];
+} GDB_SESSION;
+
+static const char GdbHexDigits[] = "0123456789abcdef";
+
+static const char GdbTargetXml[] =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\">"
+    "<feature name=\"org.gnu.gdb.pic14.core\">"
+    "<reg name=\"w\" bitsize=\"8\" type=\"uint8\" regnum=\"0\"/>"
+    "<reg name=\"status\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"fsr\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"pclath\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"intcon\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>"
+    "<reg name=\"sp\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"stk0\" bitsize=\"16\" type=\"code_ptr\"/>"
+    "<reg name=\"stk1\" bitsize=\"16\" type=\"code_ptr\"/>"
+    "<reg name=\"stk2\" bitsize=\"16\" type=\"code_ptr\"/>"
+    "<reg name=\"stk3\" bitsize=\"16\" type=\"code_ptr\"/>"
+    "<reg name=\"stk4\" bitsize=\"16\" type=\"code_ptr\"/>"
+    "<reg name=\"stk5\" bitsize=\"16\" type=\"code_ptr\"/>"
+    "<reg name=\"stk6\" bitsize=\"16\" type=\"code_ptr\"/>"
+    "<reg name=\"stk7\" bitsize=\"16\" type=\"code_ptr\"/>"
+    "</feature>"
+    "</target>";
+
+static int GdbHexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static char *GdbPutHexByte(char *Out, unsigned char Value)
+{
+    *Out++ = GdbHexDigits[Value >> 4];
+    *Out++ = GdbHexDigits[Value & 0xF];
+    return Out;
+}
+
+//Parses hex digits up to a non-hex character
+static unsigned long GdbParseHex(const char **Text)
+{
+    unsigned long value = 0;
+    int digit;
+
+    while ((digit = GdbHexValue(**Text)) >= 0)
+    {
+        value = (value << 4) | digit;
+        (*Text)++;
+    }
+
+    return value;
+}
+
+/* ------------------------- Connection ------------------------- */
+
+static int GdbReadByte(GDB_SESSION *Session)
+{
+    ssize_t bytes;
+
+    if (Session->InputStart == Session->InputEnd)
+    {
+        do
+        {
+            bytes = recv(Session->Socket, Session->Input, sizeof(Session->Input), 0);
+        }
+        while (bytes < 0 && errno == EINTR);
+
+        if (bytes <= 0)
+            return -1;
+
+        Session->InputStart = 0;
+        Session->InputEnd = (int)bytes;
+    }
+
+    return Session->Input[Session->InputStart++];
+}
+
+static int GdbWrite(GDB_SESSION *Session, const char *Data, size_t Length)
+{
+    ssize_t bytes;
+
+    while (Length != 0)
+    {
+        bytes = send(Session->Socket, Data, Length, MSG_NOSIGNAL);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return -1;
+
+        Data += bytes;
+        Length -= bytes;
+    }
+
+    return 0;
+}
+
+//Reads the next packet into Session->Packet (returns its length)
+static int GdbReadPacket(GDB_SESSION *Session)
+{
+    int c, length, checksum, sum;
+
+    for (;;)
+    {
+        //Skip acks and anything else between packets
+        do
+        {
+            c = GdbReadByte(Session);
+            if (c < 0)
+                return -1;
+        }
+        while (c != '$');
+
+        length = 0;
+        sum = 0;
+        while ((c = GdbReadByte(Session)) != '#')
+        {
+            if (c < 0)
+                return -1;
+
+            if (length == GDB_PACKET_SIZE)
+                break;
+
+            Session->Packet[length++] = (char)c;
+            sum += c;
+        }
+
+        if (c != '#')
+            continue;
+
+        checksum = GdbHexValue((char)GdbReadByte(Session)) << 4;
+        checksum |= GdbHexValue((char)GdbReadByte(Session));
+        Session->Packet[length] = 0;
+
+        if (Session->NoAck)
+            return length;
+
+        if (checksum == (sum & 0xFF))
+        {
+            if (GdbWrite(Session, "+", 1) < 0)
+                return -1;
+            return length;
+        }
+
+        //Ask for a retransmit
+        if (GdbWrite(Session, "-", 1) < 0)
+            return -1;
+    }
+}
+
+static int GdbSendPacket(GDB_SESSION *Session, const char *Data, int Length)
+{
+    unsigned char sum = 0;
+    char *out = Session->Frame;
+    int i, c;
+
+    *out++ = '$';
+    for (i = 0; i < Length; i++)
+    {
+        sum += (unsigned char)Data[i];
+        *out++ = Data[i];
+    }
+    *out++ = '#';
+    out = GdbPutHexByte(out, sum);
+
+    for (;;)
+    {
+        if (GdbWrite(Session, Session->Frame, out - Session->Frame) < 0)
+            return -1;
+
+        if (Session->NoAck)
+            return 0;
+
+        //Resend until GDB acknowledges it
+        do
+        {
+            c = GdbReadByte(Session);
+            if (c < 0)
+                return -1;
+        }
+        while (c != '+' && c != '-');
+
+        if (c == '+')
+            return 0;
+    }
+}
+
+static int GdbSendString(GDB_SESSION *Session, const char *String)
+{
+    return GdbSendPacket(Session, String, (int)strlen(String));
+}
+
+/* ------------------------- Registers and memory ------------------------- */
+
+static unsigned int GdbGetRegister(GDB_SESSION *Session, int Number, int *Size)
+{
+    PIC_CPU *cpu = Session->Cpu;
+
+    *Size = 1;
+    switch (Number)
+    {
+        case GDB_REG_W:
+            return cpu->W;
+        case GDB_REG_STATUS:
+            return cpu->Regs.STATUS;
+        case GDB_REG_FSR:
+            return cpu->Regs.FSR;
+        case GDB_REG_PCLATH:
+            return cpu->Regs.PCLATH;
+        case GDB_REG_INTCON:
+            return cpu->Regs.INTCON;
+        case GDB_REG_PC:
+            *Size = 2;
+            return CpuGetPC(cpu) * 2;
+        case GDB_REG_SP:
+            return cpu->Stack.NextTop;
+        default:
+            *Size = 2;
+            return cpu->Stack.Entries[Number - GDB_REG_STACK] * 2;
+    }
+}
+
+static void GdbSetRegister(GDB_SESSION *Session, int Number, unsigned int Value)
+{
+    PIC_CPU *cpu = Session->Cpu;
+
+    switch (Number)
+    {
+        case GDB_REG_W:
+            cpu->W = (unsigned char)Value;
+            break;
+        case GDB_REG_STATUS:
+            cpu->Regs.STATUS = (unsigned char)Value;
+            break;
+        case GDB_REG_FSR:
+            cpu->Regs.FSR = (unsigned char)Value;
+            break;
+        case GDB_REG_PCLATH:
+            cpu->Regs.PCLATH = (unsigned char)Value;
+            break;
+        case GDB_REG_INTCON:
+            cpu->Regs.INTCON = (unsigned char)Value;
+            break;
+        case GDB_REG_PC:
+            CpuSetPC(cpu, (unsigned short)((Value / 2) & (PROGRAM_MEM_INSTRUCTIONS - 1)));
+            break;
+        case GDB_REG_SP:
+            cpu->Stack.NextTop = (unsigned char)(Value % PIC_STACK_ENTRIES);
+            break;
+        default:
+            cpu->Stack.Entries[Number - GDB_REG_STACK] = (unsigned short)((Value / 2) & (PROGRAM_MEM_INSTRUCTIONS - 1));
+            break;
+    }
+}
+
+//Appends one register in target byte order
+static char *GdbPutRegister(GDB_SESSION *Session, char *Out, int Number)
+{
+    unsigned int value;
+    int size, i;
+
+    value = GdbGetRegister(Session, Number, &size);
+    for (i = 0; i < size; i++)
+    {
+        Out = GdbPutHexByte(Out, (unsigned char)(value >> (i * 8)));
+    }
+
+    return Out;
+}
+
+//Parses one register value from hex and returns the characters consumed
+static int GdbParseRegister(GDB_SESSION *Session, const char *Text, int Number, unsigned int *Value)
+{
+    int size, i, hi, lo;
+
+    GdbGetRegister(Session, Number, &size);
+
+    *Value = 0;
+    for (i = 0; i < size; i++)
+    {
+        hi = GdbHexValue(Text[i * 2]);
+        lo = (hi < 0) ? -1 : GdbHexValue(Text[i * 2 + 1]);
+        if (lo < 0)
+            return -1;
+
+        *Value |= (unsigned int)((hi << 4) | lo) << (i * 8);
+    }
+
+    return size * 2;
+}
+
+//Reads one byte of the GDB address space
+static int GdbReadMemory(GDB_SESSION *Session, unsigned long Address, unsigned char *Value)
+{
+    PIC_CPU *cpu = Session->Cpu;
+    unsigned char *file;
+
+    if (Address < GDB_PROGRAM_BASE + PROGRAM_MEM_INSTRUCTIONS * 2)
+    {
+        unsigned short word = CpuGetOpcode(cpu, (unsigned short)(Address / 2));
+
+        *Value = (Address & 1) ? (unsigned char)(word >> 8) : (unsigned char)word;
+        return 0;
+    }
+    else if (Address >= GDB_DATA_BASE && Address < GDB_DATA_BASE + DBG_DATA_SIZE)
+    {
+        //Bank mirrors read the register they alias
+        file = RegsFilePointer(&cpu->Regs, (unsigned char)(Address - GDB_DATA_BASE));
+        *Value = (file != NULL) ? *file : 0;
+        return 0;
+    }
+    else if (Address >= GDB_EEPROM_BASE && Address < GDB_EEPROM_BASE + EEPROM_SIZE)
+    {
+        *Value = cpu->Eeprom[Address - GDB_EEPROM_BASE];
+        return 0;
+    }
+
+    return -1;
+}
+
+static int GdbWriteMemory(GDB_SESSION *Session, unsigned long Address, unsigned char Value)
+{
+    PIC_CPU *cpu = Session->Cpu;
+    unsigned char *file;
+
+    if (Address < GDB_PROGRAM_BASE + PROGRAM_MEM_INSTRUCTIONS * 2)
+    {
+        unsigned short pc = (unsigned short)(Address / 2);
+        unsigned short word = CpuGetOpcode(cpu, pc);
+
+        if (Address & 1)
+            word = (word & 0x00FF) | (Value << 8);
+        else
+            word = (word & 0xFF00) | Value;
+
+        //The first write gives the CPU its own copy of program memory
+        return CpuSetOpcode(cpu, pc, word);
+    }
+    else if (Address >= GDB_DATA_BASE && Address < GDB_DATA_BASE + DBG_DATA_SIZE)
+    {
+        file = RegsFilePointer(&cpu->Regs, (unsigned char)(Address - GDB_DATA_BASE));
+        if (file != NULL)
+            *file = Value;
+        return 0;
+    }
+    else if (Address >= GDB_EEPROM_BASE && Address < GDB_EEPROM_BASE + EEPROM_SIZE)
+    {
+        cpu->Eeprom[Address - GDB_EEPROM_BASE] = Value;
+        return 0;
+    }
+
+    return -1;
+}
+
+/* ------------------------- Packet handlers ------------------------- */
+
+//m addr,length: the whole range is answered in one packet
+static int GdbHandleReadMemory(GDB_SESSION *Session, const char *Args)
+{
+    unsigned long address, length, i;
+    unsigned char value;
+    char *out = Session->Reply;
+
+    address = GdbParseHex(&Args);
+    if (*Args++ != ',')
+        return GdbSendString(Session, "E01");
+    length = GdbParseHex(&Args);
+
+    if (length > GDB_PACKET_SIZE / 2)
+        length = GDB_PACKET_SIZE / 2;
+
+    for (i = 0; i < length; i++)
+    {
+        if (GdbReadMemory(Session, address + i, &value) < 0)
+            break;
+
+        out = GdbPutHexByte(out, value);
+    }
+
+    if (i == 0 && length != 0)
+        return GdbSendString(Session, "E01");
+
+    return GdbSendPacket(Session, Session->Reply, (int)(out - Session->Reply));
+}
+
+//M addr,length:hex and X addr,length:binary
+static int GdbHandleWriteMemory(GDB_SESSION *Session, const char *Args, int Length, int Binary)
+{
+    const char *end = Session->Packet + Length;
+    unsigned long address, length, i;
+    unsigned char value;
+    int hi, lo;
+
+    address = GdbParseHex(&Args);
+    if (*Args++ != ',')
+        return GdbSendString(Session, "E01");
+    length = GdbParseHex(&Args);
+    if (*Args++ != ':')
+        return GdbSendString(Session, "E01");
+
+    for (i = 0; i < length; i++)
+    {
+        if (Binary)
+        {
+            if (Args >= end)
+                return GdbSendString(Session, "E01");
+
+            value = (unsigned char)*Args++;
+            if (value == '}' && Args < end)
+                value = (unsigned char)(*Args++ ^ 0x20);
+        }
+        else
+        {
+            hi = GdbHexValue(Args[0]);
+            lo = (hi < 0) ? -1 : GdbHexValue(Args[1]);
+            if (lo < 0)
+                return GdbSendString(Session, "E01");
+
+            value = (unsigned char)((hi << 4) | lo);
+            Args += 2;
+        }
+
+        if (GdbWriteMemory(Session, address + i, value) < 0)
+            return GdbSendString(Session, "E01");
+    }
+
+    return GdbSendString(Session, "OK");
+}
+
+static int GdbHandleReadRegisters(GDB_SESSION *Session)
+{
+    char *out = Session->Reply;
+    int i;
+
+    for (i = 0; i < GDB_REG_COUNT; i++)
+    {
+        out = GdbPutRegister(Session, out, i);
+    }
+
+    return GdbSendPacket(Session, Session->Reply, (int)(out - Session->Reply));
+}
+
+static int GdbHandleWriteRegisters(GDB_SESSION *Session, const char *Args)
+{
+    unsigned int value;
+    int i, used;
+
+    for (i = 0; i < GDB_REG_COUNT; i++)
+    {
+        used = GdbParseRegister(Session, Args, i, &value);
+        if (used < 0)
+            return GdbSendString(Session, "E01");
+
+        GdbSetRegister(Session, i, value);
+        Args += used;
+    }
+
+    return GdbSendString(Session, "OK");
+}
+
+//Only pay for debug checks while something is set
+static void GdbUpdateAttach(GDB_SESSION *Session)
+{
+    CpuAttachDebug(Session->Cpu, DbgIsActive(&Session->Debug) ? &Session->Debug : NULL);
+}
+
+static int GdbWatchFlags(GDB_SESSION *Session, int Address)
+{
+    int flags = 0;
+
+    Address = RegsCanonicalAddress((unsigned char)Address);
+    if (DbgTestBit(Session->Debug.WatchRead, Address))
+        flags |= DBG_WATCH_READ;
+    if (DbgTestBit(Session->Debug.WatchWrite, Address))
+        flags |= DBG_WATCH_WRITE;
+
+    return flags;
+}
+
+//Z/z type,addr,kind
+static int GdbHandleBreakpoint(GDB_SESSION *Session, const char *Args, int Insert)
+{
+    unsigned long type, address, length, i;
+    unsigned int *kinds, mask;
+    int flags, current, offset, pc;
+
+    type = GdbParseHex(&Args);
+    if (*Args++ != ',')
+        return GdbSendString(Session, "E01");
+    address = GdbParseHex(&Args);
+    if (*Args++ != ',')
+        return GdbSendString(Session, "E01");
+    length = GdbParseHex(&Args);
+
+    //Software breakpoints can't patch flash, so both kinds use the bitmap
+    if (type == 0 || type == 1)
+    {
+        if (address >= PROGRAM_MEM_INSTRUCTIONS * 2 || (address & 1))
+            return GdbSendString(Session, "E01");
+
+        pc = (int)(address / 2);
+        kinds = (type == 0) ? Session->SwBreaks : Session->HwBreaks;
+        mask = 1U << (pc & 31);
+
+        if (Insert)
+        {
+            if (DbgSetBreakpoint(&Session->Debug, pc, NULL) < 0)
+                return GdbSendString(Session, "E01");
+
+            kinds[pc >> 5] |= mask;
+        }
+        else
+        {
+            kinds[pc >> 5] &= ~mask;
+
+            //The bitmap entry stays while the other kind still uses it
+            if (!DbgTestBit(Session->SwBreaks, pc) && !DbgTestBit(Session->HwBreaks, pc))
+                DbgClearBreakpoint(&Session->Debug, pc);
+        }
+    }
+    else if (type >= 2 && type <= 4)
+    {
+        flags = (type == 2) ? DBG_WATCH_WRITE : (type == 3) ? DBG_WATCH_READ : (DBG_WATCH_READ | DBG_WATCH_WRITE);
+
+        if (address < GDB_DATA_BASE || address + length > GDB_DATA_BASE + DBG_DATA_SIZE)
+            return GdbSendString(Session, "E01");
+
+        for (i = 0; i < length; i++)
+        {
+            offset = (int)(address - GDB_DATA_BASE + i);
+            current = GdbWatchFlags(Session, offset);
+            current = Insert ? (current | flags) : (current & ~flags);
+
+            DbgClearWatch(&Session->Debug, offset);
+            if (current != 0)
+                DbgSetWatch(&Session->Debug, offset, current);
+        }
+    }
+    else
+    {
+        //Unsupported type
+        return GdbSendString(Session, "");
+    }
+
+    GdbUpdateAttach(Session);
+
+    return GdbSendString(Session, "OK");
+}
+
+//Checks for a ^C from GDB without blocking (-1 if GDB went away)
+static int GdbInterrupted(GDB_SESSION *Session)
+{
+    struct pollfd pfd;
+    int c;
+
+    if (Session->InputStart == Session->InputEnd)
+    {
+        pfd.fd = Session->Socket;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 0) <= 0)
+            return 0;
+    }
+
+    //Anything but ^C is left for the packet reader
+    c = GdbReadByte(Session);
+    if (c < 0)
+        return -1;
+    else if (c == 0x03)
+        return 1;
+
+    Session->InputStart--;
+    return 0;
+}
+
+//Runs the CPU and sends the stop reply
+static int GdbResume(GDB_SESSION *Session, int Step)
+{
+    PIC_CPU *cpu = Session->Cpu;
+    unsigned int retired;
+    int err, interrupted;
+
+    //Resuming never re-hits the breakpoint at the current PC
+    Session->Debug.StopPC = CpuGetPC(cpu);
+    Session->Debug.Resume = 1;
+
+    if (Step)
+    {
+        err = CpuRun(cpu, 1, &retired);
+    }
+    else
+    {
+        //Run in batches and only look at the socket in between
+        do
+        {
+            err = CpuRun(cpu, GDB_RUN_SLICE, &retired);
+            if (err != 0)
+                break;
+
+            //A disconnect ends the session instead of running on
+            interrupted = GdbInterrupted(Session);
+            if (interrupted < 0)
+                return 1;
+            else if (interrupted)
+            {
+                strcpy(Session->LastStop, "S02");
+                return GdbSendString(Session, Session->LastStop);
+            }
+        }
+        while (err == 0);
+    }
+
+    if (err == CPU_ERR_INVALID)
+    {
+        strcpy(Session->LastStop, "S04");
+    }
+    else if (err == CPU_ERR_WATCH)
+    {
+        snprintf(Session->LastStop, sizeof(Session->LastStop), "T05%s:%x;",
+                 (Session->Debug.StopAccess == DBG_WATCH_WRITE) ? "watch" :
+                 (Session->Debug.StopAccess == DBG_WATCH_READ) ? "rwatch" : "awatch",
+                 GDB_DATA_BASE + Session->Debug.StopAddress);
+    }
+    else if (err == CPU_ERR_BREAK)
+    {
+        strcpy(Session->LastStop, DbgTestBit(Session->SwBreaks, CpuGetPC(cpu)) ? "T05swbreak:;" : "T05hwbreak:;");
+    }
+    else
+    {
+        //Steps and SLEEP both stop with a trap
+        strcpy(Session->LastStop, "S05");
+    }
+
+    return GdbSendString(Session, Session->LastStop);
+}
+
+//qXfer:features:read:target.xml:offset,length
+static int GdbHandleXfer(GDB_SESSION *Session, const char *Args)
+{
+    const char *prefix = "features:read:target.xml:";
+    unsigned long offset, length, total = sizeof(GdbTargetXml) - 1;
+
+    if (strncmp(Args, prefix, strlen(prefix)) != 0)
+        return GdbSendString(Session, "");
+
+    Args += strlen(prefix);
+    offset = GdbParseHex(&Args);
+    if (*Args++ != ',')
+        return GdbSendString(Session, "E01");
+    length = GdbParseHex(&Args);
+
+    if (length > GDB_PACKET_SIZE - 1)
+        length = GDB_PACKET_SIZE - 1;
+    if (offset >= total)
+        return GdbSendString(Session, "l");
+    if (offset + length > total)
+        length = total - offset;
+
+    Session->Reply[0] = (offset + length == total) ? 'l' : 'm';
+    memcpy(&Session->Reply[1], &GdbTargetXml[offset], length);
+
+    return GdbSendPacket(Session, Session->Reply, (int)length + 1);
+}
+
+static int GdbHandleQuery(GDB_SESSION *Session, const char *Packet)
+{
+    if (strncmp(Packet, "qSupported", 10) == 0)
+    {
+        snprintf(Session->Reply, sizeof(Session->Reply),
+                 "PacketSize=%x;qXfer:features:read+;QStartNoAckMode+;vContSupported+;swbreak+;hwbreak+",
+                 GDB_PACKET_SIZE);
+        return GdbSendString(Session, Session->Reply);
+    }
+    else if (strncmp(Packet, "qXfer:", 6) == 0)
+        return GdbHandleXfer(Session, Packet + 6);
+    else if (strcmp(Packet, "qAttached") == 0)
+        return GdbSendString(Session, "1");
+    else if (strcmp(Packet, "qC") == 0)
+        return GdbSendString(Session, "QC1");
+    else if (strcmp(Packet, "qfThreadInfo") == 0)
+        return GdbSendString(Session, "m1");
+    else if (strcmp(Packet, "qsThreadInfo") == 0)
+        return GdbSendString(Session, "l");
+
+    return GdbSendString(Session, "");
+}
+
+//vCont;action[:thread]... (there's only one thread, so the first action wins)
+static int GdbHandleVCont(GDB_SESSION *Session, const char *Packet)
+{
+    if (strcmp(Packet, "vCont?") == 0)
+        return GdbSendString(Session, "vCont;c;C;s;S");
+
+    if (Packet[5] != ';')
+        return GdbSendString(Session, "");
+
+    switch (Packet[6])
+    {
+        case 'c':
+        case 'C':
+            return GdbResume(Session, 0);
+        case 's':
+        case 'S':
+            return GdbResume(Session, 1);
+    }
+
+    return GdbSendString(Session, "E01");
+}
+
+//Handles one packet (returns 1 when the session should end)
+static int GdbHandlePacket(GDB_SESSION *Session, int Length)
+{
+    const char *packet = Session->Packet;
+    unsigned long number;
+    unsigned int value;
+    char *out;
+
+    switch (packet[0])
+    {
+        case '?':
+            return GdbSendString(Session, Session->LastStop);
+        case 'g':
+            return GdbHandleReadRegisters(Session);
+        case 'G':
+            return GdbHandleWriteRegisters(Session, packet + 1);
+        case 'p':
+            packet++;
+            number = GdbParseHex(&packet);
+            if (number >= GDB_REG_COUNT)
+                return GdbSendString(Session, "E01");
+
+            out = GdbPutRegister(Session, Session->Reply, (int)number);
+            return GdbSendPacket(Session, Session->Reply, (int)(out - Session->Reply));
+        case 'P':
+            packet++;
+            number = GdbParseHex(&packet);
+            if (number >= GDB_REG_COUNT || *packet++ != '=' ||
+                GdbParseRegister(Session, packet, (int)number, &value) < 0)
+                return GdbSendString(Session, "E01");
+
+            GdbSetRegister(Session, (int)number, value);
+            return GdbSendString(Session, "OK");
+        case 'm':
+            return GdbHandleReadMemory(Session, packet + 1);
+        case 'M':
+            return GdbHandleWriteMemory(Session, packet + 1, Length, 0);
+        case 'X':
+            return GdbHandleWriteMemory(Session, packet + 1, Length, 1);
+        case 'c':
+            return GdbResume(Session, 0);
+        case 's':
+            return GdbResume(Session, 1);
+        case 'Z':
+            return GdbHandleBreakpoint(Session, packet + 1, 1);
+        case 'z':
+            return GdbHandleBreakpoint(Session, packet + 1, 0);
+        case 'H':
+        case 'T':
+            return GdbSendString(Session, "OK");
+        case 'q':
+            return GdbHandleQuery(Session, packet);
+        case 'Q':
+            if (strcmp(packet, "QStartNoAckMode") == 0)
+            {
+                if (GdbSendString(Session, "OK") < 0)
+                    return -1;
+                Session->NoAck = 1;
+                return 0;
+            }
+            return GdbSendString(Session, "");
+        case 'v':
+            if (strncmp(packet, "vCont", 5) == 0)
+                return GdbHandleVCont(Session, packet);
+            return GdbSendString(Session, "");
+        case 'D':
+            GdbSendString(Session, "OK");
+            return 1;
+        case 'k':
+            return 1;
+    }
+
+    return GdbSendString(Session, "");
+}
+
+/* ------------------------- Server ------------------------- */
+
+//Listens on a Unix socket path (anything with a '/') or a loopback TCP port
+static int GdbListen(const char *Listen)
+{
+    int fd, one = 1;
+
+    if (strchr(Listen, '/') != NULL)
+    {
+        struct sockaddr_un addr;
+
+        if (strlen(Listen) >= sizeof(addr.sun_path))
+        {
+            printf("Socket path is too long\n");
+            return -1;
+        }
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, Listen);
+        unlink(Listen);
+
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    else
+    {
+        struct sockaddr_in addr;
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short)atoi(Listen));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+//Serves one debugger connection until it detaches or disconnects
+int GdbServe(PIC_CPU *Cpu, const char *Listen)
+{
+    GDB_SESSION *session;
+    int server, length, err = 0, one = 1;
+
+    if (Listen == NULL)
+        Listen = GDB_DEFAULT_PORT;
+
+    session = calloc(1, sizeof(GDB_SESSION));
+    if (session == NULL)
+    {
+        printf("Out of memory\n");
+        return -1;
+    }
+
+    session->Cpu = Cpu;
+    DbgInitialize(&session->Debug);
+    strcpy(session->LastStop, "S05");
+
+    server = GdbListen(Listen);
+    if (server < 0)
+    {
+        printf("Failed to listen on %s\n", Listen);
+        free(session);
+        return -1;
+    }
+
+    printf("Waiting for GDB on %s\n", Listen);
+    fflush(stdout);
+
+    session->Socket = accept(server, NULL, NULL);
+    close(server);
+    if (session->Socket < 0)
+    {
+        printf("Failed to accept a connection\n");
+        free(session);
+        return -1;
+    }
+
+    //Replies are small and latency bound (fails harmlessly on Unix sockets)
+    setsockopt(session->Socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    for (;;)
+    {
+        length = GdbReadPacket(session);
+        if (length < 0)
+            break;
+
+        err = GdbHandlePacket(session, length);
+        if (err != 0)
+            break;
+    }
+
+    //Leave the CPU without our debug state
+    CpuAttachDebug(Cpu, NULL);
+    close(session->Socket);
+    free(session);
+
+    printf("GDB disconnected\n");
+
+    return (err < 0) ? err : 0;
+}
@@ -0,0 +1,34 @@
+//
+//  gdb.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  GDB remote serial protocol stub. Memory is exposed with the AVR-style
+//  split address map that GDB front ends already understand.
+//
+
+#ifndef PIC16F84A_Emulator_gdb_h
+#define PIC16F84A_Emulator_gdb_h
+
+#include "cpu.h"
+
+//Memory map seen by GDB (program memory is byte addressed, 2 bytes per word)
+#define GDB_PROGRAM_BASE 0x000000
+#define GDB_DATA_BASE    0x800000
+#define GDB_EEPROM_BASE  0x810000
+
+//Default TCP port on the loopback interface
+#define GDB_DEFAULT_PORT "1234"
+
+//Largest packet we accept or send
+#define GDB_PACKET_SIZE  0x4000
+
+//Instructions run between checks for an interrupt from GDB
+#define GDB_RUN_SLICE    0x10000
+
+int GdbServe(PIC_CPU *Cpu, const char *Listen);
+
+#endif
@@ -0,0 +1,447 @@
+//
+//  image.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "image.h"
+#include "fuse.h"
+#include "lexer.h"
+
+//Decoded images keyed by content hash (the cache holds one reference)
+static PIC_IMAGE *ImageCache[IMAGE_CACHE_BUCKETS];
+static int ImageCacheCount;
+static pthread_mutex_t ImageCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+//64-bit FNV-1a
+unsigned long long ImgHash(const void *Buffer, size_t Size)
+{
+    const unsigned char *p = Buffer;
+    unsigned long long hash = 14695981039346656037ull;
+    size_t i;
+
+    for (i = 0; i < Size; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static int ImgError(int Quiet, const char *Format, ...)
+{
+    va_list args;
+
+    if (Quiet)
+        return -1;
+
+    va_start(args, Format);
+    vprintf(Format, args);
+    va_end(args);
+
+    return -1;
+}
+
+static void ImgReset(PIC_IMAGE *Image)
+{
+    int i;
+
+    for (i = 0; i < PROGRAM_MEM_INSTRUCTIONS; i++)
+    {
+        Image->ProgMem[i].Opcode = IMAGE_ERASED_WORD;
+    }
+
+    memset(Image->Eeprom, 0xFF, EEPROM_SIZE);
+    Image->ConfigWord = IMAGE_ERASED_WORD;
+    Image->WordCount = 0;
+}
+
+//Fills in the predecoded form of program memory
+static void ImgDecode(PIC_IMAGE *Image)
+{
+    int i;
+
+    //ISA_INSN has a padding byte and Decoded is written to .pcf files as is,
+    //so clear it to keep them reproducible
+    memset(Image->Decoded, 0, sizeof(Image->Decoded));
+
+    for (i = 0; i < PROGRAM_MEM_INSTRUCTIONS; i++)
+    {
+        Image->Decoded[i].Opcode = Image->ProgMem[i].Opcode;
+        Image->Decoded[i].Id = IsaDecode(Image->ProgMem[i].Opcode);
+    }
+
+    FuseProgram(Image->Decoded, PROGRAM_MEM_INSTRUCTIONS, Image->Fused);
+}
+
+static int ImgHexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+
+    return -1;
+}
+
+//Reads one hex byte at *p
+static int ImgHexByte(const char **p, const char *End)
+{
+    int hi, lo;
+
+    if (End - *p < 2)
+        return -1;
+
+    hi = ImgHexDigit((*p)[0]);
+    lo = ImgHexDigit((*p)[1]);
+    if (hi < 0 || lo < 0)
+        return -1;
+
+    *p += 2;
+    return (hi << 4) | lo;
+}
+
+//Stores one byte at an INHX8M byte address
+static void ImgStoreByte(PIC_IMAGE *Image, unsigned long Address, unsigned char Data)
+{
+    unsigned long word = Address >> 1;
+    int high = (int)(Address & 1);
+
+    if (word < PROGRAM_MEM_INSTRUCTIONS)
+    {
+        unsigned short value = Image->ProgMem[word].Opcode;
+
+        if (high)
+            value = (value & 0x00FF) | ((Data << 8) & 0x3F00);
+        else
+            value = (value & 0x3F00) | Data;
+
+        Image->ProgMem[word].Opcode = value;
+        if (word >= Image->WordCount)
+            Image->WordCount = (unsigned short)(word + 1);
+    }
+    else if (word == IMAGE_CONFIG_ADDR)
+    {
+        if (high)
+            Image->ConfigWord = (Image->ConfigWord & 0x00FF) | ((Data << 8) & 0x3F00);
+        else
+            Image->ConfigWord = (Image->ConfigWord & 0x3F00) | Data;
+    }
+    else if (word >= IMAGE_EEPROM_ADDR && word < IMAGE_EEPROM_ADDR + EEPROM_SIZE)
+    {
+        //EEPROM bytes occupy the low half of each word
+        if (!high)
+            Image->Eeprom[word - IMAGE_EEPROM_ADDR] = Data;
+    }
+}
+
+//Parses INHX8M and INHX32 in a single pass over the buffer
+int ImgParseHex(PIC_IMAGE *Image, const char *Buffer, size_t Size, int Quiet)
+{
+    const char *p = Buffer;
+    const char *end = Buffer + Size;
+    unsigned long base = 0;
+    int line = 1;
+
+    ImgReset(Image);
+
+    while (p < end)
+    {
+        int count, addrHigh, addrLow, type, checksum, value, i;
+        unsigned long address;
+        const char *data;
+
+        //Skip to the next record
+        if (*p != ':')
+        {
+            if (*p == '\n')
+                line++;
+            else if (*p != '\r' && *p != ' ' && *p != '\t')
+            {
+                return ImgError(Quiet, "HEX line %d: Expected ':'\n", line);
+            }
+
+            p++;
+            continue;
+        }
+        p++;
+
+        count = ImgHexByte(&p, end);
+        addrHigh = ImgHexByte(&p, end);
+        addrLow = ImgHexByte(&p, end);
+        type = ImgHexByte(&p, end);
+        if (count < 0 || addrHigh < 0 || addrLow < 0 || type < 0)
+        {
+            return ImgError(Quiet, "HEX line %d: Malformed record\n", line);
+        }
+
+        address = (addrHigh << 8) | addrLow;
+        checksum = count + addrHigh + addrLow + type;
+
+        //Verify the checksum before touching the data
+        data = p;
+        for (i = 0; i <= count; i++)
+        {
+            value = ImgHexByte(&p, end);
+            if (value < 0)
+            {
+                return ImgError(Quiet, "HEX line %d: Truncated record\n", line);
+            }
+            checksum += value;
+        }
+
+        if ((checksum & 0xFF) != 0)
+        {
+            return ImgError(Quiet, "HEX line %d: Bad checksum\n", line);
+        }
+
+        switch (type)
+        {
+            case 0x00:
+                //Data
+                for (i = 0; i < count; i++)
+                {
+                    ImgStoreByte(Image, base + address + i, ImgHexByte(&data, end));
+                }
+                break;
+            case 0x01:
+                //End of file
+                ImgDecode(Image);
+                return 0;
+            case 0x02:
+                //Extended segment address
+                base = ((ImgHexByte(&data, end) << 8) | ImgHexByte(&data, end)) << 4;
+                break;
+            case 0x04:
+                //Extended linear address (INHX32)
+                base = (unsigned long)((ImgHexByte(&data, end) << 8) | ImgHexByte(&data, end)) << 16;
+                break;
+            default:
+                //Start address records don't matter to a PIC
+                break;
+        }
+    }
+
+    return ImgError(Quiet, "HEX line %d: Missing end of file record\n", line);
+}
+
+//Raw images are little-endian 14-bit words starting at address 0
+int ImgParseRaw(PIC_IMAGE *Image, const unsigned char *Buffer, size_t Size, int Quiet)
+{
+    size_t i;
+
+    if (Size > PROGRAM_MEM_INSTRUCTIONS * sizeof(PIC_OPCODE))
+    {
+        return ImgError(Quiet, "Program is too large for the PIC\n");
+    }
+
+    if ((Size % sizeof(PIC_OPCODE)) != 0)
+    {
+        return ImgError(Quiet, "Program is not valid PIC bytecode\n");
+    }
+
+    ImgReset(Image);
+
+    for (i = 0; i < Size; i += 2)
+    {
+        Image->ProgMem[i / 2].Opcode = (Buffer[i] | (Buffer[i + 1] << 8)) & PIC_OPCODE_MASK;
+    }
+
+    Image->WordCount = (unsigned short)(Size / 2);
+    ImgDecode(Image);
+
+    return 0;
+}
+
+//Raw bytecode can start with ':' (MOVLW 0x3A) or whitespace bytes, so a
+//buffer is only HEX if its first line is a complete record
+static int ImgIsHex(const char *Buffer, size_t Size)
+{
+    const char *p = Buffer, *end = Buffer + Size;
+    int length, data, sum, i;
+
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        p++;
+
+    if (p == end || *p++ != ':')
+        return 0;
+
+    //Length, address, type, data and checksum bytes that sum to zero
+    length = ImgHexByte(&p, end);
+    if (length < 0)
+        return 0;
+
+    sum = length;
+    for (i = 0; i < length + 4; i++)
+    {
+        data = ImgHexByte(&p, end);
+        if (data < 0)
+            return 0;
+
+        sum += data;
+    }
+
+    if ((sum & 0xFF) != 0)
+        return 0;
+
+    return p == end || *p == '\r' || *p == '\n';
+}
+
+//Parses HEX or raw bytecode depending on what the buffer looks like
+int ImgParseBuffer(PIC_IMAGE *Image, const void *Buffer, size_t Size, int Quiet)
+{
+    if (ImgIsHex(Buffer, Size))
+        return ImgParseHex(Image, Buffer, Size, Quiet);
+    else
+        return ImgParseRaw(Image, Buffer, Size, Quiet);
+}
+
+//Must be called with the cache lock held. The hash only narrows the search,
+//the source bytes decide whether an entry really is the same file.
+static PIC_IMAGE *ImgCacheLookup(PIC_IMAGE *Bucket, unsigned long long Hash, const void *Buffer, size_t Size)
+{
+    PIC_IMAGE *image;
+
+    for (image = Bucket; image != NULL; image = image->Next)
+    {
+        if (image->Hash == Hash && image->SourceSize == Size &&
+            memcmp(image->Source, Buffer, Size) == 0)
+        {
+            image->RefCount++;
+            return image;
+        }
+    }
+
+    return NULL;
+}
+
+//Frees unreferenced images until at most Keep are cached.
+//Must be called with the cache lock held.
+static void ImgCacheTrim(int Keep)
+{
+    PIC_IMAGE **link, *image;
+    int i;
+
+    for (i = 0; i < IMAGE_CACHE_BUCKETS && ImageCacheCount > Keep; i++)
+    {
+        link = &ImageCache[i];
+        while ((image = *link) != NULL && ImageCacheCount > Keep)
+        {
+            if (image->RefCount == 1)
+            {
+                *link = image->Next;
+                free(image);
+                ImageCacheCount--;
+            }
+            else
+            {
+                link = &image->Next;
+            }
+        }
+    }
+}
+
+PIC_IMAGE *ImgLoadBuffer(const void *Buffer, size_t Size, int Quiet)
+{
+    unsigned long long hash = ImgHash(Buffer, Size);
+    PIC_IMAGE **bucket = &ImageCache[hash & (IMAGE_CACHE_BUCKETS - 1)];
+    PIC_IMAGE *image, *cached;
+    int err;
+
+    //Check for an already decoded copy
+    pthread_mutex_lock(&ImageCacheLock);
+    cached = ImgCacheLookup(*bucket, hash, Buffer, Size);
+    pthread_mutex_unlock(&ImageCacheLock);
+    if (cached != NULL)
+        return cached;
+
+    //The source copy follows the image in one allocation
+    image = malloc(sizeof(PIC_IMAGE) + Size);
+    if (!image)
+        return NULL;
+
+    err = ImgParseBuffer(image, Buffer, Size, Quiet);
+    if (err < 0)
+    {
+        free(image);
+        return NULL;
+    }
+
+    image->Hash = hash;
+    image->Source = (const unsigned char *)(image + 1);
+    image->SourceSize = Size;
+    memcpy(image + 1, Buffer, Size);
+
+    //One reference for the caller and one for the cache
+    image->RefCount = 2;
+
+    pthread_mutex_lock(&ImageCacheLock);
+
+    //Somebody else may have decoded it in the meantime
+    cached = ImgCacheLookup(*bucket, hash, Buffer, Size);
+    if (cached == NULL)
+    {
+        image->Next = *bucket;
+        *bucket = image;
+
+        //Make room by dropping images nobody is using
+        ImageCacheCount++;
+        if (ImageCacheCount > IMAGE_CACHE_LIMIT)
+            ImgCacheTrim(IMAGE_CACHE_LIMIT);
+    }
+
+    pthread_mutex_unlock(&ImageCacheLock);
+
+    if (cached != NULL)
+    {
+        free(image);
+        return cached;
+    }
+
+    return image;
+}
+
+PIC_IMAGE *ImgLoadFile(const char *Path)
+{
+    ASM_SOURCE source;
+    PIC_IMAGE *image;
+
+    if (LexMapSource(Path, &source) < 0)
+    {
+        printf("Failed to open %s\n", Path);
+        return NULL;
+    }
+
+    image = ImgLoadBuffer(source.Buffer, source.Size, 0);
+    LexUnmapSource(&source);
+
+    return image;
+}
+
+void ImgRelease(PIC_IMAGE *Image)
+{
+    //The cache keeps its reference so reloads stay cheap
+    pthread_mutex_lock(&ImageCacheLock);
+    Image->RefCount--;
+    pthread_mutex_unlock(&ImageCacheLock);
+}
+
+//Frees every cached image nobody else references
+void ImgFlushCache(void)
+{
+    pthread_mutex_lock(&ImageCacheLock);
+    ImgCacheTrim(0);
+    pthread_mutex_unlock(&ImageCacheLock);
+}
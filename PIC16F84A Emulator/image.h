@@ -0,0 +1,60 @@
+//
+//  image.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#ifndef PIC16F84A_Emulator_image_h
+#define PIC16F84A_Emulator_image_h
+
+#include <stddef.h>
+
+#include "cpu.h"
+#include "isa.h"
+
+//Word addresses of the non-program areas in HEX files
+#define IMAGE_CONFIG_ADDR   0x2007
+#define IMAGE_EEPROM_ADDR   0x2100
+
+//Unprogrammed flash and config words read as all ones
+#define IMAGE_ERASED_WORD   0x3FFF
+
+//Buckets in the decoded image cache (must be a power of 2)
+#define IMAGE_CACHE_BUCKETS 0x40
+
+//Images the cache holds on to before it starts freeing unreferenced ones
+#define IMAGE_CACHE_LIMIT   0x40
+
+//This struct represents a loaded and decoded firmware image.
+//Images are immutable once loaded and can be shared by any number of CPUs.
+typedef struct _PIC_IMAGE {
+    struct _PIC_IMAGE *Next;        //Cache chain
+    unsigned long long Hash;        //Content hash of the source file
+    const unsigned char *Source;    //Copy of the source file (cached images only)
+    size_t SourceSize;
+    int RefCount;
+
+    unsigned short WordCount;       //Highest programmed word + 1
+    unsigned short ConfigWord;
+    unsigned char Eeprom[EEPROM_SIZE];
+    PIC_OPCODE ProgMem[PROGRAM_MEM_INSTRUCTIONS];
+    ISA_INSN Decoded[PROGRAM_MEM_INSTRUCTIONS];
+    unsigned char Fused[PROGRAM_MEM_INSTRUCTIONS];  //FUSE_* kind of each word
+} PIC_IMAGE;
+
+unsigned long long ImgHash(const void *Buffer, size_t Size);
+
+//Quiet parses report errors only through the return value
+int ImgParseHex(PIC_IMAGE *Image, const char *Buffer, size_t Size, int Quiet);
+int ImgParseRaw(PIC_IMAGE *Image, const unsigned char *Buffer, size_t Size, int Quiet);
+int ImgParseBuffer(PIC_IMAGE *Image, const void *Buffer, size_t Size, int Quiet);
+
+PIC_IMAGE *ImgLoadBuffer(const void *Buffer, size_t Size, int Quiet);
+PIC_IMAGE *ImgLoadFile(const char *Path);
+void ImgRelease(PIC_IMAGE *Image);
+void ImgFlushCache(void);
+
+#endif
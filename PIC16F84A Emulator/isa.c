@@ -0,0 +1,175 @@
+//
+//  isa.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+
+#include "isa.h"
+#include "opcode.h"
+
+const ISA_ENTRY IsaTable[ISA_COUNT] =
+{
+#define ISA_OP(Name, Mask, Match, Format, Cycles) {#Name, Mask, Match, Format, Cycles},
+#include "isa.def"
+#undef ISA_OP
+};
+
+//Identifies this build's isa.def so stored decode IDs can be trusted
+unsigned int IsaFingerprint(void)
+{
+    unsigned int hash = 2166136261u;
+    const char *p;
+    int i;
+
+    for (i = 0; i < ISA_COUNT; i++)
+    {
+        for (p = IsaTable[i].Mnemonic; *p; p++)
+        {
+            hash = (hash ^ (unsigned char)*p) * 16777619u;
+        }
+
+        hash = (hash ^ IsaTable[i].Mask) * 16777619u;
+        hash = (hash ^ IsaTable[i].Match) * 16777619u;
+        hash = (hash ^ IsaTable[i].Format) * 16777619u;
+    }
+
+    return hash ^ sizeof(ISA_INSN);
+}
+
+int IsaLookupMnemonic(const char *Name, int Length)
+{
+    const char *mnemonic;
+    int id;
+    int i;
+
+    id = IsaMnemonicSlots[IsaMnemonicHash(Name, Length, IsaMnemonicSeed)];
+    if (id == ISA_INVALID)
+        return -1;
+
+    //The hash is perfect for valid names, so one compare settles it
+    mnemonic = IsaTable[id].Mnemonic;
+    for (i = 0; i < Length; i++)
+    {
+        if (toupper((unsigned char)Name[i]) != mnemonic[i])
+            return -1;
+    }
+
+    if (mnemonic[i] != 0)
+        return -1;
+
+    return id;
+}
+
+//Returns the maximum operand count and the number that must be given
+int IsaOperandCount(int Id, int *Required)
+{
+    switch (IsaTable[Id].Format)
+    {
+        case ISA_FMT_F:
+        case ISA_FMT_K8:
+        case ISA_FMT_K11:
+            *Required = 1;
+            return 1;
+        case ISA_FMT_FD:
+            //The destination defaults to W
+            *Required = 1;
+            return 2;
+        case ISA_FMT_FB:
+            *Required = 2;
+            return 2;
+        default:
+            *Required = 0;
+            return 0;
+    }
+}
+
+//Returns whether the instruction reads and/or writes its file register
+int IsaFileAccess(int Id, unsigned short Opcode)
+{
+    switch (Id)
+    {
+        case ISA_CLRF:
+        case ISA_MOVWF:
+            return ISA_ACCESS_WRITE;
+        case ISA_BCF:
+        case ISA_BSF:
+            return ISA_ACCESS_READ | ISA_ACCESS_WRITE;
+        case ISA_BTFSC:
+        case ISA_BTFSS:
+            return ISA_ACCESS_READ;
+    }
+
+    if (Id >= ISA_COUNT || IsaTable[Id].Format != ISA_FMT_FD)
+        return 0;
+
+    if (ISA_DEST(Opcode) == DST_F)
+        return ISA_ACCESS_READ | ISA_ACCESS_WRITE;
+
+    return ISA_ACCESS_READ;
+}
+
+unsigned short IsaEncode(int Id, int Operand1, int Operand2)
+{
+    unsigned short opcode;
+
+    if (Id < 0 || Id >= ISA_COUNT)
+        return OP_INVALID;
+
+    opcode = IsaTable[Id].Match;
+    switch (IsaTable[Id].Format)
+    {
+        case ISA_FMT_F:
+            opcode |= (Operand1 & 0x7F);
+            break;
+        case ISA_FMT_FD:
+            opcode |= (Operand1 & 0x7F);
+            opcode |= (Operand2 << 7) & 0x80;
+            break;
+        case ISA_FMT_FB:
+            opcode |= (Operand1 & 0x7F);
+            opcode |= (Operand2 << 7) & 0x380;
+            break;
+        case ISA_FMT_K8:
+            opcode |= (Operand1 & 0xFF);
+            break;
+        case ISA_FMT_K11:
+            opcode |= (Operand1 & 0x7FF);
+            break;
+    }
+
+    return opcode;
+}
+
+int IsaFormat(unsigned short Opcode, char *Buffer, int Size)
+{
+    int id;
+
+    //Make sure this is 14-bit
+    if ((Opcode & 0xC000) != 0)
+        return snprintf(Buffer, Size, "Invalid high bits in opcode");
+
+    id = IsaDecode(Opcode);
+    if (id == ISA_INVALID)
+        return snprintf(Buffer, Size, "Invalid opcode 0x%x", Opcode);
+
+    switch (IsaTable[id].Format)
+    {
+        case ISA_FMT_F:
+            return snprintf(Buffer, Size, "%s %d", IsaTable[id].Mnemonic, ISA_FILE(Opcode));
+        case ISA_FMT_FD:
+            return snprintf(Buffer, Size, "%s %d, %d", IsaTable[id].Mnemonic, ISA_FILE(Opcode), ISA_DEST(Opcode));
+        case ISA_FMT_FB:
+            return snprintf(Buffer, Size, "%s %d, %d", IsaTable[id].Mnemonic, ISA_FILE(Opcode), ISA_BIT(Opcode));
+        case ISA_FMT_K8:
+            return snprintf(Buffer, Size, "%s %d", IsaTable[id].Mnemonic, ISA_K8(Opcode));
+        case ISA_FMT_K11:
+            return snprintf(Buffer, Size, "%s %d", IsaTable[id].Mnemonic, ISA_K11(Opcode));
+        default:
+            return snprintf(Buffer, Size, "%s", IsaTable[id].Mnemonic);
+    }
+}
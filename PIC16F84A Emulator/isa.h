@@ -0,0 +1,98 @@
+//
+//  isa.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#ifndef PIC16F84A_Emulator_isa_h
+#define PIC16F84A_Emulator_isa_h
+
+#include <ctype.h>
+
+//Operand formats
+#define ISA_FMT_NONE  0x00  //No operands
+#define ISA_FMT_F     0x01  //f
+#define ISA_FMT_FD    0x02  //f, d
+#define ISA_FMT_FB    0x03  //f, b
+#define ISA_FMT_K8    0x04  //8-bit literal
+#define ISA_FMT_K11   0x05  //11-bit address
+
+//Operand field extraction
+#define ISA_FILE(op)  ((op) & 0x7F)
+#define ISA_DEST(op)  (((op) & 0x80) >> 7)
+#define ISA_BIT(op)   (((op) & 0x380) >> 7)
+#define ISA_K8(op)    ((op) & 0xFF)
+#define ISA_K11(op)   ((op) & 0x7FF)
+
+//Instruction IDs in isa.def order
+enum {
+#define ISA_OP(Name, Mask, Match, Format, Cycles) ISA_##Name,
+#include "isa.def"
+#undef ISA_OP
+    ISA_COUNT
+};
+
+//Decode result for words that aren't instructions
+#define ISA_INVALID ISA_COUNT
+
+//How an instruction uses its f operand (IsaFileAccess)
+#define ISA_ACCESS_READ  0x01
+#define ISA_ACCESS_WRITE 0x02
+
+//One decode table entry per 14-bit word
+#define ISA_DECODE_ENTRIES 0x4000
+
+//Size of the mnemonic perfect hash table (must be a power of 2)
+#define ISA_HASH_SLOTS 0x80
+
+//This struct represents one row of isa.def
+typedef struct _ISA_ENTRY {
+    const char *Mnemonic;
+    unsigned short Mask;
+    unsigned short Match;
+    unsigned char Format;
+    unsigned char Cycles;
+} ISA_ENTRY;
+
+extern const ISA_ENTRY IsaTable[ISA_COUNT];
+
+//A predecoded instruction word
+typedef struct _ISA_INSN {
+    unsigned short Opcode;
+    unsigned char Id;
+} ISA_INSN;
+
+//Generated by isagen from isa.def
+extern const unsigned char IsaDecodeTable[ISA_DECODE_ENTRIES];
+extern const unsigned char IsaMnemonicSlots[ISA_HASH_SLOTS];
+extern const unsigned int IsaMnemonicSeed;
+
+//Returns the instruction ID of a 14-bit opcode
+#define IsaDecode(opcode) (IsaDecodeTable[(opcode) & 0x3FFF])
+
+//Case-insensitive mnemonic hash shared by isagen and the lookup
+static inline unsigned int IsaMnemonicHash(const char *Name, int Length, unsigned int Seed)
+{
+    unsigned int hash = Seed;
+    int i;
+
+    for (i = 0; i < Length; i++)
+    {
+        hash ^= (unsigned char)toupper((unsigned char)Name[i]);
+        hash *= 16777619u;
+    }
+
+    return (hash ^ (hash >> 15)) & (ISA_HASH_SLOTS - 1);
+}
+
+unsigned int IsaFingerprint(void);
+int IsaLookupMnemonic(const char *Name, int Length);
+int IsaOperandCount(int Id, int *Required);
+unsigned short IsaEncode(int Id, int Operand1, int Operand2);
+int IsaFileAccess(int Id, unsigned short Opcode);
+int IsaFormat(unsigned short Opcode, char *Buffer, int Size);
+
+#endif
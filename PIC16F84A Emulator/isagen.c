@@ -0,0 +1,101 @@
+//
+//  isagen.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Build-time generator for the decode and mnemonic tables in isa.def.
+//  Writes isa_tables.c to stdout.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "isa.h"
+
+static const ISA_ENTRY GenTable[ISA_COUNT] =
+{
+#define ISA_OP(Name, Mask, Match, Format, Cycles) {#Name, Mask, Match, Format, Cycles},
+#include "isa.def"
+#undef ISA_OP
+};
+
+//Finds a seed that gives every mnemonic its own slot
+static int GenFindSeed(unsigned int *Seed, unsigned char *Slots)
+{
+    unsigned int seed;
+    int i;
+
+    for (seed = 2166136261u; seed < 2166136261u + 0x100000; seed++)
+    {
+        memset(Slots, ISA_INVALID, ISA_HASH_SLOTS);
+
+        for (i = 0; i < ISA_COUNT; i++)
+        {
+            const char *name = GenTable[i].Mnemonic;
+            unsigned int slot = IsaMnemonicHash(name, (int)strlen(name), seed);
+
+            if (Slots[slot] != ISA_INVALID)
+                break;
+
+            Slots[slot] = i;
+        }
+
+        if (i == ISA_COUNT)
+        {
+            *Seed = seed;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+int main(void)
+{
+    unsigned char slots[ISA_HASH_SLOTS];
+    unsigned int seed;
+    int opcode, i;
+
+    if (GenFindSeed(&seed, slots) < 0)
+    {
+        fprintf(stderr, "isagen: no perfect hash seed found\n");
+        return 1;
+    }
+
+    printf("//\n//  isa_tables.c\n//  PIC16F84A Emulator\n//\n");
+    printf("//  Generated by isagen from isa.def - do not edit\n//\n\n");
+    printf("#include \"isa.h\"\n\n");
+
+    printf("const unsigned int IsaMnemonicSeed = 0x%xu;\n\n", seed);
+
+    printf("const unsigned char IsaMnemonicSlots[ISA_HASH_SLOTS] =\n{");
+    for (i = 0; i < ISA_HASH_SLOTS; i++)
+    {
+        printf("%s%d,", (i % 16) ? " " : "\n    ", slots[i]);
+    }
+    printf("\n};\n\n");
+
+    printf("const unsigned char IsaDecodeTable[ISA_DECODE_ENTRIES] =\n{");
+    for (opcode = 0; opcode < ISA_DECODE_ENTRIES; opcode++)
+    {
+        int id = ISA_INVALID;
+
+        //First match wins
+        for (i = 0; i < ISA_COUNT; i++)
+        {
+            if ((opcode & GenTable[i].Mask) == GenTable[i].Match)
+            {
+                id = i;
+                break;
+            }
+        }
+
+        printf("%s%d,", (opcode % 16) ? " " : "\n    ", id);
+    }
+    printf("\n};\n");
+
+    return 0;
+}
@@ -0,0 +1,279 @@
+//
+//  lexer.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lexer.h"
+
+void LexInitialize(ASM_LEXER *Lexer, const char *Buffer, size_t Size)
+{
+    Lexer->Cursor = Buffer;
+    Lexer->End = Buffer + Size;
+    Lexer->LineStart = Buffer;
+    Lexer->Line = 1;
+}
+
+static int LexIsIdentChar(char c)
+{
+    return isalnum((unsigned char)c) || c == '_' || c == '.';
+}
+
+static int LexDigitValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+
+    c = toupper((unsigned char)c);
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return 99;
+}
+
+//Accumulates digits of the given radix, returning the number consumed
+static int LexScanDigits(ASM_LEXER *Lexer, const char *p, int Radix, unsigned int *Value)
+{
+    int count = 0;
+
+    *Value = 0;
+    while (p < Lexer->End && LexDigitValue(*p) < Radix)
+    {
+        *Value = (*Value * Radix) + LexDigitValue(*p);
+        p++;
+        count++;
+    }
+
+    return count;
+}
+
+//Scans 0x1F, 1Fh, 31 and H'1F' style numbers
+static void LexScanNumber(ASM_LEXER *Lexer, ASM_TOKEN *Token)
+{
+    const char *p = Token->Start;
+    int digits;
+
+    if (p + 1 < Lexer->End && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+    {
+        digits = LexScanDigits(Lexer, p + 2, 16, &Token->Value);
+        p += 2 + digits;
+        if (digits == 0)
+            Token->Type = TOK_ERROR;
+    }
+    else
+    {
+        //Try a trailing H suffix before settling on decimal
+        digits = LexScanDigits(Lexer, p, 16, &Token->Value);
+        if (p + digits < Lexer->End && (p[digits] == 'h' || p[digits] == 'H'))
+        {
+            p += digits + 1;
+        }
+        else
+        {
+            p += LexScanDigits(Lexer, p, 10, &Token->Value);
+        }
+    }
+
+    //Numbers can't run into identifiers
+    if (p < Lexer->End && LexIsIdentChar(*p))
+    {
+        Token->Type = TOK_ERROR;
+        while (p < Lexer->End && LexIsIdentChar(*p))
+            p++;
+    }
+
+    Lexer->Cursor = p;
+}
+
+//Scans radix-quoted numbers like B'0101' and D'10'
+static int LexScanQuoted(ASM_LEXER *Lexer, ASM_TOKEN *Token)
+{
+    const char *p = Token->Start;
+    int radix, digits;
+
+    if (p + 2 >= Lexer->End || p[1] != '\'')
+        return 0;
+
+    switch (toupper((unsigned char)p[0]))
+    {
+        case 'B': radix = 2; break;
+        case 'O': radix = 8; break;
+        case 'D': radix = 10; break;
+        case 'H': radix = 16; break;
+        default: return 0;
+    }
+
+    Token->Type = TOK_NUMBER;
+    digits = LexScanDigits(Lexer, p + 2, radix, &Token->Value);
+    p += 2 + digits;
+    if (digits == 0 || p >= Lexer->End || *p != '\'')
+    {
+        Token->Type = TOK_ERROR;
+        Lexer->Cursor = p;
+        return 1;
+    }
+
+    Lexer->Cursor = p + 1;
+    return 1;
+}
+
+void LexNext(ASM_LEXER *Lexer, ASM_TOKEN *Token)
+{
+    const char *p = Lexer->Cursor;
+
+    //Skip whitespace and comments
+    while (p < Lexer->End)
+    {
+        if (*p == ';')
+        {
+            while (p < Lexer->End && *p != '\n')
+                p++;
+        }
+        else if (*p != '\n' && (isspace((unsigned char)*p) || *p == 0))
+        {
+            p++;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    Token->Start = p;
+    Token->Length = 1;
+    Token->Line = Lexer->Line;
+    Token->Column = (int)(p - Lexer->LineStart) + 1;
+    Token->Value = 0;
+
+    if (p >= Lexer->End)
+    {
+        Token->Type = TOK_EOF;
+        Token->Length = 0;
+        Lexer->Cursor = p;
+        return;
+    }
+
+    Lexer->Cursor = p + 1;
+    switch (*p)
+    {
+        case '\n':
+            Token->Type = TOK_NEWLINE;
+            Lexer->Line++;
+            Lexer->LineStart = p + 1;
+            return;
+        case ',':
+            Token->Type = TOK_COMMA;
+            return;
+        case ':':
+            Token->Type = TOK_COLON;
+            return;
+        case '+':
+            Token->Type = TOK_PLUS;
+            return;
+        case '-':
+            Token->Type = TOK_MINUS;
+            return;
+    }
+
+    if (isdigit((unsigned char)*p))
+    {
+        Token->Type = TOK_NUMBER;
+        LexScanNumber(Lexer, Token);
+    }
+    else if (isalpha((unsigned char)*p) || *p == '_')
+    {
+        if (!LexScanQuoted(Lexer, Token))
+        {
+            Token->Type = TOK_IDENT;
+            while (p < Lexer->End && LexIsIdentChar(*p))
+                p++;
+            Lexer->Cursor = p;
+        }
+    }
+    else
+    {
+        Token->Type = TOK_ERROR;
+    }
+
+    Token->Length = (int)(Lexer->Cursor - Token->Start);
+}
+
+//Case-insensitive compare of a token against an upper case keyword
+int LexTokenEquals(const ASM_TOKEN *Token, const char *Keyword)
+{
+    int i;
+
+    if (Token->Type != TOK_IDENT)
+        return 0;
+
+    for (i = 0; i < Token->Length; i++)
+    {
+        if (toupper((unsigned char)Token->Start[i]) != Keyword[i])
+            return 0;
+    }
+
+    return Keyword[i] == 0;
+}
+
+int LexMapSource(const char *Path, ASM_SOURCE *Source)
+{
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(Path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    //Empty files can't be mapped
+    if (st.st_size == 0)
+    {
+        close(fd);
+        Source->Buffer = "";
+        Source->Size = 0;
+        Source->Mapped = 0;
+        return 0;
+    }
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    //The tokenizer walks the file front to back exactly once
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    Source->Buffer = map;
+    Source->Size = (size_t)st.st_size;
+    Source->Mapped = 1;
+
+    return 0;
+}
+
+void LexUnmapSource(ASM_SOURCE *Source)
+{
+    if (Source->Mapped)
+    {
+        munmap((void *)Source->Buffer, Source->Size);
+    }
+
+    Source->Buffer = NULL;
+    Source->Size = 0;
+    Source->Mapped = 0;
+}
@@ -0,0 +1,59 @@
+//
+//  lexer.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#ifndef PIC16F84A_Emulator_lexer_h
+#define PIC16F84A_Emulator_lexer_h
+
+#include <stddef.h>
+
+//Token types
+#define TOK_EOF      0x00
+#define TOK_NEWLINE  0x01
+#define TOK_IDENT    0x02
+#define TOK_NUMBER   0x03
+#define TOK_COMMA    0x04
+#define TOK_COLON    0x05
+#define TOK_PLUS     0x06
+#define TOK_MINUS    0x07
+#define TOK_ERROR    0x08
+
+//A token is a view into the source buffer (nothing is copied)
+typedef struct _ASM_TOKEN {
+    int Type;
+    const char *Start;
+    int Length;
+    int Line;
+    int Column;
+    unsigned int Value;     //Numeric value of TOK_NUMBER
+} ASM_TOKEN;
+
+//This struct represents the tokenizer's position in the source
+typedef struct _ASM_LEXER {
+    const char *Cursor;
+    const char *End;
+    const char *LineStart;
+    int Line;
+} ASM_LEXER;
+
+//A source file mapped into memory
+typedef struct _ASM_SOURCE {
+    const char *Buffer;
+    size_t Size;
+    int Mapped;
+} ASM_SOURCE;
+
+void LexInitialize(ASM_LEXER *Lexer, const char *Buffer, size_t Size);
+void LexNext(ASM_LEXER *Lexer, ASM_TOKEN *Token);
+
+int LexTokenEquals(const ASM_TOKEN *Token, const char *Keyword);
+
+int LexMapSource(const char *Path, ASM_SOURCE *Source);
+void LexUnmapSource(ASM_SOURCE *Source);
+
+#endif
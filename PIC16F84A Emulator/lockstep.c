@@ -0,0 +1,262 @@
+//
+//  lockstep.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lockstep.h"
+#include "isa.h"
+#include "regs.h"
+
+//Decodes every fetch with CpuExecuteOpcode
+static void LockstepAttachReference(PIC_CPU *Cpu, const PIC_IMAGE *Image)
+{
+    CpuAttachDecoded(Cpu, NULL);
+}
+
+//Runs out of the image's predecoded stream with CpuExecuteDecoded
+static void LockstepAttachDecoded(PIC_CPU *Cpu, const PIC_IMAGE *Image)
+{
+    CpuAttachDecoded(Cpu, Image->Decoded);
+}
+
+//Adds the image's superinstructions on top of the predecoded stream
+static void LockstepAttachFused(PIC_CPU *Cpu, const PIC_IMAGE *Image)
+{
+    CpuAttachDecoded(Cpu, Image->Decoded);
+    CpuAttachFused(Cpu, Image->Fused);
+}
+
+//The first entry is the reference every other engine is checked against
+static const LOCKSTEP_ENGINE LockstepEngines[] =
+{
+    {"reference", LockstepAttachReference},
+    {"decoded", LockstepAttachDecoded},
+    {"fused", LockstepAttachFused},
+    {NULL, NULL}
+};
+
+const LOCKSTEP_ENGINE *LockstepFindEngine(const char *Name)
+{
+    int i;
+
+    for (i = 0; LockstepEngines[i].Name != NULL; i++)
+    {
+        if (strcmp(LockstepEngines[i].Name, Name) == 0)
+            return &LockstepEngines[i];
+    }
+
+    return NULL;
+}
+
+void LockstepPrintEngines(void)
+{
+    int i;
+
+    for (i = 0; LockstepEngines[i].Name != NULL; i++)
+    {
+        printf("%s%s", (i != 0) ? " " : "", LockstepEngines[i].Name);
+    }
+    printf("\n");
+}
+
+//Both engines start from the same fully defined state
+static void LockstepReset(PIC_CPU *Cpu, const PIC_IMAGE *Image, const LOCKSTEP_ENGINE *Engine)
+{
+    memset(Cpu, 0, sizeof(PIC_CPU));
+    CpuInitializeCore(Cpu);
+    CpuSetTrace(Cpu, 0);
+
+    CpuAttachProgram(Cpu, Image->ProgMem, NULL);
+    memcpy(Cpu->Eeprom, Image->Eeprom, EEPROM_SIZE);
+
+    Engine->Attach(Cpu, Image);
+}
+
+//Compares W, STATUS, PC, cycles, the stack and hashes of the register file and EEPROM
+static int LockstepMatch(PIC_CPU *Reference, int ReferenceErr, unsigned int ReferenceRetired,
+                         PIC_CPU *Candidate, int CandidateErr, unsigned int CandidateRetired)
+{
+    if (ReferenceErr != CandidateErr || ReferenceRetired != CandidateRetired)
+        return 0;
+
+    if (Reference->W != Candidate->W ||
+        Reference->Regs.STATUS != Candidate->Regs.STATUS ||
+        CpuGetPC(Reference) != CpuGetPC(Candidate) ||
+        Reference->Cycles != Candidate->Cycles)
+        return 0;
+
+    if (Reference->Stack.NextTop != Candidate->Stack.NextTop ||
+        memcmp(Reference->Stack.Entries, Candidate->Stack.Entries, sizeof(Reference->Stack.Entries)) != 0)
+        return 0;
+
+    if (ImgHash(&Reference->Regs, sizeof(REGISTER_FILE)) != ImgHash(&Candidate->Regs, sizeof(REGISTER_FILE)) ||
+        ImgHash(Reference->Eeprom, EEPROM_SIZE) != ImgHash(Candidate->Eeprom, EEPROM_SIZE))
+        return 0;
+
+    return 1;
+}
+
+//Runs both engines Steps instructions from a checkpoint and compares them
+static int LockstepProbe(const PIC_CPU *ReferenceStart, const PIC_CPU *CandidateStart,
+                         unsigned int Steps, LOCKSTEP_RESULT *Result, unsigned int *Retired)
+{
+    unsigned int referenceRetired, candidateRetired;
+
+    Result->Reference = *ReferenceStart;
+    Result->Candidate = *CandidateStart;
+
+    Result->ReferenceErr = CpuRun(&Result->Reference, Steps, &referenceRetired);
+    Result->CandidateErr = CpuRun(&Result->Candidate, Steps, &candidateRetired);
+    *Retired = referenceRetired;
+
+    return LockstepMatch(&Result->Reference, Result->ReferenceErr, referenceRetired,
+                         &Result->Candidate, Result->CandidateErr, candidateRetired);
+}
+
+//Runs Image on the reference path and Engine side by side for up to Count
+//instructions (0 runs until both stop). Result->Diverged is set on the
+//first mismatch and Result holds both states right after it.
+int LockstepRun(const PIC_IMAGE *Image, const LOCKSTEP_ENGINE *Engine,
+                unsigned long long Count, unsigned int Interval, LOCKSTEP_RESULT *Result)
+{
+    PIC_CPU reference, candidate;
+    unsigned int slice, good, bad, mid, retired;
+
+    if (Interval == 0)
+        Interval = LOCKSTEP_DEFAULT_INTERVAL;
+
+    memset(Result, 0, sizeof(LOCKSTEP_RESULT));
+
+    LockstepReset(&reference, Image, &LockstepEngines[0]);
+    LockstepReset(&candidate, Image, Engine);
+
+    while (Count == 0 || Result->Retired < Count)
+    {
+        slice = Interval;
+        if (Count != 0 && Count - Result->Retired < slice)
+            slice = (unsigned int)(Count - Result->Retired);
+
+        if (!LockstepProbe(&reference, &candidate, slice, Result, &retired))
+        {
+            //Bisect the interval (nothing differed at 'good' steps, something did at 'bad')
+            good = 0;
+            bad = slice;
+            while (bad - good > 1)
+            {
+                mid = good + (bad - good) / 2;
+                if (LockstepProbe(&reference, &candidate, mid, Result, &retired))
+                    good = mid;
+                else
+                    bad = mid;
+            }
+
+            //Note the instruction, then leave the states right after it
+            LockstepProbe(&reference, &candidate, good, Result, &retired);
+            Result->DivergencePC = CpuGetPC(&Result->Reference);
+            Result->DivergenceOpcode = CpuGetOpcode(&Result->Reference, Result->DivergencePC);
+            LockstepProbe(&reference, &candidate, bad, Result, &retired);
+
+            Result->Retired += good;
+            Result->Diverged = 1;
+            return 0;
+        }
+
+        //Both agree, so this is the new checkpoint
+        reference = Result->Reference;
+        candidate = Result->Candidate;
+        Result->Retired += retired;
+
+        //Both stopped on the same instruction
+        if (Result->ReferenceErr < 0)
+        {
+            Result->StopReason = Result->ReferenceErr;
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+static const char *LockstepStopName(int Err)
+{
+    switch (Err)
+    {
+        case 0:
+            return "running";
+        case CPU_ERR_INVALID:
+            return "invalid opcode";
+        case CPU_ERR_HALTED:
+            return "halted";
+        default:
+            return "stopped";
+    }
+}
+
+static void LockstepDumpRow(const char *Name, unsigned int Reference, unsigned int Candidate)
+{
+    printf("%-10s 0x%-10x 0x%-10x%s\n", Name, Reference, Candidate,
+           (Reference != Candidate) ? " <--" : "");
+}
+
+//Prints both states side by side, marking every field that differs
+void LockstepDumpDivergence(const LOCKSTEP_RESULT *Result, const char *EngineName)
+{
+    PIC_CPU *reference = (PIC_CPU *)&Result->Reference;
+    PIC_CPU *candidate = (PIC_CPU *)&Result->Candidate;
+    unsigned char *referenceFile, *candidateFile;
+    const char *name;
+    char name2[16], text[0x40];
+    int i;
+
+    IsaFormat(Result->DivergenceOpcode, text, sizeof(text));
+    printf("Diverged at instruction %llu (0x%03x: %s)\n", Result->Retired, Result->DivergencePC, text);
+    printf("%-10s %-12s %-12s\n", "", "reference", EngineName);
+    printf("%-10s %-12s %-12s%s\n", "stop", LockstepStopName(Result->ReferenceErr),
+           LockstepStopName(Result->CandidateErr),
+           (Result->ReferenceErr != Result->CandidateErr) ? " <--" : "");
+    LockstepDumpRow("PC", CpuGetPC(reference), CpuGetPC(candidate));
+    LockstepDumpRow("W", reference->W, candidate->W);
+    LockstepDumpRow("STATUS", reference->Regs.STATUS, candidate->Regs.STATUS);
+    LockstepDumpRow("cycles", (unsigned int)reference->Cycles, (unsigned int)candidate->Cycles);
+    LockstepDumpRow("SP", reference->Stack.NextTop, candidate->Stack.NextTop);
+    for (i = 0; i < PIC_STACK_ENTRIES; i++)
+    {
+        snprintf(name2, sizeof(name2), "STK%d", i);
+        LockstepDumpRow(name2, reference->Stack.Entries[i], candidate->Stack.Entries[i]);
+    }
+
+    //Only the file registers that differ (STATUS is already shown)
+    for (i = 0; i < 0x100; i++)
+    {
+        referenceFile = RegsFilePointer(&reference->Regs, (unsigned char)i);
+        candidateFile = RegsFilePointer(&candidate->Regs, (unsigned char)i);
+        if (referenceFile == NULL || RegsCanonicalAddress((unsigned char)i) != i ||
+            i == REG_STATUS || *referenceFile == *candidateFile)
+            continue;
+
+        name = RegsGetRegisterName((unsigned char)i);
+        if (name == NULL)
+        {
+            snprintf(name2, sizeof(name2), "0x%02x", i);
+            name = name2;
+        }
+
+        LockstepDumpRow(name, *referenceFile, *candidateFile);
+    }
+
+    for (i = 0; i < EEPROM_SIZE; i++)
+    {
+        if (reference->Eeprom[i] != candidate->Eeprom[i])
+        {
+            snprintf(name2, sizeof(name2), "EE 0x%02x", i);
+            LockstepDumpRow(name2, reference->Eeprom[i], candidate->Eeprom[i]);
+        }
+    }
+}
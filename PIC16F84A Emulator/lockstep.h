@@ -0,0 +1,53 @@
+//
+//  lockstep.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Differential testing of execution engines. A candidate engine runs
+//  next to the reference fetch-and-decode path and their architectural
+//  state is compared at regular checkpoints. After a mismatch the last
+//  interval is bisected down to the first instruction that differs.
+//
+
+#ifndef PIC16F84A_Emulator_lockstep_h
+#define PIC16F84A_Emulator_lockstep_h
+
+#include "cpu.h"
+#include "image.h"
+
+//Instructions between checkpoints by default
+#define LOCKSTEP_DEFAULT_INTERVAL 0x1000
+
+//An execution engine: prepares a freshly reset CPU to run Image.
+//New engines are added to LockstepEngines in lockstep.c.
+typedef struct _LOCKSTEP_ENGINE {
+    const char *Name;
+    void (*Attach)(PIC_CPU *Cpu, const PIC_IMAGE *Image);
+} LOCKSTEP_ENGINE;
+
+//Outcome of one lockstep run
+typedef struct _LOCKSTEP_RESULT {
+    unsigned long long Retired;     //Instructions both engines agreed on
+    int Diverged;
+    int StopReason;                 //CPU_ERR_* both engines stopped with (or 0)
+
+    //The first differing instruction and the states right after it
+    unsigned short DivergencePC;
+    unsigned short DivergenceOpcode;
+    PIC_CPU Reference;
+    PIC_CPU Candidate;
+    int ReferenceErr;
+    int CandidateErr;
+} LOCKSTEP_RESULT;
+
+const LOCKSTEP_ENGINE *LockstepFindEngine(const char *Name);
+void LockstepPrintEngines(void);
+
+int LockstepRun(const PIC_IMAGE *Image, const LOCKSTEP_ENGINE *Engine,
+                unsigned long long Count, unsigned int Interval, LOCKSTEP_RESULT *Result);
+void LockstepDumpDivergence(const LOCKSTEP_RESULT *Result, const char *EngineName);
+
+#endif
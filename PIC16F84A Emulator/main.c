@@ -9,21 +9,423 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 
+#include "assembler.h"
+#include "debug.h"
+#include "disasm.h"
 #include "emu.h"
+#include "lexer.h"
+#include "net.h"
 #include "opcode.h"
+#include "sweep.h"
+#include "wcet.h"
+
+//Parses the options after the file name in A and B modes
+static int MainParseOptions(int argc, const char *argv[], EMU_OPTIONS *Options)
+{
+    static const char *registers[VCD_MAX_SIGNALS];
+    static const char *breakpoints[PROGRAM_MEM_INSTRUCTIONS];
+    static const char *watches[DBG_DATA_SIZE];
+    int i;
+
+    memset(Options, 0, sizeof(*Options));
+    Options->VcdRegisters = registers;
+    Options->Breakpoints = breakpoints;
+    Options->Watches = watches;
+
+    for (i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-q") == 0)
+        {
+            Options->Quiet = 1;
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            Options->MaxInstructions = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-vcd") == 0 && i + 1 < argc)
+        {
+            Options->VcdPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc &&
+                 Options->VcdRegisterCount < VCD_MAX_SIGNALS)
+        {
+            registers[Options->VcdRegisterCount++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc &&
+                 Options->BreakpointCount < PROGRAM_MEM_INSTRUCTIONS)
+        {
+            breakpoints[Options->BreakpointCount++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "-watch") == 0 && i + 1 < argc &&
+                 Options->WatchCount < DBG_DATA_SIZE)
+        {
+            watches[Options->WatchCount++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "-stats") == 0 && i + 1 < argc)
+        {
+            Options->StatsPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-cover") == 0 && i + 1 < argc)
+        {
+            Options->CoveragePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-gdb") == 0 && i + 1 < argc)
+        {
+            Options->GdbListen = argv[++i];
+        }
+        else if (strcmp(argv[i], "-fork") == 0 && i + 1 < argc)
+        {
+            Options->ForkCheckpoint = argv[++i];
+        }
+        else if (strcmp(argv[i], "-clock") == 0 && i + 1 < argc)
+        {
+            Options->OscillatorHz = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-speed") == 0 && i + 1 < argc)
+        {
+            Options->Speed = strtod(argv[++i], NULL);
+        }
+        else
+        {
+            printf("Unknown option: %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//Parses TARGET[@at]=v1,v2,... or TARGET[@at]=lo..hi into an axis
+static int MainParseAxis(const char *Arg, SWEEP_AXIS *Axis, unsigned char *Values)
+{
+    char target[32];
+    const char *equals, *at, *next;
+    char *end;
+    unsigned long lo, hi;
+    size_t length;
+
+    equals = strchr(Arg, '=');
+    if (equals == NULL)
+        return -1;
+
+    at = memchr(Arg, '@', equals - Arg);
+    length = ((at != NULL) ? at : equals) - Arg;
+    if (length == 0 || length >= sizeof(target))
+        return -1;
+
+    memcpy(target, Arg, length);
+    target[length] = 0;
+
+    //W, a register name or a file address
+    if (strcasecmp(target, "W") == 0)
+        Axis->Target = SWEEP_TARGET_W;
+    else if ((Axis->Target = RegsLookupRegisterName(target)) < 0)
+    {
+        Axis->Target = (int)strtol(target, &end, 0);
+        if (*end != 0 || Axis->Target < 0 || Axis->Target > 0xFF)
+            return -1;
+    }
+
+    Axis->At = (at != NULL) ? strtoull(at + 1, NULL, 0) : 0;
+    Axis->Values = Values;
+    Axis->ValueCount = 0;
+
+    lo = strtoul(equals + 1, &end, 0);
+    if (strncmp(end, "..", 2) == 0)
+    {
+        hi = strtoul(end + 2, &end, 0);
+        if (*end != 0 || lo > hi || hi > 0xFF)
+            return -1;
+
+        while (lo <= hi)
+            Values[Axis->ValueCount++] = (unsigned char)lo++;
+
+        return 0;
+    }
+
+    for (next = equals + 1; Axis->ValueCount < 0x100; next = end + 1)
+    {
+        lo = strtoul(next, &end, 0);
+        if (end == next || lo > 0xFF)
+            return -1;
+
+        Values[Axis->ValueCount++] = (unsigned char)lo;
+        if (*end != ',')
+            break;
+    }
+
+    return (*end == 0) ? 0 : -1;
+}
+
+//Assembly sources are assembled into Image, anything else goes through the image loader
+static PIC_IMAGE *MainLoadSweepImage(const char *Path, PIC_IMAGE *Image)
+{
+    ASM_CONTEXT context;
+    ASM_PROGRAM *program;
+    ASM_SOURCE source;
+    const char *ext = strrchr(Path, '.');
+    int err;
+
+    if (ext == NULL || (strcasecmp(ext, ".asm") != 0 && strcasecmp(ext, ".s") != 0))
+        return ImgLoadFile(Path);
+
+    if (LexMapSource(Path, &source) < 0)
+        return NULL;
+
+    if (AsmInitializeContext(&context) < 0)
+    {
+        LexUnmapSource(&source);
+        return NULL;
+    }
+
+    program = AsmAssembleAscii(&context, source.Buffer, source.Size);
+    AsmDestroyContext(&context);
+    LexUnmapSource(&source);
+    if (program == NULL)
+        return NULL;
+
+    err = ImgParseRaw(Image, (const unsigned char *)program->Opcodes, program->OpcodeCount * sizeof(PIC_OPCODE), 0);
+    free(program);
+
+    return (err < 0) ? NULL : Image;
+}
+
+//Parameter sweep mode: PIC-EMU P <file> [-n count] [-threads N] [-axis ...] [-r register] -o results.csv
+static int MainSweep(int argc, const char *argv[])
+{
+    static unsigned char values[SWEEP_MAX_AXES][0x100];
+    static int registers[SWEEP_FILE_SIZE];
+    static PIC_IMAGE assembled;
+    static SWEEP sweep;
+    SWEEP_RESULTS results;
+    PIC_IMAGE *image;
+    const char *output = NULL;
+    int registerCount = 0;
+    int i, err;
+
+    for (i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            sweep.MaxInstructions = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            sweep.ThreadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-axis") == 0 && i + 1 < argc &&
+                 sweep.AxisCount < SWEEP_MAX_AXES)
+        {
+            if (MainParseAxis(argv[++i], &sweep.Axes[sweep.AxisCount], values[sweep.AxisCount]) < 0)
+            {
+                printf("Bad sweep axis: %s\n", argv[i]);
+                return -1;
+            }
+            sweep.AxisCount++;
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc &&
+                 registerCount < SWEEP_FILE_SIZE)
+        {
+            registers[registerCount] = RegsLookupRegisterName(argv[++i]);
+            if (registers[registerCount] < 0)
+                registers[registerCount] = (int)strtol(argv[i], NULL, 0) & 0xFF;
+            registerCount++;
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else
+        {
+            printf("Unknown option: %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    if (output == NULL)
+    {
+        printf("Sweep mode needs -o <results.csv>\n");
+        return -1;
+    }
+
+    image = MainLoadSweepImage(argv[2], &assembled);
+    if (image == NULL)
+    {
+        printf("Failed to load the input file\n");
+        return -1;
+    }
+
+    sweep.Image = image;
+
+    printf("PIC Emulator - %s\n", argv[2]);
+    printf("Sweep Mode: %u variations\n", SweepVariationCount(&sweep));
+
+    err = SweepRun(&sweep, &results);
+    if (image != &assembled)
+        ImgRelease(image);
+    if (err < 0)
+        return err;
+
+    err = SweepWriteCsv(&sweep, &results, registers, registerCount, output);
+    SweepFreeResults(&results);
+
+    return err;
+}
+
+//Board mode: PIC-EMU N <board> [-c cycles] [-quantum Q] [-threads N] [-vcd file.vcd]
+static int MainBoard(int argc, const char *argv[])
+{
+    unsigned long long cycles = 0x100000, quantum = NET_DEFAULT_QUANTUM;
+    const char *vcd = NULL;
+    int threadCount = 0;
+    NET_BOARD *board;
+    int i, err;
+
+    for (i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            cycles = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-quantum") == 0 && i + 1 < argc)
+        {
+            quantum = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            threadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-vcd") == 0 && i + 1 < argc)
+        {
+            vcd = argv[++i];
+        }
+        else
+        {
+            printf("Unknown option: %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    board = NetLoadBoard(argv[2]);
+    if (board == NULL)
+        return -1;
+
+    if (vcd != NULL && NetOpenVcd(board, vcd) < 0)
+    {
+        NetDestroyBoard(board);
+        return -1;
+    }
+
+    printf("PIC Emulator - %s\n", argv[2]);
+    printf("Board Mode: %d devices, %d nets\n", board->DeviceCount, board->NetCount);
+
+    err = NetRun(board, cycles, quantum, threadCount);
+    if (err == 0)
+        NetPrintSummary(board);
+
+    NetDestroyBoard(board);
+
+    return err;
+}
+
+//Analysis mode: PIC-EMU W <file> prints worst-case cycles and stack depth
+static int MainAnalyze(const char *Path)
+{
+    static DIS_CONTEXT labels;
+    static WCET_REPORT report;
+    ASM_CONTEXT context;
+    ASM_PROGRAM *program = NULL;
+    ASM_SOURCE source;
+    PCF_FILE compiled;
+    PIC_IMAGE *image = NULL;
+    const PIC_OPCODE *progMem;
+    const char *ext = strrchr(Path, '.');
+    int count, err;
+
+    DisInitialize(&labels);
+
+    //Source and compiled files bring their labels along
+    if (ext != NULL && (strcasecmp(ext, ".asm") == 0 || strcasecmp(ext, ".s") == 0))
+    {
+        if (LexMapSource(Path, &source) < 0)
+        {
+            printf("Failed to open the input file\n");
+            return -1;
+        }
+
+        if (AsmInitializeContext(&context) < 0)
+        {
+            LexUnmapSource(&source);
+            return -1;
+        }
+
+        program = AsmAssembleAscii(&context, source.Buffer, source.Size);
+        LexUnmapSource(&source);
+        if (program == NULL)
+        {
+            AsmDestroyContext(&context);
+            return -1;
+        }
+
+        DisAddSymbolTable(&labels, &context.Symbols);
+        progMem = program->Opcodes;
+        count = program->OpcodeCount;
+    }
+    else if ((err = PcfMap(Path, &compiled)) == 0)
+    {
+        DisAddCompiledSymbols(&labels, &compiled);
+        progMem = compiled.ProgMem;
+        count = compiled.Header->WordCount;
+    }
+    else if (err == PCF_ERR_NOT_PCF && (image = ImgLoadFile(Path)) != NULL)
+    {
+        progMem = image->ProgMem;
+        count = image->WordCount;
+    }
+    else
+    {
+        printf("Failed to load the input file\n");
+        return -1;
+    }
+
+    err = WcetAnalyze(progMem, count, &report);
+    if (err == 0)
+    {
+        WcetPrintReport(&report, &labels);
+
+        //Let scripts fail a build on stack wraparound
+        if (report.StackDepth < 0 || report.StackDepth > PIC_STACK_ENTRIES)
+            err = 1;
+    }
+
+    if (program != NULL)
+    {
+        free(program);
+        AsmDestroyContext(&context);
+    }
+    else if (image != NULL)
+        ImgRelease(image);
+    else
+        PcfUnmap(&compiled);
+
+    return err;
+}
 
 int main(int argc, const char * argv[])
 {
 #define MAX_INPUT_LEN 32
-#define MAX_OPNAME_LEN 16
-    char opname[MAX_OPNAME_LEN], opstr[MAX_INPUT_LEN];
-    int op1, op2;
+    char opstr[MAX_INPUT_LEN];
     int err;
     EMU_STATE state;
-    unsigned char badops[PROGRAM_MEM_SIZE];
+    ASM_CONTEXT context;
+    EMU_OPTIONS options;
+    unsigned char badops[PROGRAM_MEM_INSTRUCTIONS * sizeof(PIC_OPCODE)];
 
     
     if (argc <= 1)
@@ -38,9 +440,16 @@ int main(int argc, const char * argv[])
             printf("Failed to initialize emulator\n");
             return err;
         }
+
+        err = AsmInitializeContext(&context);
+        if (err < 0)
+        {
+            printf("Failed to initialize the assembler context\n");
+            return err;
+        }
         
-        memset(badops, 0xFF, PROGRAM_MEM_SIZE);
-        err = CpuInitializeProgramMemory(&state.Cpu, badops, PROGRAM_MEM_SIZE);
+        memset(badops, 0xFF, sizeof(badops));
+        err = CpuInitializeProgramMemory(&state.Cpu, badops, sizeof(badops));
         if (err < 0)
         {
             printf("Failed to initialize program memory\n");
@@ -74,18 +483,13 @@ int main(int argc, const char * argv[])
                     }
                     else
                     {
-                        //Decode the string
-                        err = DecodeStringInput(&state.AsmContext, opstr, opname, &op1, &op2);
+                        //Assemble the line
+                        err = AsmAssembleLine(&context, opstr, strlen(opstr), &opcode);
                         if (err < 0)
                         {
                             //Invalid input
                             opcode = OP_INVALID;
                         }
-                        else
-                        {
-                            //Generate an opcode
-                            opcode = OpGenerateOpcode(opname, (char)op1, (char)op2);
-                        }
                     }
                 }
                 while (opcode == OP_INVALID);
@@ -100,72 +504,179 @@ int main(int argc, const char * argv[])
                 return err;
         }
     }
-    else
+    else if (argc < 3)
+    {
+        printf("Usage: %s [B|A|D|S] <file> [-q] [-n count] [-vcd file.vcd] [-r register] [-b addr[:cond]] [-watch addr[:rw]] [-stats file.csv] [-cover file.csv] [-gdb port|path] [-fork addr[:cond]] [-clock hz [-speed x]]...\n", argv[0]);
+        printf("       %s P <file> [-n count] [-threads N] [-axis target[@at]=v1,v2|lo..hi]... [-r register]... -o results.csv\n", argv[0]);
+        printf("       %s W <file>\n", argv[0]);
+        printf("       %s N <board> [-c cycles] [-quantum Q] [-threads N] [-vcd file.vcd]\n", argv[0]);
+        return -1;
+    }
+    //Parameter sweep mode has options of its own
+    else if (toupper(*argv[1]) == 'P')
+    {
+        return MainSweep(argc, argv);
+    }
+    //Static analysis doesn't run anything
+    else if (toupper(*argv[1]) == 'W')
+    {
+        return MainAnalyze(argv[2]);
+    }
+    //So does board simulation
+    else if (toupper(*argv[1]) == 'N')
+    {
+        return MainBoard(argc, argv);
+    }
+    else if (MainParseOptions(argc, argv, &options) < 0)
+    {
+        return -1;
+    }
+    //Binary mode (raw words or Intel HEX)
+    else if (toupper(*argv[1]) == 'B')
     {
-        FILE *f;
-        int size;
-        unsigned char *fbuffer;
+        PIC_IMAGE *image;
+        PCF_FILE compiled;
         
         printf("PIC Emulator - %s\n", argv[2]);
         
-        //Open the input file
-        f = fopen(argv[2], "r");
-        if (f == NULL)
+        //Precompiled files are mapped and run without decoding
+        err = PcfMap(argv[2], &compiled);
+        if (err == 0)
         {
-            printf("Failed to open the input file\n");
+            printf("Compiled Mode\n");
+            
+            err = EmuExecuteCompiled(&compiled, &options);
+            PcfUnmap(&compiled);
+            if (err < 0)
+            {
+                //Halts were already reported
+                if (err != CPU_ERR_HALTED)
+                    printf("Failed to execute bytecode\n");
+                return err;
+            }
+            
+            return 0;
+        }
+        else if (err != PCF_ERR_NOT_PCF)
+        {
+            printf("Failed to load the input file\n");
             return -1;
         }
         
-        //Grab file size
-        fseek(f, 0, SEEK_END);
-        size = (int)ftell(f);
-        rewind(f);
-        
-        //Allocate a buffer for the file contents
-        fbuffer = malloc(size);
-        if (!fbuffer)
+        //Load and decode the image
+        image = ImgLoadFile(argv[2]);
+        if (image == NULL)
+        {
+            printf("Failed to load the input file\n");
             return -1;
+        }
         
-        //Read in the file
-        fread(fbuffer, 1, size, f);
+        printf("Binary Mode\n");
 
-        //Rewind the file
-        rewind(f);
-        
-        //Initialize the emulator
-        err = EmuInitialize(&state);
+        //Execute the image
+        err = EmuExecuteImage(image, &options);
+        ImgRelease(image);
         if (err < 0)
         {
-            printf("Failed to initialize emulator\n");
+            //Halts were already reported
+            if (err != CPU_ERR_HALTED)
+                printf("Failed to execute bytecode\n");
             return err;
         }
+    }
+    //ASCII mode
+    else if (toupper(*argv[1]) == 'A')
+    {
+        ASM_SOURCE source;
+        
+        printf("PIC Emulator - %s\n", argv[2]);
         
-        //Binary mode
-        if (toupper(*argv[1]) == 'B')
+        //Map the source file (the assembler reads it in place)
+        err = LexMapSource(argv[2], &source);
+        if (err < 0)
         {
-            printf("Binary Mode\n");
+            printf("Failed to open the input file\n");
+            return -1;
+        }
+        
+        printf("ASCII Mode\n");
 
-            //Execute the bytecode
-            err = EmuExecuteBytecode(fbuffer, size);
-            if (err < 0)
-            {
+        //Assemble and execute the ASCII
+        err = EmuAssembleAndExecute(source.Buffer, source.Size, &options);
+        LexUnmapSource(&source);
+        if (err < 0)
+        {
+            //Halts were already reported
+            if (err != CPU_ERR_HALTED)
                 printf("Failed to execute bytecode\n");
-                return err;
-            }
+            return err;
         }
-        //ASCII mode
-        else if (toupper(*argv[1]) == 'A')
+    }
+
+    //Streaming mode (file or - for stdin)
+    else if (toupper(*argv[1]) == 'S')
+    {
+        static char output[0x10000];
+        int fd;
+
+        fd = strcmp(argv[2], "-") == 0 ? STDIN_FILENO : open(argv[2], O_RDONLY);
+        if (fd < 0)
         {
-            printf("ASCII Mode\n");
+            printf("Failed to open the input file\n");
+            return -1;
+        }
 
-            //Assemble and execute the ASCII
-            err = EmuAssembleAndExecute((char*)fbuffer, size);
-            if (err < 0)
-            {
-                printf("Failed to execute bytecode\n");
-                return err;
-            }
+        //Nobody is watching, so batch up the output too
+        setvbuf(stdout, output, _IOFBF, sizeof(output));
+
+        err = EmuExecuteStream(fd);
+        if (fd != STDIN_FILENO)
+            close(fd);
+        if (err < 0)
+            return err;
+    }
+    //Disassembly mode
+    else if (toupper(*argv[1]) == 'D')
+    {
+        static DIS_CONTEXT context;
+        static char listing[0x10000];
+        PCF_FILE compiled;
+        PIC_IMAGE *image = NULL;
+        const PIC_OPCODE *progMem;
+        int address, count, done;
+        size_t length;
+
+        DisInitialize(&context);
+
+        //Compiled files bring their labels along
+        err = PcfMap(argv[2], &compiled);
+        if (err == 0)
+        {
+            DisAddCompiledSymbols(&context, &compiled);
+            progMem = compiled.ProgMem;
+            count = compiled.Header->WordCount;
+        }
+        else if (err == PCF_ERR_NOT_PCF && (image = ImgLoadFile(argv[2])) != NULL)
+        {
+            progMem = image->ProgMem;
+            count = image->WordCount;
         }
+        else
+        {
+            printf("Failed to load the input file\n");
+            return -1;
+        }
+
+        for (address = 0; address < count; address += done)
+        {
+            length = DisAssembleImage(&context, progMem, address, count - address, listing, sizeof(listing), &done);
+            fwrite(listing, 1, length, stdout);
+        }
+
+        if (image != NULL)
+            ImgRelease(image);
+        else
+            PcfUnmap(&compiled);
     }
 
     return 0;
@@ -0,0 +1,668 @@
+//
+//  net.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "net.h"
+#include "assembler.h"
+#include "lexer.h"
+#include "regs.h"
+
+//Longest line accepted in a board file
+#define NET_LINE_MAX 0x200
+
+//Instructions per CpuRun call inside a quantum
+#define NET_RUN_SLICE 0x100000
+
+#define NET_VCD_ID(net) ((char)('!' + (net)))
+
+//Reusable barrier (pthread_barrier_t isn't available everywhere)
+typedef struct _NET_BARRIER {
+    pthread_mutex_t Lock;
+    pthread_cond_t Cond;
+    int Count;
+    int Waiting;
+    unsigned int Generation;
+} NET_BARRIER;
+
+//Shared by every worker during NetRun
+typedef struct _NET_RUN {
+    NET_BOARD *Board;
+    unsigned long long End;
+    unsigned long long Quantum;
+    int ThreadCount;
+    int Started;        //Start gate, set once ThreadCount is final
+    NET_BARRIER Barrier;
+} NET_RUN;
+
+typedef struct _NET_WORKER {
+    NET_RUN *Run;
+    int Index;
+} NET_WORKER;
+
+static void NetBarrierWait(NET_BARRIER *Barrier)
+{
+    unsigned int generation;
+
+    pthread_mutex_lock(&Barrier->Lock);
+
+    generation = Barrier->Generation;
+    if (++Barrier->Waiting == Barrier->Count)
+    {
+        Barrier->Waiting = 0;
+        Barrier->Generation++;
+        pthread_cond_broadcast(&Barrier->Cond);
+    }
+    else
+    {
+        while (generation == Barrier->Generation)
+            pthread_cond_wait(&Barrier->Cond, &Barrier->Lock);
+    }
+
+    pthread_mutex_unlock(&Barrier->Lock);
+}
+
+static int NetIsAssembly(const char *Path)
+{
+    const char *ext = strrchr(Path, '.');
+
+    return ext != NULL && (strcasecmp(ext, ".asm") == 0 || strcasecmp(ext, ".s") == 0);
+}
+
+//Assembly is assembled into an image of our own, anything else comes from the cache
+static int NetLoadFirmware(NET_DEVICE *Device, const char *Path)
+{
+    ASM_CONTEXT context;
+    ASM_PROGRAM *program;
+    ASM_SOURCE source;
+    int err;
+
+    if (!NetIsAssembly(Path))
+    {
+        Device->Image = ImgLoadFile(Path);
+        return (Device->Image != NULL) ? 0 : -1;
+    }
+
+    if (LexMapSource(Path, &source) < 0)
+    {
+        printf("Failed to open %s\n", Path);
+        return -1;
+    }
+
+    if (AsmInitializeContext(&context) < 0)
+    {
+        LexUnmapSource(&source);
+        return -1;
+    }
+
+    program = AsmAssembleAscii(&context, source.Buffer, source.Size);
+    AsmDestroyContext(&context);
+    LexUnmapSource(&source);
+    if (program == NULL)
+        return -1;
+
+    Device->Image = malloc(sizeof(PIC_IMAGE));
+    if (Device->Image == NULL)
+    {
+        free(program);
+        return -1;
+    }
+
+    Device->Owned = 1;
+    err = ImgParseRaw(Device->Image, (const unsigned char *)program->Opcodes, program->OpcodeCount * sizeof(PIC_OPCODE), 0);
+    free(program);
+
+    return err;
+}
+
+//Power-on state (W and SRAM start zeroed) so board runs are repeatable
+static void NetResetDevice(NET_DEVICE *Device)
+{
+    PIC_CPU *cpu = &Device->Cpu;
+
+    memset(cpu, 0, sizeof(PIC_CPU));
+    CpuInitializeCore(cpu);
+    CpuSetTrace(cpu, 0);
+    memcpy(cpu->Eeprom, Device->Image->Eeprom, EEPROM_SIZE);
+    CpuAttachProgram(cpu, Device->Image->ProgMem, Device->Image->Decoded);
+    CpuAttachFused(cpu, Device->Image->Fused);
+}
+
+static int NetFindDevice(const NET_BOARD *Board, const char *Name, size_t Length)
+{
+    int i;
+
+    for (i = 0; i < Board->DeviceCount; i++)
+    {
+        if (strlen(Board->Devices[i].Name) == Length && strncasecmp(Board->Devices[i].Name, Name, Length) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+//Parses "device.RA0".."device.RA4" and "device.RB0".."device.RB7"
+static int NetParsePin(const NET_BOARD *Board, const char *Text, NET_PIN *Pin)
+{
+    const char *dot = strchr(Text, '.');
+
+    if (dot == NULL || strlen(dot) != 4 || toupper((unsigned char)dot[1]) != 'R')
+        return -1;
+
+    Pin->Device = NetFindDevice(Board, Text, dot - Text);
+    if (Pin->Device < 0)
+        return -1;
+
+    Pin->Bit = (unsigned char)(dot[3] - '0');
+    switch (toupper((unsigned char)dot[2]))
+    {
+        case 'A':
+            Pin->Port = REG_PORTA;
+            return (dot[3] >= '0' && dot[3] <= '4') ? 0 : -1;
+        case 'B':
+            Pin->Port = REG_PORTB;
+            return (dot[3] >= '0' && dot[3] <= '7') ? 0 : -1;
+    }
+
+    return -1;
+}
+
+//Firmware paths are relative to the board file
+static void NetResolvePath(const char *BoardPath, const char *Path, char *Out, size_t Size)
+{
+    const char *slash = strrchr(BoardPath, '/');
+
+    if (Path[0] == '/' || slash == NULL)
+        snprintf(Out, Size, "%s", Path);
+    else
+        snprintf(Out, Size, "%.*s/%s", (int)(slash - BoardPath), BoardPath, Path);
+}
+
+static int NetParseDevice(NET_BOARD *Board, const char *BoardPath, char **Save)
+{
+    char path[NET_LINE_MAX];
+    NET_DEVICE *device;
+    char *name, *file;
+
+    name = strtok_r(NULL, " \t", Save);
+    file = strtok_r(NULL, " \t", Save);
+    if (name == NULL || file == NULL || strlen(name) >= NET_NAME_MAX || strchr(name, '.') != NULL)
+        return -1;
+
+    if (Board->DeviceCount == NET_MAX_DEVICES || NetFindDevice(Board, name, strlen(name)) >= 0)
+        return -1;
+
+    device = &Board->Devices[Board->DeviceCount];
+    strcpy(device->Name, name);
+
+    NetResolvePath(BoardPath, file, path, sizeof(path));
+    if (NetLoadFirmware(device, path) < 0)
+    {
+        printf("Failed to load %s\n", path);
+        if (device->Owned)
+            free(device->Image);
+        device->Image = NULL;
+        return -1;
+    }
+
+    NetResetDevice(device);
+    Board->DeviceCount++;
+
+    return 0;
+}
+
+static int NetParseNet(NET_BOARD *Board, char **Save)
+{
+    NET *net;
+    char *token;
+
+    token = strtok_r(NULL, " \t", Save);
+    if (token == NULL || strlen(token) >= NET_NAME_MAX || Board->NetCount == NET_MAX_NETS)
+        return -1;
+
+    net = &Board->Nets[Board->NetCount];
+    memset(net, 0, sizeof(NET));
+    strcpy(net->Name, token);
+
+    while ((token = strtok_r(NULL, " \t", Save)) != NULL)
+    {
+        if (strcasecmp(token, "pullup") == 0)
+            net->Model = NET_MODEL_PULLUP;
+        else if (strcasecmp(token, "pulldown") == 0)
+            net->Model = NET_MODEL_PULLDOWN;
+        else if (strcasecmp(token, "high") == 0)
+            net->Model = NET_MODEL_HIGH;
+        else if (strcasecmp(token, "low") == 0)
+            net->Model = NET_MODEL_LOW;
+        else if (strcasecmp(token, "clock") == 0)
+        {
+            token = strtok_r(NULL, " \t", Save);
+            if (token == NULL || (net->Period = strtoull(token, NULL, 0)) == 0)
+                return -1;
+            net->Model = NET_MODEL_CLOCK;
+        }
+        else if (net->PinCount == NET_MAX_PINS || NetParsePin(Board, token, &net->Pins[net->PinCount++]) < 0)
+        {
+            return -1;
+        }
+    }
+
+    Board->NetCount++;
+
+    return 0;
+}
+
+//Board files hold one statement per line:
+//  device <name> <firmware>
+//  net <name> <device>.R<port><bit>... [pullup|pulldown|high|low|clock <cycles>]
+NET_BOARD *NetLoadBoard(const char *Path)
+{
+    char line[NET_LINE_MAX];
+    NET_BOARD *board;
+    ASM_SOURCE source;
+    const char *next, *end;
+    char *token, *save;
+    int number = 0, err = 0;
+    size_t length;
+
+    if (LexMapSource(Path, &source) < 0)
+    {
+        printf("Failed to open %s\n", Path);
+        return NULL;
+    }
+
+    board = calloc(1, sizeof(NET_BOARD));
+    if (board == NULL)
+    {
+        LexUnmapSource(&source);
+        return NULL;
+    }
+
+    for (next = source.Buffer, end = source.Buffer + source.Size; next < end && err == 0; next += length + 1)
+    {
+        const char *newline = memchr(next, '\n', end - next);
+
+        length = (newline != NULL) ? (size_t)(newline - next) : (size_t)(end - next);
+        number++;
+
+        if (length >= sizeof(line))
+        {
+            printf("Line %d: Line is too long\n", number);
+            err = -1;
+            break;
+        }
+
+        memcpy(line, next, length);
+        line[length] = 0;
+
+        //Drop comments and line endings
+        line[strcspn(line, ";#\r")] = 0;
+
+        token = strtok_r(line, " \t", &save);
+        if (token == NULL)
+            continue;
+
+        if (strcasecmp(token, "device") == 0)
+            err = NetParseDevice(board, Path, &save);
+        else if (strcasecmp(token, "net") == 0)
+            err = NetParseNet(board, &save);
+        else
+            err = -1;
+
+        if (err < 0)
+            printf("Line %d: Bad %s statement\n", number, token);
+    }
+
+    LexUnmapSource(&source);
+
+    if (err < 0 || board->DeviceCount == 0)
+    {
+        if (err == 0)
+            printf("%s has no devices\n", Path);
+        NetDestroyBoard(board);
+        return NULL;
+    }
+
+    return board;
+}
+
+void NetDestroyBoard(NET_BOARD *Board)
+{
+    int i;
+
+    for (i = 0; i < Board->DeviceCount; i++)
+    {
+        CpuFreeProgramMemory(&Board->Devices[i].Cpu);
+
+        if (Board->Devices[i].Owned)
+            free(Board->Devices[i].Image);
+        else
+            ImgRelease(Board->Devices[i].Image);
+    }
+
+    if (Board->Vcd != NULL)
+        fclose(Board->Vcd);
+
+    free(Board);
+}
+
+int NetOpenVcd(NET_BOARD *Board, const char *Path)
+{
+    int i;
+
+    Board->Vcd = fopen(Path, "w");
+    if (Board->Vcd == NULL)
+    {
+        printf("Failed to create %s\n", Path);
+        return -1;
+    }
+
+    fprintf(Board->Vcd, "$version PIC16F84A Emulator $end\n");
+    fprintf(Board->Vcd, "$timescale 1us $end\n");
+    fprintf(Board->Vcd, "$scope module board $end\n");
+    for (i = 0; i < Board->NetCount; i++)
+    {
+        fprintf(Board->Vcd, "$var wire 1 %c %s $end\n", NET_VCD_ID(i), Board->Nets[i].Name);
+    }
+    fprintf(Board->Vcd, "$upscope $end\n$enddefinitions $end\n");
+
+    return 0;
+}
+
+//Open-drain RA4 can only pull low
+static int NetIsOpenDrain(const NET_PIN *Pin)
+{
+    return Pin->Port == REG_PORTA && Pin->Bit == 4;
+}
+
+static unsigned char NetTris(PIC_CPU *Cpu, const NET_PIN *Pin)
+{
+    return (Pin->Port == REG_PORTA) ? Cpu->Regs.TRISA : Cpu->Regs.TRISB;
+}
+
+//Works out a net's level from everything driving it
+static int NetResolve(NET_BOARD *Board, NET *Net)
+{
+    int drive0 = 0, drive1 = 0, i;
+    const NET_PIN *pin;
+    PIC_CPU *cpu;
+
+    for (i = 0; i < Net->PinCount; i++)
+    {
+        pin = &Net->Pins[i];
+        cpu = &Board->Devices[pin->Device].Cpu;
+
+        //Inputs don't drive
+        if ((NetTris(cpu, pin) >> pin->Bit) & 1)
+            continue;
+
+        if ((*RegsFilePointer(&cpu->Regs, pin->Port) >> pin->Bit) & 1)
+        {
+            if (!NetIsOpenDrain(pin))
+                drive1++;
+        }
+        else
+        {
+            drive0++;
+        }
+    }
+
+    switch (Net->Model)
+    {
+        case NET_MODEL_HIGH:
+            drive1++;
+            break;
+        case NET_MODEL_LOW:
+            drive0++;
+            break;
+        case NET_MODEL_CLOCK:
+            if ((Board->Now / Net->Period) & 1)
+                drive1++;
+            else
+                drive0++;
+            break;
+    }
+
+    if (drive0 != 0 && drive1 != 0)
+    {
+        Net->Contentions++;
+        return 0;
+    }
+    else if (drive0 != 0)
+        return 0;
+    else if (drive1 != 0)
+        return 1;
+    else if (Net->Model == NET_MODEL_PULLUP)
+        return 1;
+    else if (Net->Model == NET_MODEL_PULLDOWN)
+        return 0;
+
+    //Floating nets keep their last level
+    return Net->Level;
+}
+
+//Resolves every net and latches the levels into the input pins. Only
+//input bits are touched so output latches survive read-modify-writes.
+static void NetExchange(NET_BOARD *Board, int First)
+{
+    const NET_PIN *pin;
+    unsigned char *port;
+    int i, j, level, stamped = 0;
+    NET *net;
+
+    if (First && Board->Vcd != NULL)
+        fprintf(Board->Vcd, "#%llu\n$dumpvars\n", Board->Now);
+
+    for (i = 0; i < Board->NetCount; i++)
+    {
+        net = &Board->Nets[i];
+        level = NetResolve(Board, net);
+
+        if (level != net->Level || First)
+        {
+            if (!First)
+                net->Transitions++;
+
+            if (Board->Vcd != NULL)
+            {
+                if (!First && !stamped)
+                    fprintf(Board->Vcd, "#%llu\n", Board->Now);
+                stamped = 1;
+                fprintf(Board->Vcd, "%d%c\n", level, NET_VCD_ID(i));
+            }
+        }
+
+        net->Level = level;
+
+        for (j = 0; j < net->PinCount; j++)
+        {
+            pin = &net->Pins[j];
+            if (!((NetTris(&Board->Devices[pin->Device].Cpu, pin) >> pin->Bit) & 1))
+                continue;
+
+            port = RegsFilePointer(&Board->Devices[pin->Device].Cpu.Regs, pin->Port);
+            if (level)
+                *port |= (1 << pin->Bit);
+            else
+                *port &= ~(1 << pin->Bit);
+        }
+    }
+
+    if (First && Board->Vcd != NULL)
+        fprintf(Board->Vcd, "$end\n");
+}
+
+//Runs one device up to a cycle (at most one cycle past it)
+static void NetRunDevice(NET_DEVICE *Device, unsigned long long End)
+{
+    PIC_CPU *cpu = &Device->Cpu;
+    unsigned long long slice;
+    unsigned int retired;
+    int err;
+
+    while (Device->Stopped == 0 && cpu->Cycles < End)
+    {
+        //Instructions take one or two cycles
+        slice = (End - cpu->Cycles + 1) / 2;
+        if (slice > NET_RUN_SLICE)
+            slice = NET_RUN_SLICE;
+
+        err = CpuRun(cpu, (unsigned int)slice, &retired);
+        if (err < 0)
+            Device->Stopped = err;
+    }
+}
+
+static void *NetWorker(void *Context)
+{
+    NET_WORKER *worker = Context;
+    NET_RUN *run = worker->Run;
+    NET_BOARD *board = run->Board;
+    unsigned long long target;
+    int i;
+
+    //Wait until every thread that will take part has been started
+    pthread_mutex_lock(&run->Barrier.Lock);
+    while (!run->Started)
+        pthread_cond_wait(&run->Barrier.Cond, &run->Barrier.Lock);
+    pthread_mutex_unlock(&run->Barrier.Lock);
+
+    while (board->Now < run->End)
+    {
+        target = board->Now + run->Quantum;
+        if (target > run->End)
+            target = run->End;
+
+        //Devices only see each other's pins at quantum boundaries
+        for (i = worker->Index; i < board->DeviceCount; i += run->ThreadCount)
+        {
+            NetRunDevice(&board->Devices[i], target);
+        }
+
+        NetBarrierWait(&run->Barrier);
+
+        if (worker->Index == 0)
+        {
+            board->Now = target;
+            NetExchange(board, 0);
+        }
+
+        NetBarrierWait(&run->Barrier);
+    }
+
+    return NULL;
+}
+
+//Simulates the board for Cycles more instruction cycles
+int NetRun(NET_BOARD *Board, unsigned long long Cycles, unsigned long long Quantum, int ThreadCount)
+{
+    NET_RUN run;
+    NET_WORKER workers[NET_MAX_DEVICES];
+    pthread_t threads[NET_MAX_DEVICES];
+    int i, j;
+
+    if (Quantum == 0)
+        Quantum = NET_DEFAULT_QUANTUM;
+
+    if (ThreadCount <= 0)
+        ThreadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (ThreadCount > Board->DeviceCount)
+        ThreadCount = Board->DeviceCount;
+    if (ThreadCount <= 0)
+        ThreadCount = 1;
+
+    run.Board = Board;
+    run.End = Board->Now + Cycles;
+    run.Quantum = Quantum;
+    run.ThreadCount = ThreadCount;
+    run.Started = 0;
+    run.Barrier.Count = ThreadCount;
+    run.Barrier.Waiting = 0;
+    run.Barrier.Generation = 0;
+    pthread_mutex_init(&run.Barrier.Lock, NULL);
+    pthread_cond_init(&run.Barrier.Cond, NULL);
+
+    //Pins start out with the reset state of every driver
+    if (Board->Now == 0)
+        NetExchange(Board, 1);
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        workers[i].Run = &run;
+        workers[i].Index = i;
+    }
+
+    //The calling thread works too
+    for (i = 1; i < ThreadCount; i++)
+    {
+        if (pthread_create(&threads[i], NULL, NetWorker, &workers[i]) != 0)
+        {
+            printf("Failed to start worker threads, running with %d\n", i);
+            break;
+        }
+    }
+
+    //Every worker has to show up at each barrier, so the threads that did
+    //start split the devices between them before any of them runs
+    pthread_mutex_lock(&run.Barrier.Lock);
+    run.ThreadCount = i;
+    run.Barrier.Count = i;
+    run.Started = 1;
+    pthread_cond_broadcast(&run.Barrier.Cond);
+    pthread_mutex_unlock(&run.Barrier.Lock);
+
+    NetWorker(&workers[0]);
+
+    for (j = 1; j < run.ThreadCount; j++)
+    {
+        pthread_join(threads[j], NULL);
+    }
+
+    pthread_cond_destroy(&run.Barrier.Cond);
+    pthread_mutex_destroy(&run.Barrier.Lock);
+
+    if (Board->Vcd != NULL)
+        fflush(Board->Vcd);
+
+    return 0;
+}
+
+void NetPrintSummary(const NET_BOARD *Board)
+{
+    const NET_DEVICE *device;
+    const NET *net;
+    int i;
+
+    printf("Board at cycle %llu\n", Board->Now);
+
+    for (i = 0; i < Board->DeviceCount; i++)
+    {
+        device = &Board->Devices[i];
+        printf("%s: PC=0x%03x W=0x%02x PORTA=0x%02x PORTB=0x%02x cycles=%llu %s\n", device->Name,
+               CpuGetPC((PIC_CPU *)&device->Cpu), device->Cpu.W, device->Cpu.Regs.PORTA, device->Cpu.Regs.PORTB,
+               device->Cpu.Cycles,
+               (device->Stopped == CPU_ERR_HALTED) ? "halted" :
+               (device->Stopped == CPU_ERR_INVALID) ? "invalid opcode" : "running");
+    }
+
+    for (i = 0; i < Board->NetCount; i++)
+    {
+        net = &Board->Nets[i];
+        printf("%s: %d (%llu transitions", net->Name, net->Level, net->Transitions);
+        if (net->Contentions != 0)
+            printf(", %llu quanta in contention", net->Contentions);
+        printf(")\n");
+    }
+}
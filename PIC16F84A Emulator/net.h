@@ -0,0 +1,82 @@
+//
+//  net.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Board-level co-simulation. Several CPUs run in parallel for a fixed
+//  number of cycles, then meet at a barrier where every net is resolved
+//  from the pins driving it and the levels are latched into the pins
+//  reading it. Inputs therefore lag outputs by at most one quantum.
+//
+
+#ifndef PIC16F84A_Emulator_net_h
+#define PIC16F84A_Emulator_net_h
+
+#include <stdio.h>
+
+#include "cpu.h"
+#include "image.h"
+
+#define NET_MAX_DEVICES   0x10
+#define NET_MAX_NETS      0x40
+#define NET_MAX_PINS      0x10
+#define NET_NAME_MAX      0x20
+
+//Cycles between pin exchanges unless the caller picks something else
+#define NET_DEFAULT_QUANTUM 0x10
+
+//Host-side models that can sit on a net
+#define NET_MODEL_NONE      0
+#define NET_MODEL_PULLUP    1   //Reads 1 when nothing drives the net
+#define NET_MODEL_PULLDOWN  2
+#define NET_MODEL_HIGH      3   //Always drives 1
+#define NET_MODEL_LOW       4
+#define NET_MODEL_CLOCK     5   //Drives a square wave, Period cycles per half
+
+//One device pin
+typedef struct _NET_PIN {
+    int Device;
+    unsigned char Port;             //REG_PORTA or REG_PORTB
+    unsigned char Bit;
+} NET_PIN;
+
+typedef struct _NET {
+    char Name[NET_NAME_MAX];
+    int PinCount;
+    NET_PIN Pins[NET_MAX_PINS];
+    int Model;
+    unsigned long long Period;
+    int Level;
+    unsigned long long Transitions;
+    unsigned long long Contentions; //Quanta with pins driving both levels
+} NET;
+
+typedef struct _NET_DEVICE {
+    char Name[NET_NAME_MAX];
+    PIC_CPU Cpu;
+    PIC_IMAGE *Image;
+    int Owned;                      //Image was assembled here (not from the cache)
+    int Stopped;                    //CPU_ERR_* once it halts
+} NET_DEVICE;
+
+//This struct represents a whole board
+typedef struct _NET_BOARD {
+    int DeviceCount;
+    NET_DEVICE Devices[NET_MAX_DEVICES];
+    int NetCount;
+    NET Nets[NET_MAX_NETS];
+    unsigned long long Now;         //Cycles simulated so far
+    FILE *Vcd;                      //Net levels (NULL if not recording)
+} NET_BOARD;
+
+NET_BOARD *NetLoadBoard(const char *Path);
+void NetDestroyBoard(NET_BOARD *Board);
+
+int NetOpenVcd(NET_BOARD *Board, const char *Path);
+int NetRun(NET_BOARD *Board, unsigned long long Cycles, unsigned long long Quantum, int ThreadCount);
+void NetPrintSummary(const NET_BOARD *Board);
+
+#endif
@@ -0,0 +1,97 @@
+//
+//  pace.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "pace.h"
+
+//Every instruction cycle is 4 oscillator periods
+#define PACE_CLOCKS_PER_CYCLE 4
+
+#define PACE_NS_PER_SEC 1000000000ULL
+
+static unsigned long long PaceToNs(const struct timespec *Time)
+{
+    return (unsigned long long)Time->tv_sec * PACE_NS_PER_SEC + Time->tv_nsec;
+}
+
+static void PaceFromNs(struct timespec *Time, unsigned long long Ns)
+{
+    Time->tv_sec = (time_t)(Ns / PACE_NS_PER_SEC);
+    Time->tv_nsec = (long)(Ns % PACE_NS_PER_SEC);
+}
+
+//Speed scales the target rate (2.0 runs twice as fast as the real part)
+int PaceInitialize(PIC_PACE *Pace, unsigned long long OscillatorHz, double Speed, unsigned long long Cycles)
+{
+    double slice;
+
+    if (OscillatorHz < PACE_CLOCKS_PER_CYCLE || Speed <= 0)
+    {
+        printf("Bad clock rate or speed\n");
+        return -1;
+    }
+
+    memset(Pace, 0, sizeof(PIC_PACE));
+    Pace->NsPerCycle = (double)PACE_NS_PER_SEC * PACE_CLOCKS_PER_CYCLE / OscillatorHz / Speed;
+
+    //At least one instruction, even for absurdly slow clocks
+    slice = PACE_QUANTUM_NS / Pace->NsPerCycle;
+    Pace->Slice = (slice < 1) ? 1 : (slice > 0x100000) ? 0x100000 : (unsigned int)slice;
+
+    Pace->StartCycles = Cycles;
+    clock_gettime(CLOCK_MONOTONIC, &Pace->Start);
+
+    return 0;
+}
+
+//Sleeps until the CPU's cycle count matches wall-clock time. Deadlines are
+//always computed from the start of the run rather than the last wake-up.
+void PaceWait(PIC_PACE *Pace, unsigned long long Cycles)
+{
+    unsigned long long deadline, now, lag;
+    struct timespec time;
+
+    Pace->Quanta++;
+
+    deadline = PaceToNs(&Pace->Start) + (unsigned long long)((Cycles - Pace->StartCycles) * Pace->NsPerCycle);
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    now = PaceToNs(&time);
+
+    if (now >= deadline)
+    {
+        lag = now - deadline;
+        Pace->Late++;
+        if (lag > Pace->MaxLagNs)
+            Pace->MaxLagNs = lag;
+
+        //Something stalled us for long enough that catching up would run
+        //the firmware flat out, so restart the schedule from here
+        if (lag > PACE_MAX_LAG_NS)
+        {
+            Pace->Start = time;
+            Pace->StartCycles = Cycles;
+            Pace->Resyncs++;
+        }
+
+        return;
+    }
+
+    PaceFromNs(&time, deadline);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, NULL) == EINTR);
+}
+
+void PacePrintSummary(const PIC_PACE *Pace)
+{
+    printf("Paced %llu quanta: %llu late (max %llu us behind), %llu resyncs\n",
+           Pace->Quanta, Pace->Late, Pace->MaxLagNs / 1000, Pace->Resyncs);
+}
@@ -0,0 +1,41 @@
+//
+//  pace.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Wall-clock pacing. The CPU runs in quanta of a millisecond or so and the
+//  host sleeps until the absolute time the last quantum should have ended,
+//  so sleep overshoot never accumulates into drift.
+//
+
+#ifndef PIC16F84A_Emulator_pace_h
+#define PIC16F84A_Emulator_pace_h
+
+#include <time.h>
+
+//Wall-clock time covered by one quantum
+#define PACE_QUANTUM_NS     1000000ULL
+
+//Falling further behind than this gives up on catching up
+#define PACE_MAX_LAG_NS     100000000ULL
+
+//This struct represents one paced run
+typedef struct _PIC_PACE {
+    double NsPerCycle;              //Instruction cycle time divided by the speed multiplier
+    unsigned int Slice;             //Instructions per quantum
+    struct timespec Start;          //Wall-clock time of StartCycles
+    unsigned long long StartCycles;
+    unsigned long long Quanta;
+    unsigned long long Late;        //Quanta that finished after their deadline
+    unsigned long long MaxLagNs;
+    unsigned long long Resyncs;     //Times the schedule was moved instead of caught up
+} PIC_PACE;
+
+int PaceInitialize(PIC_PACE *Pace, unsigned long long OscillatorHz, double Speed, unsigned long long Cycles);
+void PaceWait(PIC_PACE *Pace, unsigned long long Cycles);
+void PacePrintSummary(const PIC_PACE *Pace);
+
+#endif
@@ -0,0 +1,344 @@
+//
+//  pcf.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pcf.h"
+#include "fuse.h"
+
+#define PCF_ROUND_UP(x) (((x) + PCF_ALIGN - 1) & ~(PCF_ALIGN - 1))
+
+static int PcfCompareSymbols(const void *A, const void *B)
+{
+    const PCF_SYMBOL *a = A, *b = B;
+
+    if (a->Value != b->Value)
+        return (a->Value < b->Value) ? -1 : 1;
+
+    //Labels first so address lookups find them quickly
+    return (int)(a->Type == SYM_TYPE_LABEL ? 0 : 1) - (int)(b->Type == SYM_TYPE_LABEL ? 0 : 1);
+}
+
+//Writes a block and pads it out to PCF_ALIGN
+static int PcfWriteBlock(FILE *f, const void *Data, unsigned int Size, unsigned int *Offset)
+{
+    static const unsigned char zeros[PCF_ALIGN];
+    unsigned int padding;
+
+    if (Size != 0 && fwrite(Data, 1, Size, f) != Size)
+        return -1;
+
+    padding = PCF_ROUND_UP(*Offset + Size) - (*Offset + Size);
+    if (padding != 0 && fwrite(zeros, 1, padding, f) != padding)
+        return -1;
+
+    *Offset += Size + padding;
+
+    return 0;
+}
+
+static int PcfWriteSection(FILE *f, PCF_HEADER *Header, int Index, const void *Data, unsigned int Size, unsigned int Count, unsigned int *Offset)
+{
+    Header->Sections[Index].Offset = *Offset;
+    Header->Sections[Index].Size = Size;
+    Header->Sections[Index].Count = Count;
+
+    return PcfWriteBlock(f, Data, Size, Offset);
+}
+
+int PcfWrite(const char *Path, const PIC_IMAGE *Image, SYM_TABLE *Symbols, const int *Lines, int LineCount)
+{
+    PCF_HEADER header;
+    PCF_SYMBOL *symbols = NULL;
+    char *strings = NULL;
+    unsigned int lines[PROGRAM_MEM_INSTRUCTIONS];
+    unsigned int symbolCount = 0, stringSize = 0;
+    unsigned int offset;
+    char tempPath[1024];
+    FILE *f;
+    unsigned int i;
+    int err = -1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.Magic, PCF_MAGIC, 4);
+    header.Version = PCF_VERSION;
+    header.HeaderSize = sizeof(PCF_HEADER);
+    header.IsaFingerprint = IsaFingerprint();
+    header.ContentHash = Image->Hash;
+    header.WordCount = Image->WordCount;
+    header.ConfigWord = Image->ConfigWord;
+    memcpy(header.Eeprom, Image->Eeprom, EEPROM_SIZE);
+
+    //Flatten the user-defined symbols
+    if (Symbols != NULL)
+    {
+        for (i = 0; i < Symbols->SlotCount; i++)
+        {
+            if (Symbols->Slots[i].Name != NULL && Symbols->Slots[i].Type != SYM_TYPE_BUILTIN)
+                stringSize += Symbols->Slots[i].Length + 1;
+        }
+
+        symbols = malloc((Symbols->Count + 1) * sizeof(PCF_SYMBOL));
+        strings = malloc(stringSize + 1);
+        if (!symbols || !strings)
+        {
+            printf("Out of memory\n");
+            goto Exit;
+        }
+
+        stringSize = 0;
+        for (i = 0; i < Symbols->SlotCount; i++)
+        {
+            SYM_ENTRY *entry = &Symbols->Slots[i];
+
+            if (entry->Name == NULL || entry->Type == SYM_TYPE_BUILTIN)
+                continue;
+
+            memset(&symbols[symbolCount], 0, sizeof(PCF_SYMBOL));
+            symbols[symbolCount].NameOffset = stringSize;
+            symbols[symbolCount].Value = entry->Value;
+            symbols[symbolCount].Type = entry->Type;
+            symbolCount++;
+
+            memcpy(&strings[stringSize], entry->Name, entry->Length);
+            strings[stringSize + entry->Length] = 0;
+            stringSize += entry->Length + 1;
+        }
+
+        qsort(symbols, symbolCount, sizeof(PCF_SYMBOL), PcfCompareSymbols);
+    }
+
+    //Unknown lines are 0
+    for (i = 0; i < PROGRAM_MEM_INSTRUCTIONS; i++)
+    {
+        lines[i] = (Lines != NULL && (int)i < LineCount) ? (unsigned int)Lines[i] : 0;
+    }
+
+    //Write to a temporary name so readers never see a partial file
+    snprintf(tempPath, sizeof(tempPath), "%s.%d.tmp", Path, (int)getpid());
+    f = fopen(tempPath, "wb");
+    if (f == NULL)
+    {
+        printf("Failed to create %s\n", tempPath);
+        goto Exit;
+    }
+
+    //The header is rewritten once the section table is known
+    offset = 0;
+    if (PcfWriteBlock(f, &header, sizeof(header), &offset) < 0 ||
+        PcfWriteSection(f, &header, PCF_SEC_PROGRAM, Image->ProgMem, sizeof(Image->ProgMem), PROGRAM_MEM_INSTRUCTIONS, &offset) < 0 ||
+        PcfWriteSection(f, &header, PCF_SEC_DECODED, Image->Decoded, sizeof(Image->Decoded), PROGRAM_MEM_INSTRUCTIONS, &offset) < 0 ||
+        PcfWriteSection(f, &header, PCF_SEC_SYMBOLS, symbols, symbolCount * sizeof(PCF_SYMBOL), symbolCount, &offset) < 0 ||
+        PcfWriteSection(f, &header, PCF_SEC_STRINGS, strings, stringSize, stringSize, &offset) < 0 ||
+        PcfWriteSection(f, &header, PCF_SEC_LINES, lines, sizeof(lines), PROGRAM_MEM_INSTRUCTIONS, &offset) < 0 ||
+        fseek(f, 0, SEEK_SET) != 0 ||
+        fwrite(&header, 1, sizeof(header), f) != sizeof(header))
+    {
+        printf("Failed to write %s\n", tempPath);
+        fclose(f);
+        unlink(tempPath);
+        goto Exit;
+    }
+
+    if (fclose(f) != 0 || rename(tempPath, Path) != 0)
+    {
+        printf("Failed to write %s\n", Path);
+        unlink(tempPath);
+        goto Exit;
+    }
+
+    err = 0;
+
+Exit:
+    free(symbols);
+    free(strings);
+
+    return err;
+}
+
+static int PcfCheckSection(const PCF_HEADER *Header, size_t MapSize, int Index, size_t ElementSize, unsigned int Count)
+{
+    const PCF_SECTION *section = &Header->Sections[Index];
+
+    if (section->Offset % PCF_ALIGN != 0 ||
+        (size_t)section->Offset + section->Size > MapSize ||
+        section->Size != ElementSize * section->Count)
+        return -1;
+
+    //Fixed-size sections must be complete
+    if (Count != 0 && section->Count != Count)
+        return -1;
+
+    return 0;
+}
+
+static int PcfValidate(PCF_FILE *File)
+{
+    const PCF_HEADER *header = File->Header;
+    const unsigned char *base = (const unsigned char *)header;
+    const PCF_SECTION *strings;
+    unsigned int i;
+
+    if (header->Version != PCF_VERSION || header->HeaderSize != sizeof(PCF_HEADER))
+    {
+        printf("Unsupported .pcf version\n");
+        return -1;
+    }
+
+    if (header->IsaFingerprint != IsaFingerprint())
+    {
+        printf(".pcf was built for a different instruction set table\n");
+        return -1;
+    }
+
+    if (header->WordCount > PROGRAM_MEM_INSTRUCTIONS)
+    {
+        printf("Corrupt .pcf word count\n");
+        return -1;
+    }
+
+    if (PcfCheckSection(header, File->MapSize, PCF_SEC_PROGRAM, sizeof(PIC_OPCODE), PROGRAM_MEM_INSTRUCTIONS) < 0 ||
+        PcfCheckSection(header, File->MapSize, PCF_SEC_DECODED, sizeof(ISA_INSN), PROGRAM_MEM_INSTRUCTIONS) < 0 ||
+        PcfCheckSection(header, File->MapSize, PCF_SEC_SYMBOLS, sizeof(PCF_SYMBOL), 0) < 0 ||
+        PcfCheckSection(header, File->MapSize, PCF_SEC_STRINGS, 1, 0) < 0 ||
+        PcfCheckSection(header, File->MapSize, PCF_SEC_LINES, sizeof(unsigned int), PROGRAM_MEM_INSTRUCTIONS) < 0)
+    {
+        printf("Corrupt .pcf section table\n");
+        return -1;
+    }
+
+    File->ProgMem = (const PIC_OPCODE *)(base + header->Sections[PCF_SEC_PROGRAM].Offset);
+    File->Decoded = (const ISA_INSN *)(base + header->Sections[PCF_SEC_DECODED].Offset);
+    File->Symbols = (const PCF_SYMBOL *)(base + header->Sections[PCF_SEC_SYMBOLS].Offset);
+    File->SymbolCount = header->Sections[PCF_SEC_SYMBOLS].Count;
+    File->Strings = (const char *)(base + header->Sections[PCF_SEC_STRINGS].Offset);
+    File->Lines = (const unsigned int *)(base + header->Sections[PCF_SEC_LINES].Offset);
+
+    //Decoded IDs index the dispatch table, so they have to be right
+    for (i = 0; i < PROGRAM_MEM_INSTRUCTIONS; i++)
+    {
+        if (File->Decoded[i].Opcode != File->ProgMem[i].Opcode ||
+            File->Decoded[i].Id != IsaDecode(File->ProgMem[i].Opcode))
+        {
+            printf("Corrupt .pcf decoded stream at 0x%x\n", i);
+            return -1;
+        }
+    }
+
+    FuseProgram(File->Decoded, PROGRAM_MEM_INSTRUCTIONS, File->Fused);
+
+    //Names must stay inside the terminated string pool
+    strings = &header->Sections[PCF_SEC_STRINGS];
+    if (strings->Size != 0 && File->Strings[strings->Size - 1] != 0)
+    {
+        printf("Corrupt .pcf string pool\n");
+        return -1;
+    }
+
+    for (i = 0; i < File->SymbolCount; i++)
+    {
+        if (File->Symbols[i].NameOffset >= strings->Size)
+        {
+            printf("Corrupt .pcf symbol table\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int PcfMap(const char *Path, PCF_FILE *File)
+{
+    struct stat st;
+    void *map;
+    int fd;
+
+    memset(File, 0, sizeof(*File));
+
+    fd = open(Path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    //Check the magic before committing to a mapping
+    if ((size_t)st.st_size < sizeof(PCF_HEADER))
+    {
+        close(fd);
+        return PCF_ERR_NOT_PCF;
+    }
+
+    //Shared and read-only so the page cache backs every user
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    File->Header = map;
+    File->MapSize = (size_t)st.st_size;
+
+    if (memcmp(File->Header->Magic, PCF_MAGIC, 4) != 0)
+    {
+        PcfUnmap(File);
+        return PCF_ERR_NOT_PCF;
+    }
+
+    if (PcfValidate(File) < 0)
+    {
+        PcfUnmap(File);
+        return -1;
+    }
+
+    return 0;
+}
+
+void PcfUnmap(PCF_FILE *File)
+{
+    if (File->Header != NULL)
+    {
+        munmap((void *)File->Header, File->MapSize);
+    }
+
+    memset(File, 0, sizeof(*File));
+}
+
+//Finds a label naming the given program address
+const PCF_SYMBOL *PcfFindLabel(const PCF_FILE *File, int Address)
+{
+    unsigned int lo = 0, hi = File->SymbolCount;
+
+    //First symbol with a value >= Address
+    while (lo < hi)
+    {
+        unsigned int mid = lo + (hi - lo) / 2;
+
+        if (File->Symbols[mid].Value < Address)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    //Labels sort ahead of constants with the same value
+    if (lo < File->SymbolCount &&
+        File->Symbols[lo].Value == Address &&
+        File->Symbols[lo].Type == SYM_TYPE_LABEL)
+        return &File->Symbols[lo];
+
+    return NULL;
+}
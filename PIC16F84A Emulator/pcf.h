@@ -0,0 +1,88 @@
+//
+//  pcf.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  PIC compiled firmware (.pcf) files hold everything needed to start
+//  executing: program words, the predecoded instruction stream, the
+//  symbol table and the source line map. They are mapped read-only, so
+//  every process and thread using one shares a single physical copy.
+//
+
+#ifndef PIC16F84A_Emulator_pcf_h
+#define PIC16F84A_Emulator_pcf_h
+
+#include <stddef.h>
+
+#include "cpu.h"
+#include "image.h"
+#include "isa.h"
+#include "symtab.h"
+
+#define PCF_MAGIC       "PCF\x1A"
+#define PCF_VERSION     1
+
+//Sections start on a cache line boundary
+#define PCF_ALIGN       0x40
+
+//Section indices
+#define PCF_SEC_PROGRAM 0x00    //PIC_OPCODE[PROGRAM_MEM_INSTRUCTIONS]
+#define PCF_SEC_DECODED 0x01    //ISA_INSN[PROGRAM_MEM_INSTRUCTIONS]
+#define PCF_SEC_SYMBOLS 0x02    //PCF_SYMBOL[], sorted by value
+#define PCF_SEC_STRINGS 0x03    //Symbol names (NUL-terminated)
+#define PCF_SEC_LINES   0x04    //unsigned int[PROGRAM_MEM_INSTRUCTIONS], 0 = none
+#define PCF_SEC_COUNT   0x05
+
+//Return code of PcfMap for files that aren't .pcf at all
+#define PCF_ERR_NOT_PCF (-2)
+
+typedef struct _PCF_SECTION {
+    unsigned int Offset;
+    unsigned int Size;
+    unsigned int Count;
+} PCF_SECTION;
+
+//The header sits at offset 0 of the file
+typedef struct _PCF_HEADER {
+    char Magic[4];
+    unsigned int Version;
+    unsigned int HeaderSize;
+    unsigned int IsaFingerprint;    //Decode IDs are only valid for this ISA
+    unsigned long long ContentHash; //Hash of the source the file was built from
+    unsigned short WordCount;
+    unsigned short ConfigWord;
+    unsigned char Eeprom[EEPROM_SIZE];
+    PCF_SECTION Sections[PCF_SEC_COUNT];
+} PCF_HEADER;
+
+typedef struct _PCF_SYMBOL {
+    unsigned int NameOffset;        //Into PCF_SEC_STRINGS
+    int Value;
+    unsigned char Type;             //SYM_TYPE_*
+    unsigned char Reserved[3];
+} PCF_SYMBOL;
+
+//This struct represents a mapped .pcf file (all pointers are into the mapping)
+typedef struct _PCF_FILE {
+    const PCF_HEADER *Header;
+    const PIC_OPCODE *ProgMem;
+    const ISA_INSN *Decoded;
+    const PCF_SYMBOL *Symbols;
+    unsigned int SymbolCount;
+    const char *Strings;
+    const unsigned int *Lines;
+    size_t MapSize;
+    unsigned char Fused[PROGRAM_MEM_INSTRUCTIONS];  //Found again on every map
+} PCF_FILE;
+
+int PcfWrite(const char *Path, const PIC_IMAGE *Image, SYM_TABLE *Symbols, const int *Lines, int LineCount);
+
+int PcfMap(const char *Path, PCF_FILE *File);
+void PcfUnmap(PCF_FILE *File);
+
+const PCF_SYMBOL *PcfFindLabel(const PCF_FILE *File, int Address);
+
+#endif
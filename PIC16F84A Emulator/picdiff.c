@@ -0,0 +1,232 @@
+//
+//  picdiff.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  pic-diff: runs programs on an execution engine in lockstep with the
+//  reference decoder and reports the first instruction where they differ
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "assembler.h"
+#include "image.h"
+#include "lexer.h"
+#include "lockstep.h"
+
+//Instructions per program unless -n says otherwise
+#define DIFF_DEFAULT_COUNT 1000000
+
+typedef struct _DIFF_OPTIONS {
+    const LOCKSTEP_ENGINE *Engine;
+    unsigned long long Count;
+    unsigned int Interval;
+    unsigned int FuzzCount;
+    unsigned int Seed;
+} DIFF_OPTIONS;
+
+static int DiffIsAssembly(const char *Path)
+{
+    const char *ext = strrchr(Path, '.');
+
+    return ext != NULL && (strcasecmp(ext, ".asm") == 0 || strcasecmp(ext, ".s") == 0);
+}
+
+static int DiffLoadAssembly(const char *Path, PIC_IMAGE *Image)
+{
+    ASM_CONTEXT context;
+    ASM_PROGRAM *program;
+    ASM_SOURCE source;
+    int err;
+
+    err = LexMapSource(Path, &source);
+    if (err < 0)
+    {
+        printf("Failed to open %s\n", Path);
+        return err;
+    }
+
+    err = AsmInitializeContext(&context);
+    if (err < 0)
+    {
+        LexUnmapSource(&source);
+        return err;
+    }
+
+    program = AsmAssembleAscii(&context, source.Buffer, source.Size);
+    AsmDestroyContext(&context);
+    LexUnmapSource(&source);
+    if (program == NULL)
+        return -1;
+
+    err = ImgParseRaw(Image, (const unsigned char *)program->Opcodes, program->OpcodeCount * sizeof(PIC_OPCODE), 0);
+    free(program);
+
+    return err;
+}
+
+static int DiffLoadFile(const char *Path, PIC_IMAGE *Image)
+{
+    PIC_IMAGE *loaded;
+
+    if (DiffIsAssembly(Path))
+        return DiffLoadAssembly(Path, Image);
+
+    loaded = ImgLoadFile(Path);
+    if (loaded == NULL)
+        return -1;
+
+    memcpy(Image, loaded, sizeof(PIC_IMAGE));
+    ImgRelease(loaded);
+
+    return 0;
+}
+
+//xorshift32, so a seed reproduces the same programs everywhere
+static unsigned int DiffRandom(unsigned int *State)
+{
+    unsigned int x = *State;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *State = x;
+
+    return x;
+}
+
+static void DiffFuzzImage(PIC_IMAGE *Image, unsigned int *State)
+{
+    unsigned char words[PROGRAM_MEM_INSTRUCTIONS * sizeof(PIC_OPCODE)];
+    unsigned int value;
+    int i;
+
+    for (i = 0; i < sizeof(words); i += 2)
+    {
+        value = DiffRandom(State);
+        words[i] = (unsigned char)value;
+        words[i + 1] = (unsigned char)(value >> 8);
+    }
+
+    ImgParseRaw(Image, words, sizeof(words), 0);
+
+    for (i = 0; i < EEPROM_SIZE; i++)
+    {
+        Image->Eeprom[i] = (unsigned char)DiffRandom(State);
+    }
+}
+
+//Returns 1 if the engines diverged
+static int DiffRun(const char *Name, const PIC_IMAGE *Image, const DIFF_OPTIONS *Options)
+{
+    static LOCKSTEP_RESULT result;
+
+    LockstepRun(Image, Options->Engine, Options->Count, Options->Interval, &result);
+
+    if (result.Diverged)
+    {
+        printf("%s: DIVERGED\n", Name);
+        LockstepDumpDivergence(&result, Options->Engine->Name);
+        return 1;
+    }
+
+    printf("%s: ok, %llu instructions (%s)\n", Name, result.Retired,
+           (result.StopReason == CPU_ERR_HALTED) ? "halted" :
+           (result.StopReason == CPU_ERR_INVALID) ? "invalid opcode" : "limit");
+
+    return 0;
+}
+
+static void DiffUsage(const char *Name)
+{
+    printf("Usage: %s [-e engine] [-n count] [-i interval] [-fuzz programs] [-seed n] [file...]\n", Name);
+    printf("Engines: ");
+    LockstepPrintEngines();
+}
+
+int main(int argc, const char * argv[])
+{
+    static PIC_IMAGE image;
+    DIFF_OPTIONS options;
+    const char **files;
+    char name[48];
+    unsigned int state, i;
+    int arg, diverged = 0, inputs = 0;
+
+    options.Engine = LockstepFindEngine("decoded");
+    options.Count = DIFF_DEFAULT_COUNT;
+    options.Interval = LOCKSTEP_DEFAULT_INTERVAL;
+    options.FuzzCount = 0;
+    options.Seed = 1;
+
+    //Options apply to every input no matter where they appear
+    files = malloc(argc * sizeof(const char *));
+    if (files == NULL)
+        return -1;
+
+    for (arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "-e") == 0 && arg + 1 < argc)
+        {
+            options.Engine = LockstepFindEngine(argv[++arg]);
+            if (options.Engine == NULL)
+            {
+                printf("Unknown engine: %s\n", argv[arg]);
+                DiffUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc)
+            options.Count = strtoull(argv[++arg], NULL, 0);
+        else if (strcmp(argv[arg], "-i") == 0 && arg + 1 < argc)
+            options.Interval = (unsigned int)strtoul(argv[++arg], NULL, 0);
+        else if (strcmp(argv[arg], "-fuzz") == 0 && arg + 1 < argc)
+            options.FuzzCount = (unsigned int)strtoul(argv[++arg], NULL, 0);
+        else if (strcmp(argv[arg], "-seed") == 0 && arg + 1 < argc)
+            options.Seed = (unsigned int)strtoul(argv[++arg], NULL, 0);
+        else if (argv[arg][0] == '-')
+        {
+            DiffUsage(argv[0]);
+            return -1;
+        }
+        else
+            files[inputs++] = argv[arg];
+    }
+
+    if (inputs == 0 && options.FuzzCount == 0)
+    {
+        DiffUsage(argv[0]);
+        return -1;
+    }
+
+    for (arg = 0; arg < inputs; arg++)
+    {
+        if (DiffLoadFile(files[arg], &image) < 0)
+        {
+            printf("%s: failed to load\n", files[arg]);
+            return -1;
+        }
+
+        diverged |= DiffRun(files[arg], &image, &options);
+    }
+
+    //xorshift never leaves zero
+    state = (options.Seed != 0) ? options.Seed : 1;
+    for (i = 0; i < options.FuzzCount; i++)
+    {
+        //Running with -seed <this> -fuzz 1 reproduces the program
+        snprintf(name, sizeof(name), "fuzz #%u (seed 0x%x)", i, state);
+        DiffFuzzImage(&image, &state);
+        diverged |= DiffRun(name, &image, &options);
+    }
+
+    free(files);
+
+    return diverged;
+}
@@ -0,0 +1,338 @@
+//
+//  picemu.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "picemu.h"
+#include "assembler.h"
+#include "cpu.h"
+#include "device.h"
+#include "image.h"
+#include "regs.h"
+
+//The public sizes are part of the ABI and must track the core
+typedef char PicEmuCheckProgram[(PICEMU_PROGRAM_WORDS == PROGRAM_MEM_INSTRUCTIONS) ? 1 : -1];
+typedef char PicEmuCheckEeprom[(PICEMU_EEPROM_SIZE == EEPROM_SIZE) ? 1 : -1];
+typedef char PicEmuCheckStack[(PICEMU_STACK_ENTRIES == PIC_STACK_ENTRIES) ? 1 : -1];
+typedef char PicEmuCheckEvents[(PICEMU_EVENT_READ == DEV_EVENT_READ && PICEMU_EVENT_WRITE == DEV_EVENT_WRITE &&
+                                PICEMU_EVENT_QUANTUM == DEV_EVENT_QUANTUM && PICEMU_EVENT_HALTED == DEV_EVENT_HALTED &&
+                                PICEMU_EVENT_INVALID_OPCODE == DEV_EVENT_INVALID) ? 1 : -1];
+
+//Smallest PICEMU_STATE a caller may pass (the first version of the struct)
+#define PICEMU_STATE_MIN_SIZE (offsetof(PICEMU_STATE, Files) + PICEMU_FILE_SIZE)
+
+//This struct represents one embedded emulator instance
+struct _PICEMU {
+    PIC_DEVICE Device;          //CPU plus where PicEmuResume is suspended
+    PIC_IMAGE Image;            //Loaded program and its decoded copy
+    unsigned int Traps[DEV_TRAP_WORDS];
+    unsigned long long Retired;
+    int ErrorLine;
+};
+
+unsigned int PicEmuGetVersion(void)
+{
+    return PICEMU_API_VERSION;
+}
+
+//Resets the CPU into a reproducible state running the loaded image
+static void PicEmuResetCore(PICEMU *Emu)
+{
+    CpuInitializeCore(&Emu->Device.Cpu);
+    CpuSetTrace(&Emu->Device.Cpu, 0);
+
+    //The hardware leaves these undefined but callers want repeatable runs
+    Emu->Device.Cpu.W = 0;
+    memset(Emu->Device.Cpu.Regs.SRAM, 0, sizeof(Emu->Device.Cpu.Regs.SRAM));
+
+    CpuAttachDecoded(&Emu->Device.Cpu, Emu->Image.Decoded);
+    DevInitialize(&Emu->Device, Emu->Traps, Emu->Device.Quantum);
+    Emu->Retired = 0;
+}
+
+//Points the CPU at a freshly parsed image
+static void PicEmuStartImage(PICEMU *Emu)
+{
+    CpuAttachProgram(&Emu->Device.Cpu, Emu->Image.ProgMem, Emu->Image.Decoded);
+    memcpy(Emu->Device.Cpu.Eeprom, Emu->Image.Eeprom, EEPROM_SIZE);
+    DevComputeTraps(&Emu->Device.Cpu, Emu->Traps);
+
+    PicEmuResetCore(Emu);
+}
+
+PICEMU *PicEmuCreate(void)
+{
+    PICEMU *emu;
+
+    emu = calloc(1, sizeof(PICEMU));
+    if (emu == NULL)
+        return NULL;
+
+    //Start out with erased flash
+    if (ImgParseRaw(&emu->Image, NULL, 0, 1) < 0)
+    {
+        free(emu);
+        return NULL;
+    }
+
+    PicEmuStartImage(emu);
+
+    return emu;
+}
+
+void PicEmuDestroy(PICEMU *Emu)
+{
+    if (Emu != NULL)
+        CpuFreeProgramMemory(&Emu->Device.Cpu);
+
+    free(Emu);
+}
+
+int PicEmuLoadImage(PICEMU *Emu, const void *Buffer, size_t Size)
+{
+    if (Emu == NULL || (Buffer == NULL && Size != 0))
+        return PICEMU_ERR_BAD_ARGUMENT;
+
+    if (ImgParseBuffer(&Emu->Image, Buffer, Size, 1) < 0)
+    {
+        //Don't leave a half parsed image behind
+        ImgParseRaw(&Emu->Image, NULL, 0, 1);
+        PicEmuStartImage(Emu);
+        return PICEMU_ERR_BAD_IMAGE;
+    }
+
+    PicEmuStartImage(Emu);
+
+    return PICEMU_OK;
+}
+
+int PicEmuLoadSource(PICEMU *Emu, const char *Source, size_t Size)
+{
+    ASM_CONTEXT context;
+    ASM_PROGRAM *program;
+    int err;
+
+    if (Emu == NULL || (Source == NULL && Size != 0))
+        return PICEMU_ERR_BAD_ARGUMENT;
+
+    Emu->ErrorLine = 0;
+
+    if (AsmInitializeContext(&context) < 0)
+        return PICEMU_ERR_NO_MEMORY;
+
+    context.Quiet = 1;
+    program = AsmAssembleAscii(&context, Source, Size);
+    if (program == NULL)
+    {
+        Emu->ErrorLine = context.ErrorLine;
+        AsmDestroyContext(&context);
+
+        //No line means the assembler itself ran out of memory
+        return (Emu->ErrorLine != 0) ? PICEMU_ERR_ASSEMBLY : PICEMU_ERR_NO_MEMORY;
+    }
+
+    AsmDestroyContext(&context);
+
+    err = ImgParseRaw(&Emu->Image, (const unsigned char *)program->Opcodes,
+                      program->OpcodeCount * sizeof(PIC_OPCODE), 1);
+    free(program);
+
+    if (err < 0)
+    {
+        ImgParseRaw(&Emu->Image, NULL, 0, 1);
+        PicEmuStartImage(Emu);
+        return PICEMU_ERR_BAD_IMAGE;
+    }
+
+    PicEmuStartImage(Emu);
+
+    return PICEMU_OK;
+}
+
+int PicEmuGetErrorLine(const PICEMU *Emu)
+{
+    return (Emu != NULL) ? Emu->ErrorLine : 0;
+}
+
+int PicEmuReset(PICEMU *Emu)
+{
+    if (Emu == NULL)
+        return PICEMU_ERR_BAD_ARGUMENT;
+
+    PicEmuResetCore(Emu);
+
+    return PICEMU_OK;
+}
+
+int PicEmuRun(PICEMU *Emu, unsigned int Count, unsigned int *Retired)
+{
+    unsigned int retired = 0;
+    int err;
+
+    if (Emu == NULL)
+        return PICEMU_ERR_BAD_ARGUMENT;
+
+    err = CpuRun(&Emu->Device.Cpu, Count, &retired);
+    Emu->Retired += retired;
+
+    if (Retired != NULL)
+        *Retired = retired;
+
+    switch (err)
+    {
+        case 0:
+            return PICEMU_OK;
+        case CPU_ERR_HALTED:
+            return PICEMU_ERR_HALTED;
+        default:
+            return PICEMU_ERR_INVALID_OPCODE;
+    }
+}
+
+int PicEmuSetQuantum(PICEMU *Emu, unsigned long long Cycles)
+{
+    if (Emu == NULL)
+        return PICEMU_ERR_BAD_ARGUMENT;
+
+    Emu->Device.Quantum = Cycles;
+    Emu->Device.QuantumEnd = Emu->Device.Cpu.Cycles + Cycles;
+
+    return PICEMU_OK;
+}
+
+int PicEmuResume(PICEMU *Emu, unsigned char Input, PICEMU_EVENT *Event)
+{
+    unsigned long long retired;
+    DEV_EVENT event;
+    int kind;
+
+    if (Emu == NULL || Event == NULL)
+        return PICEMU_ERR_BAD_ARGUMENT;
+
+    retired = Emu->Device.Retired;
+    kind = DevResume(&Emu->Device, Input, &event);
+    Emu->Retired += Emu->Device.Retired - retired;
+
+    //Copied field by field so the public layout is independent of the core
+    Event->Kind = kind;
+    Event->Address = event.Address;
+    Event->Value = event.Value;
+    Event->PC = event.PC;
+    Event->Cycles = event.Cycles;
+
+    return kind;
+}
+
+int PicEmuGetState(const PICEMU *Emu, PICEMU_STATE *State)
+{
+    PICEMU_STATE state;
+    PIC_CPU *cpu;
+    unsigned char *file;
+    size_t size;
+    int i;
+
+    if (Emu == NULL || State == NULL || State->Size < PICEMU_STATE_MIN_SIZE)
+        return PICEMU_ERR_BAD_ARGUMENT;
+
+    //The core's accessors take non-const pointers but only read
+    cpu = (PIC_CPU *)&Emu->Device.Cpu;
+
+    memset(&state, 0, sizeof(state));
+    state.PC = CpuGetPC(cpu);
+    state.W = cpu->W;
+    state.Status = cpu->Regs.STATUS;
+    state.StackPointer = cpu->Stack.NextTop;
+    for (i = 0; i < PIC_STACK_ENTRIES; i++)
+    {
+        state.Stack[i] = cpu->Stack.Entries[i];
+    }
+    state.Cycles = cpu->Cycles;
+    state.Retired = Emu->Retired;
+
+    for (i = 0; i < PICEMU_FILE_SIZE; i++)
+    {
+        file = RegsFilePointer(&cpu->Regs, (unsigned char)i);
+        state.Files[i] = (file != NULL) ? *file : 0;
+    }
+
+    //Older callers get the fields their struct has room for
+    size = (State->Size < sizeof(state)) ? State->Size : sizeof(state);
+    memcpy((char *)State + sizeof(State->Size), (char *)&state + sizeof(state.Size), size - sizeof(State->Size));
+
+    return PICEMU_OK;
+}
+
+int PicEmuReadFile(const PICEMU *Emu, unsigned int Address, unsigned char *Value)
+{
+    unsigned char *file;
+
+    if (Emu == NULL || Value == NULL)
+        return PICEMU_ERR_BAD_ARGUMENT;
+    if (Address >= PICEMU_FILE_SIZE)
+        return PICEMU_ERR_BAD_ADDRESS;
+
+    //Bank mirrors read the register they alias
+    file = RegsFilePointer((REGISTER_FILE *)&Emu->Device.Cpu.Regs, (unsigned char)Address);
+    *Value = (file != NULL) ? *file : 0;
+
+    return PICEMU_OK;
+}
+
+int PicEmuWriteFile(PICEMU *Emu, unsigned int Address, unsigned char Value)
+{
+    unsigned char *file;
+
+    if (Emu == NULL)
+        return PICEMU_ERR_BAD_ARGUMENT;
+    if (Address >= PICEMU_FILE_SIZE)
+        return PICEMU_ERR_BAD_ADDRESS;
+
+    file = RegsFilePointer(&Emu->Device.Cpu.Regs, (unsigned char)Address);
+    if (file == NULL)
+        return PICEMU_ERR_BAD_ADDRESS;
+
+    *file = Value;
+
+    return PICEMU_OK;
+}
+
+int PicEmuReadProgram(const PICEMU *Emu, unsigned int Address, unsigned short *Word)
+{
+    if (Emu == NULL || Word == NULL)
+        return PICEMU_ERR_BAD_ARGUMENT;
+    if (Address >= PICEMU_PROGRAM_WORDS)
+        return PICEMU_ERR_BAD_ADDRESS;
+
+    *Word = Emu->Device.Cpu.ProgMem[Address].Opcode & PIC_OPCODE_MASK;
+
+    return PICEMU_OK;
+}
+
+int PicEmuReadEeprom(const PICEMU *Emu, unsigned int Address, unsigned char *Value)
+{
+    if (Emu == NULL || Value == NULL)
+        return PICEMU_ERR_BAD_ARGUMENT;
+    if (Address >= PICEMU_EEPROM_SIZE)
+        return PICEMU_ERR_BAD_ADDRESS;
+
+    *Value = Emu->Device.Cpu.Eeprom[Address];
+
+    return PICEMU_OK;
+}
+
+int PicEmuSetW(PICEMU *Emu, unsigned char W)
+{
+    if (Emu == NULL)
+        return PICEMU_ERR_BAD_ARGUMENT;
+
+    Emu->Device.Cpu.W = W;
+
+    return PICEMU_OK;
+}
@@ -0,0 +1,120 @@
+//
+//  picemu.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Public interface of libpicemu. Only this header is installed with the
+//  library; everything behind the PICEMU handle may change between
+//  releases. The library never prints and reports errors only through
+//  return values.
+//
+
+#ifndef PIC16F84A_Emulator_picemu_h
+#define PIC16F84A_Emulator_picemu_h
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define PICEMU_API __attribute__((visibility("default")))
+#else
+#define PICEMU_API
+#endif
+
+//Bumped whenever an existing function or PICEMU_STATE field changes
+#define PICEMU_API_VERSION          1
+
+//Return codes
+#define PICEMU_OK                   0
+#define PICEMU_ERR_NO_MEMORY        (-1)
+#define PICEMU_ERR_BAD_IMAGE        (-2)    //Not raw bytecode or a valid HEX file
+#define PICEMU_ERR_ASSEMBLY         (-3)    //See PicEmuGetErrorLine
+#define PICEMU_ERR_BAD_ADDRESS      (-4)
+#define PICEMU_ERR_BAD_ARGUMENT     (-5)
+#define PICEMU_ERR_INVALID_OPCODE   (-6)    //Run stopped on an unsupported word
+#define PICEMU_ERR_HALTED           (-7)    //Run stopped on SLEEP
+
+//Sizes of the emulated memories
+#define PICEMU_PROGRAM_WORDS        0x400
+#define PICEMU_FILE_SIZE            0x100
+#define PICEMU_EEPROM_SIZE          0x40
+#define PICEMU_STACK_ENTRIES        8
+
+//Why PicEmuResume returned
+#define PICEMU_EVENT_READ           1       //About to read a port, resume with its input
+#define PICEMU_EVENT_WRITE          2       //Wrote a port
+#define PICEMU_EVENT_QUANTUM        3       //Cycle quantum expired
+#define PICEMU_EVENT_HALTED         4
+#define PICEMU_EVENT_INVALID_OPCODE 5
+
+typedef struct _PICEMU PICEMU;
+
+//Snapshot of the CPU. Callers set Size to sizeof(PICEMU_STATE) so fields
+//can be appended without breaking older binaries: PicEmuGetState only fills
+//in the fields that fit in Size.
+typedef struct _PICEMU_STATE {
+    unsigned int Size;
+    unsigned short PC;
+    unsigned char W;
+    unsigned char Status;
+    unsigned char StackPointer;
+    unsigned short Stack[PICEMU_STACK_ENTRIES];
+    unsigned long long Cycles;
+    unsigned long long Retired;
+    unsigned char Files[PICEMU_FILE_SIZE];  //As seen by direct addressing
+} PICEMU_STATE;
+
+//One port access or stop reported by PicEmuResume
+typedef struct _PICEMU_EVENT {
+    int Kind;
+    unsigned char Address;                  //0x05/0x06 (PORTA/B) or 0x85/0x86 (TRISA/B)
+    unsigned char Value;                    //Current value for reads, new value for writes
+    unsigned short PC;
+    unsigned long long Cycles;
+} PICEMU_EVENT;
+
+PICEMU_API unsigned int PicEmuGetVersion(void);
+
+//A new handle has erased program memory and zeroed W and SRAM
+PICEMU_API PICEMU *PicEmuCreate(void);
+PICEMU_API void PicEmuDestroy(PICEMU *Emu);
+
+//Loads raw little-endian bytecode or Intel HEX and resets the CPU
+PICEMU_API int PicEmuLoadImage(PICEMU *Emu, const void *Buffer, size_t Size);
+
+//Assembles source text, loads it and resets the CPU
+PICEMU_API int PicEmuLoadSource(PICEMU *Emu, const char *Source, size_t Size);
+PICEMU_API int PicEmuGetErrorLine(const PICEMU *Emu);
+
+//Power-on reset that keeps program memory and EEPROM
+PICEMU_API int PicEmuReset(PICEMU *Emu);
+
+//Runs up to Count instructions. Retired may be NULL.
+PICEMU_API int PicEmuRun(PICEMU *Emu, unsigned int Count, unsigned int *Retired);
+
+//Coroutine-style stepping: runs until the firmware reads or writes PORTA or
+//PORTB, writes TRISA or TRISB, or the quantum expires, then returns the event
+//kind.
+//Input becomes the port's value when the previous event was a read.
+PICEMU_API int PicEmuSetQuantum(PICEMU *Emu, unsigned long long Cycles);
+PICEMU_API int PicEmuResume(PICEMU *Emu, unsigned char Input, PICEMU_EVENT *Event);
+
+PICEMU_API int PicEmuGetState(const PICEMU *Emu, PICEMU_STATE *State);
+
+PICEMU_API int PicEmuReadFile(const PICEMU *Emu, unsigned int Address, unsigned char *Value);
+PICEMU_API int PicEmuWriteFile(PICEMU *Emu, unsigned int Address, unsigned char Value);
+PICEMU_API int PicEmuReadProgram(const PICEMU *Emu, unsigned int Address, unsigned short *Word);
+PICEMU_API int PicEmuReadEeprom(const PICEMU *Emu, unsigned int Address, unsigned char *Value);
+PICEMU_API int PicEmuSetW(PICEMU *Emu, unsigned char W);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
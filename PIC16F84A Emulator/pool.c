@@ -0,0 +1,165 @@
+//
+//  pool.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "pool.h"
+
+//Explicit huge pages are 2 MB on every platform we care about
+#define POOL_HUGE_PAGE 0x200000
+
+#define POOL_ROUND_UP(x, a) (((x) + (a) - 1) & ~(size_t)((a) - 1))
+
+static PIC_CPU *PoolInstance(PIC_POOL *Pool, unsigned int Index)
+{
+    return (PIC_CPU *)(Pool->Slab + Index * POOL_STRIDE);
+}
+
+//Tries explicit huge pages first, then asks for transparent ones
+static int PoolMapSlab(PIC_POOL *Pool, size_t Size)
+{
+    void *map = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    Pool->SlabSize = POOL_ROUND_UP(Size, POOL_HUGE_PAGE);
+    map = mmap(NULL, Pool->SlabSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    Pool->HugePages = (map != MAP_FAILED);
+#endif
+
+    if (map == MAP_FAILED)
+    {
+        Pool->SlabSize = Size;
+        map = mmap(NULL, Pool->SlabSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED)
+            return -1;
+
+#ifdef MADV_HUGEPAGE
+        //Only a hint, small pages work too
+        madvise(map, Pool->SlabSize, MADV_HUGEPAGE);
+#endif
+    }
+
+    Pool->Slab = map;
+
+    return 0;
+}
+
+PIC_POOL *PoolCreate(const PIC_CPU *Golden, unsigned int Count)
+{
+    PIC_POOL *pool;
+    unsigned int i;
+
+    //Every instance would end up sharing (and freeing) the same private copy
+    if (Golden->PrivateProgMem != NULL)
+    {
+        printf("Pool templates must use shared program memory\n");
+        return NULL;
+    }
+
+    pool = calloc(1, sizeof(PIC_POOL));
+    if (pool == NULL)
+        return NULL;
+
+    memcpy(&pool->Golden, Golden, sizeof(PIC_CPU));
+    pool->Count = Count;
+
+    pool->FreeList = malloc(Count * sizeof(unsigned int));
+    if (pool->FreeList == NULL || PoolMapSlab(pool, (size_t)Count * POOL_STRIDE) < 0)
+    {
+        printf("Out of memory\n");
+        free(pool->FreeList);
+        free(pool);
+        return NULL;
+    }
+
+    //Hand out low indexes first so a small batch stays on few pages
+    for (i = 0; i < Count; i++)
+    {
+        pool->FreeList[i] = Count - 1 - i;
+        memcpy(PoolInstance(pool, i), Golden, sizeof(PIC_CPU));
+    }
+    pool->FreeCount = Count;
+
+    return pool;
+}
+
+void PoolDestroy(PIC_POOL *Pool)
+{
+    unsigned int i;
+
+    for (i = 0; i < Pool->Count; i++)
+    {
+        free(PoolInstance(Pool, i)->PrivateProgMem);
+    }
+
+    munmap(Pool->Slab, Pool->SlabSize);
+    free(Pool->FreeList);
+    free(Pool);
+}
+
+//Returns a freshly reset instance (NULL if the pool is exhausted)
+PIC_CPU *PoolAcquire(PIC_POOL *Pool)
+{
+    PIC_CPU *cpu;
+
+    if (Pool->FreeCount == 0)
+        return NULL;
+
+    cpu = PoolInstance(Pool, Pool->FreeList[--Pool->FreeCount]);
+    PoolResetDirty(Pool, cpu);
+
+    return cpu;
+}
+
+void PoolRelease(PIC_POOL *Pool, PIC_CPU *Cpu)
+{
+    Pool->FreeList[Pool->FreeCount++] = (unsigned int)(((unsigned char *)Cpu - Pool->Slab) / POOL_STRIDE);
+}
+
+//Drops anything the instance allocated since its last reset
+static void PoolDropPrivate(PIC_CPU *Cpu)
+{
+    if (Cpu->PrivateProgMem != NULL)
+    {
+        free(Cpu->PrivateProgMem);
+        Cpu->PrivateProgMem = NULL;
+    }
+}
+
+//Copies the whole template back
+void PoolReset(PIC_POOL *Pool, PIC_CPU *Cpu)
+{
+    PoolDropPrivate(Cpu);
+    memcpy(Cpu, &Pool->Golden, sizeof(PIC_CPU));
+}
+
+//Only copies the cache lines that differ from the template. Lines a short
+//run never touched (attachments, EEPROM) are left alone, so they stay clean
+//and shared in the cache instead of being written back.
+void PoolResetDirty(PIC_POOL *Pool, PIC_CPU *Cpu)
+{
+    unsigned char *line = (unsigned char *)Cpu;
+    const unsigned char *golden = (const unsigned char *)&Pool->Golden;
+    size_t offset, length;
+
+    PoolDropPrivate(Cpu);
+
+    for (offset = 0; offset < sizeof(PIC_CPU); offset += POOL_CACHE_LINE)
+    {
+        length = sizeof(PIC_CPU) - offset;
+        if (length > POOL_CACHE_LINE)
+            length = POOL_CACHE_LINE;
+
+        if (memcmp(line + offset, golden + offset, length) != 0)
+            memcpy(line + offset, golden + offset, length);
+    }
+}
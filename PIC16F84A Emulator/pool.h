@@ -0,0 +1,45 @@
+//
+//  pool.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Slab of CPU instances for batch and fuzz runs. Every instance is reset
+//  by copying a golden post-init template over it instead of going through
+//  CpuInitializeCore and the program load again. Pools are not thread safe:
+//  acquire instances up front and hand them to threads afterwards.
+//
+
+#ifndef PIC16F84A_Emulator_pool_h
+#define PIC16F84A_Emulator_pool_h
+
+#include "cpu.h"
+
+#define POOL_CACHE_LINE   0x40
+
+//Instances start on their own cache line
+#define POOL_STRIDE       ((sizeof(PIC_CPU) + POOL_CACHE_LINE - 1) & ~(size_t)(POOL_CACHE_LINE - 1))
+
+//This struct represents one slab of instances
+typedef struct _PIC_POOL {
+    PIC_CPU Golden;                 //What every instance is reset to
+    unsigned char *Slab;
+    size_t SlabSize;
+    int HugePages;                  //Slab is backed by explicit huge pages
+    unsigned int Count;
+    unsigned int FreeCount;
+    unsigned int *FreeList;         //Stack of free instance indexes
+} PIC_POOL;
+
+PIC_POOL *PoolCreate(const PIC_CPU *Golden, unsigned int Count);
+void PoolDestroy(PIC_POOL *Pool);
+
+PIC_CPU *PoolAcquire(PIC_POOL *Pool);
+void PoolRelease(PIC_POOL *Pool, PIC_CPU *Cpu);
+
+void PoolReset(PIC_POOL *Pool, PIC_CPU *Cpu);
+void PoolResetDirty(PIC_POOL *Pool, PIC_CPU *Cpu);
+
+#endif
@@ -8,74 +8,187 @@
 //
 
 #include <stdio.h>
+#include <strings.h>
 
 #include "regs.h"
 
-void RegsPrintRegisterName(unsigned char RegFileAddr)
+//Special function register names by full (banked) address.
+//GPRs and unimplemented locations have no entry.
+static const char *RegsNames[0x100] =
+{
+    [REG_INDF] = "INDF",
+    [REG_TMR0] = "TMR0",
+    [REG_PCL] = "PCL",
+    [REG_STATUS] = "STATUS",
+    [REG_FSR] = "FSR",
+    [REG_PORTA] = "PORTA",
+    [REG_PORTB] = "PORTB",
+    //0x07 and 0x87 are unimplemented on PIC
+    [REG_EEDATA] = "EEDATA",
+    [REG_EEADR] = "EEADR",
+    [REG_PCLATH] = "PCLATH",
+    [REG_INTCON] = "INTCON",
+
+    [REG_INDF | 0x80] = "INDF",
+    [REG_OPTION_REG] = "OPTION_REG",
+    [REG_PCL | 0x80] = "PCL",
+    [REG_STATUS | 0x80] = "STATUS",
+    [REG_FSR | 0x80] = "FSR",
+    [REG_TRISA] = "TRISA",
+    [REG_TRISB] = "TRISB",
+    [REG_EECON1] = "EECON1",
+    [0x89] = "EECON2",
+    [REG_PCLATH | 0x80] = "PCLATH",
+    [REG_INTCON | 0x80] = "INTCON",
+};
+
+//General purpose registers 0x0C-0x4F are mirrored, 0x50-0x7F are unimplemented
+#define REGS_VIEW_ROW(Base) \
+    Base + 0x0, Base + 0x1, Base + 0x2, Base + 0x3, Base + 0x4, Base + 0x5, Base + 0x6, Base + 0x7, \
+    Base + 0x8, Base + 0x9, Base + 0xA, Base + 0xB, Base + 0xC, Base + 0xD, Base + 0xE, Base + 0xF
+#define REGS_VIEW_GPRS \
+    REGS_VIEW_ROW(0x10), REGS_VIEW_ROW(0x20), REGS_VIEW_ROW(0x30), REGS_VIEW_ROW(0x40), \
+    [0x50 ... REGS_VIEW_SIZE - 1] = REGS_VIEW_NONE
+
+const unsigned char RegsBankViews[2][REGS_VIEW_SIZE] =
 {
-    switch (RegFileAddr)
     {
-        case REG_TMR0:
-            printf("TMR0");
-            return;
-        case REG_OPTION_REG:
-            printf("OPTION_REG");
-            return;
+        REGS_VIEW_INDIRECT, REG_TMR0, REG_PCL, REG_STATUS,
+        REG_FSR, REG_PORTA, REG_PORTB, REGS_VIEW_NONE,
+        REG_EEDATA, REG_EEADR, REG_PCLATH, REG_INTCON,
+        0x0C, 0x0D, 0x0E, 0x0F,
+        REGS_VIEW_GPRS
+    },
+    {
+        REGS_VIEW_INDIRECT, REG_OPTION_REG, REG_PCL, REG_STATUS,
+        REG_FSR, REG_TRISA, REG_TRISB, REGS_VIEW_NONE,
+        REG_EECON1, REGS_VIEW_NONE, REG_PCLATH, REG_INTCON,  //EECON2 isn't a physical register
+        0x0C, 0x0D, 0x0E, 0x0F,
+        REGS_VIEW_GPRS
+    }
+};
+
+const unsigned char RegsReadMasks[sizeof(REGISTER_FILE)] =
+{
+    [0 ... sizeof(REGISTER_FILE) - 1] = 0xFF,
+    [REG_TMR0] = READ_MASK_TMR0,
+    [REG_PCL] = READ_MASK_PCL,
+    [REG_STATUS] = READ_MASK_STATUS,
+    [REG_FSR] = READ_MASK_FSR,
+    [REG_PORTA] = READ_MASK_PORTA,
+    [REG_PORTB] = READ_MASK_PORTB,
+    [REG_EEDATA] = READ_MASK_EEDATA,
+    [REG_EEADR] = READ_MASK_EEADR,
+    [REG_PCLATH] = READ_MASK_PCLATH,
+    [REG_INTCON] = READ_MASK_INTCON,
+    [REG_OPTION_REG] = READ_MASK_OPTION_REG,
+    [REG_TRISA] = READ_MASK_TRISA,
+    [REG_TRISB] = READ_MASK_TRISB,
+    [REG_EECON1] = READ_MASK_EECON1,
+};
+
+const unsigned char RegsWriteMasks[sizeof(REGISTER_FILE)] =
+{
+    [0 ... sizeof(REGISTER_FILE) - 1] = 0xFF,
+    [REG_TMR0] = WRITE_MASK_TMR0,
+    [REG_PCL] = WRITE_MASK_PCL,
+    [REG_STATUS] = WRITE_MASK_STATUS,
+    [REG_FSR] = WRITE_MASK_FSR,
+    [REG_PORTA] = WRITE_MASK_PORTA,
+    [REG_PORTB] = WRITE_MASK_PORTB,
+    [REG_EEDATA] = WRITE_MASK_EEDATA,
+    [REG_EEADR] = WRITE_MASK_EEADR,
+    [REG_PCLATH] = WRITE_MASK_PCLATH,
+    [REG_INTCON] = WRITE_MASK_INTCON,
+    [REG_OPTION_REG] = WRITE_MASK_OPTION_REG,
+    [REG_TRISA] = WRITE_MASK_TRISA,
+    [REG_TRISB] = WRITE_MASK_TRISB,
+    [REG_EECON1] = WRITE_MASK_EECON1,
+};
+
+const char *RegsGetRegisterName(unsigned char RegFileAddr)
+{
+    return RegsNames[RegFileAddr];
+}
+
+//Returns the file offset of a named register or -1
+int RegsLookupRegisterName(const char *Name)
+{
+    int i;
+
+    for (i = 0; i < 0x100; i++)
+    {
+        if (RegsNames[i] != NULL && strcasecmp(RegsNames[i], Name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+int RegsIsGpr(unsigned char RegFileAddr)
+{
+    return ((RegFileAddr & 0x7F) >= 0x0C) && ((RegFileAddr & 0x7F) < 0x50);
+}
+
+//Folds bank mirrors onto the file offset that holds the register
+unsigned char RegsCanonicalAddress(unsigned char RegFileAddr)
+{
+    switch (RegFileAddr & 0x7F)
+    {
+        case REG_INDF:
         case REG_PCL:
-        case REG_PCL | 0x80:
-            printf("PCL");
-            return;
         case REG_STATUS:
-        case REG_STATUS | 0x80:
-            printf("STATUS");
-            return;
         case REG_FSR:
-        case REG_FSR | 0x80:
-            printf("FSR");
-            return;
-        case REG_PORTA:
-            printf("PORTA");
-            return;
-        case REG_TRISA:
-            printf("TRISA");
-            return;
-        case REG_PORTB:
-            printf("PORTB");
-            return;
-        case REG_TRISB:
-            printf("TRISB");
-            return;
-        //0x07 and 0x87 are unimplemented on PIC
-        case REG_EEDATA:
-            printf("EEDATA");
-            return;
-        case REG_EECON1:
-            printf("EECON1");
-            return;
-        case REG_EEADR:
-            printf("EEADR");
-            return;
-        case 0x89:
-            //Not a real register
-            return;
         case REG_PCLATH:
-        case REG_PCLATH | 0x80:
-            printf("PCLATH");
-            return;
         case REG_INTCON:
-        case REG_INTCON | 0x80:
-            printf("INTCON");
-            return;
+            return RegFileAddr & 0x7F;
+    }
+
+    if (RegsIsGpr(RegFileAddr))
+        return RegFileAddr & 0x7F;
+
+    return RegFileAddr;
+}
+
+//Raw storage behind an absolute file address (NULL past the register file)
+unsigned char *RegsFilePointer(REGISTER_FILE *Regs, unsigned char RegFileAddr)
+{
+    RegFileAddr = RegsCanonicalAddress(RegFileAddr);
+    if (RegFileAddr >= sizeof(REGISTER_FILE))
+        return NULL;
+
+    return &((unsigned char *)Regs)[RegFileAddr];
+}
+
+//Returns the file offset an f operand refers to with the current FSR and bank
+unsigned char RegsResolveAddress(REGISTER_FILE *Regs, unsigned char RegFileAddr)
+{
+    if ((RegFileAddr & 0x7F) == 0)
+        RegFileAddr = Regs->FSR;
+
+    if ((Regs->STATUS & STATUS_RP0) != 0)
+        RegFileAddr |= 0x80;
+    else
+        RegFileAddr &= ~0x80;
+
+    return RegsCanonicalAddress(RegFileAddr);
+}
+
+void RegsPrintRegisterName(unsigned char RegFileAddr)
+{
+    //EECON2 isn't a real register
+    if (RegsNames[RegFileAddr] != NULL && RegFileAddr != 0x89)
+    {
+        printf("%s", RegsNames[RegFileAddr]);
     }
-    
     //Check if this is an unimplemented location
-    if (((RegFileAddr & 0x7F) >= 0x50) ||
-        ((RegFileAddr & 0x7F) == 0x07))
+    else if (((RegFileAddr & 0x7F) >= 0x50) ||
+             ((RegFileAddr & 0x7F) == 0x07))
     {
         printf("Unimplemented");
     }
     //Check if it's a GPR
-    else if ((RegFileAddr & 0x7F) >= 0x0C)
+    else if (RegsIsGpr(RegFileAddr))
     {
         //Mask the MSB
         RegFileAddr &= 0x7F;
@@ -121,7 +234,8 @@ void RegsInitializeRegisterFile(REGISTER_FILE *Regs)
     Regs->EECON1 = RESET_EECON1;
 }
 
-void RegsSetValue(REGISTER_FILE *Regs, unsigned char RegFileAddr, unsigned char Value)
+//Returns the file offset that was written or -1 if nothing was stored
+int RegsSetValue(REGISTER_FILE *Regs, unsigned char RegFileAddr, unsigned char Value, int Trace)
 {
     unsigned char WriteMask;
     unsigned char *Destination;
@@ -148,81 +262,67 @@ void RegsSetValue(REGISTER_FILE *Regs, unsigned char RegFileAddr, unsigned char
     switch (RegFileAddr)
     {
         case REG_TMR0:
-            printf("TMR0");
             WriteMask = WRITE_MASK_TMR0;
             Destination = &Regs->TMR0;
             break;
         case REG_OPTION_REG:
-            printf("OPTION_REG");
             WriteMask = WRITE_MASK_OPTION_REG;
             Destination = &Regs->OPTION_REG;
             break;
         case REG_PCL:
         case REG_PCL | 0x80:
-            printf("PCL");
             WriteMask = WRITE_MASK_PCL;
             Destination = &Regs->PCL;
             break;
         case REG_STATUS:
         case REG_STATUS | 0x80:
-            printf("STATUS");
             WriteMask = WRITE_MASK_STATUS;
             Destination = &Regs->STATUS;
             break;
         case REG_FSR:
         case REG_FSR | 0x80:
-            printf("FSR");
             WriteMask = WRITE_MASK_FSR;
             Destination = &Regs->FSR;
             break;
         case REG_PORTA:
-            printf("PORTA");
             WriteMask = WRITE_MASK_PORTA;
             Destination = &Regs->PORTA;
             break;
         case REG_TRISA:
-            printf("TRISA");
             WriteMask = WRITE_MASK_TRISA;
             Destination = &Regs->TRISA;
             break;
         case REG_PORTB:
-            printf("PORTB");
             WriteMask = WRITE_MASK_PORTB;
             Destination = &Regs->PORTB;
             break;
         case REG_TRISB:
-            printf("TRISB");
             WriteMask = WRITE_MASK_TRISB;
             Destination = &Regs->TRISB;
             break;
         //0x07 and 0x87 are unimplemented on PIC
         case REG_EEDATA:
-            printf("EEDATA");
             WriteMask = WRITE_MASK_EEDATA;
             Destination = &Regs->EEDATA;
             break;
         case REG_EECON1:
-            printf("EECON1");
             WriteMask = WRITE_MASK_EECON1;
             Destination = &Regs->EECON1;
             break;
         case REG_EEADR:
-            printf("EEADR");
             WriteMask = WRITE_MASK_EEADR;
             Destination = &Regs->EEADR;
             break;
         case 0x89:
             //EECON2 - Not a physical register
-            return;
+            return -1;
         case REG_PCLATH:
         case REG_PCLATH | 0x80:
-            printf("PCLATH");
             WriteMask = WRITE_MASK_PCLATH;
             Destination = &Regs->PCLATH;
             break;
         case REG_INTCON:
         case REG_INTCON | 0x80:
-            printf("INTCON");
             WriteMask = WRITE_MASK_INTCON;
             Destination = &Regs->INTCON;
             break;
@@ -232,21 +332,27 @@ void RegsSetValue(REGISTER_FILE *Regs, unsigned char RegFileAddr, unsigned char
     if (Destination != NULL)
     {
         //Print some debugging stuff
-        if ((RegFileAddr & 0x7F) == REG_STATUS)
-        {
-            printf(": [");
-            RegsPrintStatusRegister(*Destination);
-            printf("] -> [");
-            RegsPrintStatusRegister(Value & WriteMask);
-            printf("]\n");
-        }
-        else
+        if (Trace)
         {
-            printf(": 0x%x -> 0x%x\n", *Destination, (Value & WriteMask));
+            RegsPrintRegisterName(RegFileAddr);
+            if ((RegFileAddr & 0x7F) == REG_STATUS)
+            {
+                printf(": [");
+                RegsPrintStatusRegister(*Destination);
+                printf("] -> [");
+                RegsPrintStatusRegister(Value & WriteMask);
+                printf("]\n");
+            }
+            else
+            {
+                printf(": 0x%x -> 0x%x\n", *Destination, (Value & WriteMask));
+            }
         }
 
         *Destination &= ~WriteMask;
         *Destination |= (Value & WriteMask);
+
+        return (int)(Destination - (unsigned char *)Regs);
     }
     else
     {
@@ -255,7 +361,7 @@ void RegsSetValue(REGISTER_FILE *Regs, unsigned char RegFileAddr, unsigned char
             ((RegFileAddr & 0x7F) == 0x07))
         {
             //No-op
-            return;
+            return -1;
         }
         //Check if it's a GPR write
         else if ((RegFileAddr & 0x7F) >= 0x0C)
@@ -265,15 +371,20 @@ void RegsSetValue(REGISTER_FILE *Regs, unsigned char RegFileAddr, unsigned char
         }
 
         //Print some debugging output
-        RegsPrintRegisterName(RegFileAddr);
-        printf(": %d -> %d\n", ((unsigned char *)Regs)[RegFileAddr], Value);
+        if (Trace)
+        {
+            RegsPrintRegisterName(RegFileAddr);
+            printf(": %d -> %d\n", ((unsigned char *)Regs)[RegFileAddr], Value);
+        }
         
         //Do a simple memory write
         ((unsigned char *)Regs)[RegFileAddr] = Value;
+
+        return RegFileAddr;
     }
 }
 
-char RegsGetValue(REGISTER_FILE *Regs, unsigned char RegFileAddr)
+unsigned char RegsGetValue(REGISTER_FILE *Regs, unsigned char RegFileAddr)
 {
     unsigned char ReadMask;
     unsigned char *Source;
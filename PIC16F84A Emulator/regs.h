@@ -194,13 +194,35 @@ typedef struct _REGISTER_FILE {
 #define STATUS_C           (1 << STATUS_C_BIT)
 
 
+/* ------------ Pre-resolved register views ----------- */
+
+//A view maps each 7-bit f operand to the file offset it reaches in one bank.
+//Mirrored registers and GPRs have the same offset in both views.
+#define REGS_VIEW_SIZE      0x80
+#define REGS_VIEW_INDIRECT  0x00    //INDF: resolve through FSR
+#define REGS_VIEW_NONE      0xFF    //Unimplemented (reads 0, writes are dropped)
+
+extern const unsigned char RegsBankViews[2][REGS_VIEW_SIZE];
+
+//Read and write masks by file offset
+extern const unsigned char RegsReadMasks[sizeof(REGISTER_FILE)];
+extern const unsigned char RegsWriteMasks[sizeof(REGISTER_FILE)];
+
 /* --------- Function definitions for regs.c -------- */
 void RegsInitializeRegisterFile(REGISTER_FILE *Regs);
 
-void RegsSetValue(REGISTER_FILE *Regs, unsigned char RegFileAddr, unsigned char Value);
+int RegsSetValue(REGISTER_FILE *Regs, unsigned char RegFileAddr, unsigned char Value, int Trace);
+
+unsigned char RegsGetValue(REGISTER_FILE *Regs, unsigned char RegFileAddr);
 
-char RegsGetValue(REGISTER_FILE *Regs, unsigned char RegFileAddr);
+const char *RegsGetRegisterName(unsigned char RegFileAddr);
+int RegsLookupRegisterName(const char *Name);
+int RegsIsGpr(unsigned char RegFileAddr);
+unsigned char RegsCanonicalAddress(unsigned char RegFileAddr);
+unsigned char RegsResolveAddress(REGISTER_FILE *Regs, unsigned char RegFileAddr);
+unsigned char *RegsFilePointer(REGISTER_FILE *Regs, unsigned char RegFileAddr);
 
+void RegsPrintRegisterName(unsigned char RegFileAddr);
 void RegsPrintStatusRegister(unsigned char StatusVal);
 
 #endif
@@ -16,7 +16,7 @@ void StkInitialize(PIC_STACK *Stack)
     Stack->NextTop = 0;
 }
 
-void StkPush(PIC_STACK *Stack, unsigned char Data)
+void StkPush(PIC_STACK *Stack, unsigned short Data)
 {
     //Store the data in the next location
     Stack->Entries[Stack->NextTop] = Data;
@@ -26,7 +26,7 @@ void StkPush(PIC_STACK *Stack, unsigned char Data)
     Stack->NextTop %= PIC_STACK_ENTRIES;
 }
 
-unsigned char StkPop(PIC_STACK *Stack)
+unsigned short StkPop(PIC_STACK *Stack)
 {
     //Update the next top
     Stack->NextTop = Stack->NextTop - 1;
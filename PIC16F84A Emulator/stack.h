@@ -13,12 +13,12 @@
 #define PIC_STACK_ENTRIES 8
 
 typedef struct _PIC_STACK {
-    unsigned char Entries[PIC_STACK_ENTRIES];
+    unsigned short Entries[PIC_STACK_ENTRIES];
     unsigned char NextTop;
 } PIC_STACK;
 
-void StkPush(PIC_STACK *Stack, unsigned char Data);
-unsigned char StkPop(PIC_STACK *Stack);
+void StkPush(PIC_STACK *Stack, unsigned short Data);
+unsigned short StkPop(PIC_STACK *Stack);
 
 void StkInitialize(PIC_STACK *Stack);
 
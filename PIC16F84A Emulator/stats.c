@@ -0,0 +1,159 @@
+//
+//  stats.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "stats.h"
+#include "regs.h"
+
+PIC_STATS *StatCreate(void)
+{
+    PIC_STATS *stats;
+
+    stats = calloc(1, sizeof(PIC_STATS));
+    if (stats == NULL)
+        return NULL;
+
+    //No previous instruction to pair with yet
+    stats->LastId = -1;
+
+    return stats;
+}
+
+void StatDestroy(PIC_STATS *Stats)
+{
+    free(Stats);
+}
+
+//Counts an instruction that is about to execute
+void StatRecord(PIC_STATS *Stats, PIC_CPU *Cpu, int Id, unsigned short Opcode)
+{
+    unsigned char file, bank;
+    int access;
+
+    Stats->Instructions[Id]++;
+    if (Stats->LastId >= 0)
+        Stats->Pairs[Stats->LastId][Id]++;
+    Stats->LastId = Id;
+
+    access = IsaFileAccess(Id, Opcode);
+    if (access == 0)
+        return;
+
+    file = ISA_FILE(Opcode);
+    bank = (Cpu->Regs.STATUS & STATUS_RP0) ? 1 : 0;
+
+    if (access & ISA_ACCESS_READ)
+    {
+        Stats->Reads[bank][file]++;
+        if (file == REG_INDF)
+            Stats->IndirectReads[Cpu->Regs.FSR]++;
+    }
+
+    if (access & ISA_ACCESS_WRITE)
+    {
+        Stats->Writes[bank][file]++;
+        if (file == REG_INDF)
+            Stats->IndirectWrites[Cpu->Regs.FSR]++;
+
+        if (RegsResolveAddress(&Cpu->Regs, file) == REG_PCL)
+            Stats->PclWrites++;
+    }
+}
+
+//Counts bank switches once the instruction has run
+void StatRecordStatus(PIC_STATS *Stats, unsigned char OldStatus, unsigned char NewStatus)
+{
+    if ((OldStatus ^ NewStatus) & STATUS_RP0)
+        Stats->BankSwitches++;
+}
+
+static const char *StatInstructionName(int Id)
+{
+    return (Id < ISA_COUNT) ? IsaTable[Id].Mnemonic : "invalid";
+}
+
+static void StatWriteRegister(FILE *File, const char *Kind, int Address, int Bank, unsigned long long Count)
+{
+    const char *name = RegsGetRegisterName((unsigned char)Address);
+
+    if (Count == 0)
+        return;
+
+    fprintf(File, "%s,", Kind);
+    if (name != NULL)
+        fprintf(File, "%s,", name);
+    else
+        fprintf(File, "0x%02x,", Address);
+
+    //Indirect accesses have no bank of their own
+    if (Bank >= 0)
+        fprintf(File, "%d,%llu\n", Bank, Count);
+    else
+        fprintf(File, ",%llu\n", Count);
+}
+
+//Writes every nonzero counter as kind,name,bank,count
+int StatWriteCsv(const PIC_STATS *Stats, const char *Path)
+{
+    FILE *file;
+    int i, j, bank;
+
+    file = fopen(Path, "w");
+    if (file == NULL)
+    {
+        printf("Failed to create %s\n", Path);
+        return -1;
+    }
+
+    fprintf(file, "kind,name,bank,count\n");
+
+    for (i = 0; i < STAT_IDS; i++)
+    {
+        if (Stats->Instructions[i] != 0)
+            fprintf(file, "instruction,%s,,%llu\n", StatInstructionName(i), Stats->Instructions[i]);
+    }
+
+    for (i = 0; i < STAT_IDS; i++)
+    {
+        for (j = 0; j < STAT_IDS; j++)
+        {
+            if (Stats->Pairs[i][j] != 0)
+                fprintf(file, "pair,%s->%s,,%llu\n", StatInstructionName(i), StatInstructionName(j), Stats->Pairs[i][j]);
+        }
+    }
+
+    for (bank = 0; bank < 2; bank++)
+    {
+        for (i = 0; i < STAT_BANK_SIZE; i++)
+        {
+            StatWriteRegister(file, "read", (bank << 7) | i, bank, Stats->Reads[bank][i]);
+            StatWriteRegister(file, "write", (bank << 7) | i, bank, Stats->Writes[bank][i]);
+        }
+    }
+
+    //Indirect targets are listed by FSR value
+    for (i = 0; i < 0x100; i++)
+    {
+        StatWriteRegister(file, "indirect_read", i, -1, Stats->IndirectReads[i]);
+        StatWriteRegister(file, "indirect_write", i, -1, Stats->IndirectWrites[i]);
+    }
+
+    fprintf(file, "event,bank_switch,,%llu\n", Stats->BankSwitches);
+    fprintf(file, "event,pcl_write,,%llu\n", Stats->PclWrites);
+
+    if (fclose(file) != 0)
+    {
+        printf("Failed to write %s\n", Path);
+        return -1;
+    }
+
+    return 0;
+}
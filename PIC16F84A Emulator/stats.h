@@ -0,0 +1,51 @@
+//
+//  stats.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Dynamic instruction mix and register access counters. They are only
+//  updated while attached to a CPU, which then runs its instrumented loop.
+//
+
+#ifndef PIC16F84A_Emulator_stats_h
+#define PIC16F84A_Emulator_stats_h
+
+#include "cpu.h"
+
+//Instruction IDs plus one slot for invalid words
+#define STAT_IDS        (ISA_COUNT + 1)
+
+//File offsets within one bank
+#define STAT_BANK_SIZE  0x80
+
+//This struct represents one set of counters
+typedef struct _PIC_STATS {
+    unsigned long long Instructions[STAT_IDS];
+    unsigned long long Pairs[STAT_IDS][STAT_IDS];   //[previous][current]
+
+    //Direct accesses by bank and offset
+    unsigned long long Reads[2][STAT_BANK_SIZE];
+    unsigned long long Writes[2][STAT_BANK_SIZE];
+
+    //INDF accesses by the FSR value they resolved to
+    unsigned long long IndirectReads[0x100];
+    unsigned long long IndirectWrites[0x100];
+
+    unsigned long long BankSwitches;                //RP0 changes
+    unsigned long long PclWrites;                   //Computed jumps
+
+    int LastId;
+} PIC_STATS;
+
+PIC_STATS *StatCreate(void);
+void StatDestroy(PIC_STATS *Stats);
+
+void StatRecord(PIC_STATS *Stats, PIC_CPU *Cpu, int Id, unsigned short Opcode);
+void StatRecordStatus(PIC_STATS *Stats, unsigned char OldStatus, unsigned char NewStatus);
+
+int StatWriteCsv(const PIC_STATS *Stats, const char *Path);
+
+#endif
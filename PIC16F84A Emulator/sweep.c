@@ -0,0 +1,352 @@
+//
+//  sweep.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "sweep.h"
+#include "pool.h"
+#include "regs.h"
+
+//Instructions per CpuRun call between stimulus checks
+#define SWEEP_RUN_SLICE 0x100000
+
+//Shared by every worker
+typedef struct _SWEEP_JOB {
+    const SWEEP *Sweep;
+    SWEEP_RESULTS *Results;
+    PIC_POOL *Pool;                     //One instance per worker
+    int Order[SWEEP_MAX_AXES];          //Axes sorted by At
+    unsigned int Next;                  //Next variation to claim
+} SWEEP_JOB;
+
+typedef struct _SWEEP_WORKER {
+    SWEEP_JOB *Job;
+    PIC_CPU *Cpu;
+} SWEEP_WORKER;
+
+unsigned int SweepVariationCount(const SWEEP *Sweep)
+{
+    unsigned int count = 1;
+    int i;
+
+    for (i = 0; i < Sweep->AxisCount; i++)
+    {
+        count *= Sweep->Axes[i].ValueCount;
+    }
+
+    return count;
+}
+
+//Variations are numbered in mixed radix with the first axis changing fastest
+int SweepAxisValue(const SWEEP *Sweep, unsigned int Variation, int Axis)
+{
+    int i;
+
+    for (i = 0; i < Axis; i++)
+    {
+        Variation /= Sweep->Axes[i].ValueCount;
+    }
+
+    return Sweep->Axes[Axis].Values[Variation % Sweep->Axes[Axis].ValueCount];
+}
+
+static void SweepApply(PIC_CPU *Cpu, int Target, unsigned char Value)
+{
+    unsigned char *file;
+
+    if (Target == SWEEP_TARGET_W)
+    {
+        Cpu->W = Value;
+        return;
+    }
+
+    //Stimulus drives the file directly, like a pin or a debugger would
+    file = RegsFilePointer(&Cpu->Regs, (unsigned char)Target);
+    if (file != NULL)
+        *file = Value;
+}
+
+static void SweepRunVariation(SWEEP_JOB *Job, PIC_CPU *Cpu, unsigned int Variation)
+{
+    const SWEEP *sweep = Job->Sweep;
+    SWEEP_RESULTS *results = Job->Results;
+    unsigned long long retired = 0, limit, hash = 14695981039346656037ull;
+    unsigned int slice, done;
+    unsigned char *file;
+    int next = 0, axis, err = 0, i;
+
+    //Every variation starts from the pool's golden state
+    PoolResetDirty(Job->Pool, Cpu);
+    Cpu->PortHash = &hash;
+
+    for (;;)
+    {
+        //Apply every stimulus that is due
+        while (next < sweep->AxisCount && sweep->Axes[Job->Order[next]].At <= retired)
+        {
+            axis = Job->Order[next++];
+            SweepApply(Cpu, sweep->Axes[axis].Target, (unsigned char)SweepAxisValue(sweep, Variation, axis));
+        }
+
+        if (sweep->MaxInstructions != 0 && retired >= sweep->MaxInstructions)
+            break;
+
+        //Run up to the limit or the next stimulus, whichever comes first
+        limit = sweep->MaxInstructions;
+        if (next < sweep->AxisCount && (limit == 0 || sweep->Axes[Job->Order[next]].At < limit))
+            limit = sweep->Axes[Job->Order[next]].At;
+
+        slice = SWEEP_RUN_SLICE;
+        if (limit != 0 && limit - retired < slice)
+            slice = (unsigned int)(limit - retired);
+
+        err = CpuRun(Cpu, slice, &done);
+        retired += done;
+        if (err < 0)
+            break;
+    }
+
+    Cpu->PortHash = NULL;
+
+    results->StopReason[Variation] = err;
+    results->Retired[Variation] = retired;
+    results->Cycles[Variation] = Cpu->Cycles;
+    results->PortHash[Variation] = hash;
+    results->PC[Variation] = CpuGetPC(Cpu);
+    results->W[Variation] = Cpu->W;
+
+    for (i = 0; i < SWEEP_FILE_SIZE; i++)
+    {
+        file = RegsFilePointer(&Cpu->Regs, (unsigned char)i);
+        results->Files[i * results->Count + Variation] = (file != NULL) ? *file : 0;
+    }
+}
+
+static void *SweepWorker(void *Context)
+{
+    SWEEP_WORKER *worker = Context;
+    SWEEP_JOB *job = worker->Job;
+    unsigned int variation;
+
+    //Claim variations one at a time so uneven run lengths balance out
+    while ((variation = __sync_fetch_and_add(&job->Next, 1)) < job->Results->Count)
+    {
+        SweepRunVariation(job, worker->Cpu, variation);
+    }
+
+    return NULL;
+}
+
+void SweepFreeResults(SWEEP_RESULTS *Results)
+{
+    free(Results->StopReason);
+    free(Results->Retired);
+    free(Results->Cycles);
+    free(Results->PortHash);
+    free(Results->PC);
+    free(Results->W);
+    free(Results->Files);
+    memset(Results, 0, sizeof(SWEEP_RESULTS));
+}
+
+static int SweepAllocateResults(SWEEP_RESULTS *Results, unsigned int Count)
+{
+    memset(Results, 0, sizeof(SWEEP_RESULTS));
+    Results->Count = Count;
+
+    Results->StopReason = malloc(Count * sizeof(int));
+    Results->Retired = malloc(Count * sizeof(unsigned long long));
+    Results->Cycles = malloc(Count * sizeof(unsigned long long));
+    Results->PortHash = malloc(Count * sizeof(unsigned long long));
+    Results->PC = malloc(Count * sizeof(unsigned short));
+    Results->W = malloc(Count);
+    Results->Files = malloc((size_t)Count * SWEEP_FILE_SIZE);
+
+    if (!Results->StopReason || !Results->Retired || !Results->Cycles || !Results->PortHash ||
+        !Results->PC || !Results->W || !Results->Files)
+    {
+        SweepFreeResults(Results);
+        return -1;
+    }
+
+    return 0;
+}
+
+//The state every variation starts from: reset, quiet, W and SRAM zeroed, and
+//sharing the image's program memory, decoded program and superinstructions
+static void SweepBuildGolden(const SWEEP *Sweep, PIC_CPU *Cpu)
+{
+    memset(Cpu, 0, sizeof(PIC_CPU));
+    CpuInitializeCore(Cpu);
+    CpuSetTrace(Cpu, 0);
+    memcpy(Cpu->Eeprom, Sweep->Image->Eeprom, EEPROM_SIZE);
+    CpuAttachProgram(Cpu, Sweep->Image->ProgMem, Sweep->Image->Decoded);
+    CpuAttachFused(Cpu, Sweep->Image->Fused);
+}
+
+//Runs every variation of the grid and fills in Results
+int SweepRun(const SWEEP *Sweep, SWEEP_RESULTS *Results)
+{
+    SWEEP_JOB job;
+    PIC_CPU golden;
+    SWEEP_WORKER *workers;
+    pthread_t *threads;
+    unsigned int count;
+    int threadCount, i, j, axis;
+
+    for (i = 0; i < Sweep->AxisCount; i++)
+    {
+        if (Sweep->Axes[i].ValueCount <= 0 || Sweep->Axes[i].Target < 0 ||
+            Sweep->Axes[i].Target > SWEEP_TARGET_W)
+        {
+            printf("Bad sweep axis %d\n", i);
+            return -1;
+        }
+    }
+
+    count = SweepVariationCount(Sweep);
+    if (SweepAllocateResults(Results, count) < 0)
+    {
+        printf("Out of memory\n");
+        return -1;
+    }
+
+    //Stimulus is applied in time order
+    job.Sweep = Sweep;
+    job.Results = Results;
+    job.Next = 0;
+    for (i = 0; i < Sweep->AxisCount; i++)
+    {
+        axis = i;
+        for (j = i; j > 0 && Sweep->Axes[job.Order[j - 1]].At > Sweep->Axes[axis].At; j--)
+        {
+            job.Order[j] = job.Order[j - 1];
+        }
+        job.Order[j] = axis;
+    }
+
+    threadCount = Sweep->ThreadCount;
+    if (threadCount <= 0)
+        threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount <= 0)
+        threadCount = 1;
+    if ((unsigned int)threadCount > count)
+        threadCount = (int)count;
+
+    SweepBuildGolden(Sweep, &golden);
+    job.Pool = PoolCreate(&golden, threadCount);
+    threads = malloc(threadCount * sizeof(pthread_t));
+    workers = malloc(threadCount * sizeof(SWEEP_WORKER));
+    if (job.Pool == NULL || threads == NULL || workers == NULL)
+    {
+        printf("Out of memory\n");
+        if (job.Pool != NULL)
+            PoolDestroy(job.Pool);
+        free(threads);
+        free(workers);
+        SweepFreeResults(Results);
+        return -1;
+    }
+
+    for (i = 0; i < threadCount; i++)
+    {
+        workers[i].Job = &job;
+        workers[i].Cpu = PoolAcquire(job.Pool);
+    }
+
+    //The calling thread works too
+    for (i = 1; i < threadCount; i++)
+    {
+        if (pthread_create(&threads[i], NULL, SweepWorker, &workers[i]) != 0)
+            break;
+    }
+
+    SweepWorker(&workers[0]);
+
+    for (j = 1; j < i; j++)
+    {
+        pthread_join(threads[j], NULL);
+    }
+
+    PoolDestroy(job.Pool);
+    free(threads);
+    free(workers);
+
+    return 0;
+}
+
+//Writes one row per variation with the axis values and outcomes
+int SweepWriteCsv(const SWEEP *Sweep, const SWEEP_RESULTS *Results,
+                  const int *Registers, int RegisterCount, const char *Path)
+{
+    const char *name;
+    FILE *file;
+    unsigned int v;
+    int i;
+
+    file = fopen(Path, "w");
+    if (file == NULL)
+    {
+        printf("Failed to create %s\n", Path);
+        return -1;
+    }
+
+    fprintf(file, "variation");
+    for (i = 0; i < Sweep->AxisCount; i++)
+    {
+        name = (Sweep->Axes[i].Target == SWEEP_TARGET_W) ? "W" : RegsGetRegisterName((unsigned char)Sweep->Axes[i].Target);
+        if (name != NULL)
+            fprintf(file, ",%s@%llu", name, Sweep->Axes[i].At);
+        else
+            fprintf(file, ",0x%02x@%llu", Sweep->Axes[i].Target, Sweep->Axes[i].At);
+    }
+    fprintf(file, ",stop,retired,cycles,port_hash,pc,w");
+    for (i = 0; i < RegisterCount; i++)
+    {
+        name = RegsGetRegisterName((unsigned char)Registers[i]);
+        if (name != NULL)
+            fprintf(file, ",%s", name);
+        else
+            fprintf(file, ",0x%02x", Registers[i]);
+    }
+    fprintf(file, "\n");
+
+    for (v = 0; v < Results->Count; v++)
+    {
+        fprintf(file, "%u", v);
+        for (i = 0; i < Sweep->AxisCount; i++)
+        {
+            fprintf(file, ",%d", SweepAxisValue(Sweep, v, i));
+        }
+
+        fprintf(file, ",%s,%llu,%llu,%016llx,0x%03x,%u",
+                (Results->StopReason[v] == CPU_ERR_HALTED) ? "halted" :
+                (Results->StopReason[v] == CPU_ERR_INVALID) ? "invalid" : "limit",
+                Results->Retired[v], Results->Cycles[v], Results->PortHash[v],
+                Results->PC[v], Results->W[v]);
+
+        for (i = 0; i < RegisterCount; i++)
+        {
+            fprintf(file, ",%u", Results->Files[Registers[i] * Results->Count + v]);
+        }
+        fprintf(file, "\n");
+    }
+
+    if (fclose(file) != 0)
+    {
+        printf("Failed to write %s\n", Path);
+        return -1;
+    }
+
+    return 0;
+}
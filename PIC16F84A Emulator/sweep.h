@@ -0,0 +1,65 @@
+//
+//  sweep.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Parameter sweeps: one image is run under every combination of a set of
+//  initial-state and stimulus axes. Workers on every core execute out of
+//  the image's shared read-only decoded program and results are stored
+//  as one column per field.
+//
+
+#ifndef PIC16F84A_Emulator_sweep_h
+#define PIC16F84A_Emulator_sweep_h
+
+#include "cpu.h"
+#include "image.h"
+
+//Pseudo file address that targets W
+#define SWEEP_TARGET_W    0x100
+
+#define SWEEP_MAX_AXES    0x10
+#define SWEEP_FILE_SIZE   0x100
+
+//One dimension of the grid: Target is set to each value in turn, either
+//at reset (At == 0) or once At instructions have retired
+typedef struct _SWEEP_AXIS {
+    int Target;
+    unsigned long long At;
+    int ValueCount;
+    const unsigned char *Values;
+} SWEEP_AXIS;
+
+typedef struct _SWEEP {
+    const PIC_IMAGE *Image;
+    unsigned long long MaxInstructions;     //Per variation (0 runs until the CPU stops)
+    int ThreadCount;                        //0 uses every online core
+    int AxisCount;
+    SWEEP_AXIS Axes[SWEEP_MAX_AXES];
+} SWEEP;
+
+//Per-variation outcomes, one array per column
+typedef struct _SWEEP_RESULTS {
+    unsigned int Count;
+    int *StopReason;                        //0 or CPU_ERR_*
+    unsigned long long *Retired;
+    unsigned long long *Cycles;
+    unsigned long long *PortHash;           //Hash of every PORTA/B and TRISA/B write
+    unsigned short *PC;
+    unsigned char *W;
+    unsigned char *Files;                   //Files[Address * Count + Variation]
+} SWEEP_RESULTS;
+
+unsigned int SweepVariationCount(const SWEEP *Sweep);
+int SweepAxisValue(const SWEEP *Sweep, unsigned int Variation, int Axis);
+
+int SweepRun(const SWEEP *Sweep, SWEEP_RESULTS *Results);
+void SweepFreeResults(SWEEP_RESULTS *Results);
+
+int SweepWriteCsv(const SWEEP *Sweep, const SWEEP_RESULTS *Results,
+                  const int *Registers, int RegisterCount, const char *Path);
+
+#endif
@@ -0,0 +1,156 @@
+//
+//  symtab.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "symtab.h"
+
+//Case-insensitive FNV-1a
+static unsigned int SymHash(const char *Name, int Length)
+{
+    unsigned int hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < Length; i++)
+    {
+        hash ^= (unsigned char)toupper((unsigned char)Name[i]);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static int SymNameEquals(SYM_ENTRY *Entry, const char *Name, int Length, unsigned int Hash)
+{
+    int i;
+
+    if (Entry->Hash != Hash || Entry->Length != Length)
+        return 0;
+
+    for (i = 0; i < Length; i++)
+    {
+        if (toupper((unsigned char)Entry->Name[i]) != toupper((unsigned char)Name[i]))
+            return 0;
+    }
+
+    return 1;
+}
+
+//Finds the slot holding the symbol or the free slot where it belongs
+static SYM_ENTRY *SymFindSlot(SYM_TABLE *Table, const char *Name, int Length, unsigned int Hash)
+{
+    unsigned int mask = Table->SlotCount - 1;
+    unsigned int i;
+
+    //Linear probing always terminates since the table is never full
+    for (i = Hash & mask; ; i = (i + 1) & mask)
+    {
+        SYM_ENTRY *entry = &Table->Slots[i];
+
+        if (entry->Name == NULL || SymNameEquals(entry, Name, Length, Hash))
+            return entry;
+    }
+}
+
+static int SymGrow(SYM_TABLE *Table)
+{
+    SYM_ENTRY *oldSlots = Table->Slots;
+    unsigned int oldCount = Table->SlotCount;
+    unsigned int i;
+
+    Table->Slots = calloc(oldCount * 2, sizeof(SYM_ENTRY));
+    if (!Table->Slots)
+    {
+        Table->Slots = oldSlots;
+        return -1;
+    }
+
+    Table->SlotCount = oldCount * 2;
+
+    //Reinsert everything (names stay in the arena)
+    for (i = 0; i < oldCount; i++)
+    {
+        if (oldSlots[i].Name != NULL)
+        {
+            *SymFindSlot(Table, oldSlots[i].Name, oldSlots[i].Length, oldSlots[i].Hash) = oldSlots[i];
+        }
+    }
+
+    free(oldSlots);
+
+    return 0;
+}
+
+int SymInitialize(SYM_TABLE *Table)
+{
+    Table->Slots = calloc(SYM_INITIAL_SLOTS, sizeof(SYM_ENTRY));
+    if (!Table->Slots)
+        return -1;
+
+    Table->SlotCount = SYM_INITIAL_SLOTS;
+    Table->Count = 0;
+    ArenaInitialize(&Table->Names);
+
+    return 0;
+}
+
+void SymDestroy(SYM_TABLE *Table)
+{
+    free(Table->Slots);
+    Table->Slots = NULL;
+    Table->SlotCount = 0;
+    Table->Count = 0;
+
+    ArenaDestroy(&Table->Names);
+}
+
+SYM_ENTRY *SymLookup(SYM_TABLE *Table, const char *Name, int Length)
+{
+    SYM_ENTRY *entry;
+
+    entry = SymFindSlot(Table, Name, Length, SymHash(Name, Length));
+    if (entry->Name == NULL)
+        return NULL;
+
+    return entry;
+}
+
+int SymInsert(SYM_TABLE *Table, const char *Name, int Length, int Type, int Value)
+{
+    unsigned int hash = SymHash(Name, Length);
+    SYM_ENTRY *entry;
+
+    //Keep the load factor under 3/4
+    if ((Table->Count + 1) * 4 > Table->SlotCount * 3)
+    {
+        if (SymGrow(Table) < 0)
+            return -1;
+    }
+
+    entry = SymFindSlot(Table, Name, Length, hash);
+    if (entry->Name != NULL)
+    {
+        //Already defined
+        return -1;
+    }
+
+    entry->Name = ArenaStrDup(&Table->Names, Name, Length);
+    if (!entry->Name)
+        return -1;
+
+    entry->Hash = hash;
+    entry->Length = Length;
+    entry->Type = Type;
+    entry->Value = Value;
+    Table->Count++;
+
+    return 0;
+}
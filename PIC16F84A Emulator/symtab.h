@@ -0,0 +1,46 @@
+//
+//  symtab.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#ifndef PIC16F84A_Emulator_symtab_h
+#define PIC16F84A_Emulator_symtab_h
+
+#include "arena.h"
+
+//Initial slot count (must be a power of 2)
+#define SYM_INITIAL_SLOTS 0x100
+
+//Symbol types
+#define SYM_TYPE_BUILTIN  0x01  //Predefined register, bit or destination name
+#define SYM_TYPE_LABEL    0x02  //Program memory address
+#define SYM_TYPE_CONSTANT 0x03  //EQU or CBLOCK value
+
+//One slot of the symbol table (Name is NULL if the slot is free)
+typedef struct _SYM_ENTRY {
+    const char *Name;
+    unsigned int Hash;
+    unsigned short Length;
+    unsigned char Type;
+    int Value;
+} SYM_ENTRY;
+
+//This struct represents an open-addressed, case-insensitive symbol table
+typedef struct _SYM_TABLE {
+    SYM_ENTRY *Slots;
+    unsigned int SlotCount;
+    unsigned int Count;
+    ARENA Names;
+} SYM_TABLE;
+
+int SymInitialize(SYM_TABLE *Table);
+void SymDestroy(SYM_TABLE *Table);
+
+SYM_ENTRY *SymLookup(SYM_TABLE *Table, const char *Name, int Length);
+int SymInsert(SYM_TABLE *Table, const char *Name, int Length, int Type, int Value);
+
+#endif
@@ -0,0 +1,358 @@
+//
+//  tests.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  pic-tests: boundary cases for the parsers that see untrusted input
+//  (firmware image detection, .pcf files and GDB remote packets)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "gdb.h"
+#include "image.h"
+#include "pcf.h"
+
+static int TestFailures;
+static char TestDir[64];
+
+static void TestCheck(int Condition, const char *What)
+{
+    if (!Condition)
+    {
+        printf("FAIL: %s\n", What);
+        TestFailures++;
+    }
+}
+
+//Parses a buffer into a fresh image (NULL on failure)
+static PIC_IMAGE *TestParse(const void *Buffer, size_t Size)
+{
+    PIC_IMAGE *image = calloc(1, sizeof(PIC_IMAGE));
+
+    if (image != NULL && ImgParseBuffer(image, Buffer, Size, 1) < 0)
+    {
+        free(image);
+        return NULL;
+    }
+
+    return image;
+}
+
+static void TestImageDetection(void)
+{
+    //One word of MOVLW 0xFF and an EOF record
+    static const char hex[] = ":02000000FF30CF\n:00000001FF\n";
+    static const char badChecksum[] = ":02000000FF30CE\n:00000001FF\n";
+    static const char truncated[] = ":0200";
+    static const unsigned char colon[] = { 0x3A, 0x30 };
+    static const unsigned char blank[] = { 0x20, 0x0A };
+    static const unsigned char odd[] = { 0x3A };
+    PIC_IMAGE *image;
+
+    image = TestParse(hex, sizeof(hex) - 1);
+    TestCheck(image != NULL, "HEX: valid file loads");
+    if (image != NULL)
+    {
+        TestCheck(image->WordCount == 1, "HEX: word count");
+        TestCheck(image->ProgMem[0].Opcode == 0x30FF, "HEX: word 0");
+        TestCheck(image->ProgMem[1].Opcode == IMAGE_ERASED_WORD, "HEX: word 1 is erased");
+        free(image);
+    }
+
+    //Raw bytecode that happens to start with ':' is still raw bytecode
+    image = TestParse(colon, sizeof(colon));
+    TestCheck(image != NULL, "raw: leading ':' loads");
+    if (image != NULL)
+    {
+        TestCheck(image->WordCount == 1, "raw: leading ':' word count");
+        TestCheck(image->ProgMem[0].Opcode == 0x303A, "raw: leading ':' word 0");
+        free(image);
+    }
+
+    image = TestParse(blank, sizeof(blank));
+    TestCheck(image != NULL && image->ProgMem[0].Opcode == 0x0A20, "raw: whitespace bytes load as a word");
+    free(image);
+
+    //A first record with a bad checksum isn't HEX, so it's 14 raw words
+    image = TestParse(badChecksum, sizeof(badChecksum) - 1);
+    TestCheck(image != NULL, "raw: bad HEX checksum loads as raw");
+    if (image != NULL)
+    {
+        TestCheck(image->WordCount == (sizeof(badChecksum) - 1) / 2, "raw: bad HEX checksum word count");
+        TestCheck(image->ProgMem[0].Opcode == 0x303A, "raw: bad HEX checksum word 0");
+        free(image);
+    }
+
+    image = TestParse(truncated, sizeof(truncated) - 1);
+    TestCheck(image == NULL, "raw: truncated record with an odd length is rejected");
+    free(image);
+
+    image = TestParse(odd, sizeof(odd));
+    TestCheck(image == NULL, "raw: odd length is rejected");
+    free(image);
+}
+
+static void TestPcfRoundTrip(void)
+{
+    static const unsigned char program[] = { 0xFF, 0x30, 0x86, 0x00, 0x01, 0x28 };
+    char path[128];
+    PIC_IMAGE *image;
+    SYM_TABLE symbols;
+    PCF_FILE file;
+    const PCF_SYMBOL *label;
+    unsigned short wordCount;
+    int lines[] = { 1, 2, 4 };
+    int i, fd, err;
+
+    snprintf(path, sizeof(path), "%s/test.pcf", TestDir);
+
+    image = TestParse(program, sizeof(program));
+    TestCheck(image != NULL, "pcf: source image loads");
+    if (image == NULL)
+        return;
+
+    image->ConfigWord = 0x3FF1;
+    image->Eeprom[0] = 0x5A;
+
+    if (SymInitialize(&symbols) < 0)
+    {
+        TestCheck(0, "pcf: symbol table");
+        free(image);
+        return;
+    }
+
+    SymInsert(&symbols, "loop", 4, SYM_TYPE_LABEL, 1);
+
+    err = PcfWrite(path, image, &symbols, lines, 3);
+    SymDestroy(&symbols);
+    TestCheck(err == 0, "pcf: write");
+
+    err = PcfMap(path, &file);
+    TestCheck(err == 0, "pcf: map");
+    if (err == 0)
+    {
+        TestCheck(file.Header->WordCount == image->WordCount, "pcf: word count survives");
+        TestCheck(file.Header->ConfigWord == image->ConfigWord, "pcf: config word survives");
+        TestCheck(memcmp(file.Header->Eeprom, image->Eeprom, EEPROM_SIZE) == 0, "pcf: EEPROM survives");
+        TestCheck(memcmp(file.Decoded, image->Decoded, sizeof(image->Decoded)) == 0, "pcf: decoded stream survives");
+
+        for (i = 0; i < PROGRAM_MEM_INSTRUCTIONS; i++)
+        {
+            if (file.ProgMem[i].Opcode != image->ProgMem[i].Opcode)
+                break;
+        }
+        TestCheck(i == PROGRAM_MEM_INSTRUCTIONS, "pcf: program memory survives");
+        TestCheck(file.Lines[2] == 4 && file.Lines[3] == 0, "pcf: line map survives");
+
+        label = PcfFindLabel(&file, 1);
+        TestCheck(label != NULL && strcmp(file.Strings + label->NameOffset, "loop") == 0, "pcf: label survives");
+
+        PcfUnmap(&file);
+    }
+
+    //A word count past the end of program memory must not map
+    fd = open(path, O_WRONLY);
+    TestCheck(fd >= 0, "pcf: reopen");
+    if (fd >= 0)
+    {
+        wordCount = PROGRAM_MEM_INSTRUCTIONS + 1;
+        TestCheck(pwrite(fd, &wordCount, sizeof(wordCount), offsetof(PCF_HEADER, WordCount)) == sizeof(wordCount),
+                  "pcf: corrupt word count");
+        close(fd);
+
+        err = PcfMap(path, &file);
+        TestCheck(err < 0 && err != PCF_ERR_NOT_PCF, "pcf: oversized word count is rejected");
+        if (err == 0)
+            PcfUnmap(&file);
+    }
+
+    //Neither may a file cut off inside its sections
+    TestCheck(PcfWrite(path, image, NULL, NULL, 0) == 0, "pcf: rewrite");
+    TestCheck(truncate(path, sizeof(PCF_HEADER) + 1) == 0, "pcf: truncate");
+    err = PcfMap(path, &file);
+    TestCheck(err < 0 && err != PCF_ERR_NOT_PCF, "pcf: truncated file is rejected");
+    if (err == 0)
+        PcfUnmap(&file);
+
+    unlink(path);
+    free(image);
+}
+
+//Sends one packet and reads the reply into Reply (-1 if the stub hung up)
+static int TestGdbExchange(int Socket, const char *Packet, char *Reply, int ReplySize)
+{
+    char buffer[256];
+    unsigned char sum = 0;
+    int i, length;
+    char c;
+
+    for (i = 0; Packet[i] != 0; i++)
+        sum += (unsigned char)Packet[i];
+
+    length = snprintf(buffer, sizeof(buffer), "$%s#%02x", Packet, sum);
+    if (write(Socket, buffer, length) != length)
+        return -1;
+
+    //Skip the acknowledgement
+    do
+    {
+        if (read(Socket, &c, 1) != 1)
+            return -1;
+    }
+    while (c != '$');
+
+    for (i = 0; ; i++)
+    {
+        if (read(Socket, &c, 1) != 1)
+            return -1;
+        if (c == '#')
+            break;
+        if (i < ReplySize - 1)
+            Reply[i] = c;
+    }
+    Reply[(i < ReplySize - 1) ? i : ReplySize - 1] = 0;
+
+    //Checksum
+    if (read(Socket, &c, 1) != 1 || read(Socket, &c, 1) != 1 || write(Socket, "+", 1) != 1)
+        return -1;
+
+    return 0;
+}
+
+static void TestGdbReply(int Socket, const char *Packet, const char *Expected)
+{
+    char reply[256], what[128];
+
+    snprintf(what, sizeof(what), "RSP: %s replies %s", Packet, Expected);
+    TestCheck(TestGdbExchange(Socket, Packet, reply, sizeof(reply)) == 0 && strcmp(reply, Expected) == 0, what);
+}
+
+static void TestGdbRegisters(void)
+{
+    static const unsigned char program[] = { 0xFF, 0x30, 0x00, 0x00 };
+    struct sockaddr_un addr;
+    PIC_IMAGE *image;
+    PIC_CPU cpu;
+    char reply[256];
+    pid_t child;
+    int fd, status, tries;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/gdb.sock", TestDir);
+
+    image = TestParse(program, sizeof(program));
+    TestCheck(image != NULL, "RSP: program loads");
+    if (image == NULL)
+        return;
+
+    fflush(stdout);
+    child = fork();
+    if (child < 0)
+    {
+        TestCheck(0, "RSP: fork");
+        free(image);
+        return;
+    }
+    else if (child == 0)
+    {
+        //The stub reports its progress on stdout
+        freopen("/dev/null", "w", stdout);
+
+        memset(&cpu, 0, sizeof(cpu));
+        if (CpuInitializeCore(&cpu) < 0)
+            _exit(1);
+
+        CpuAttachProgram(&cpu, image->ProgMem, image->Decoded);
+        CpuAttachFused(&cpu, image->Fused);
+
+        _exit((GdbServe(&cpu, addr.sun_path) < 0) ? 1 : 0);
+    }
+
+    //Wait for the stub to start listening
+    fd = -1;
+    for (tries = 0; tries < 200 && fd < 0; tries++)
+    {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            close(fd);
+            fd = -1;
+            usleep(10000);
+        }
+    }
+
+    TestCheck(fd >= 0, "RSP: connect");
+    if (fd >= 0)
+    {
+        TestGdbReply(fd, "P0=2a", "OK");
+        TestGdbReply(fd, "p0", "2a");
+        TestGdbReply(fd, "P5=0400", "OK");
+        TestGdbReply(fd, "p5", "0400");
+        TestGdbReply(fd, "pe", "0000");
+
+        //Register numbers past the last stack entry (and ones that only fit
+        //an unsigned long) are errors, as are short or missing values
+        TestGdbReply(fd, "pf", "E01");
+        TestGdbReply(fd, "pffffffff", "E01");
+        TestGdbReply(fd, "pffffffffffffffff", "E01");
+        TestGdbReply(fd, "Pf=00", "E01");
+        TestGdbReply(fd, "Pffffffff=00", "E01");
+        TestGdbReply(fd, "P0=2", "E01");
+        TestGdbReply(fd, "P0", "E01");
+
+        //Failed writes leave the register alone
+        TestGdbReply(fd, "p0", "2a");
+
+        TestCheck(TestGdbExchange(fd, "D", reply, sizeof(reply)) == 0 && strcmp(reply, "OK") == 0, "RSP: detach");
+        close(fd);
+    }
+    else
+    {
+        kill(child, SIGKILL);
+    }
+
+    TestCheck(waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0,
+              "RSP: stub exits cleanly");
+
+    unlink(addr.sun_path);
+    free(image);
+}
+
+int main(int argc, const char * argv[])
+{
+    strcpy(TestDir, "/tmp/pic-tests-XXXXXX");
+    if (mkdtemp(TestDir) == NULL)
+    {
+        printf("Failed to create a scratch directory\n");
+        return -1;
+    }
+
+    TestImageDetection();
+    TestPcfRoundTrip();
+    TestGdbRegisters();
+
+    rmdir(TestDir);
+
+    if (TestFailures != 0)
+    {
+        printf("%d test(s) failed\n", TestFailures);
+        return -1;
+    }
+
+    printf("All tests passed\n");
+    return 0;
+}
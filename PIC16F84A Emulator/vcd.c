@@ -0,0 +1,334 @@
+//
+//  vcd.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vcd.h"
+#include "cpu.h"
+#include "regs.h"
+
+//VCD identifiers are single printable characters
+#define VCD_ID(signal) ((char)('!' + (signal)))
+
+static int VcdAddSignal(VCD_WRITER *Writer, const char *Name, int Address, int Width)
+{
+    VCD_SIGNAL *signal;
+
+    //Already traced
+    if (Writer->SignalOf[Address] != VCD_NO_SIGNAL)
+        return 0;
+
+    if (Writer->SignalCount == VCD_MAX_SIGNALS)
+    {
+        printf("Too many VCD signals\n");
+        return -1;
+    }
+
+    signal = &Writer->Signals[Writer->SignalCount];
+    snprintf(signal->Name, sizeof(signal->Name), "%s", Name);
+    signal->Address = (unsigned short)Address;
+    signal->Width = (unsigned char)Width;
+
+    Writer->SignalOf[Address] = (unsigned char)Writer->SignalCount++;
+
+    return 0;
+}
+
+VCD_WRITER *VcdCreate(void)
+{
+    VCD_WRITER *writer;
+
+    writer = calloc(1, sizeof(VCD_WRITER));
+    if (writer == NULL)
+        return NULL;
+
+    memset(writer->SignalOf, VCD_NO_SIGNAL, sizeof(writer->SignalOf));
+
+    //Pins, their directions, W and STATUS are always traced
+    VcdAddSignal(writer, "PORTA", REG_PORTA, 5);
+    VcdAddSignal(writer, "PORTB", REG_PORTB, 8);
+    VcdAddSignal(writer, "TRISA", REG_TRISA, 5);
+    VcdAddSignal(writer, "TRISB", REG_TRISB, 8);
+    VcdAddSignal(writer, "W", VCD_ADDR_W, 8);
+    VcdAddSignal(writer, "STATUS", REG_STATUS, 8);
+
+    return writer;
+}
+
+//Adds a register by name (e.g. FSR) or file address (e.g. 0x20)
+int VcdAddRegister(VCD_WRITER *Writer, const char *Name)
+{
+    char *end;
+    long address;
+
+    address = RegsLookupRegisterName(Name);
+    if (address < 0)
+    {
+        address = strtol(Name, &end, 0);
+        if (end == Name || *end != 0 || address < 0 || address > 0xFF)
+        {
+            printf("Unknown register: %s\n", Name);
+            return -1;
+        }
+    }
+
+    //Writes land on the canonical address of mirrored registers
+    address = RegsCanonicalAddress((unsigned char)address);
+    if (address >= (long)sizeof(REGISTER_FILE))
+    {
+        printf("Unimplemented register: %s\n", Name);
+        return -1;
+    }
+
+    return VcdAddSignal(Writer, Name, (int)address, 8);
+}
+
+static char *VcdPutValue(char *Out, int Signal, unsigned char Value, int Width)
+{
+    int i;
+
+    *Out++ = 'b';
+    for (i = Width - 1; i >= 0; i--)
+    {
+        *Out++ = (Value & (1 << i)) ? '1' : '0';
+    }
+    *Out++ = ' ';
+    *Out++ = VCD_ID(Signal);
+    *Out++ = '\n';
+
+    return Out;
+}
+
+static char *VcdPutCycle(char *Out, unsigned long long Cycle)
+{
+    char digits[24];
+    int count = 0;
+
+    do
+    {
+        digits[count++] = '0' + (char)(Cycle % 10);
+        Cycle /= 10;
+    }
+    while (Cycle != 0);
+
+    *Out++ = '#';
+    while (count > 0)
+    {
+        *Out++ = digits[--count];
+    }
+    *Out++ = '\n';
+
+    return Out;
+}
+
+static void VcdWriteBlock(VCD_WRITER *Writer, VCD_BLOCK *Block)
+{
+    char text[0x10000];
+    char *out = text;
+    unsigned int i;
+
+    for (i = 0; i < Block->Count; i++)
+    {
+        VCD_EVENT *event = &Block->Events[i];
+
+        //Worst case is a timestamp and an 8-bit value
+        if (out - text > sizeof(text) - 64)
+        {
+            fwrite(text, 1, out - text, Writer->File);
+            out = text;
+        }
+
+        if (event->Cycle != Writer->LastCycle)
+        {
+            out = VcdPutCycle(out, event->Cycle);
+            Writer->LastCycle = event->Cycle;
+        }
+
+        out = VcdPutValue(out, event->Signal, event->Value, Writer->Signals[event->Signal].Width);
+    }
+
+    fwrite(text, 1, out - text, Writer->File);
+    Block->Count = 0;
+}
+
+static void *VcdThread(void *Context)
+{
+    VCD_WRITER *writer = Context;
+    VCD_BLOCK *block;
+
+    pthread_mutex_lock(&writer->Lock);
+    for (;;)
+    {
+        while (writer->Full == NULL && !writer->Stopping)
+            pthread_cond_wait(&writer->Wake, &writer->Lock);
+
+        block = writer->Full;
+        if (block == NULL)
+            break;
+
+        writer->Full = block->Next;
+        if (writer->Full == NULL)
+            writer->FullTail = &writer->Full;
+
+        //Format without holding up the CPU
+        pthread_mutex_unlock(&writer->Lock);
+        VcdWriteBlock(writer, block);
+        pthread_mutex_lock(&writer->Lock);
+
+        block->Next = writer->Free;
+        writer->Free = block;
+        pthread_cond_broadcast(&writer->Wake);
+    }
+    pthread_mutex_unlock(&writer->Lock);
+
+    return NULL;
+}
+
+//Queues the current block for writing and takes a free one
+static void VcdSubmit(VCD_WRITER *Writer, int Wait)
+{
+    pthread_mutex_lock(&Writer->Lock);
+
+    Writer->Current->Next = NULL;
+    *Writer->FullTail = Writer->Current;
+    Writer->FullTail = &Writer->Current->Next;
+    Writer->Current = NULL;
+    pthread_cond_broadcast(&Writer->Wake);
+
+    if (Wait)
+    {
+        //The CPU waits if the disk can't keep up
+        while (Writer->Free == NULL)
+            pthread_cond_wait(&Writer->Wake, &Writer->Lock);
+
+        Writer->Current = Writer->Free;
+        Writer->Free = Writer->Current->Next;
+    }
+
+    pthread_mutex_unlock(&Writer->Lock);
+}
+
+int VcdOpen(VCD_WRITER *Writer, const char *Path, struct _PIC_CPU *Cpu)
+{
+    char line[64];
+    int i;
+
+    Writer->File = fopen(Path, "w");
+    if (Writer->File == NULL)
+    {
+        printf("Failed to create %s\n", Path);
+        return -1;
+    }
+
+    setvbuf(Writer->File, Writer->FileBuffer, _IOFBF, sizeof(Writer->FileBuffer));
+
+    //One instruction cycle is 1us with a 4MHz oscillator
+    fprintf(Writer->File, "$version PIC16F84A Emulator $end\n");
+    fprintf(Writer->File, "$timescale 1us $end\n");
+    fprintf(Writer->File, "$scope module pic16f84a $end\n");
+    for (i = 0; i < Writer->SignalCount; i++)
+    {
+        fprintf(Writer->File, "$var reg %d %c %s $end\n", Writer->Signals[i].Width, VCD_ID(i), Writer->Signals[i].Name);
+    }
+    fprintf(Writer->File, "$upscope $end\n$enddefinitions $end\n");
+
+    //Initial values
+    fprintf(Writer->File, "#%llu\n$dumpvars\n", Cpu->Cycles);
+    for (i = 0; i < Writer->SignalCount; i++)
+    {
+        int address = Writer->Signals[i].Address;
+
+        Writer->Last[i] = (address == VCD_ADDR_W) ? Cpu->W : *RegsFilePointer(&Cpu->Regs, (unsigned char)address);
+        fwrite(line, 1, VcdPutValue(line, i, Writer->Last[i], Writer->Signals[i].Width) - line, Writer->File);
+    }
+    fprintf(Writer->File, "$end\n");
+    Writer->LastCycle = Cpu->Cycles;
+
+    //All blocks but the first start out free
+    pthread_mutex_init(&Writer->Lock, NULL);
+    pthread_cond_init(&Writer->Wake, NULL);
+    Writer->Current = &Writer->Blocks[0];
+    Writer->Free = NULL;
+    for (i = 1; i < VCD_BLOCK_COUNT; i++)
+    {
+        Writer->Blocks[i].Next = Writer->Free;
+        Writer->Free = &Writer->Blocks[i];
+    }
+    Writer->Full = NULL;
+    Writer->FullTail = &Writer->Full;
+    Writer->Stopping = 0;
+
+    if (pthread_create(&Writer->Thread, NULL, VcdThread, Writer) != 0)
+    {
+        printf("Failed to start the VCD writer\n");
+        pthread_cond_destroy(&Writer->Wake);
+        pthread_mutex_destroy(&Writer->Lock);
+        fclose(Writer->File);
+
+        //Nothing is left for VcdClose to stop
+        Writer->File = NULL;
+        return -1;
+    }
+
+    Writer->Cpu = Cpu;
+    Cpu->Vcd = Writer;
+
+    return 0;
+}
+
+//Flushes everything, stops the writer thread and frees the writer
+void VcdClose(VCD_WRITER *Writer, unsigned long long Cycle)
+{
+    if (Writer->File != NULL)
+    {
+        Writer->Cpu->Vcd = NULL;
+
+        if (Writer->Current->Count != 0)
+            VcdSubmit(Writer, 0);
+
+        pthread_mutex_lock(&Writer->Lock);
+        Writer->Stopping = 1;
+        pthread_cond_broadcast(&Writer->Wake);
+        pthread_mutex_unlock(&Writer->Lock);
+
+        pthread_join(Writer->Thread, NULL);
+
+        //Mark the end of the run
+        if (Cycle > Writer->LastCycle)
+            fprintf(Writer->File, "#%llu\n", Cycle);
+
+        fclose(Writer->File);
+        pthread_cond_destroy(&Writer->Wake);
+        pthread_mutex_destroy(&Writer->Lock);
+    }
+
+    free(Writer);
+}
+
+void VcdRecord(VCD_WRITER *Writer, unsigned long long Cycle, int Address, unsigned char Value)
+{
+    int signal = Writer->SignalOf[Address];
+    VCD_EVENT *event;
+
+    //Only changes of traced signals are kept
+    if (signal == VCD_NO_SIGNAL || Writer->Last[signal] == Value)
+        return;
+
+    Writer->Last[signal] = Value;
+
+    event = &Writer->Current->Events[Writer->Current->Count++];
+    event->Cycle = Cycle;
+    event->Signal = (unsigned char)signal;
+    event->Value = Value;
+
+    if (Writer->Current->Count == VCD_BLOCK_EVENTS)
+        VcdSubmit(Writer, 1);
+}
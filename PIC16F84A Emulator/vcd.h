@@ -0,0 +1,84 @@
+//
+//  vcd.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Value Change Dump output timestamped by instruction cycle. The CPU
+//  only appends small binary records to a block; full blocks are
+//  formatted and written by a background thread.
+//
+
+#ifndef PIC16F84A_Emulator_vcd_h
+#define PIC16F84A_Emulator_vcd_h
+
+#include <stdio.h>
+#include <pthread.h>
+
+//Pseudo file offset used to trace W
+#define VCD_ADDR_W        0x100
+#define VCD_ADDR_COUNT    0x101
+
+#define VCD_MAX_SIGNALS   0x40
+#define VCD_NO_SIGNAL     0xFF
+
+//Events per block and blocks in flight
+#define VCD_BLOCK_EVENTS  0x10000
+#define VCD_BLOCK_COUNT   4
+
+typedef struct _VCD_EVENT {
+    unsigned long long Cycle;
+    unsigned char Signal;
+    unsigned char Value;
+} VCD_EVENT;
+
+typedef struct _VCD_BLOCK {
+    struct _VCD_BLOCK *Next;
+    unsigned int Count;
+    VCD_EVENT Events[VCD_BLOCK_EVENTS];
+} VCD_BLOCK;
+
+typedef struct _VCD_SIGNAL {
+    char Name[16];
+    unsigned short Address;
+    unsigned char Width;
+} VCD_SIGNAL;
+
+struct _PIC_CPU;
+
+//This struct represents a VCD file being written
+typedef struct _VCD_WRITER {
+    //Hot path state (owned by the CPU thread)
+    unsigned char SignalOf[VCD_ADDR_COUNT];
+    unsigned char Last[VCD_MAX_SIGNALS];
+    VCD_BLOCK *Current;
+
+    VCD_SIGNAL Signals[VCD_MAX_SIGNALS];
+    int SignalCount;
+
+    //Blocks are handed between the CPU and the writer thread
+    pthread_mutex_t Lock;
+    pthread_cond_t Wake;
+    VCD_BLOCK *Free;
+    VCD_BLOCK *Full;
+    VCD_BLOCK **FullTail;
+    int Stopping;
+    pthread_t Thread;
+
+    FILE *File;
+    char FileBuffer[0x10000];
+    unsigned long long LastCycle;
+    struct _PIC_CPU *Cpu;
+    VCD_BLOCK Blocks[VCD_BLOCK_COUNT];
+} VCD_WRITER;
+
+VCD_WRITER *VcdCreate(void);
+int VcdAddRegister(VCD_WRITER *Writer, const char *Name);
+int VcdOpen(VCD_WRITER *Writer, const char *Path, struct _PIC_CPU *Cpu);
+void VcdClose(VCD_WRITER *Writer, unsigned long long Cycle);
+
+void VcdRecord(VCD_WRITER *Writer, unsigned long long Cycle, int Address, unsigned char Value);
+
+#endif
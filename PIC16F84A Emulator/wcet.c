@@ -0,0 +1,1029 @@
+//
+//  wcet.c
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Loops are collapsed innermost first: once a loop is bounded, its header
+//  stands in for the whole body with one edge per exit costing every
+//  iteration but the last plus the path out. What remains of a function is
+//  then acyclic and its longest path is the worst case. Callees are assumed
+//  to leave loop counters alone.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wcet.h"
+#include "regs.h"
+#include "stack.h"
+
+//Successor standing for a return (or SLEEP)
+#define WCET_EXIT 0xFFFF
+
+//Words searched backwards from a loop header for its counter's initial value
+#define WCET_INIT_WINDOW 0x10
+
+//Distinct exits a bounded loop may have
+#define WCET_MAX_EXITS 0x10
+
+//Most successors of one word (a full RETLW table)
+#define WCET_MAX_SUCCESSORS 0x100
+
+#define WCET_TEST_BIT(bitmap, bit) (((bitmap)[(bit) >> 5] >> ((bit) & 0x1F)) & 1)
+#define WCET_SET_BIT(bitmap, bit) ((bitmap)[(bit) >> 5] |= (1u << ((bit) & 0x1F)))
+
+typedef struct _WCET_EDGE {
+    unsigned short To;
+    unsigned short Callee;          //CALL target (WCET_EXIT if not a call)
+    unsigned int Cycles;            //Without the callee
+} WCET_EDGE;
+
+typedef struct _WCET_EXIT_EDGE {
+    unsigned short To;
+    unsigned long long Cycles;
+} WCET_EXIT_EDGE;
+
+typedef struct _WCET_CONTEXT {
+    const PIC_OPCODE *ProgMem;
+    int Count;
+    WCET_REPORT *Report;
+
+    //Successors of every word (EdgeStart[pc] up to EdgeStart[pc + 1])
+    WCET_EDGE *Edges;
+    unsigned char *Back;            //Back edges of the function being analyzed
+    int EdgeCount;
+    int EdgeCapacity;
+    int EdgeStart[PROGRAM_MEM_INSTRUCTIONS + 1];
+    int Error[PROGRAM_MEM_INSTRUCTIONS];
+
+    unsigned int Calls[WCET_MAX_FUNCTIONS][WCET_MAX_FUNCTIONS / 32];
+
+    //Scratch for the function being analyzed
+    unsigned char InFunc[PROGRAM_MEM_INSTRUCTIONS];
+    unsigned char Visited[PROGRAM_MEM_INSTRUCTIONS];
+    unsigned char OnStack[PROGRAM_MEM_INSTRUCTIONS];
+    unsigned char Collapsed[PROGRAM_MEM_INSTRUCTIONS];
+    unsigned char Reached[PROGRAM_MEM_INSTRUCTIONS];
+    unsigned short Rep[PROGRAM_MEM_INSTRUCTIONS];
+    unsigned short Headers[PROGRAM_MEM_INSTRUCTIONS];
+    unsigned short Queue[PROGRAM_MEM_INSTRUCTIONS];
+    int StackEdge[PROGRAM_MEM_INSTRUCTIONS];
+    int Sizes[PROGRAM_MEM_INSTRUCTIONS];
+    int Order[PROGRAM_MEM_INSTRUCTIONS];
+    int Indegree[PROGRAM_MEM_INSTRUCTIONS];
+    unsigned long long Dist[PROGRAM_MEM_INSTRUCTIONS];
+    int ExitCount[PROGRAM_MEM_INSTRUCTIONS];
+    WCET_EXIT_EDGE Exits[PROGRAM_MEM_INSTRUCTIONS][WCET_MAX_EXITS];
+} WCET_CONTEXT;
+
+static int WcetId(const WCET_CONTEXT *Context, int PC)
+{
+    return IsaDecode(Context->ProgMem[PC].Opcode);
+}
+
+static int WcetIsSkip(int Id)
+{
+    return Id == ISA_DECFSZ || Id == ISA_INCFSZ || Id == ISA_BTFSC || Id == ISA_BTFSS;
+}
+
+static int WcetAddEdge(WCET_CONTEXT *Context, int From, int To, int Callee, unsigned int Cycles)
+{
+    WCET_EDGE *edges;
+
+    //Falling or jumping off the end of the program
+    if (To != WCET_EXIT && To >= Context->Count)
+    {
+        Context->Error[From] = WCET_REASON_INVALID;
+        return 0;
+    }
+
+    if (Context->EdgeCount == Context->EdgeCapacity)
+    {
+        edges = realloc(Context->Edges, (Context->EdgeCapacity + 0x400) * sizeof(WCET_EDGE));
+        if (edges == NULL)
+            return -1;
+
+        Context->Edges = edges;
+        Context->EdgeCapacity += 0x400;
+    }
+
+    Context->Edges[Context->EdgeCount].To = (unsigned short)To;
+    Context->Edges[Context->EdgeCount].Callee = (unsigned short)Callee;
+    Context->Edges[Context->EdgeCount].Cycles = Cycles;
+    Context->EdgeCount++;
+
+    return 0;
+}
+
+//Decodes the successors of every word
+static int WcetBuildEdges(WCET_CONTEXT *Context)
+{
+    unsigned short opcode;
+    int pc, id, target, err;
+
+    for (pc = 0; pc < Context->Count; pc++)
+    {
+        Context->EdgeStart[pc] = Context->EdgeCount;
+
+        opcode = Context->ProgMem[pc].Opcode;
+        id = IsaDecode(opcode);
+
+        switch (id)
+        {
+            case ISA_INVALID:
+                Context->Error[pc] = WCET_REASON_INVALID;
+                err = 0;
+                break;
+            case ISA_GOTO:
+                err = WcetAddEdge(Context, pc, ISA_K11(opcode), WCET_EXIT, 2);
+                break;
+            case ISA_CALL:
+                err = WcetAddEdge(Context, pc, pc + 1, ISA_K11(opcode), 2);
+                if (ISA_K11(opcode) >= Context->Count)
+                    Context->Error[pc] = WCET_REASON_INVALID;
+                break;
+            case ISA_RETURN:
+            case ISA_RETLW:
+            case ISA_RETFIE:
+                err = WcetAddEdge(Context, pc, WCET_EXIT, WCET_EXIT, 2);
+                break;
+            case ISA_SLEEP:
+                err = WcetAddEdge(Context, pc, WCET_EXIT, WCET_EXIT, 1);
+                break;
+            case ISA_DECFSZ:
+            case ISA_INCFSZ:
+            case ISA_BTFSC:
+            case ISA_BTFSS:
+                //Skipping costs the second cycle
+                err = WcetAddEdge(Context, pc, pc + 1, WCET_EXIT, 1);
+                if (err == 0)
+                    err = WcetAddEdge(Context, pc, pc + 2, WCET_EXIT, 2);
+                break;
+            default:
+                if (!((IsaFileAccess(id, opcode) & ISA_ACCESS_WRITE) && ISA_FILE(opcode) == REG_PCL))
+                {
+                    err = WcetAddEdge(Context, pc, pc + 1, WCET_EXIT, IsaTable[id].Cycles);
+                    break;
+                }
+
+                //ADDWF PCL,F in front of RETLW or GOTO words is a table lookup
+                err = 0;
+                for (target = pc + 1; target < Context->Count && err == 0; target++)
+                {
+                    if (WcetId(Context, target) != ISA_RETLW && WcetId(Context, target) != ISA_GOTO)
+                        break;
+                    err = WcetAddEdge(Context, pc, target, WCET_EXIT, 2);
+                }
+
+                if (id != ISA_ADDWF || target == pc + 1)
+                    Context->Error[pc] = WCET_REASON_COMPUTED_JUMP;
+                break;
+        }
+
+        if (err < 0)
+            return -1;
+    }
+
+    Context->EdgeStart[Context->Count] = Context->EdgeCount;
+
+    return 0;
+}
+
+static int WcetFindFunction(const WCET_REPORT *Report, int Entry)
+{
+    int i;
+
+    for (i = 0; i < Report->FunctionCount; i++)
+    {
+        if (Report->Functions[i].Entry == Entry)
+            return i;
+    }
+
+    return -1;
+}
+
+static int WcetAddFunction(WCET_REPORT *Report, int Entry, int Kind)
+{
+    WCET_FUNCTION *function;
+    int index;
+
+    index = WcetFindFunction(Report, Entry);
+    if (index >= 0)
+        return index;
+
+    if (Report->FunctionCount == WCET_MAX_FUNCTIONS)
+    {
+        printf("Too many subroutines to analyze\n");
+        return -1;
+    }
+
+    function = &Report->Functions[Report->FunctionCount];
+    memset(function, 0, sizeof(WCET_FUNCTION));
+    function->Entry = (unsigned short)Entry;
+    function->Kind = Kind;
+
+    return Report->FunctionCount++;
+}
+
+//The first reason a function can't be bounded is the one reported
+static void WcetFail(WCET_FUNCTION *Function, int Reason, int PC)
+{
+    if (Function->Reason == WCET_REASON_NONE)
+    {
+        Function->Reason = Reason;
+        Function->ReasonPC = (unsigned short)PC;
+    }
+
+    Function->Cycles = WCET_UNBOUNDED;
+}
+
+//Marks every word reachable from Entry without returning
+static void WcetMarkFunction(WCET_CONTEXT *Context, int Entry)
+{
+    int head = 0, tail = 0, pc, e, to;
+
+    memset(Context->InFunc, 0, sizeof(Context->InFunc));
+
+    Context->InFunc[Entry] = 1;
+    Context->Queue[tail++] = (unsigned short)Entry;
+
+    while (head < tail)
+    {
+        pc = Context->Queue[head++];
+        for (e = Context->EdgeStart[pc]; e < Context->EdgeStart[pc + 1]; e++)
+        {
+            to = Context->Edges[e].To;
+            if (to != WCET_EXIT && !Context->InFunc[to])
+            {
+                Context->InFunc[to] = 1;
+                Context->Queue[tail++] = (unsigned short)to;
+            }
+        }
+    }
+}
+
+static unsigned long long WcetEdgeCycles(const WCET_CONTEXT *Context, const WCET_EDGE *Edge)
+{
+    int callee;
+
+    if (Edge->Callee == WCET_EXIT)
+        return Edge->Cycles;
+
+    callee = WcetFindFunction(Context->Report, Edge->Callee);
+    if (callee < 0 || Context->Report->Functions[callee].Cycles == WCET_UNBOUNDED)
+        return Edge->Cycles;
+
+    return Edge->Cycles + Context->Report->Functions[callee].Cycles;
+}
+
+//Where a word stands in the collapsed graph
+static int WcetRep(const WCET_CONTEXT *Context, int PC)
+{
+    return (PC == WCET_EXIT) ? WCET_EXIT : Context->Rep[PC];
+}
+
+//Finds back edges with a depth-first walk from the entry
+static int WcetFindLoops(WCET_CONTEXT *Context, int Entry)
+{
+    int depth = 0, headers = 0, pc, e, to;
+
+    memset(Context->Visited, 0, sizeof(Context->Visited));
+    memset(Context->OnStack, 0, sizeof(Context->OnStack));
+    memset(Context->Reached, 0, sizeof(Context->Reached));
+    memset(Context->Back, 0, Context->EdgeCount);
+
+    Context->Visited[Entry] = Context->OnStack[Entry] = 1;
+    Context->Queue[depth] = (unsigned short)Entry;
+    Context->StackEdge[depth++] = Context->EdgeStart[Entry];
+
+    while (depth > 0)
+    {
+        pc = Context->Queue[depth - 1];
+        e = Context->StackEdge[depth - 1];
+
+        if (e == Context->EdgeStart[pc + 1])
+        {
+            Context->OnStack[pc] = 0;
+            depth--;
+            continue;
+        }
+
+        Context->StackEdge[depth - 1]++;
+
+        to = Context->Edges[e].To;
+        if (to == WCET_EXIT)
+            continue;
+
+        if (Context->OnStack[to])
+        {
+            Context->Back[e] = 1;
+
+            //Every back edge to a header makes up one loop
+            if (!Context->Reached[to])
+            {
+                Context->Reached[to] = 1;
+                Context->Headers[headers++] = (unsigned short)to;
+            }
+        }
+        else if (!Context->Visited[to])
+        {
+            Context->Visited[to] = Context->OnStack[to] = 1;
+            Context->Queue[depth] = (unsigned short)to;
+            Context->StackEdge[depth++] = Context->EdgeStart[to];
+        }
+    }
+
+    return headers;
+}
+
+//Words that reach a back edge to Header without passing through it
+static int WcetLoopBody(WCET_CONTEXT *Context, int Header, unsigned char *Body)
+{
+    int changed = 1, size = 1, pc, e, to;
+
+    memset(Body, 0, Context->Count);
+    Body[Header] = 1;
+
+    for (pc = 0; pc < Context->Count; pc++)
+    {
+        for (e = Context->EdgeStart[pc]; e < Context->EdgeStart[pc + 1]; e++)
+        {
+            if (Context->InFunc[pc] && Context->Back[e] && Context->Edges[e].To == Header && !Body[pc])
+            {
+                Body[pc] = 1;
+                size++;
+            }
+        }
+    }
+
+    while (changed)
+    {
+        changed = 0;
+        for (pc = 0; pc < Context->Count; pc++)
+        {
+            if (!Context->InFunc[pc] || Body[pc])
+                continue;
+
+            for (e = Context->EdgeStart[pc]; e < Context->EdgeStart[pc + 1]; e++)
+            {
+                to = Context->Edges[e].To;
+                if (to != WCET_EXIT && to != Header && Body[to])
+                {
+                    Body[pc] = 1;
+                    size++;
+                    changed = 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    return size;
+}
+
+//Walks straight-line code back from the header for MOVLW k/MOVWF f or CLRF f
+static int WcetFindInit(const WCET_CONTEXT *Context, int Header, const unsigned char *Body, int File, int *Value)
+{
+    unsigned short opcode;
+    int pc, id, wantW = 0;
+
+    for (pc = Header - 1; pc >= 0 && pc > Header - 1 - WCET_INIT_WINDOW; pc--)
+    {
+        if (!Context->InFunc[pc] || Body[pc] || Context->Error[pc] != WCET_REASON_NONE)
+            return -1;
+
+        opcode = Context->ProgMem[pc].Opcode;
+        id = IsaDecode(opcode);
+
+        //Only code that always runs before the header counts
+        if (id == ISA_GOTO || id == ISA_CALL || id == ISA_RETURN || id == ISA_RETLW ||
+            id == ISA_RETFIE || id == ISA_SLEEP || WcetIsSkip(id))
+            return -1;
+        if (pc > 0 && WcetIsSkip(WcetId(Context, pc - 1)))
+            return -1;
+
+        if (!wantW)
+        {
+            if (!(IsaFileAccess(id, opcode) & ISA_ACCESS_WRITE) || ISA_FILE(opcode) != File)
+                continue;
+
+            if (id == ISA_CLRF)
+            {
+                *Value = 0;
+                return 0;
+            }
+            else if (id != ISA_MOVWF)
+                return -1;
+
+            wantW = 1;
+        }
+        else if (id == ISA_MOVLW)
+        {
+            *Value = ISA_K8(opcode);
+            return 0;
+        }
+        else if (id == ISA_CLRW)
+        {
+            *Value = 0;
+            return 0;
+        }
+        else if (IsaTable[id].Format == ISA_FMT_K8 || (IsaTable[id].Format == ISA_FMT_FD && ISA_DEST(opcode) == DST_W))
+        {
+            return -1;
+        }
+    }
+
+    return -1;
+}
+
+//Looks for the DECFSZ/INCFSZ that leaves the loop and how often it runs
+static int WcetBoundLoop(WCET_CONTEXT *Context, int Header, const unsigned char *Body, WCET_LOOP *Loop)
+{
+    unsigned short opcode;
+    int counter, pc, e, to, id, value, file, head, tail, bypass;
+
+    for (counter = 0; counter < Context->Count; counter++)
+    {
+        if (!Body[counter] || counter + 1 >= Context->Count || !Body[counter + 1] ||
+            (counter + 2 < Context->Count && Body[counter + 2]))
+            continue;
+
+        opcode = Context->ProgMem[counter].Opcode;
+        id = IsaDecode(opcode);
+        if ((id != ISA_DECFSZ && id != ISA_INCFSZ) || ISA_DEST(opcode) != DST_F)
+            continue;
+
+        file = ISA_FILE(opcode);
+
+        //Nothing else in the loop may touch the counter
+        for (pc = 0; pc < Context->Count; pc++)
+        {
+            if (Body[pc] && pc != counter &&
+                (IsaFileAccess(WcetId(Context, pc), Context->ProgMem[pc].Opcode) & ISA_ACCESS_WRITE) &&
+                ISA_FILE(Context->ProgMem[pc].Opcode) == file)
+                break;
+        }
+        if (pc != Context->Count)
+            continue;
+
+        //Every way around the loop has to count
+        memset(Context->Visited, 0, Context->Count);
+        head = tail = bypass = 0;
+        Context->Visited[Header] = 1;
+        Context->Queue[tail++] = (unsigned short)Header;
+        while (counter != Header && head < tail && !bypass)
+        {
+            pc = Context->Queue[head++];
+            for (e = Context->EdgeStart[pc]; e < Context->EdgeStart[pc + 1]; e++)
+            {
+                to = Context->Edges[e].To;
+                if (to == Header && Context->Back[e])
+                    bypass = 1;
+                else if (to != WCET_EXIT && to != counter && Body[to] && !Context->Visited[to])
+                {
+                    Context->Visited[to] = 1;
+                    Context->Queue[tail++] = (unsigned short)to;
+                }
+            }
+        }
+        if (bypass)
+            continue;
+
+        if (WcetFindInit(Context, Header, Body, file, &value) < 0)
+            continue;
+
+        Loop->Counter = (unsigned short)counter;
+        Loop->CounterId = id;
+        Loop->File = (unsigned char)file;
+        if (id == ISA_DECFSZ)
+            Loop->Iterations = (value == 0) ? 0x100 : value;
+        else
+            Loop->Iterations = (value == 0) ? 0x100 : 0x100 - value;
+
+        return 0;
+    }
+
+    return -1;
+}
+
+static int WcetAddExit(WCET_CONTEXT *Context, int Header, int To, unsigned long long Cycles)
+{
+    WCET_EXIT_EDGE *exits = Context->Exits[Header];
+    int i;
+
+    for (i = 0; i < Context->ExitCount[Header]; i++)
+    {
+        if (exits[i].To == To)
+        {
+            if (Cycles > exits[i].Cycles)
+                exits[i].Cycles = Cycles;
+            return 0;
+        }
+    }
+
+    if (i == WCET_MAX_EXITS)
+        return -1;
+
+    exits[i].To = (unsigned short)To;
+    exits[i].Cycles = Cycles;
+    Context->ExitCount[Header]++;
+
+    return 0;
+}
+
+//Successors of a node in the collapsed graph (a collapsed loop leaves
+//through its exits, anything else through its own edges)
+static int WcetSuccessors(const WCET_CONTEXT *Context, int Node, WCET_EXIT_EDGE *Out)
+{
+    int count = 0, e;
+
+    if (Context->Collapsed[Node])
+    {
+        memcpy(Out, Context->Exits[Node], Context->ExitCount[Node] * sizeof(WCET_EXIT_EDGE));
+        count = Context->ExitCount[Node];
+    }
+    else
+    {
+        for (e = Context->EdgeStart[Node]; e < Context->EdgeStart[Node + 1]; e++, count++)
+        {
+            Out[count].To = Context->Edges[e].To;
+            Out[count].Cycles = WcetEdgeCycles(Context, &Context->Edges[e]);
+        }
+    }
+
+    for (e = 0; e < count; e++)
+    {
+        Out[e].To = (unsigned short)WcetRep(Context, Out[e].To);
+    }
+
+    return count;
+}
+
+//Longest paths from Start through the acyclic part of the collapsed graph
+//that lies inside Region. Returns -1 if a cycle is left.
+static int WcetLongestPaths(WCET_CONTEXT *Context, int Start, const unsigned char *Region)
+{
+    WCET_EXIT_EDGE out[WCET_MAX_SUCCESSORS];
+    int head = 0, tail = 0, nodes = 0, count, pc, to, i;
+
+    for (pc = 0; pc < Context->Count; pc++)
+    {
+        Context->Indegree[pc] = 0;
+        Context->Reached[pc] = 0;
+    }
+
+    for (pc = 0; pc < Context->Count; pc++)
+    {
+        if (!Region[pc] || Context->Rep[pc] != pc)
+            continue;
+
+        nodes++;
+        count = WcetSuccessors(Context, pc, out);
+        for (i = 0; i < count; i++)
+        {
+            to = out[i].To;
+            if (to != WCET_EXIT && to != Start && Region[to])
+                Context->Indegree[to]++;
+        }
+    }
+
+    for (pc = 0; pc < Context->Count; pc++)
+    {
+        if (Region[pc] && Context->Rep[pc] == pc && Context->Indegree[pc] == 0)
+            Context->Queue[tail++] = (unsigned short)pc;
+    }
+
+    Context->Dist[Start] = 0;
+    Context->Reached[Start] = 1;
+
+    while (head < tail)
+    {
+        pc = Context->Queue[head++];
+
+        count = WcetSuccessors(Context, pc, out);
+        for (i = 0; i < count; i++)
+        {
+            to = out[i].To;
+            if (to == WCET_EXIT || to == Start || !Region[to])
+                continue;
+
+            if (Context->Reached[pc] && (!Context->Reached[to] || Context->Dist[pc] + out[i].Cycles > Context->Dist[to]))
+            {
+                Context->Dist[to] = Context->Dist[pc] + out[i].Cycles;
+                Context->Reached[to] = 1;
+            }
+
+            if (--Context->Indegree[to] == 0)
+                Context->Queue[tail++] = (unsigned short)to;
+        }
+    }
+
+    return (tail == nodes) ? 0 : -1;
+}
+
+//Replaces a bounded loop by its header and one edge per exit
+static int WcetCollapseLoop(WCET_CONTEXT *Context, int Header, const unsigned char *Body, WCET_LOOP *Loop)
+{
+    WCET_EXIT_EDGE out[WCET_MAX_SUCCESSORS];
+    unsigned long long cycles, iteration = 0;
+    int count, pc, to, i;
+
+    if (WcetLongestPaths(Context, Header, Body) < 0)
+        return -1;
+
+    Context->ExitCount[Header] = 0;
+
+    for (pc = 0; pc < Context->Count; pc++)
+    {
+        if (!Body[pc] || Context->Rep[pc] != pc || !Context->Reached[pc])
+            continue;
+
+        count = WcetSuccessors(Context, pc, out);
+        for (i = 0; i < count; i++)
+        {
+            to = out[i].To;
+            cycles = out[i].Cycles;
+            if (to == Header)
+            {
+                if (Context->Dist[pc] + cycles > iteration)
+                    iteration = Context->Dist[pc] + cycles;
+            }
+            else if (to == WCET_EXIT || !Body[to])
+            {
+                if (WcetAddExit(Context, Header, to, Context->Dist[pc] + cycles) < 0)
+                    return -1;
+            }
+        }
+    }
+
+    //Every iteration but the last goes all the way around
+    for (pc = 0; pc < Context->ExitCount[Header]; pc++)
+    {
+        Context->Exits[Header][pc].Cycles += (Loop->Iterations - 1) * iteration;
+    }
+
+    Loop->IterationCycles = iteration;
+
+    for (pc = 0; pc < Context->Count; pc++)
+    {
+        if (Body[pc])
+            Context->Rep[pc] = (unsigned short)Header;
+    }
+    Context->Collapsed[Header] = 1;
+
+    return 0;
+}
+
+static void WcetRecordLoop(WCET_REPORT *Report, const WCET_LOOP *Loop)
+{
+    int i;
+
+    for (i = 0; i < Report->LoopCount; i++)
+    {
+        if (Report->Loops[i].Header == Loop->Header)
+            return;
+    }
+
+    if (Report->LoopCount < WCET_MAX_LOOPS)
+        Report->Loops[Report->LoopCount++] = *Loop;
+}
+
+static void WcetAnalyzeFunction(WCET_CONTEXT *Context, int Index)
+{
+    WCET_FUNCTION *function = &Context->Report->Functions[Index];
+    WCET_EXIT_EDGE out[WCET_MAX_SUCCESSORS];
+    WCET_FUNCTION *callee;
+    unsigned char *bodies = NULL, *body;
+    int *sizes = Context->Sizes, *order = Context->Order;
+    WCET_LOOP loop;
+    int headers, count, pc, e, i, j, returns = 0;
+
+    WcetMarkFunction(Context, function->Entry);
+
+    //Calls decide the stack depth, and callees have to be bounded first
+    for (pc = 0; pc < Context->Count; pc++)
+    {
+        if (!Context->InFunc[pc])
+            continue;
+
+        if (Context->Error[pc] != WCET_REASON_NONE)
+            WcetFail(function, Context->Error[pc], pc);
+
+        for (e = Context->EdgeStart[pc]; e < Context->EdgeStart[pc + 1]; e++)
+        {
+            if (Context->Edges[e].Callee == WCET_EXIT)
+                continue;
+
+            callee = &Context->Report->Functions[WcetFindFunction(Context->Report, Context->Edges[e].Callee)];
+            if (callee->State != 2)
+            {
+                WcetFail(function, WCET_REASON_RECURSION, pc);
+                function->StackDepth = -1;
+                continue;
+            }
+
+            if (callee->Cycles == WCET_UNBOUNDED)
+                WcetFail(function, WCET_REASON_CALLEE, pc);
+
+            if (function->StackDepth >= 0)
+                function->StackDepth = (callee->StackDepth < 0) ? -1 :
+                    (callee->StackDepth + 1 > function->StackDepth ? callee->StackDepth + 1 : function->StackDepth);
+        }
+    }
+
+    for (pc = 0; pc < Context->Count; pc++)
+    {
+        Context->Rep[pc] = (unsigned short)pc;
+        Context->Collapsed[pc] = 0;
+    }
+
+    headers = WcetFindLoops(Context, function->Entry);
+    if (headers != 0)
+    {
+        bodies = malloc((size_t)headers * Context->Count);
+        if (bodies == NULL)
+        {
+            WcetFail(function, WCET_REASON_LOOP, function->Entry);
+            return;
+        }
+    }
+
+    for (i = 0; i < headers; i++)
+    {
+        sizes[i] = WcetLoopBody(Context, Context->Headers[i], bodies + (size_t)i * Context->Count);
+        order[i] = i;
+    }
+
+    //Innermost (smallest) loops go first
+    for (i = 1; i < headers; i++)
+    {
+        for (j = i; j > 0 && sizes[order[j]] < sizes[order[j - 1]]; j--)
+        {
+            int swap = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = swap;
+        }
+    }
+
+    for (i = 0; i < headers; i++)
+    {
+        body = bodies + (size_t)order[i] * Context->Count;
+
+        memset(&loop, 0, sizeof(loop));
+        loop.Header = Context->Headers[order[i]];
+        for (pc = 0; pc < Context->Count; pc++)
+        {
+            if (body[pc])
+                loop.Latch = (unsigned short)pc;
+        }
+
+        if (WcetBoundLoop(Context, loop.Header, body, &loop) < 0)
+        {
+            WcetFail(function, WCET_REASON_LOOP, loop.Header);
+            WcetRecordLoop(Context->Report, &loop);
+            continue;
+        }
+
+        //Costs are meaningless once something inside is unbounded
+        if (function->Reason == WCET_REASON_NONE && WcetCollapseLoop(Context, loop.Header, body, &loop) < 0)
+            WcetFail(function, WCET_REASON_LOOP, loop.Header);
+
+        WcetRecordLoop(Context->Report, &loop);
+    }
+
+    free(bodies);
+
+    if (function->Reason != WCET_REASON_NONE)
+        return;
+
+    if (WcetLongestPaths(Context, function->Entry, Context->InFunc) < 0)
+    {
+        WcetFail(function, WCET_REASON_LOOP, function->Entry);
+        return;
+    }
+
+    //The worst case is the most expensive way out
+    for (pc = 0; pc < Context->Count; pc++)
+    {
+        if (!Context->InFunc[pc] || Context->Rep[pc] != pc || !Context->Reached[pc])
+            continue;
+
+        count = WcetSuccessors(Context, pc, out);
+        for (i = 0; i < count; i++)
+        {
+            if (out[i].To == WCET_EXIT && (!returns || Context->Dist[pc] + out[i].Cycles > function->Cycles))
+            {
+                function->Cycles = Context->Dist[pc] + out[i].Cycles;
+                returns = 1;
+            }
+        }
+    }
+
+    if (!returns)
+        WcetFail(function, WCET_REASON_NO_RETURN, function->Entry);
+}
+
+//Analyzes callees before their callers
+static void WcetVisit(WCET_CONTEXT *Context, int Index)
+{
+    int i;
+
+    Context->Report->Functions[Index].State = 1;
+
+    for (i = 0; i < Context->Report->FunctionCount; i++)
+    {
+        if (WCET_TEST_BIT(Context->Calls[Index], i) && Context->Report->Functions[i].State == 0)
+            WcetVisit(Context, i);
+    }
+
+    WcetAnalyzeFunction(Context, Index);
+    Context->Report->Functions[Index].State = 2;
+}
+
+int WcetAnalyze(const PIC_OPCODE *ProgMem, int Count, WCET_REPORT *Report)
+{
+    WCET_CONTEXT *context;
+    WCET_FUNCTION *reset, *interrupt;
+    int i, pc, e, callee, hasRetfie = 0, err = 0;
+
+    memset(Report, 0, sizeof(WCET_REPORT));
+
+    if (Count <= 0 || Count > PROGRAM_MEM_INSTRUCTIONS)
+    {
+        printf("Nothing to analyze\n");
+        return -1;
+    }
+
+    context = calloc(1, sizeof(WCET_CONTEXT));
+    if (context == NULL)
+    {
+        printf("Out of memory\n");
+        return -1;
+    }
+
+    context->ProgMem = ProgMem;
+    context->Count = Count;
+    context->Report = Report;
+
+    if (WcetBuildEdges(context) < 0 ||
+        (context->Back = malloc(context->EdgeCount + 1)) == NULL)
+    {
+        printf("Out of memory\n");
+        free(context->Edges);
+        free(context);
+        return -1;
+    }
+
+    for (pc = 0; pc < Count; pc++)
+    {
+        if (WcetId(context, pc) == ISA_RETFIE)
+            hasRetfie = 1;
+    }
+
+    //Find every subroutine reachable from reset (and the interrupt vector)
+    WcetAddFunction(Report, 0, WCET_KIND_RESET);
+    for (i = 0; i < Report->FunctionCount && err == 0; i++)
+    {
+        WcetMarkFunction(context, Report->Functions[i].Entry);
+
+        //Code at 4 that reset doesn't run into is the interrupt handler
+        if (i == 0 && hasRetfie && Count > 4 && !context->InFunc[4])
+            WcetAddFunction(Report, 4, WCET_KIND_INTERRUPT);
+
+        for (pc = 0; pc < Count && err == 0; pc++)
+        {
+            if (!context->InFunc[pc])
+                continue;
+
+            for (e = context->EdgeStart[pc]; e < context->EdgeStart[pc + 1]; e++)
+            {
+                if (context->Edges[e].Callee == WCET_EXIT)
+                    continue;
+
+                callee = WcetAddFunction(Report, context->Edges[e].Callee, WCET_KIND_SUBROUTINE);
+                if (callee < 0)
+                {
+                    err = -1;
+                    break;
+                }
+
+                WCET_SET_BIT(context->Calls[i], callee);
+            }
+        }
+    }
+
+    if (err == 0)
+    {
+        for (i = 0; i < Report->FunctionCount; i++)
+        {
+            if (Report->Functions[i].State == 0)
+                WcetVisit(context, i);
+        }
+
+        //An interrupt can arrive at the deepest point of the main code
+        reset = &Report->Functions[0];
+        Report->StackDepth = reset->StackDepth;
+        for (i = 1; i < Report->FunctionCount; i++)
+        {
+            interrupt = &Report->Functions[i];
+            if (interrupt->Kind != WCET_KIND_INTERRUPT)
+                continue;
+
+            if (Report->StackDepth < 0 || interrupt->StackDepth < 0)
+                Report->StackDepth = -1;
+            else
+                Report->StackDepth += interrupt->StackDepth + 1;
+        }
+    }
+
+    free(context->Back);
+    free(context->Edges);
+    free(context);
+
+    return err;
+}
+
+static void WcetPrintName(const DIS_CONTEXT *Labels, int Address, const char *Fallback)
+{
+    char name[DIS_LABEL_MAX + 0x10];
+
+    if (Labels != NULL && Labels->Labels[Address] != NULL)
+        snprintf(name, sizeof(name), "%.*s", Labels->LabelLength[Address], Labels->Labels[Address]);
+    else
+        snprintf(name, sizeof(name), "%s", Fallback);
+
+    printf("%-20s", name);
+}
+
+void WcetPrintReport(const WCET_REPORT *Report, const DIS_CONTEXT *Labels)
+{
+    static const char *reasons[] =
+    {
+        [WCET_REASON_LOOP] = "unbounded loop",
+        [WCET_REASON_COMPUTED_JUMP] = "computed jump",
+        [WCET_REASON_RECURSION] = "recursion",
+        [WCET_REASON_NO_RETURN] = "never returns",
+        [WCET_REASON_INVALID] = "invalid word",
+        [WCET_REASON_CALLEE] = "unbounded call",
+    };
+    static const char *kinds[] = { "reset", "interrupt", "subroutine" };
+    const WCET_FUNCTION *function;
+    const WCET_LOOP *loop;
+    int i, depth;
+
+    printf("Entry  Name                Worst case                    Stack\n");
+
+    for (i = 0; i < Report->FunctionCount; i++)
+    {
+        function = &Report->Functions[i];
+
+        printf("0x%03x  ", function->Entry);
+        WcetPrintName(Labels, function->Entry, kinds[function->Kind]);
+
+        if (function->Reason == WCET_REASON_NONE)
+            printf("%-30llu", function->Cycles);
+        else
+        {
+            char text[0x40];
+
+            snprintf(text, sizeof(text), "%s at 0x%03x", reasons[function->Reason], function->ReasonPC);
+            printf("%-30s", text);
+        }
+
+        //Subroutines and the interrupt also hold their own return address
+        depth = function->StackDepth;
+        if (depth < 0)
+            printf("unbounded\n");
+        else
+            printf("%d\n", depth + (function->Kind != WCET_KIND_RESET));
+    }
+
+    for (i = 0; i < Report->LoopCount; i++)
+    {
+        loop = &Report->Loops[i];
+        if (loop->Iterations == 0)
+        {
+            printf("Loop 0x%03x-0x%03x: no counter found\n", loop->Header, loop->Latch);
+            continue;
+        }
+
+        printf("Loop 0x%03x-0x%03x: %u iterations (%s 0x%02x at 0x%03x)", loop->Header, loop->Latch, loop->Iterations,
+               IsaTable[loop->CounterId].Mnemonic, loop->File, loop->Counter);
+        if (loop->IterationCycles != 0)
+            printf(", %llu cycles each", loop->IterationCycles);
+        printf("\n");
+    }
+
+    if (Report->StackDepth < 0)
+        printf("Worst-case stack depth: unbounded (recursion)\n");
+    else
+    {
+        printf("Worst-case stack depth: %d of %d\n", Report->StackDepth, PIC_STACK_ENTRIES);
+        if (Report->StackDepth > PIC_STACK_ENTRIES)
+            printf("Stack wraps around: %d entries overwritten\n", Report->StackDepth - PIC_STACK_ENTRIES);
+    }
+}
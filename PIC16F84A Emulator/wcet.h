@@ -0,0 +1,74 @@
+//
+//  wcet.h
+//  PIC16F84A Emulator
+//
+//  Licensed under GPLv3
+//
+//  Cameron Gutman (cameron.gutman@case.edu)
+//
+//  Offline worst-case cycle and stack depth analysis. Control flow is
+//  rebuilt from the GOTO, CALL, skip and return encodings in program memory.
+//  Loops are bounded by the DECFSZ/INCFSZ counter that exits them and the
+//  MOVLW/MOVWF (or CLRF) that loads it before the loop is entered.
+//
+
+#ifndef PIC16F84A_Emulator_wcet_h
+#define PIC16F84A_Emulator_wcet_h
+
+#include "cpu.h"
+#include "disasm.h"
+#include "opcode.h"
+
+#define WCET_MAX_FUNCTIONS  0x100
+#define WCET_MAX_LOOPS      0x100
+
+//Cycle count of anything that couldn't be bounded
+#define WCET_UNBOUNDED      (~0ULL)
+
+//What kind of code a function is
+#define WCET_KIND_RESET       0
+#define WCET_KIND_INTERRUPT   1
+#define WCET_KIND_SUBROUTINE  2
+
+//Why a function couldn't be bounded
+#define WCET_REASON_NONE            0
+#define WCET_REASON_LOOP            1   //Loop without a recognizable counter
+#define WCET_REASON_COMPUTED_JUMP   2   //PCL write that isn't a RETLW/GOTO table
+#define WCET_REASON_RECURSION       3
+#define WCET_REASON_NO_RETURN       4   //Never returns (e.g. a main loop)
+#define WCET_REASON_INVALID         5   //Runs into an invalid word or off the end
+#define WCET_REASON_CALLEE          6   //Calls something unbounded
+
+typedef struct _WCET_FUNCTION {
+    unsigned short Entry;
+    int Kind;
+    unsigned long long Cycles;      //Entry to return, including the return itself
+    int Reason;
+    unsigned short ReasonPC;
+    int StackDepth;                 //Entries pushed below it by its calls (-1 if unbounded)
+    int State;
+} WCET_FUNCTION;
+
+typedef struct _WCET_LOOP {
+    unsigned short Header;
+    unsigned short Latch;           //Last word that jumps back
+    unsigned short Counter;         //DECFSZ/INCFSZ that exits the loop
+    int CounterId;
+    unsigned char File;
+    unsigned int Iterations;        //0 if unbounded
+    unsigned long long IterationCycles;
+} WCET_LOOP;
+
+//This struct represents the analysis of one program
+typedef struct _WCET_REPORT {
+    int FunctionCount;
+    WCET_FUNCTION Functions[WCET_MAX_FUNCTIONS];
+    int LoopCount;
+    WCET_LOOP Loops[WCET_MAX_LOOPS];
+    int StackDepth;                 //Worst case including an interrupt (-1 if unbounded)
+} WCET_REPORT;
+
+int WcetAnalyze(const PIC_OPCODE *ProgMem, int Count, WCET_REPORT *Report);
+void WcetPrintReport(const WCET_REPORT *Report, const DIS_CONTEXT *Labels);
+
+#endif